@@ -0,0 +1,172 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/tlsf.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+// sense-bench-alloc [rounds]
+//
+// Streams mesh-sized allocations in and out of a fixed-size space with
+// the TLSF allocator and with a first-fit free list (what you'd write
+// without thinking about it), and reports how fast each is and how
+// fragmented the space gets. Then defragments the TLSF space and shows
+// how much would have to be copied. No GL involved.
+
+namespace {
+  const uint32_t capacity = 16 << 20;
+  const size_t target_live = 4000;
+
+  // log-uniform between 64 and 256k; lots of small meshes, a few big ones
+  uint32_t meshSize() {
+    const float t = float(rand()) / RAND_MAX;
+    return uint32_t(64.f * std::pow(4096.f, t));
+  }
+
+  // first-fit over an address-ordered free list, merging on free
+  class firstFit {
+  public:
+    explicit firstFit(uint32_t size) { m_free[0] = size; }
+
+    uint32_t allocate(uint32_t size) {
+      for(auto i = m_free.begin(); i != m_free.end(); ++i) {
+        if(i->second < size)
+          continue;
+        const uint32_t offset = i->first;
+        const uint32_t rest = i->second - size;
+        m_free.erase(i);
+        if(rest)
+          m_free[offset + size] = rest;
+        return offset;
+      }
+      return ~0u;
+    }
+
+    void free(uint32_t offset, uint32_t size) {
+      auto next = m_free.lower_bound(offset);
+      if(next != m_free.end() && offset + size == next->first) {
+        size += next->second;
+        m_free.erase(next++);
+      }
+      if(next != m_free.begin()) {
+        auto prev = next;
+        --prev;
+        if(prev->first + prev->second == offset) {
+          prev->second += size;
+          return;
+        }
+      }
+      m_free[offset] = size;
+    }
+
+    size_t freeBlocks() const { return m_free.size(); }
+    uint32_t largestFree() const {
+      uint32_t largest = 0;
+      for(auto i = m_free.begin(); i != m_free.end(); ++i)
+        largest = std::max(largest, i->second);
+      return largest;
+    }
+
+  private:
+    std::map<uint32_t, uint32_t> m_free;
+  };
+
+  struct Live
+  {
+    uint32_t size;
+    tlsfAllocator::handle tlsf;
+    uint32_t ff;
+  };
+
+  typedef std::chrono::high_resolution_clock Clock;
+}
+
+int main(int argc, char **argv) {
+  const size_t rounds = argc > 1 ? atoi(argv[1]) : 200000;
+  srand(1);
+
+  tlsfAllocator tlsf(capacity);
+  firstFit ff(capacity);
+  std::vector<Live> live;
+  double tlsf_ns = 0, ff_ns = 0;
+  size_t ops = 0, tlsf_failed = 0, ff_failed = 0;
+
+  printf("%8s | %-36s | %-36s\n", "", "tlsf", "first fit");
+  printf("%8s | %8s %6s %8s %10s | %8s %6s %8s %10s\n", "round", "ns/op", "frag", "blocks", "failed", "ns/op", "frag", "blocks", "failed");
+  for(size_t r = 1; r <= rounds; ++r) {
+    // the live count random walks between 0 and target_live, which keeps
+    // the space close to full most of the time
+    if(live.size() >= target_live || (!live.empty() && rand() % 2)) {
+      const size_t i = rand() % live.size();
+      Clock::time_point t0 = Clock::now();
+      if(live[i].tlsf != tlsfAllocator::none)
+        tlsf.free(live[i].tlsf);
+      Clock::time_point t1 = Clock::now();
+      if(live[i].ff != ~0u)
+        ff.free(live[i].ff, live[i].size);
+      Clock::time_point t2 = Clock::now();
+      tlsf_ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+      ff_ns += std::chrono::duration<double, std::nano>(t2 - t1).count();
+      live[i] = live.back();
+      live.pop_back();
+    } else {
+      Live l;
+      l.size = meshSize();
+      Clock::time_point t0 = Clock::now();
+      l.tlsf = tlsf.allocate(l.size);
+      Clock::time_point t1 = Clock::now();
+      l.ff = ff.allocate(l.size);
+      Clock::time_point t2 = Clock::now();
+      tlsf_ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+      ff_ns += std::chrono::duration<double, std::nano>(t2 - t1).count();
+      tlsf_failed += l.tlsf == tlsfAllocator::none;
+      ff_failed += l.ff == ~0u;
+      live.push_back(l);
+    }
+    ops++;
+
+    if(r % (rounds / 10) == 0) {
+      const tlsfAllocator::Stats s = tlsf.stats();
+      uint32_t ff_used = 0;
+      for(size_t i = 0; i < live.size(); ++i)
+        ff_used += live[i].ff != ~0u ? live[i].size : 0;
+      const float ff_frag = ff_used < capacity ? 1.f - float(ff.largestFree()) / (capacity - ff_used) : 0.f;
+      printf("%8zu | %8.1f %6.3f %8u %10zu | %8.1f %6.3f %8zu %10zu\n", r, tlsf_ns / ops, s.fragmentation(), s.free_blocks, tlsf_failed,
+             ff_ns / ops, ff_frag, ff.freeBlocks(), ff_failed);
+      tlsf_ns = ff_ns = 0;
+      ops = 0;
+    }
+  }
+
+  const tlsfAllocator::Stats before = tlsf.stats();
+  std::vector<tlsfAllocator::Move> moves;
+  Clock::time_point t0 = Clock::now();
+  tlsf.defragment(moves);
+  Clock::time_point t1 = Clock::now();
+  const tlsfAllocator::Stats after = tlsf.stats();
+  uint64_t moved = 0;
+  for(size_t i = 0; i < moves.size(); ++i)
+    moved += moves[i].size;
+  printf("\ndefragment: %u allocations, %zu moved (%.1f%% of used space) in %.2f ms\n", after.allocations, moves.size(),
+         before.used ? 100.0 * moved / before.used : 0.0, std::chrono::duration<double, std::milli>(t1 - t0).count());
+  printf("  fragmentation %.3f -> %.3f, free blocks %u -> %u, largest free %u -> %u\n", before.fragmentation(), after.fragmentation(),
+         before.free_blocks, after.free_blocks, before.largest_free, after.largest_free);
+  return 0;
+}
@@ -0,0 +1,222 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mesh/Bounds.hpp"
+#include "mesh/Cluster.hpp"
+#include "mesh/Optimize.hpp"
+#include "mesh/VertexData.hpp"
+#include "pipeline/ClusterCulling.hpp"
+#include "pipeline/Drawable.hpp"
+#include "util/simd.hpp"
+
+#include "3rdparty/glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// sense-bench-clusters [segments] [views]
+//
+// Builds a bumpy sphere out of segments * segments / 2 quads, clusters
+// it the way the cooker does, and reports what the clusters came out
+// like and how long that took. Then looks at it from a bunch of random
+// spots, some through a mirroring transform, and culls the clusters
+// for each view, reporting how many clusters and triangles are left
+// and the throughput.
+//
+// Every view is checked against the triangles themselves: a triangle
+// that is in view and faces the eye on screen must be in a cluster
+// that was kept. Exits non-zero if any aren't.
+
+namespace {
+  typedef std::chrono::high_resolution_clock Clock;
+
+  double seconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+  }
+
+  float randf(float lo, float hi) {
+    return lo + (hi - lo) * float(rand()) / RAND_MAX;
+  }
+
+  void buildSphere(DrawableMesh* m, size_t segments) {
+    const size_t rings = segments / 2;
+    std::vector<float> positions;
+    for(size_t i = 0; i <= rings; ++i) {
+      const float theta = float(M_PI) * i / rings;
+      for(size_t j = 0; j <= segments; ++j) {
+        const float phi = 2.f * float(M_PI) * j / segments;
+        const float r = 1.f + 0.05f * std::sin(8.f * theta) * std::sin(6.f * phi);
+        positions.push_back(r * std::sin(theta) * std::cos(phi));
+        positions.push_back(r * std::cos(theta));
+        positions.push_back(r * std::sin(theta) * std::sin(phi));
+      }
+    }
+    std::vector<uint32_t> indices;
+    for(size_t i = 0; i < rings; ++i) {
+      for(size_t j = 0; j < segments; ++j) {
+        const uint32_t a = i * (segments + 1) + j, b = a + 1, c = a + segments + 1, d = c + 1;
+        const uint32_t quad[6] = {a, c, b, b, c, d};
+        for(int t = 0; t < 2; ++t) {
+          uint32_t tri[3] = {quad[t * 3], quad[t * 3 + 1], quad[t * 3 + 2]};
+          // wind them counter-clockwise from outside
+          glm::vec3 p[3];
+          for(int v = 0; v < 3; ++v)
+            p[v] = glm::vec3(positions[tri[v] * 3], positions[tri[v] * 3 + 1], positions[tri[v] * 3 + 2]);
+          if(glm::dot(glm::cross(p[1] - p[0], p[2] - p[0]), p[0] + p[1] + p[2]) < 0.f)
+            std::swap(tri[1], tri[2]);
+          indices.insert(indices.end(), tri, tri + 3);
+        }
+      }
+    }
+
+    *m = DrawableMesh();
+    DrawableMesh::Attribute a;
+    a.type = DrawableMesh::Float;
+    a.loc = DrawableMesh::Pos;
+    a.start = 0;
+    a.size = 3;
+    a.special = DrawableMesh::None;
+    m->attributes.push_back(a);
+    m->data_stride = 12;
+    m->data_size = positions.size() * 4;
+    m->data = new char[m->data_size];
+    memcpy(m->data, &positions[0], m->data_size);
+    writeIndices(m, indices, positions.size() / 3);
+    computeMeshBounds(m);
+  }
+
+  // Whether a triangle is on screen and facing the eye, going by where
+  // its corners end up
+  bool mustDraw(const glm::mat4& transform, const glm::vec3 p[3]) {
+    // the sphere's poles have slivers with corners closer together than
+    // floats can tell apart, so which way they face is rounding noise
+    for(int v = 0; v < 3; ++v) {
+      const glm::vec3 e = p[(v + 1) % 3] - p[v];
+      if(glm::dot(e, e) < 1e-12f)
+        return false;
+    }
+    glm::vec3 ndc[3];
+    for(int v = 0; v < 3; ++v) {
+      const glm::vec4 c = transform * glm::vec4(p[v], 1.f);
+      if(c.w <= 0.f)
+        return false; // crosses the eye plane, nothing to compare against
+      ndc[v] = glm::vec3(c) / c.w;
+    }
+    for(int a = 0; a < 3; ++a) {
+      if(std::min(std::min(ndc[0][a], ndc[1][a]), ndc[2][a]) > 1.f || std::max(std::max(ndc[0][a], ndc[1][a]), ndc[2][a]) < -1.f)
+        return false;
+    }
+    const float area = (ndc[1].x - ndc[0].x) * (ndc[2].y - ndc[0].y) - (ndc[2].x - ndc[0].x) * (ndc[1].y - ndc[0].y);
+    return area > 0.f;
+  }
+}
+
+int main(int argc, char **argv) {
+  const size_t segments = argc > 1 ? atoi(argv[1]) : 512;
+  const size_t views = argc > 2 ? atoi(argv[2]) : 64;
+
+  DrawableMesh mesh;
+  buildSphere(&mesh, segments);
+  optimizeMesh(&mesh);
+
+  ClusterStats stats;
+  Clock::time_point t0 = Clock::now();
+  buildClusters(&mesh, 128, &stats);
+  const double build = seconds(t0, Clock::now());
+  const size_t triangles = mesh.index_count / 3;
+  printf("%zu triangles into %zu clusters in %.1f ms (%.2f M triangles/s)\n", triangles, stats.clusters, build * 1e3, triangles / build * 1e-6);
+  printf("%.1f triangles per cluster, radius %.3f of the mesh's, %zu (%.1f%%) with a usable cone\n",
+         stats.triangles, stats.radius, stats.cones, 100.f * stats.cones / std::max(stats.clusters, size_t(1)));
+
+  std::vector<uint32_t> indices;
+  readIndices(&mesh, indices);
+  std::vector<float> positions;
+  fetchAttributeArray(&mesh, *findAttribute(&mesh, DrawableMesh::Pos), 3, positions);
+  // which cluster every triangle ended up in
+  std::vector<uint32_t> triangle_cluster(triangles);
+  for(size_t c = 0; c < mesh.clusters.size(); ++c) {
+    for(size_t t = mesh.clusters[c].index_start / 3; t < (mesh.clusters[c].index_start + mesh.clusters[c].index_count) / 3; ++t)
+      triangle_cluster[t] = c;
+  }
+
+  ClusterSet set(&mesh);
+  std::vector<DrawCommand> commands;
+  std::vector<uint8_t> kept(set.size());
+  const glm::mat4 proj = glm::perspective(60.f, 16.f / 9.f, 0.05f, 100.f);
+  double total_time = 0.;
+  size_t total_clusters = 0, total_triangles = 0, total_commands = 0, missed = 0, needed = 0;
+  srand(1);
+  for(size_t v = 0; v < views; ++v) {
+    // somewhere from close up to a few radii out, looking near the middle
+    const glm::vec3 dir = glm::normalize(glm::vec3(randf(-1.f, 1.f), randf(-1.f, 1.f), randf(-1.f, 1.f)));
+    const glm::vec3 eye = dir * randf(1.3f, 4.f);
+    const glm::vec3 target(randf(-0.5f, 0.5f), randf(-0.5f, 0.5f), randf(-0.5f, 0.5f));
+    glm::mat4 model(1.f);
+    if(v & 1)
+      model = glm::scale(model, glm::vec3(-1.f, 1.f, 1.f));
+    const glm::mat4 transform = proj * glm::lookAt(eye, target, glm::vec3(0.f, 1.f, 0.f)) * model;
+
+    const size_t repeats = 20;
+    double best = 1e30;
+    size_t kept_clusters = 0;
+    for(size_t r = 0; r < repeats; ++r) {
+      commands.clear();
+      Clock::time_point t1 = Clock::now();
+      const ClusterView view = clusterViewFromMatrix(transform);
+      kept_clusters = set.cull(view, commands);
+      best = std::min(best, seconds(t1, Clock::now()));
+    }
+    total_time += best;
+    total_clusters += kept_clusters;
+    total_commands += commands.size();
+
+    std::fill(kept.begin(), kept.end(), 0);
+    for(auto c = commands.begin(); c != commands.end(); ++c) {
+      total_triangles += c->count / 3;
+      for(size_t t = c->first_index / 3; t < (c->first_index + c->count) / 3; ++t)
+        kept[triangle_cluster[t]] = 1;
+    }
+    // mirrored views turn the side facing the eye clockwise on screen
+    for(size_t t = 0; t < triangles; ++t) {
+      glm::vec3 p[3];
+      for(int i = 0; i < 3; ++i)
+        p[i] = glm::vec3(positions[indices[t * 3 + i] * 3], positions[indices[t * 3 + i] * 3 + 1], positions[indices[t * 3 + i] * 3 + 2]);
+      if(v & 1)
+        std::swap(p[1], p[2]);
+      if(!mustDraw(transform, p))
+        continue;
+      ++needed;
+      missed += !kept[triangle_cluster[t]];
+    }
+  }
+
+#ifdef SENSE_SSE2
+  const char* simd = "SSE2, 4 clusters at a time";
+#else
+  const char* simd = "scalar";
+#endif
+  printf("culling (%s): %.2f us per view, %.1f M clusters/s\n", simd, total_time / views * 1e6, set.size() * views / total_time * 1e-6);
+  printf("kept %.1f%% of clusters and %.1f%% of triangles on average, in %.1f commands\n",
+         100.f * total_clusters / (set.size() * views), 100.f * total_triangles / (triangles * views), float(total_commands) / views);
+  printf("check: %zu visible front-facing triangles over %zu views, %zu in culled clusters\n", needed, views, missed);
+
+  delete[] (char*)mesh.data;
+  delete[] (char*)mesh.index_data;
+  return missed ? 1 : 0;
+}
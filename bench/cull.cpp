@@ -0,0 +1,171 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "pipeline/AabbTree.hpp"
+#include "pipeline/Culling.hpp"
+#include "util/simd.hpp"
+
+#include "3rdparty/glm/gtc/matrix_transform.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// sense-bench-cull [objects] [frames]
+//
+// Scatters boxes through a large world and culls them against a camera
+// frustum a few ways: one box at a time with testAabb, all of them
+// through the batched SIMD test, and through an AabbTree. Also times
+// building the tree, moving a few objects, and the refit after moving
+// all of them. Reports throughput in objects per second. No GL involved.
+
+namespace {
+  typedef std::chrono::high_resolution_clock Clock;
+
+  double seconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+  }
+
+  float randf(float lo, float hi) {
+    return lo + (hi - lo) * float(rand()) / RAND_MAX;
+  }
+
+  Aabb randomBox(float world) {
+    const glm::vec3 c(randf(-world, world), randf(-world * 0.05f, world * 0.05f), randf(-world, world));
+    const glm::vec3 e(randf(0.5f, 4.f), randf(0.5f, 4.f), randf(0.5f, 4.f));
+    Aabb b;
+    b.min = c - e;
+    b.max = c + e;
+    return b;
+  }
+}
+
+int main(int argc, char **argv) {
+  const size_t count = argc > 1 ? atoi(argv[1]) : 100000;
+  const size_t frames = argc > 2 ? atoi(argv[2]) : 20;
+  const float world = 2000.f;
+
+#if defined(SENSE_AVX)
+  const char* simd = "AVX, 8 boxes at a time";
+#elif defined(SENSE_SSE2)
+  const char* simd = "SSE2, 4 boxes at a time";
+#else
+  const char* simd = "scalar";
+#endif
+  printf("%zu objects, batched tests use %s\n", count, simd);
+
+  srand(1);
+  std::vector<Aabb> boxes(count);
+  std::vector<float> soa[6];
+  for(size_t i = 0; i < count; ++i) {
+    boxes[i] = randomBox(world);
+    for(int a = 0; a < 3; ++a) {
+      soa[a].push_back(boxes[i].min[a]);
+      soa[a + 3].push_back(boxes[i].max[a]);
+    }
+  }
+  const float* bounds[6];
+  for(int a = 0; a < 6; ++a)
+    bounds[a] = &soa[a][0];
+
+  // a camera at the middle of the world looking along -z, 1km far plane
+  const glm::mat4 proj = glm::perspective(60.f, 16.f / 9.f, 0.5f, 1000.f);
+  std::vector<Frustum> views(frames);
+  for(size_t f = 0; f < frames; ++f) {
+    const float angle = 360.f * f / frames;
+    views[f] = frustumFromMatrix(proj * glm::rotate(glm::mat4(1.f), angle, glm::vec3(0.f, 1.f, 0.f)));
+  }
+
+  // one at a time
+  double best_scalar = 1e30;
+  size_t visible_scalar = 0;
+  for(size_t f = 0; f < frames; ++f) {
+    Clock::time_point t0 = Clock::now();
+    size_t visible = 0;
+    for(size_t i = 0; i < count; ++i)
+      visible += testAabb(views[f], boxes[i]) != CullOutside;
+    best_scalar = std::min(best_scalar, seconds(t0, Clock::now()));
+    visible_scalar += visible;
+  }
+
+  // everything through the batched test
+  std::vector<uint8_t> flags(count);
+  double best_batch = 1e30;
+  size_t visible_batch = 0;
+  for(size_t f = 0; f < frames; ++f) {
+    Clock::time_point t0 = Clock::now();
+    testAabbs(views[f], bounds, count, &flags[0]);
+    size_t visible = 0;
+    for(size_t i = 0; i < count; ++i)
+      visible += flags[i];
+    best_batch = std::min(best_batch, seconds(t0, Clock::now()));
+    visible_batch += visible;
+  }
+
+  // the tree
+  AabbTree tree;
+  std::vector<AabbTree::NodeId> leaves(count);
+  Clock::time_point t0 = Clock::now();
+  for(size_t i = 0; i < count; ++i)
+    leaves[i] = tree.insert(boxes[i], i);
+  const double build = seconds(t0, Clock::now());
+
+  std::vector<uint32_t> users;
+  double best_tree = 1e30;
+  size_t visible_tree = 0;
+  for(size_t f = 0; f < frames; ++f) {
+    users.clear();
+    Clock::time_point t1 = Clock::now();
+    tree.query(views[f], users);
+    best_tree = std::min(best_tree, seconds(t1, Clock::now()));
+    visible_tree += users.size();
+  }
+
+  // a few objects wander about; most stay inside their fattened boxes
+  const size_t movers = count / 100;
+  size_t reinserted = 0;
+  Clock::time_point t2 = Clock::now();
+  for(size_t f = 0; f < frames; ++f) {
+    for(size_t m = 0; m < movers; ++m) {
+      const size_t i = rand() % count;
+      const glm::vec3 d(randf(-0.3f, 0.3f), 0.f, randf(-0.3f, 0.3f));
+      boxes[i].min += d;
+      boxes[i].max += d;
+      reinserted += tree.move(leaves[i], boxes[i]);
+    }
+  }
+  const double move = seconds(t2, Clock::now()) / (frames * movers);
+
+  // everything moves a little, the way it does when the camera is baked into the transforms
+  Clock::time_point t3 = Clock::now();
+  for(size_t i = 0; i < count; ++i) {
+    boxes[i].min.x += 0.1f;
+    boxes[i].max.x += 0.1f;
+    tree.setBox(leaves[i], boxes[i]);
+  }
+  tree.refit();
+  const double refit = seconds(t3, Clock::now());
+
+  printf("%-24s %12s %14s %10s\n", "", "ms/frame", "Mobjects/s", "visible");
+  printf("%-24s %12.3f %14.1f %10zu\n", "testAabb, one by one", best_scalar * 1e3, count / best_scalar * 1e-6, visible_scalar / frames);
+  printf("%-24s %12.3f %14.1f %10zu\n", "testAabbs, batched", best_batch * 1e3, count / best_batch * 1e-6, visible_batch / frames);
+  printf("%-24s %12.3f %14.1f %10zu\n", "AabbTree query", best_tree * 1e3, count / best_tree * 1e-6, visible_tree / frames);
+  printf("\ntree: height %d, built in %.1f ms, %.0f ns per move (%.1f%% reinserted), refit after moving everything %.2f ms\n",
+         tree.height(), build * 1e3, move * 1e9, 100.f * reinserted / (frames * movers), refit * 1e3);
+  if(visible_scalar != visible_batch || visible_scalar != visible_tree)
+    fprintf(stderr, "the culling methods disagree!\n");
+  return 0;
+}
@@ -0,0 +1,261 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pipeline/DrawList.hpp"
+#include "pipeline/Drawable.hpp"
+#include "pipeline/Material.hpp"
+#include "util/parallel.hpp"
+
+#include <boost/functional/hash.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+// sense-bench-drawlist [frames]
+//
+// Measures what it costs to submit and order a frame of draws with the
+// sorted DrawList, next to the hashed multimap the pipeline used to
+// keep, and counts how many program/material/mesh binds each order
+// would need. Also shows the draw list's arena settling after the
+// first frame, and how recording scales when worker threads each fill
+// their own list and the lists are merged before the sort (what
+// EntityManager::drawEntities does). No GL involved; this is only the
+// CPU side.
+
+namespace {
+  const size_t num_programs = 16;
+  const size_t num_materials = 256;
+  const size_t num_meshes = 512;
+
+  struct Draw
+  {
+    uint32_t mesh;
+    uint32_t mat;
+    glm::mat4 transform;
+  };
+
+  struct Binds
+  {
+    size_t programs, materials, meshes, batches;
+  };
+
+  // what the pipeline keyed on before
+  struct OldKey
+  {
+    DrawableMesh* mesh;
+    Material* mat;
+    size_t lod;
+  };
+
+  bool operator==(const OldKey& a, const OldKey& b) {
+    return a.mesh == b.mesh && a.mat == b.mat && a.lod == b.lod;
+  }
+
+  struct OldKeyHash
+  {
+    size_t operator()(const OldKey& k) const {
+      size_t result = 0;
+      boost::hash_combine(result, k.mesh);
+      boost::hash_combine(result, k.mat);
+      boost::hash_combine(result, k.lod);
+      return result;
+    }
+  };
+
+  typedef std::unordered_multimap<OldKey, std::vector<glm::mat4>, OldKeyHash> OldList;
+
+  typedef std::chrono::high_resolution_clock Clock;
+
+  void addDraw(DrawList& list, const Draw& d, std::vector<DrawableMesh>& meshes, std::vector<Material>& materials, const std::vector<uint32_t>& mat_programs) {
+    const uint64_t key = DrawList::makeKey(0, mat_programs[d.mat], materials[d.mat].id, d.mesh, 0, DrawList::depthBucket(d.transform));
+    list.add(key, &meshes[d.mesh], &materials[d.mat], 0, d.transform);
+  }
+
+  double nsPer(Clock::time_point start, Clock::time_point end, size_t count) {
+    return std::chrono::duration<double, std::nano>(end - start).count() / count;
+  }
+
+  // Count the state changes a walk over the batches would make
+  class BindCounter
+  {
+  public:
+    BindCounter(const std::vector<uint32_t>& mat_programs) : m_mat_programs(mat_programs), m_prog(~0u), m_mat(0), m_mesh(0) {
+      m_binds.programs = m_binds.materials = m_binds.meshes = m_binds.batches = 0;
+    }
+
+    void batch(Material* mat, const Material* mat_base, DrawableMesh* mesh) {
+      const uint32_t prog = m_mat_programs[mat - mat_base];
+      if(prog != m_prog) {
+        m_binds.programs++;
+        m_prog = prog;
+        m_mat = 0;
+        m_mesh = 0;
+      }
+      if(mat != m_mat) {
+        m_binds.materials++;
+        m_mat = mat;
+      }
+      if(mesh != m_mesh) {
+        m_binds.meshes++;
+        m_mesh = mesh;
+      }
+      m_binds.batches++;
+    }
+
+    const Binds& binds() const { return m_binds; }
+
+  private:
+    const std::vector<uint32_t>& m_mat_programs;
+    uint32_t m_prog;
+    Material* m_mat;
+    DrawableMesh* m_mesh;
+    Binds m_binds;
+  };
+}
+
+int main(int argc, char **argv) {
+  const size_t frames = argc > 1 ? atoi(argv[1]) : 20;
+  const size_t sizes[] = { 10000, 50000, 100000, 200000 };
+
+  std::vector<Material> materials(num_materials);
+  std::vector<DrawableMesh> meshes(num_meshes);
+  std::vector<uint32_t> mat_programs(num_materials);
+  srand(1);
+  for(size_t i = 0; i < num_materials; ++i) {
+    materials[i].id = i + 1;
+    mat_programs[i] = rand() % num_programs;
+  }
+
+  std::vector<std::vector<Draw> > scenes;
+  printf("%8s | %10s %10s %10s | %10s %10s | %-28s | %-28s | %s\n", "draws", "add ns", "sort ns", "total ns", "old ns", "speedup", "binds prog/mat/mesh (sorted)", "binds prog/mat/mesh (old)", "arena KB first/last frame");
+  for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    const size_t count = sizes[s];
+    std::vector<Draw> scene(count);
+    for(size_t i = 0; i < count; ++i) {
+      scene[i].mesh = rand() % num_meshes;
+      scene[i].mat = rand() % num_materials;
+      scene[i].transform = glm::mat4(1.f);
+      scene[i].transform[3][2] = float(rand()) / RAND_MAX * 2.f - 1.f;
+    }
+
+    DrawList list;
+    OldList old;
+    double best_add = 1e30, best_sort = 1e30, best_old = 1e30;
+    Binds sorted_binds = Binds(), old_binds = Binds();
+    size_t first_reserved = 0;
+    for(size_t f = 0; f < frames; ++f) {
+      // sorted draw list, same as PipelineImpl::addDrawTask does it
+      list.clear();
+      Clock::time_point t0 = Clock::now();
+      for(size_t i = 0; i < count; ++i)
+        addDraw(list, scene[i], meshes, materials, mat_programs);
+      Clock::time_point t1 = Clock::now();
+      list.sort();
+      Clock::time_point t2 = Clock::now();
+      if(f == 0)
+        first_reserved = list.memoryReserved();
+      best_add = std::min(best_add, nsPer(t0, t1, count));
+      best_sort = std::min(best_sort, nsPer(t1, t2, count));
+
+      BindCounter sorted(mat_programs);
+      for(size_t i = 0; i < list.size();) {
+        const DrawList::Record& r = list.record(i);
+        for(++i; i < list.size() && list.record(i).mesh == r.mesh && list.record(i).mat == r.mat; ++i);
+        sorted.batch(r.mat, &materials[0], r.mesh);
+      }
+      sorted_binds = sorted.binds();
+
+      // the old per-pass multimap, cleared every frame
+      old.clear();
+      Clock::time_point t3 = Clock::now();
+      for(size_t i = 0; i < count; ++i) {
+        const Draw& d = scene[i];
+        OldKey k;
+        k.mesh = &meshes[d.mesh];
+        k.mat = &materials[d.mat];
+        k.lod = 0;
+        auto j = old.find(k);
+        if(j != old.end())
+          j->second.push_back(d.transform);
+        else
+          old.insert(std::make_pair(k, std::vector<glm::mat4>(1, d.transform)));
+      }
+      Clock::time_point t4 = Clock::now();
+      best_old = std::min(best_old, nsPer(t3, t4, count));
+
+      BindCounter hashed(mat_programs);
+      for(auto j = old.begin(); j != old.end(); ++j)
+        hashed.batch(j->first.mat, &materials[0], j->first.mesh);
+      old_binds = hashed.binds();
+    }
+
+    char sorted_str[64], old_str[64];
+    sprintf(sorted_str, "%zu/%zu/%zu", sorted_binds.programs, sorted_binds.materials, sorted_binds.meshes);
+    sprintf(old_str, "%zu/%zu/%zu", old_binds.programs, old_binds.materials, old_binds.meshes);
+    printf("%8zu | %10.1f %10.1f %10.1f | %10.1f %9.2fx | %-28s | %-28s | %zu/%zu\n", count, best_add, best_sort, best_add + best_sort, best_old,
+           best_old / (best_add + best_sort), sorted_str, old_str, first_reserved / 1024, list.memoryReserved() / 1024);
+    scenes.push_back(scene);
+  }
+
+  // Parallel recording: every slot records a range into its own list,
+  // then the lists are appended in slot order and sorted once
+  const size_t slots = parallelSlots();
+  printf("\n%8s | %10s %10s %10s | %10s %10s (%zu threads)\n", "draws", "record ns", "merge ns", "sort ns", "total ns", "speedup", slots);
+  for(size_t s = 0; s < scenes.size(); ++s) {
+    const std::vector<Draw>& scene = scenes[s];
+    const size_t count = scene.size();
+    std::vector<DrawList*> buckets(slots);
+    for(size_t i = 0; i < slots; ++i)
+      buckets[i] = new DrawList;
+    DrawList serial, merged;
+    double best_serial = 1e30, best_record = 1e30, best_merge = 1e30, best_sort = 1e30;
+    for(size_t f = 0; f < frames; ++f) {
+      serial.clear();
+      Clock::time_point t0 = Clock::now();
+      for(size_t i = 0; i < count; ++i)
+        addDraw(serial, scene[i], meshes, materials, mat_programs);
+      serial.sort();
+      Clock::time_point t1 = Clock::now();
+      best_serial = std::min(best_serial, nsPer(t0, t1, count));
+
+      merged.clear();
+      Clock::time_point t2 = Clock::now();
+      parallelForSlots(count, 1024, [&](size_t slot, size_t begin, size_t end) {
+          for(size_t i = begin; i < end; ++i)
+            addDraw(*buckets[slot], scene[i], meshes, materials, mat_programs);
+        });
+      Clock::time_point t3 = Clock::now();
+      for(size_t i = 0; i < slots; ++i) {
+        merged.append(*buckets[i]);
+        buckets[i]->clear();
+      }
+      Clock::time_point t4 = Clock::now();
+      merged.sort();
+      Clock::time_point t5 = Clock::now();
+      best_record = std::min(best_record, nsPer(t2, t3, count));
+      best_merge = std::min(best_merge, nsPer(t3, t4, count));
+      best_sort = std::min(best_sort, nsPer(t4, t5, count));
+      if(merged.size() != serial.size())
+        fprintf(stderr, "merged list lost draws: %zu vs %zu\n", merged.size(), serial.size());
+    }
+    const double total = best_record + best_merge + best_sort;
+    printf("%8zu | %10.1f %10.1f %10.1f | %10.1f %9.2fx\n", count, best_record, best_merge, best_sort, total, best_serial / total);
+    for(size_t i = 0; i < slots; ++i)
+      delete buckets[i];
+  }
+  return 0;
+}
@@ -0,0 +1,146 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pipeline/Lamp.hpp"
+#include "pipeline/LightGrid.hpp"
+#include "util/parallel.hpp"
+
+#include "3rdparty/glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// sense-bench-lights [max-lamps] [views]
+//
+// Scatters point and spot lamps through a big world and bins them into
+// a LightGrid from cameras looking around inside it, for 256 lamps and
+// up by fours. Times the binning on one thread and on all of them, and
+// compares how many lamps are listed at a point with how many of them
+// actually reach it.
+//
+// Every view is checked against the lamps themselves: at random points
+// in the frustum, every lamp that reaches the point must be in the list
+// of the cluster it falls in. Exits non-zero if any aren't.
+
+namespace {
+  typedef std::chrono::high_resolution_clock Clock;
+
+  double seconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+  }
+
+  float randf(float lo, float hi) {
+    return lo + (hi - lo) * float(rand()) / RAND_MAX;
+  }
+
+  const float world_size = 400.f;
+
+  Lamp randomLamp() {
+    Lamp l;
+    l.position = glm::vec3(randf(-1.f, 1.f), randf(-0.1f, 0.1f), randf(-1.f, 1.f)) * (world_size * 0.5f);
+    l.color = glm::vec3(randf(0.f, 1.f), randf(0.f, 1.f), randf(0.f, 1.f));
+    l.radius = randf(2.f, 15.f);
+    if(rand() & 1) {
+      l.type = Lamp::Spot;
+      l.direction = glm::normalize(glm::vec3(randf(-1.f, 1.f), randf(-1.f, 1.f), randf(-1.f, 1.f)));
+      l.spot_cos = std::cos(randf(0.1f, 1.5f));
+    }
+    return l;
+  }
+
+  bool reaches(const Lamp& l, const glm::vec3& p) {
+    const glm::vec3 d = p - l.position;
+    const float dist = glm::length(d);
+    if(dist > l.radius)
+      return false;
+    return l.type != Lamp::Spot || dist == 0.f || glm::dot(l.direction, d / dist) >= l.spot_cos;
+  }
+}
+
+int main(int argc, char **argv) {
+  const size_t max_lamps = argc > 1 ? atoi(argv[1]) : 16384;
+  const size_t views = argc > 2 ? atoi(argv[2]) : 16;
+  const size_t samples = 20000;
+
+  std::vector<Lamp> all_lamps;
+  for(size_t i = 0; i < max_lamps; ++i)
+    all_lamps.push_back(randomLamp());
+
+  std::vector<glm::mat4> view_matrices;
+  const glm::mat4 proj = glm::perspective(60.f, 16.f / 9.f, 0.1f, 500.f);
+  for(size_t v = 0; v < views; ++v) {
+    const glm::vec3 eye(randf(-0.4f, 0.4f) * world_size, randf(1.f, 10.f), randf(-0.4f, 0.4f) * world_size);
+    const glm::vec3 target = eye + glm::vec3(randf(-1.f, 1.f), randf(-0.3f, 0.1f), randf(-1.f, 1.f));
+    view_matrices.push_back(proj * glm::lookAt(eye, target, glm::vec3(0.f, 1.f, 0.f)));
+  }
+
+  LightGrid grid;
+  printf("%zux%zux%zu clusters, %zu views, %zu thread slots\n", grid.tilesX(), grid.tilesY(), grid.slices(), views, parallelSlots());
+  size_t missed = 0, checked = 0;
+  for(size_t count = 256; count <= max_lamps; count *= 4) {
+    const std::vector<Lamp> lamps(all_lamps.begin(), all_lamps.begin() + count);
+    double single = 0., threaded = 0.;
+    size_t culled = 0, listed = 0, reaching = 0;
+    for(size_t v = 0; v < views; ++v) {
+      const glm::mat4& m = view_matrices[v];
+      const size_t repeats = 10;
+      double best_single = 1e30, best_threaded = 1e30;
+      for(size_t r = 0; r < repeats; ++r) {
+        Clock::time_point t1 = Clock::now();
+        grid.build(m, lamps, false);
+        Clock::time_point t2 = Clock::now();
+        grid.build(m, lamps, true);
+        Clock::time_point t3 = Clock::now();
+        best_single = std::min(best_single, seconds(t1, t2));
+        best_threaded = std::min(best_threaded, seconds(t2, t3));
+      }
+      single += best_single;
+      threaded += best_threaded;
+      culled += grid.culledLamps();
+
+      // random points between the near and far planes
+      const glm::mat4 inverse = glm::inverse(m);
+      for(size_t s = 0; s < samples; ++s) {
+        const float x = randf(-1.f, 1.f), y = randf(-1.f, 1.f);
+        glm::vec4 a = inverse * glm::vec4(x, y, -1.f, 1.f);
+        glm::vec4 b = inverse * glm::vec4(x, y, 1.f, 1.f);
+        const float t = std::pow(randf(0.f, 1.f), 3.f); // most lamps are near
+        const glm::vec3 p = glm::mix(glm::vec3(a) / a.w, glm::vec3(b) / b.w, t);
+        const glm::vec4 clip = m * glm::vec4(p, 1.f);
+        const size_t tx = std::min(size_t((x + 1.f) * 0.5f * grid.tilesX()), grid.tilesX() - 1);
+        const size_t ty = std::min(size_t((y + 1.f) * 0.5f * grid.tilesY()), grid.tilesY() - 1);
+        const size_t c = grid.cluster(tx, ty, grid.slice(clip.w));
+        const uint16_t* list = &grid.indices()[0] + grid.cells()[c * 2];
+        const uint16_t* list_end = list + grid.cells()[c * 2 + 1];
+        listed += list_end - list;
+        for(size_t i = 0; i < lamps.size(); ++i) {
+          if(!reaches(lamps[i], p))
+            continue;
+          ++reaching;
+          missed += !std::binary_search(list, list_end, uint16_t(i));
+        }
+      }
+      checked += samples;
+    }
+    printf("%6zu lamps: %8.1f us on one thread, %8.1f us threaded (%.1f M lamps/s), %.1f%% culled, %.2f lamps listed and %.2f reaching at a point\n",
+           count, single / views * 1e6, threaded / views * 1e6, count * views / threaded * 1e-6, 100.f * culled / (count * views),
+           float(listed) / (samples * views), float(reaching) / (samples * views));
+  }
+  printf("check: %zu points, %zu lamps missing from their cluster's list\n", checked, missed);
+  return missed ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mesh/Occluder.hpp"
+#include "pipeline/Culling.hpp"
+#include "pipeline/Occlusion.hpp"
+#include "util/parallel.hpp"
+#include "util/simd.hpp"
+
+#include "3rdparty/glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// sense-bench-occlusion [objects]
+//
+// Builds a block of rooms, with walls as occluders and small boxes
+// scattered on the floors, and looks around from inside one of them.
+// Times rasterizing the walls into an OcclusionBuffer, on one thread
+// and on all of them, and testing the boxes against it.
+// sense-test-occlusion checks the results against a reference
+// rasterizer.
+
+namespace {
+  typedef std::chrono::high_resolution_clock Clock;
+
+  double seconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+  }
+
+  float randf(float lo, float hi) {
+    return lo + (hi - lo) * float(rand()) / RAND_MAX;
+  }
+
+  OccluderMesh unitCube() {
+    OccluderMesh m;
+    for(int i = 0; i < 8; ++i)
+      m.positions.push_back(glm::vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+    const uint32_t faces[6][4] = {
+      {0, 2, 3, 1}, {4, 5, 7, 6}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 4, 6, 2}, {1, 3, 7, 5},
+    };
+    for(int f = 0; f < 6; ++f) {
+      const uint32_t tri[6] = {faces[f][0], faces[f][1], faces[f][2], faces[f][0], faces[f][2], faces[f][3]};
+      m.indices.insert(m.indices.end(), tri, tri + 6);
+    }
+    return m;
+  }
+}
+
+int main(int argc, char **argv) {
+  const size_t count = argc > 1 ? atoi(argv[1]) : 100000;
+  const size_t runs = 20;
+
+  // 12x12 rooms, 10m on a side, with 3m walls and a 2m gap for a door
+  // in the middle of each one
+  const int rooms = 12;
+  const float room = 10.f, wall = 0.2f, height = 3.f, door = 2.f;
+  std::vector<glm::mat4> walls;
+  for(int i = 0; i <= rooms; ++i) {
+    for(int j = 0; j < rooms; ++j) {
+      const float along = j * room;
+      const float half = (room - door) * 0.5f;
+      for(int side = 0; side < 2; ++side) {
+        const float start = along + side * (half + door);
+        // one running along x, one along z
+        walls.push_back(glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(start, 0.f, i * room)), glm::vec3(half, height, wall)));
+        walls.push_back(glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(i * room, 0.f, start)), glm::vec3(wall, height, half)));
+      }
+    }
+  }
+
+  srand(1);
+  std::vector<DrawableMesh::Bounds> objects(count);
+  for(size_t i = 0; i < count; ++i) {
+    const glm::vec3 c(randf(0.f, rooms * room), randf(0.2f, 1.5f), randf(0.f, rooms * room));
+    const glm::vec3 e(randf(0.1f, 0.5f), randf(0.1f, 0.5f), randf(0.1f, 0.5f));
+    objects[i].min = c - e;
+    objects[i].max = c + e;
+    objects[i].center = c;
+    objects[i].radius = glm::length(e);
+  }
+
+  // standing in a room near the middle, looking down the diagonal
+  const glm::vec3 eye(rooms * room * 0.5f - 3.f, 1.7f, rooms * room * 0.5f - 2.f);
+  const glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(1.f, -0.05f, 0.6f), glm::vec3(0.f, 1.f, 0.f));
+  const glm::mat4 view_proj = glm::perspective(70.f, 2.f, 0.1f, 200.f) * view;
+  const Frustum frustum = frustumFromMatrix(view_proj);
+
+  const OccluderMesh cube = unitCube();
+  std::vector<glm::mat4> transforms(walls.size());
+  for(size_t i = 0; i < walls.size(); ++i)
+    transforms[i] = view_proj * walls[i];
+
+  OcclusionBuffer buffer;
+  double best_single = 1e30, best_threaded = 1e30;
+  for(size_t r = 0; r < runs; ++r) {
+    const bool threaded = r & 1;
+    Clock::time_point t0 = Clock::now();
+    buffer.clear();
+    for(size_t i = 0; i < transforms.size(); ++i)
+      buffer.addOccluder(&cube, transforms[i]);
+    buffer.rasterize(threaded);
+    double& best = threaded ? best_threaded : best_single;
+    best = std::min(best, seconds(t0, Clock::now()));
+  }
+
+  // frustum first, then the buffer, the way the pipeline does it
+  std::vector<Aabb> boxes;
+  std::vector<size_t> box_objects;
+  size_t unbounded = 0;
+  for(size_t i = 0; i < count; ++i) {
+    Aabb box;
+    Aabb world;
+    world.min = objects[i].min;
+    world.max = objects[i].max;
+    if(testAabb(frustum, world) == CullOutside)
+      continue;
+    if(!transformBounds(objects[i], view_proj, box)) {
+      ++unbounded;
+      continue;
+    }
+    boxes.push_back(box);
+    box_objects.push_back(i);
+  }
+
+  std::vector<uint8_t> visible(boxes.size());
+  double best_test = 1e30;
+  for(size_t r = 0; r < runs; ++r) {
+    Clock::time_point t0 = Clock::now();
+    for(size_t i = 0; i < boxes.size(); ++i)
+      visible[i] = buffer.testAabb(boxes[i]);
+    best_test = std::min(best_test, seconds(t0, Clock::now()));
+  }
+  const size_t occluded = std::count(visible.begin(), visible.end(), 0);
+
+#ifdef SENSE_SSE2
+  const char* simd = "SSE2";
+#else
+  const char* simd = "scalar";
+#endif
+  printf("%zux%zu buffer (%s), %zu walls (%zu triangles drawn), %zu objects\n", buffer.width(), buffer.height(), simd, walls.size(), buffer.triangles(), count);
+  printf("rasterize: %.3f ms on one thread, %.3f ms on %zu\n", best_single * 1e3, best_threaded * 1e3, parallelSlots());
+  printf("test: %zu boxes in the frustum (%zu more crossing the eye plane) in %.3f ms, %.1f Mboxes/s\n",
+         boxes.size(), unbounded, best_test * 1e3, boxes.size() / best_test * 1e-6);
+  printf("occluded: %zu (%.1f%%)\n", occluded, 100.f * occluded / std::max(boxes.size(), size_t(1)));
+  return 0;
+}
@@ -0,0 +1,139 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "pipeline/RenderGraph.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// sense-bench-rendergraph [random-graphs] [passes]
+//
+// Times compiling render graphs, without any GL around: the deferred
+// frame the pipeline builds, then random graphs. sense-test-rendergraph
+// checks what comes out.
+
+namespace {
+  typedef std::chrono::high_resolution_clock Clock;
+  typedef RenderGraph::Handle Handle;
+  typedef RenderGraph::PassId PassId;
+
+  double seconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+  }
+
+  // Same shape as what the pipeline builds, plus a debug view nobody looks at
+  void buildFrame(RenderGraph& g, bool post_lighting) {
+    const RenderGraph::TargetDesc rgba(1280, 720, RenderGraph::RGBA8, 4);
+    Handle gbuf[4];
+    gbuf[0] = g.createTarget("gcol", rgba);
+    gbuf[1] = g.createTarget("gnor", rgba);
+    gbuf[2] = g.createTarget("gmat", RenderGraph::TargetDesc(1280, 720, RenderGraph::RG16F, 4));
+    gbuf[3] = g.createTarget("depth", RenderGraph::TargetDesc(1280, 720, RenderGraph::Depth24Stencil8, 4));
+    Handle lit = g.importTarget("lcol");
+    Handle screen = g.importTarget("screen");
+    Handle debug = g.createTarget("debug", rgba);
+
+    PassId p = g.addPass("geometry");
+    for(size_t i = 0; i < 4; ++i)
+      gbuf[i] = g.write(p, gbuf[i]);
+    p = g.addPass("lighting");
+    for(size_t i = 0; i < 4; ++i)
+      g.read(p, gbuf[i]);
+    lit = g.write(p, lit);
+    p = g.addPass("debug-normals");
+    g.read(p, gbuf[1]);
+    debug = g.write(p, debug);
+    if(post_lighting) {
+      p = g.addPass("post-lighting");
+      for(size_t i = 0; i < 4; ++i)
+        g.read(p, gbuf[i]);
+      lit = g.modify(p, lit);
+    }
+    p = g.addPass("blit");
+    g.read(p, lit);
+    screen = g.write(p, screen);
+  }
+
+  // Passes read random targets and write one, out of a few
+  // descriptions. Now and then one writes to the screen or is kept.
+  void buildRandom(RenderGraph& g, size_t passes) {
+    const RenderGraph::TargetDesc descs[3] = {
+      RenderGraph::TargetDesc(1280, 720, RenderGraph::RGBA8),
+      RenderGraph::TargetDesc(640, 360, RenderGraph::RGBA16F),
+      RenderGraph::TargetDesc(1280, 720, RenderGraph::Depth24Stencil8)
+    };
+    std::vector<Handle> latest;
+    char name[32];
+    for(size_t i = 0; i < passes / 2 + 1; ++i) {
+      snprintf(name, sizeof(name), "t%u", unsigned(i));
+      latest.push_back(g.createTarget(name, descs[rand() % 3]));
+    }
+    latest.push_back(g.importTarget("screen"));
+    for(size_t i = 0; i < passes; ++i) {
+      snprintf(name, sizeof(name), "p%u", unsigned(i));
+      const PassId p = g.addPass(name);
+      std::vector<Handle> reads(rand() % 3);
+      for(size_t r = 0; r < reads.size(); ++r) {
+        reads[r] = latest[rand() % (latest.size() - 1)];
+        g.read(p, reads[r]);
+      }
+      size_t t = rand() % (latest.size() - 1);
+      if(rand() % 8 == 0)
+        t = latest.size() - 1;
+      if(rand() & 1)
+        reads.push_back(latest[t]);
+      latest[t] = reads.size() && reads.back() == latest[t] ? g.modify(p, latest[t]) : g.write(p, latest[t]);
+      if(rand() % 32 == 0)
+        g.keep(p);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  const size_t graphs = argc > 1 ? atoi(argv[1]) : 2000;
+  const size_t passes = argc > 2 ? atoi(argv[2]) : 64;
+
+  // the deferred frame, as often as the pipeline would build it
+  RenderGraph g;
+  const size_t frames = 20000;
+  Clock::time_point start = Clock::now();
+  for(size_t i = 0; i < frames; ++i) {
+    g.clear();
+    buildFrame(g, i & 1);
+    g.compile();
+  }
+  printf("deferred frame: %.2f us to build and compile\n", seconds(start, Clock::now()) * 1e6 / frames);
+
+  srand(1);
+  start = Clock::now();
+  size_t culled = 0, targets = 0, slots = 0;
+  for(size_t i = 0; i < graphs; ++i) {
+    g.clear();
+    buildRandom(g, passes);
+    g.compile();
+    culled += g.culledCount();
+    slots += g.physicalCount();
+    for(size_t t = 0; t < g.targetCount(); ++t)
+      targets += g.physical(t) != RenderGraph::none;
+  }
+  const double elapsed = seconds(start, Clock::now());
+  printf("%u random graphs of %u passes: %.2f us each, %.1f culled, %.1f targets in %.1f slots\n",
+         unsigned(graphs), unsigned(passes), elapsed * 1e6 / graphs,
+         double(culled) / graphs, double(targets) / graphs, double(slots) / graphs);
+
+  return 0;
+}
@@ -22,20 +22,25 @@
 #include "python/entity/api.hpp"
 
 #include "entity/Entity.hpp"
-#include "entity/message/DrawMessage.hpp"
 
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 
 namespace fs = boost::filesystem;
 
+// How long the window size has to stay put before the render target is
+// remade to match it
+static const std::chrono::milliseconds resize_settle(150);
+
 SenseClient::SenseClient()
-  : m_loader_init_complete(false), m_new_width(800), m_new_height(600), m_width(800), m_height(600)
+  : m_loader_init_complete(false), m_new_width(800), m_new_height(600),
+    m_pending_width(800), m_pending_height(600), m_width(800), m_height(600)
 {
   m_manager = new EntityManager;
 
   platformInit();
   m_pipeline = new Pipeline;
+  m_manager->setRenderScene(&m_pipeline->scene());
   if(!Loader::isThreaded()) {
     platformInitLoader();
     m_loader = m_pipeline->createLoader();
@@ -80,18 +85,28 @@ SenseClient::~SenseClient()
 
 bool SenseClient::tick()
 {
-  if (m_new_width != m_width || m_new_height != m_height) {
-    m_width = m_new_width;
-    m_height = m_new_height;
+  // Dragging a window edge sends a new size nearly every frame. The
+  // viewport follows right away and the old target gets stretched over
+  // it; the target itself is only remade once the size settles.
+  if (m_new_width != m_pending_width || m_new_height != m_pending_height) {
+    m_pending_width = m_new_width;
+    m_pending_height = m_new_height;
+    m_resize_time = std::chrono::steady_clock::now();
+    m_pipeline->setViewport(m_pending_width, m_pending_height);
+  }
+  if ((m_pending_width != m_width || m_pending_height != m_height) &&
+      std::chrono::steady_clock::now() - m_resize_time >= resize_settle) {
+    m_width = m_pending_width;
+    m_height = m_pending_height;
     m_pipeline->destroyRenderTarget(framebuffer);
     framebuffer = m_pipeline->createRenderTarget(width(), height(), false);
-    m_pipeline->setViewport(width(), height());
   }
 
   m_datamgr->mainThreadTick();
-  DrawMessage msg;
-  msg.pipe = m_pipeline;
-  m_test_ent->sendMessage(msg);
+  // scene drawables are already in the pipeline's RenderScene; this is
+  // for the ones that draw something new every frame
+  if(m_manager->hasImmediateDrawers())
+    m_manager->drawEntities(m_pipeline);
   m_pipeline->setRenderTarget(framebuffer);
   m_pipeline->render();
   m_pipeline->endFrame();
@@ -23,6 +23,7 @@
 
 #include <boost/filesystem/path.hpp>
 #include <boost/thread.hpp>
+#include <chrono>
 #include <string>
 
 class Pipeline;
@@ -82,8 +83,11 @@ private:
   // Temp entity for draw test (until we have a World)
   Entity* m_test_ent;
 
-  // Information about the client window
+  // Information about the client window. The platform code sets the
+  // new size as it changes; the render target follows once it stops.
   uint32_t m_new_width, m_new_height;
+  uint32_t m_pending_width, m_pending_height;
+  std::chrono::steady_clock::time_point m_resize_time;
   uint32_t m_width, m_height;
   ClientPlatform* m_platform_info;
 
@@ -0,0 +1,286 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "Cooker.hpp"
+
+#include "image/Mipmap.hpp"
+#include "image/Png.hpp"
+#include "image/Stx.hpp"
+#include "mesh/Prepare.hpp"
+#include "mesh/Sbm.hpp"
+#include "pipeline/Drawable.hpp"
+#include "pipeline/Image.hpp"
+#include "util/hash.hpp"
+#include "util/parallel.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = boost::filesystem;
+
+namespace {
+  // Bump this whenever cooked output would come out different, so
+  // everything gets redone
+  const char cook_version[] = "sense-cook 1";
+  const char cache_file[] = "cook.cache";
+
+  std::string readFile(const fs::path& path) {
+    fs::ifstream stream(path, std::ios_base::binary);
+    if(!stream)
+      throw std::runtime_error("Can't open " + path.string());
+    return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+  }
+
+  void writeFile(const fs::path& path, const std::string& data) {
+    fs::create_directories(path.parent_path());
+    // the old file might be a hard link to another output
+    boost::system::error_code ec;
+    fs::remove(path, ec);
+    fs::ofstream stream(path, std::ios_base::binary | std::ios_base::trunc);
+    stream.write(data.data(), data.size());
+    if(!stream)
+      throw std::runtime_error("Can't write " + path.string());
+  }
+
+  std::string cookMesh(const std::string& source, const std::string& name, std::ostream& log) {
+    DrawableMesh msh = DrawableMesh();
+    std::istringstream in(source);
+    std::ostringstream out;
+    try {
+      readSbm(in, &msh);
+      prepareMesh(&msh, name, log);
+      writeSbm(out, &msh);
+    } catch(...) {
+      delete[] (char*)msh.data;
+      delete[] (char*)msh.index_data;
+      throw;
+    }
+    delete[] (char*)msh.data;
+    delete[] (char*)msh.index_data;
+    return out.str();
+  }
+
+  std::string cookTexture(const std::string& source) {
+    Image img = Image();
+    std::istringstream in(source);
+    std::ostringstream out;
+    try {
+      readPng(in, &img);
+      buildMips(&img);
+      writeStx(out, &img);
+    } catch(...) {
+      delete[] img.data;
+      throw;
+    }
+    delete[] img.data;
+    return out.str();
+  }
+}
+
+Cooker::Cooker(const fs::path& source, const fs::path& output)
+  : m_source(source), m_output(output), m_cooked(0), m_skipped(0), m_deduplicated(0), m_failed(0)
+{}
+
+size_t Cooker::run(bool force)
+{
+  if(!fs::is_directory(m_source))
+    throw std::runtime_error("Data directory " + m_source.string() + " doesn't exist");
+  fs::create_directories(m_output);
+  loadCache();
+
+  std::vector<Job> jobs;
+  findJobs(jobs);
+
+  // Sources that went away take their outputs with them
+  std::unordered_map<std::string, CacheEntry> stale;
+  stale.swap(m_cache);
+  for(auto i = jobs.begin(); i != jobs.end(); ++i) {
+    auto j = stale.find(i->source);
+    if(j != stale.end()) {
+      m_cache.insert(*j);
+      stale.erase(j);
+    }
+  }
+  for(auto i = stale.begin(); i != stale.end(); ++i) {
+    boost::system::error_code ec;
+    fs::remove(m_output / i->second.output, ec);
+    std::cout << "Removed " << i->second.output << std::endl;
+  }
+  for(auto i = m_cache.begin(); i != m_cache.end(); ++i)
+    m_blobs.insert(std::make_pair(i->second.blob, i->second.output));
+
+  parallelFor(jobs.size(), 1, [&](size_t begin, size_t end) {
+      for(size_t i = begin; i < end; ++i)
+        cook(jobs[i], force);
+    });
+
+  saveCache();
+  std::cout << m_cooked << " cooked (" << m_deduplicated << " deduplicated), "
+            << m_skipped << " up to date, " << m_failed << " failed" << std::endl;
+  return m_failed;
+}
+
+void Cooker::findJobs(std::vector<Job>& jobs)
+{
+  const fs::path output = fs::absolute(m_output);
+  for(fs::recursive_directory_iterator i(m_source), end; i != end; ++i) {
+    if(fs::is_directory(i->path())) {
+      if(fs::equivalent(i->path(), output))
+        i.no_push(); // don't cook our own output
+      continue;
+    }
+
+    fs::path rel;
+    const fs::path full = i->path();
+    auto s = m_source.begin();
+    auto f = full.begin();
+    for(; s != m_source.end() && f != full.end() && *s == *f; ++s, ++f);
+    for(; f != full.end(); ++f)
+      rel /= *f;
+
+    // only the places the data manager loads from
+    Job job;
+    const std::string dir = rel.begin()->string();
+    const std::string ext = rel.extension().string();
+    if(dir == "models" && ext == ".sbm")
+      job.type = CookMesh;
+    else if(dir == "textures" && ext == ".png")
+      job.type = CookTexture;
+    else
+      continue;
+    job.source = rel.generic_string();
+    job.output = (job.type == CookTexture ? rel.replace_extension(".stx") : rel).generic_string();
+    jobs.push_back(job);
+  }
+}
+
+void Cooker::loadCache()
+{
+  m_cache.clear();
+  fs::ifstream stream(m_output / cache_file);
+  std::string line;
+  while(std::getline(stream, line)) {
+    // source \t key \t blob \t output
+    std::istringstream fields(line);
+    std::string source, output;
+    CacheEntry entry;
+    if(!std::getline(fields, source, '\t'))
+      continue;
+    fields >> std::hex >> entry.key >> entry.blob;
+    fields.ignore(1);
+    if(!fields || !std::getline(fields, output))
+      continue;
+    entry.output = output;
+    m_cache[source] = entry;
+  }
+}
+
+void Cooker::saveCache()
+{
+  std::ostringstream out;
+  for(auto i = m_cache.begin(); i != m_cache.end(); ++i)
+    out << i->first << '\t' << std::hex << i->second.key << '\t' << i->second.blob << '\t' << i->second.output << '\n';
+  writeFile(m_output / cache_file, out.str());
+}
+
+void Cooker::cook(const Job& job, bool force)
+{
+  std::ostringstream log;
+  try {
+    const std::string source = readFile(m_source / job.source);
+    const uint64_t key = hashBytes(source.data(), source.size(), hashBytes(cook_version, sizeof(cook_version)));
+
+    if(!force) {
+      boost::mutex::scoped_lock lock(m_lock);
+      auto i = m_cache.find(job.source);
+      if(i != m_cache.end() && i->second.key == key && fs::exists(m_output / job.output)) {
+        m_skipped++;
+        return;
+      }
+    }
+
+    std::string data;
+    switch(job.type) {
+    case CookMesh:
+      data = cookMesh(source, job.source, log);
+      break;
+    case CookTexture:
+      data = cookTexture(source);
+      break;
+    }
+    store(job, key, data, log);
+  } catch(std::exception& e) {
+    log << "Failed to cook " << job.source << ": " << e.what() << std::endl;
+    boost::mutex::scoped_lock lock(m_lock);
+    m_failed++;
+    std::cerr << log.str();
+    return;
+  }
+
+  boost::mutex::scoped_lock lock(m_lock);
+  std::cout << log.str();
+}
+
+void Cooker::store(const Job& job, uint64_t key, const std::string& data, std::ostream& log)
+{
+  const uint64_t blob = hashBytes(data.data(), data.size());
+  const fs::path output = m_output / job.output;
+
+  std::string existing;
+  {
+    boost::mutex::scoped_lock lock(m_lock);
+    // whatever this output held before is about to go, so nothing
+    // should link to it for those contents any more
+    for(auto i = m_blobs.begin(); i != m_blobs.end();) {
+      if(i->second == job.output && i->first != blob)
+        i = m_blobs.erase(i);
+      else
+        ++i;
+    }
+    auto i = m_blobs.find(blob);
+    if(i != m_blobs.end() && i->second != job.output)
+      existing = i->second;
+    else
+      m_blobs[blob] = job.output;
+  }
+
+  // Same contents as something we already have; share the file if we
+  // can. The other output may be getting cooked again on another
+  // thread, so only keep the link if it really has our contents.
+  bool linked = false;
+  if(!existing.empty() && fs::exists(m_output / existing)) {
+    boost::system::error_code ec;
+    fs::create_directories(output.parent_path());
+    fs::remove(output, ec);
+    fs::create_hard_link(m_output / existing, output, ec);
+    linked = !ec && fs::file_size(output, ec) == data.size() && !ec && readFile(output) == data;
+  }
+  if(!linked)
+    writeFile(output, data);
+  log << "Cooked " << job.source << " -> " << job.output << " (" << data.size() << " bytes"
+      << (linked ? ", shared with " + existing : std::string()) << ")" << std::endl;
+
+  CacheEntry entry;
+  entry.key = key;
+  entry.blob = blob;
+  entry.output = job.output;
+  boost::mutex::scoped_lock lock(m_lock);
+  m_cache[job.source] = entry;
+  m_cooked++;
+  if(linked)
+    m_deduplicated++;
+}
@@ -0,0 +1,79 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SENSE_COOK_COOKER_HPP
+#define SENSE_COOK_COOKER_HPP
+
+#include <boost/filesystem/path.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Converts the source assets in a data directory into the formats the
+// engine loads fastest: SBM meshes under models/ get optimized, LODed
+// and quantized, PNG textures under textures/ become STX with a
+// prebuilt mip chain. The output mirrors
+// the source layout, and the data manager picks cooked files over
+// source files when both exist.
+//
+// A cache in the output directory remembers the content hash of each
+// source (salted with the cooker version) so only changed assets are
+// redone. Outputs with identical contents are stored once and hard
+// linked where the filesystem allows.
+class Cooker
+{
+public:
+  Cooker(const boost::filesystem::path& source, const boost::filesystem::path& output);
+
+  // Cook everything that changed (or everything, if force is set).
+  // Returns the number of assets that failed.
+  size_t run(bool force);
+
+private:
+  enum JobType {
+    CookMesh,
+    CookTexture,
+  };
+
+  struct Job {
+    JobType type;
+    std::string source; // relative to m_source, with forward slashes
+    std::string output; // relative to m_output
+  };
+
+  struct CacheEntry {
+    uint64_t key; // source contents + cooker version
+    uint64_t blob; // output contents
+    std::string output;
+  };
+
+  boost::filesystem::path m_source;
+  boost::filesystem::path m_output;
+
+  boost::mutex m_lock; // covers everything below
+  std::unordered_map<std::string, CacheEntry> m_cache;
+  std::unordered_map<uint64_t, std::string> m_blobs; // output contents -> an output that has them
+  size_t m_cooked, m_skipped, m_deduplicated, m_failed;
+
+  void findJobs(std::vector<Job>&);
+  void loadCache();
+  void saveCache();
+  void cook(const Job&, bool force);
+  void store(const Job&, uint64_t key, const std::string& data, std::ostream& log);
+};
+
+#endif // SENSE_COOK_COOKER_HPP
@@ -0,0 +1,50 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "Cooker.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// sense-cook [--force] [data dir] [output dir]
+//
+// Cooks the assets under the data directory (../data by default) into
+// the output directory (data/cooked by default, which is where the
+// engine looks for them).
+int main(int argc, char **argv) {
+  bool force = false;
+  std::vector<std::string> paths;
+  for(int i = 1; i < argc; ++i) {
+    if(strcmp(argv[i], "--force") == 0 || strcmp(argv[i], "-f") == 0) {
+      force = true;
+    } else if(argv[i][0] == '-') {
+      std::cerr << "Usage: " << argv[0] << " [--force] [data dir] [output dir]" << std::endl;
+      return 2;
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  boost::filesystem::path source = paths.size() > 0 ? paths[0] : "../data";
+  boost::filesystem::path output = paths.size() > 1 ? boost::filesystem::path(paths[1]) : source / "cooked";
+
+  try {
+    Cooker cooker(source, output);
+    return cooker.run(force) ? 1 : 0;
+  } catch(std::exception& e) {
+    std::cerr << "sense-cook: " << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -4,10 +4,9 @@ in vec2 te0;
 
 out vec2 vtexcoord;
 
-uniform mat4 modelview[SENSE_MAX_INSTANCES];
 uniform mat4 projection;
 
 void main(void) {
   vtexcoord = te0;
-  gl_Position = projection * modelview[gl_InstanceID] * vec4(pos, 1.0);
+  gl_Position = projection * sense_modelview_affine() * vec4(pos, 1.0);
 }
\ No newline at end of file
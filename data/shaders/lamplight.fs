@@ -0,0 +1,50 @@
+uniform sampler2DMS gcol;
+uniform sampler2DMS gnor;
+uniform sampler2DMS gmat;
+uniform sampler2DMS gdep;
+
+out vec4 lcol;
+
+const vec3 ambient = vec3(0.05);
+
+vec4 shade(ivec2 pixel, vec2 ndc, int i)
+{
+  vec4 albedo = texelFetch(gcol, pixel, i);
+  vec3 n = normalize(texelFetch(gnor, pixel, i).xyz * 2.0 - 1.0);
+  float depth = texelFetch(gdep, pixel, i).r;
+  // back to lamp space; the w that comes out is one over the clip w
+  vec4 p = sense_clip_to_lamp * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+  uvec2 list = sense_lamp_list(gl_FragCoord.xy, 1.0 / p.w);
+  vec3 light = ambient;
+  for(uint j = 0u; j < list.y; j++)
+    light += sense_lamp(sense_lamp_index(list.x + j), p.xyz / p.w, n);
+  return vec4(albedo.rgb * light, albedo.a);
+}
+
+// Away from edges every sample holds the same surface, so it only
+// needs lighting once
+bool edge(ivec2 pixel)
+{
+  vec4 c = texelFetch(gcol, pixel, 0);
+  vec4 n = texelFetch(gnor, pixel, 0);
+  float d = texelFetch(gdep, pixel, 0).r;
+  for(int i = 1; i < sense_samples; i++) {
+    if(texelFetch(gcol, pixel, i) != c || texelFetch(gnor, pixel, i) != n || texelFetch(gdep, pixel, i).r != d)
+      return true;
+  }
+  return false;
+}
+
+void main()
+{
+  ivec2 pixel = ivec2(floor(gl_FragCoord.xy));
+  vec2 ndc = gl_FragCoord.xy / sense_viewport * 2.0 - 1.0;
+  if(!edge(pixel)) {
+    lcol = shade(pixel, ndc, 0);
+    return;
+  }
+  vec4 color = vec4(0.0);
+  for(int i = 0; i < sense_samples; i++)
+    color += shade(pixel, ndc, i);
+  lcol = color / float(sense_samples);
+}
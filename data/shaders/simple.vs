@@ -8,13 +8,11 @@ out vec3 vnor;
 out vec3 vtan;
 out vec3 vbitan;
 
-uniform mat4 modelview[SENSE_MAX_INSTANCES];
-
 void main(void) 
 {
   vtex = te0;
-  vnor = nor;
-  vtan = tan;
+  vnor = sense_normal(nor);
+  vtan = sense_tangent(tan);
   vbitan = cross(vnor, vtan);
-  gl_Position = modelview[gl_InstanceID] * vec4(pos, 1.0);
+  gl_Position = sense_modelview() * vec4(sense_position(pos), 1.0);
 }
@@ -14,6 +14,7 @@
 
 #include "CoordinateComponent.hpp"
 #include "Entity.hpp"
+#include "message/TransformMessage.hpp"
 
 #include "3rdparty/glm/gtc/matrix_transform.hpp"
 
@@ -31,12 +32,14 @@ void CoordinateComponent::setParentTransform(glm::mat4 par2wor)
 {
   parent2world = par2wor;
   local2world = local2parent * parent2world;
+  m_owner->sendMessage(TransformMessage());
 }
 
 void CoordinateComponent::setTransform(glm::mat4 loc2par)
 {
   local2parent = loc2par;
   local2world = local2parent * parent2world;
+  m_owner->sendMessage(TransformMessage());
 }
 
 void CoordinateComponent::receiveMessage(const Message&)
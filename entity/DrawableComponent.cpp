@@ -17,28 +17,51 @@
 #include "Entity.hpp"
 #include "message/DrawMessage.hpp"
 #include "message/LoadMessage.hpp"
+#include "message/TransformMessage.hpp"
 
+#include "mesh/Lod.hpp"
 #include "world/DataManager.hpp"
 #include "pipeline/interface.hpp"
+#include "pipeline/RenderScene.hpp"
 
 #include "util/util.hpp"
 
 DrawableComponent::DrawableComponent(Entity* owner)
-  : Component(owner), coord(0), skel(0)
+  : Component(owner), m_lod(0), m_occluder(false), m_scene(0), m_proxy(RenderScene::none), m_immediate(0), coord(0), skel(0)
 {
   m_mesh = m_owner->m_datamgr->loadMesh("monkey");
   m_mat = m_owner->m_datamgr->loadMaterial("simple");
 }
 
 DrawableComponent::~DrawableComponent()
-{}
+{
+  if(m_scene)
+    m_scene->remove(m_proxy);
+  if(m_immediate)
+    m_immediate->removeImmediateDrawer(this);
+}
 
 void DrawableComponent::receiveMessage(const Message& msg)
 {
   // DrawMessage
   try {
     const DrawMessage& dmsg = dynamic_cast<const DrawMessage&>(msg);
-    draw(dmsg.pipe);
+    if(!m_scene)
+      draw(dmsg.pipe, dmsg.bucket);
+    return;
+  } catch (std::bad_cast&) {}
+
+  // TransformMessage
+  try {
+    const TransformMessage& tmsg = dynamic_cast<const TransformMessage&>(msg);
+    UNUSED(tmsg);
+    if(m_scene && coord) {
+      m_scene->setTransform(m_proxy, coord->transform());
+      if(m_mesh->buffer) {
+        m_lod = selectLod(m_mesh, coord->transform(), m_lod);
+        m_scene->setLod(m_proxy, m_lod);
+      }
+    }
     return;
   } catch (std::bad_cast&) {}
 
@@ -56,10 +79,50 @@ void DrawableComponent::receiveMessage(const Message& msg)
 
     if(!coord)
       throw std::runtime_error("DrawableComponent requires CoordinateComponent");
+
+    m_scene = m_owner->m_scene;
+    if(m_scene && m_proxy == RenderScene::none) {
+      m_proxy = m_scene->add(m_mesh, m_mat, coord->transform(), Pipeline::PassStandard, m_lod);
+      m_scene->setOccluder(m_proxy, m_occluder);
+    }
+    if(!m_scene && !m_immediate && m_owner->m_manager) {
+      m_immediate = m_owner->m_manager;
+      m_immediate->addImmediateDrawer(this);
+    }
   } catch (std::bad_cast&) {}
 }
 
-void DrawableComponent::draw(Pipeline* pipe)
+void DrawableComponent::setMesh(DrawableMesh* mesh)
+{
+  m_mesh = mesh;
+  m_lod = 0;
+  if(m_scene) {
+    m_scene->setMesh(m_proxy, mesh);
+    m_scene->setLod(m_proxy, 0);
+  }
+}
+
+void DrawableComponent::setMaterial(Material* mat)
+{
+  m_mat = mat;
+  if(m_scene)
+    m_scene->setMaterial(m_proxy, mat);
+}
+
+void DrawableComponent::setOccluder(bool occluder)
+{
+  m_occluder = occluder;
+  if(m_scene)
+    m_scene->setOccluder(m_proxy, occluder);
+}
+
+void DrawableComponent::draw(Pipeline* pipe, DrawBucket* bucket)
 {
-  pipe->addDrawTask(m_mesh, m_mat, coord->transform(), Pipeline::PassStandard);
+  // the mesh gets its LODs before it gets a buffer, so don't look until then
+  if(m_mesh->buffer)
+    m_lod = selectLod(m_mesh, coord->transform(), m_lod);
+  if(bucket)
+    pipe->addDrawTask(bucket, m_mesh, m_mat, coord->transform(), Pipeline::PassStandard, m_lod);
+  else
+    pipe->addDrawTask(m_mesh, m_mat, coord->transform(), Pipeline::PassStandard, m_lod);
 }
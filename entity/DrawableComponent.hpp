@@ -17,11 +17,17 @@
 
 #include "Component.hpp"
 
+#include <cstddef>
+#include <cstdint>
+
 struct DrawableMesh;
 struct Material;
 
 class Pipeline;
+class RenderScene;
+struct DrawBucket;
 
+class EntityManager;
 class CoordinateComponent;
 class SkeletonComponent;
 
@@ -33,11 +39,26 @@ public:
 
   virtual void receiveMessage(const Message&);
 
-  void draw(Pipeline*);
+  void setMesh(DrawableMesh*);
+  void setMaterial(Material*);
+  // Whether this hides other drawables from the occlusion culling. Walls
+  // and other big solid things, not small or see-through ones.
+  void setOccluder(bool);
+
+  // Entities in a RenderScene get a proxy when they load and are kept
+  // up to date from then on. The rest sign up with the EntityManager
+  // and are drawn in response to DrawMessage, into bucket if there is
+  // one; that's how workers draw.
+  void draw(Pipeline*, DrawBucket* bucket=0);
 
 private:
   DrawableMesh *m_mesh;
   Material* m_mat;
+  size_t m_lod; // LOD drawn last frame
+  bool m_occluder;
+  RenderScene* m_scene;
+  uint32_t m_proxy; // RenderScene::ProxyId
+  EntityManager* m_immediate; // who sends DrawMessage, without a scene
 
   CoordinateComponent* coord;
   SkeletonComponent* skel;
@@ -14,8 +14,19 @@
 
 #include "Entity.hpp"
 #include "Component.hpp"
+#include "message/DrawMessage.hpp"
 #include "message/LoadMessage.hpp"
 
+#include "pipeline/interface.hpp"
+#include "util/parallel.hpp"
+
+#include <algorithm>
+
+namespace {
+  // Components per thread below which recording isn't worth splitting up
+  const size_t min_draw_chunk = 1024;
+}
+
 Message::~Message() {}
 
 void Entity::sendMessage(const Message& m)
@@ -45,6 +56,8 @@ Entity* EntityManager::createEntity(std::string classname, boost::uuids::uuid* u
   Entity* e =  m_factories[classname]->create();
   if (e) {
     e->m_type = classname;
+    e->m_scene = m_scene;
+    e->m_manager = this;
     if(uuid)
       e->m_uuid = *uuid;
     else
@@ -84,3 +97,43 @@ void EntityManager::addFactory(std::string classname, EntityFactory* fact)
 {
   m_factories.insert(std::make_pair(classname, fact));
 }
+
+void EntityManager::addImmediateDrawer(Component* c)
+{
+  m_immediate.push_back(c);
+}
+
+void EntityManager::removeImmediateDrawer(Component* c)
+{
+  auto i = std::find(m_immediate.begin(), m_immediate.end(), c);
+  if(i != m_immediate.end()) {
+    *i = m_immediate.back();
+    m_immediate.pop_back();
+  }
+}
+
+void EntityManager::drawEntities(Pipeline* pipe)
+{
+  // merging buckets isn't free, so skip them unless there's more than one thread's worth
+  const size_t slots = parallelSlots();
+  if(slots == 1 || m_immediate.size() < 2 * min_draw_chunk) {
+    DrawMessage msg;
+    msg.pipe = pipe;
+    msg.bucket = 0;
+    for(size_t i = 0; i < m_immediate.size(); ++i)
+      m_immediate[i]->receiveMessage(msg);
+    return;
+  }
+
+  std::vector<DrawBucket*> buckets(slots);
+  for(size_t i = 0; i < slots; ++i)
+    buckets[i] = pipe->drawBucket(i);
+
+  parallelForSlots(m_immediate.size(), min_draw_chunk, [&](size_t slot, size_t begin, size_t end) {
+      DrawMessage msg;
+      msg.pipe = pipe;
+      msg.bucket = buckets[slot];
+      for(size_t i = begin; i < end; ++i)
+        m_immediate[i]->receiveMessage(msg);
+    });
+}
@@ -21,9 +21,13 @@
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 class Component;
 class DataManager;
+class EntityManager;
+class Pipeline;
+class RenderScene;
 
 struct Message
 {
@@ -32,6 +36,8 @@ struct Message
 
 struct Entity
 {
+  Entity() : m_datamgr(0), m_scene(0), m_manager(0) {}
+
   std::string m_type;
   std::string m_name;
   boost::uuids::uuid m_uuid;
@@ -39,6 +45,8 @@ struct Entity
 
   // The high-level engine parts that Entities might need to reference
   DataManager* m_datamgr;
+  RenderScene* m_scene; // set by EntityManager::createEntity
+  EntityManager* m_manager; // likewise
 
   void sendMessage(const Message&);
 };
@@ -69,15 +77,35 @@ private:
 class EntityManager
 {
 public:
+  EntityManager() : m_scene(0) {}
+
   Entity* createEntity(std::string, boost::uuids::uuid* uuid=NULL);
   void destroyEntity(boost::uuids::uuid);
   Entity* findEntity(boost::uuids::uuid);
 
   void addFactory(std::string, EntityFactory*);
+
+  // Entities created from now on keep their draws here
+  void setRenderScene(RenderScene* scene) { m_scene = scene; }
+
+  // Components that draw something different every frame instead of
+  // keeping a RenderScene proxy sign up here for DrawMessage, and sign
+  // off before they go away.
+  void addImmediateDrawer(Component*);
+  void removeImmediateDrawer(Component*);
+  bool hasImmediateDrawers() const { return !m_immediate.empty(); }
+
+  // Send each signed up component a DrawMessage. They're split into
+  // ranges across worker threads, each recording into its own pipeline
+  // bucket, so components must handle DrawMessage without touching
+  // shared state.
+  void drawEntities(Pipeline*);
 private:
   std::unordered_map<boost::uuids::uuid, Entity*, boost::hash<boost::uuids::uuid> > m_entities;
   std::unordered_map<std::string, EntityFactory*> m_factories;
   boost::uuids::random_generator m_uuidgen;
+  RenderScene* m_scene;
+  std::vector<Component*> m_immediate;
 };
 
 #endif // SENSE_ENTITY_ENTITY_HPP
@@ -18,11 +18,13 @@
 #include "../Entity.hpp"
 
 class Pipeline;
+struct DrawBucket;
 
 struct DrawMessage : public Message {
   virtual ~DrawMessage();
 
   Pipeline* pipe;
+  DrawBucket* bucket; // record here if set; the message is being sent from a worker
 };
 
 #endif // SENSE_ENTITY_MESSAGE_DRAW_HPP
@@ -1,7 +1,9 @@
 #include "DrawMessage.hpp"
 #include "LoadMessage.hpp"
+#include "TransformMessage.hpp"
 
 #define DESTRUCTOR(CLASS) CLASS::~CLASS() {}
 
 DESTRUCTOR(DrawMessage)
 DESTRUCTOR(LoadMessage)
+DESTRUCTOR(TransformMessage)
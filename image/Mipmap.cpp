@@ -0,0 +1,101 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "Mipmap.hpp"
+
+#include "pipeline/Image.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+size_t imageChannels(const Image* img)
+{
+  switch(img->format) {
+  case Image::R8: return 1;
+  case Image::RG8: return 2;
+  case Image::RGB8: return 3;
+  case Image::RGBA8: return 4;
+  }
+  return 0;
+}
+
+unsigned int mipWidth(const Image* img, unsigned int level)
+{
+  return std::max(img->width >> level, 1u);
+}
+
+unsigned int mipHeight(const Image* img, unsigned int level)
+{
+  return std::max(img->height >> level, 1u);
+}
+
+size_t mipSize(const Image* img, unsigned int level)
+{
+  return size_t(mipWidth(img, level)) * mipHeight(img, level) * imageChannels(img);
+}
+
+size_t mipOffset(const Image* img, unsigned int level)
+{
+  size_t offset = 0;
+  for(unsigned int i = 0; i < level; ++i)
+    offset += mipSize(img, i);
+  return offset;
+}
+
+void buildMips(Image* img)
+{
+  if(img->mip_count > 1 || !img->width || !img->height)
+    return;
+  unsigned int levels = 1;
+  while((img->width >> levels) || (img->height >> levels))
+    ++levels;
+
+  const size_t channels = imageChannels(img);
+  Image out = *img;
+  out.mip_count = levels;
+  out.data = new char[mipOffset(&out, levels)];
+  memcpy(out.data, img->data, mipSize(img, 0));
+
+  // sum the source texels that fall into each destination texel
+  std::vector<unsigned int> sums;
+  std::vector<unsigned int> counts;
+  for(unsigned int level = 1; level < levels; ++level) {
+    const unsigned int sw = mipWidth(&out, level - 1), sh = mipHeight(&out, level - 1);
+    const unsigned int dw = mipWidth(&out, level), dh = mipHeight(&out, level);
+    const unsigned char* src = (const unsigned char*)out.data + mipOffset(&out, level - 1);
+    unsigned char* dst = (unsigned char*)out.data + mipOffset(&out, level);
+    sums.assign(size_t(dw) * dh * channels, 0);
+    counts.assign(size_t(dw) * dh, 0);
+    for(unsigned int y = 0; y < sh; ++y) {
+      const unsigned int dy = std::min(y / 2, dh - 1);
+      for(unsigned int x = 0; x < sw; ++x) {
+        const unsigned int dx = std::min(x / 2, dw - 1);
+        const size_t d = size_t(dy) * dw + dx;
+        const unsigned char* s = src + (size_t(y) * sw + x) * channels;
+        for(size_t c = 0; c < channels; ++c)
+          sums[d * channels + c] += s[c];
+        counts[d]++;
+      }
+    }
+    for(size_t d = 0; d < counts.size(); ++d) {
+      for(size_t c = 0; c < channels; ++c)
+        dst[d * channels + c] = (sums[d * channels + c] + counts[d] / 2) / counts[d];
+    }
+  }
+
+  delete[] img->data;
+  img->data = out.data;
+  img->mip_count = levels;
+  img->pipe_build_mips = false;
+}
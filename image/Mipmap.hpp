@@ -0,0 +1,33 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SENSE_IMAGE_MIPMAP_HPP
+#define SENSE_IMAGE_MIPMAP_HPP
+
+#include <cstddef>
+
+struct Image;
+
+size_t imageChannels(const Image*);
+// Bytes used by the given mip level, and by all levels up to (not including) it
+size_t mipSize(const Image*, unsigned int level);
+size_t mipOffset(const Image*, unsigned int level);
+unsigned int mipWidth(const Image*, unsigned int level);
+unsigned int mipHeight(const Image*, unsigned int level);
+
+// Replace the image data with a full mip chain, box filtered down to
+// 1x1. Odd sizes fold the last row/column into the one before. Images
+// that already have mips are left alone.
+void buildMips(Image*);
+
+#endif // SENSE_IMAGE_MIPMAP_HPP
@@ -0,0 +1,101 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "Png.hpp"
+
+#include "pipeline/Image.hpp"
+
+#include <png.h>
+
+#include <stdexcept>
+
+namespace {
+  void readPngData(png_structp pngPtr, png_bytep data, png_size_t length) {
+    png_voidp a = png_get_io_ptr(pngPtr);
+    ((std::istream*)a)->read((char*)data, length);
+  }
+}
+
+void readPng(std::istream& stream, Image* img)
+{
+  const std::streampos base = stream.tellg();
+  char pngsig[8];
+  stream.read(pngsig, 8);
+  int is_png = png_sig_cmp((png_bytep)pngsig, 0, 8);
+  if(!stream || is_png != 0)
+    throw std::runtime_error("Not a PNG file");
+  png_structp pngPtr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if(!pngPtr)
+    throw std::runtime_error("Error initializing PNG reader");
+  png_infop infoPtr = png_create_info_struct(pngPtr);
+  if(!infoPtr) {
+    png_destroy_read_struct(&pngPtr, 0, 0);
+    throw std::runtime_error("Error initializing PNG reader");
+  }
+  stream.seekg(base);
+  png_set_read_fn(pngPtr, (png_voidp)(&stream), readPngData);
+  png_set_sig_bytes(pngPtr, 0);
+  png_read_info(pngPtr, infoPtr);
+
+  img->width = png_get_image_width(pngPtr, infoPtr);
+  img->height = png_get_image_height(pngPtr, infoPtr);
+
+  png_uint_32 bitdepth = png_get_bit_depth(pngPtr, infoPtr);
+  png_uint_32 channels = png_get_channels(pngPtr, infoPtr);
+  png_uint_32 color_type = png_get_color_type(pngPtr, infoPtr);
+
+  png_set_expand(pngPtr);
+
+  switch(color_type) {
+  case PNG_COLOR_TYPE_PALETTE:
+    channels = 3;
+    break;
+  case PNG_COLOR_TYPE_GRAY:
+    bitdepth = 8;
+    break;
+  }
+
+  if(png_get_valid(pngPtr, infoPtr, PNG_INFO_tRNS)) {
+    channels++;
+  }
+
+  if(bitdepth == 16) {
+    png_set_strip_16(pngPtr);
+    bitdepth = 8;
+  }
+
+  if(bitdepth != 8) {
+    png_destroy_read_struct(&pngPtr, &infoPtr,(png_infopp)0);
+    throw std::runtime_error("PNGs with bitdepths other than 8 are not supported");
+  }
+
+  png_bytep* rowPtrs = new png_bytep[img->height];
+  img->data = new char[img->width*img->height*channels];
+  img->mip_count = 1;
+  img->pipe_build_mips = true;
+  const unsigned int stride = img->width * channels;
+  for(size_t i = 0; i < img->height; i++) {
+    png_uint_32 q = (img->height - i - 1) * stride;
+    rowPtrs[i] = (png_bytep)img->data + q;
+  }
+  png_read_image(pngPtr, rowPtrs);
+  delete[] rowPtrs;
+  png_destroy_read_struct(&pngPtr, &infoPtr,(png_infopp)0);
+
+  switch(channels) {
+  case 1: img->format = Image::R8; break;
+  case 2: img->format = Image::RG8; break;
+  case 3: img->format = Image::RGB8; break;
+  case 4: img->format = Image::RGBA8; break;
+  }
+}
@@ -0,0 +1,26 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SENSE_IMAGE_PNG_HPP
+#define SENSE_IMAGE_PNG_HPP
+
+#include <istream>
+
+struct Image;
+
+// Decode a PNG into the image. Rows are stored bottom-up, the way GL
+// wants them. Data is allocated with new[]. Throws std::runtime_error
+// if the stream isn't a PNG we can handle.
+void readPng(std::istream&, Image*);
+
+#endif // SENSE_IMAGE_PNG_HPP
@@ -0,0 +1,85 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "Stx.hpp"
+#include "Mipmap.hpp"
+
+#include "pipeline/Image.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#pragma pack(push, 1)
+namespace {
+  static const char stx_magic[] = "STX\0";
+  const uint32_t stx_version = 1;
+
+  struct StxHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t format; // Image::Format
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_count;
+    uint32_t data_offset; // from the start of the file, 16-byte aligned
+    uint32_t data_size;
+  };
+
+  static_assert(sizeof(StxHeader) % 16 == 0, "STX header must be 16-byte aligned");
+}
+#pragma pack(pop)
+
+void readStx(std::istream& stream, Image* img)
+{
+  const std::streampos base = stream.tellg();
+  StxHeader head;
+  stream.read((char*)&head, sizeof(StxHeader));
+  if(!stream || memcmp(head.magic, stx_magic, 4) != 0)
+    throw std::runtime_error("STX signature verification failed");
+  if(head.version != stx_version)
+    throw std::runtime_error("Unsupported STX version");
+  if(head.format > Image::RGBA8 || !head.mip_count || head.mip_count > 32)
+    throw std::runtime_error("Bad STX header");
+
+  img->format = (Image::Format)head.format;
+  img->width = head.width;
+  img->height = head.height;
+  img->mip_count = head.mip_count;
+  img->pipe_build_mips = false;
+  if(head.data_size != mipOffset(img, head.mip_count))
+    throw std::runtime_error("STX data size doesn't match its header");
+
+  img->data = new char[head.data_size];
+  stream.seekg(base + std::streamoff(head.data_offset));
+  stream.read(img->data, head.data_size);
+  if(!stream)
+    throw std::runtime_error("STX file is truncated");
+}
+
+void writeStx(std::ostream& stream, const Image* img)
+{
+  StxHeader head;
+  memcpy(head.magic, stx_magic, 4);
+  head.version = stx_version;
+  head.format = img->format;
+  head.width = img->width;
+  head.height = img->height;
+  head.mip_count = img->mip_count;
+  head.data_offset = sizeof(StxHeader);
+  head.data_size = mipOffset(img, img->mip_count);
+  stream.write((const char*)&head, sizeof(StxHeader));
+  stream.write(img->data, head.data_size);
+  if(!stream)
+    throw std::runtime_error("Failed writing STX");
+}
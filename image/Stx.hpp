@@ -0,0 +1,28 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SENSE_IMAGE_STX_HPP
+#define SENSE_IMAGE_STX_HPP
+
+#include <istream>
+#include <ostream>
+
+struct Image;
+
+// STX is the cooked texture format: a small header followed by the raw
+// texels of every mip level, ready to hand to the pipeline. Data is
+// allocated with new[]. Throws std::runtime_error on malformed files.
+void readStx(std::istream&, Image*);
+void writeStx(std::ostream&, const Image*);
+
+#endif // SENSE_IMAGE_STX_HPP
@@ -0,0 +1,100 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Bounds.hpp"
+#include "VertexData.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+  // Box first, then the sphere around the box center. This needs a
+  // second pass but gives a much tighter sphere than the box diagonal.
+  template <typename Index>
+  DrawableMesh::Bounds fitBounds(const float* positions, Index index, size_t count) {
+    DrawableMesh::Bounds b;
+    if(!count) {
+      b.min = b.max = b.center = glm::vec3(0.f);
+      b.radius = 0.f;
+      return b;
+    }
+    b.min = glm::vec3(std::numeric_limits<float>::max());
+    b.max = glm::vec3(-std::numeric_limits<float>::max());
+    for(size_t i = 0; i < count; ++i) {
+      const float* p = positions + index(i) * 3;
+      glm::vec3 v(p[0], p[1], p[2]);
+      b.min = glm::min(b.min, v);
+      b.max = glm::max(b.max, v);
+    }
+    b.center = (b.min + b.max) * 0.5f;
+    float r2 = 0.f;
+    for(size_t i = 0; i < count; ++i) {
+      const float* p = positions + index(i) * 3;
+      glm::vec3 d = glm::vec3(p[0], p[1], p[2]) - b.center;
+      r2 = std::max(r2, glm::dot(d, d));
+    }
+    b.radius = std::sqrt(r2);
+    return b;
+  }
+
+  struct Direct {
+    size_t operator()(size_t i) const { return i; }
+  };
+
+  struct Indexed {
+    const uint32_t* indices;
+    size_t operator()(size_t i) const { return indices[i]; }
+  };
+}
+
+DrawableMesh::Bounds computeBounds(const float* positions, size_t count)
+{
+  return fitBounds(positions, Direct(), count);
+}
+
+DrawableMesh::Bounds computeBounds(const float* positions, const uint32_t* indices, size_t index_count)
+{
+  Indexed idx = { indices };
+  return fitBounds(positions, idx, index_count);
+}
+
+void computeMeshBounds(DrawableMesh* m)
+{
+  std::vector<uint32_t> indices;
+  readIndices(m, indices);
+  if(m->submeshes.empty()) {
+    DrawableMesh::Submesh sub = DrawableMesh::Submesh();
+    sub.index_start = 0;
+    sub.index_count = m->lods.empty() ? indices.size() : m->lods[0].index_count;
+    sub.material = 0;
+    m->submeshes.push_back(sub);
+  }
+
+  const DrawableMesh::Attribute* pos = findAttribute(m, DrawableMesh::Pos);
+  std::vector<float> positions;
+  if(pos)
+    fetchAttributeArray(m, *pos, 3, positions);
+  else
+    indices.clear();
+
+  const float* p = positions.empty() ? 0 : &positions[0];
+  m->bounds = computeBounds(p, positions.size() / 3);
+  for(auto i = m->submeshes.begin(); i != m->submeshes.end(); ++i) {
+    const size_t start = std::min(i->index_start, indices.size());
+    const size_t count = std::min(i->index_count, indices.size() - start);
+    i->bounds = computeBounds(p, count ? &indices[start] : 0, count);
+  }
+}
@@ -0,0 +1,33 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_MESH_BOUNDS_HPP
+#define SENSE_MESH_BOUNDS_HPP
+
+#include "pipeline/Drawable.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// Fit bounds around a set of points (tightly packed xyz)
+DrawableMesh::Bounds computeBounds(const float* positions, size_t count);
+
+// Fit bounds around the vertices referenced by part of an index list
+DrawableMesh::Bounds computeBounds(const float* positions, const uint32_t* indices, size_t index_count);
+
+// Recompute the bounds of a mesh and all its submeshes from the vertex
+// data. Meshes without submeshes get a single one covering everything.
+void computeMeshBounds(DrawableMesh*);
+
+#endif // SENSE_MESH_BOUNDS_HPP
@@ -0,0 +1,200 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Cluster.hpp"
+#include "Bounds.hpp"
+#include "VertexData.hpp"
+
+#include "pipeline/Drawable.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+  // Split one range of the index list, [start, start + count), into
+  // clusters. The range is rewritten in place.
+  void clusterRange(DrawableMesh* m, std::vector<uint32_t>& indices, size_t start, size_t count,
+                    const std::vector<float>& positions, size_t max_triangles) {
+    const size_t triangles = count / 3;
+    const size_t vertices = positions.size() / 3;
+    const uint32_t* idx = &indices[start];
+    if(!triangles)
+      return;
+
+    std::vector<glm::vec3> centroids(triangles);
+    std::vector<glm::vec3> normals(triangles); // zero for degenerate triangles
+    for(size_t t = 0; t < triangles; ++t) {
+      glm::vec3 p[3];
+      for(int v = 0; v < 3; ++v)
+        p[v] = glm::vec3(positions[idx[t * 3 + v] * 3], positions[idx[t * 3 + v] * 3 + 1], positions[idx[t * 3 + v] * 3 + 2]);
+      centroids[t] = (p[0] + p[1] + p[2]) / 3.f;
+      const glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+      const float len = glm::length(n);
+      normals[t] = len > 0.f ? n / len : glm::vec3(0.f);
+    }
+
+    // triangles around each vertex
+    std::vector<uint32_t> offsets(vertices + 1, 0);
+    for(size_t i = 0; i < triangles * 3; ++i)
+      offsets[idx[i] + 1]++;
+    for(size_t v = 0; v < vertices; ++v)
+      offsets[v + 1] += offsets[v];
+    std::vector<uint32_t> adjacent(triangles * 3);
+    {
+      std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+      for(size_t i = 0; i < triangles * 3; ++i)
+        adjacent[fill[idx[i]]++] = i / 3;
+    }
+
+    const uint32_t none = uint32_t(-1);
+    std::vector<uint8_t> used(triangles, 0);
+    std::vector<uint32_t> vertex_cluster(vertices, none); // which cluster last took the vertex
+    std::vector<uint32_t> candidate_cluster(triangles, none);
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> members;
+    std::vector<uint32_t> out;
+    out.reserve(count);
+    size_t seed = 0;
+    for(uint32_t cluster = 0; out.size() < triangles * 3; ++cluster) {
+      while(used[seed])
+        ++seed;
+      members.clear();
+      candidates.clear();
+      glm::vec3 centroid_sum(0.f);
+      glm::vec3 normal_sum(0.f);
+
+      uint32_t next = seed;
+      while(next != none) {
+        used[next] = 1;
+        members.push_back(next);
+        centroid_sum += centroids[next];
+        normal_sum += normals[next];
+        for(int v = 0; v < 3; ++v) {
+          const uint32_t vtx = idx[next * 3 + v];
+          if(vertex_cluster[vtx] == cluster)
+            continue;
+          vertex_cluster[vtx] = cluster;
+          for(uint32_t a = offsets[vtx]; a < offsets[vtx + 1]; ++a) {
+            const uint32_t t = adjacent[a];
+            if(!used[t] && candidate_cluster[t] != cluster) {
+              candidate_cluster[t] = cluster;
+              candidates.push_back(t);
+            }
+          }
+        }
+        if(members.size() >= max_triangles)
+          break;
+
+        // Take the neighbour that brings the fewest new vertices, then
+        // the one closest to the middle, with normals pointing away from
+        // the rest counting as further away
+        const glm::vec3 center = centroid_sum / float(members.size());
+        const float normal_len = glm::length(normal_sum);
+        const glm::vec3 normal = normal_len > 0.f ? normal_sum / normal_len : glm::vec3(0.f);
+        next = none;
+        int best_new = 4;
+        float best_score = std::numeric_limits<float>::max();
+        for(size_t c = 0; c < candidates.size();) {
+          const uint32_t t = candidates[c];
+          if(used[t]) {
+            candidates[c] = candidates.back();
+            candidates.pop_back();
+            continue;
+          }
+          ++c;
+          int added = 0;
+          for(int v = 0; v < 3; ++v)
+            added += vertex_cluster[idx[t * 3 + v]] != cluster;
+          if(added > best_new)
+            continue;
+          const glm::vec3 d = centroids[t] - center;
+          const float score = glm::dot(d, d) * (2.f - glm::dot(normals[t], normal));
+          if(added < best_new || score < best_score) {
+            best_new = added;
+            best_score = score;
+            next = t;
+          }
+        }
+      }
+
+      // keep the cache optimized order inside the cluster
+      std::sort(members.begin(), members.end());
+      DrawableMesh::Cluster c;
+      c.index_start = start + out.size();
+      c.index_count = members.size() * 3;
+      for(auto t = members.begin(); t != members.end(); ++t)
+        out.insert(out.end(), idx + *t * 3, idx + *t * 3 + 3);
+      const DrawableMesh::Bounds b = computeBounds(&positions[0], &out[c.index_start - start], c.index_count);
+      c.center = b.center;
+      c.radius = b.radius;
+
+      const float normal_len = glm::length(normal_sum);
+      c.cone_axis = normal_len > 0.f ? normal_sum / normal_len : glm::vec3(0.f, 0.f, 1.f);
+      float min_dot = normal_len > 0.f ? 1.f : 0.f;
+      for(auto t = members.begin(); t != members.end(); ++t) {
+        if(normals[*t] != glm::vec3(0.f))
+          min_dot = std::min(min_dot, glm::dot(normals[*t], c.cone_axis));
+      }
+      c.cone_cos = std::max(min_dot, 0.f);
+      m->clusters.push_back(c);
+    }
+    std::copy(out.begin(), out.end(), indices.begin() + start);
+  }
+}
+
+bool buildClusters(DrawableMesh* m, size_t max_triangles, ClusterStats* stats)
+{
+  const DrawableMesh::Attribute* pos = findAttribute(m, DrawableMesh::Pos);
+  if(!pos || !m->index_data || !max_triangles)
+    return false;
+  std::vector<uint32_t> indices;
+  readIndices(m, indices);
+
+  // Triangles can't move between submeshes
+  std::vector<std::pair<size_t, size_t> > ranges;
+  for(auto i = m->submeshes.begin(); i != m->submeshes.end(); ++i) {
+    if(i->index_start + i->index_count > indices.size() || i->index_count % 3 != 0)
+      return false;
+    ranges.push_back(std::make_pair(i->index_start, i->index_count));
+  }
+  if(ranges.empty())
+    ranges.push_back(std::make_pair(size_t(0), m->lods.empty() ? indices.size() : m->lods[0].index_count));
+  std::sort(ranges.begin(), ranges.end());
+  if(ranges.back().second % 3 != 0)
+    return false;
+
+  std::vector<float> positions;
+  fetchAttributeArray(m, *pos, 3, positions);
+  m->clusters.clear();
+  for(auto i = ranges.begin(); i != ranges.end(); ++i)
+    clusterRange(m, indices, i->first, i->second, positions, max_triangles);
+  writeIndices(m, indices, vertexCount(m));
+
+  if(stats) {
+    ClusterStats s = ClusterStats();
+    s.clusters = m->clusters.size();
+    for(auto c = m->clusters.begin(); c != m->clusters.end(); ++c) {
+      s.triangles += c->index_count / 3;
+      s.radius += c->radius;
+      s.cones += c->cone_cos > 0.f;
+    }
+    if(s.clusters) {
+      s.triangles /= s.clusters;
+      s.radius /= s.clusters * std::max(m->bounds.radius, 1e-20f);
+    }
+    *stats = s;
+  }
+  return true;
+}
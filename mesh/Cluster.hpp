@@ -0,0 +1,39 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_MESH_CLUSTER_HPP
+#define SENSE_MESH_CLUSTER_HPP
+
+#include <cstddef>
+
+struct DrawableMesh;
+
+struct ClusterStats
+{
+  size_t clusters;
+  float triangles; // average per cluster
+  float radius; // average cluster radius over the mesh's
+  size_t cones; // clusters narrow enough to ever face away as a whole
+};
+
+// Split LOD 0 of each submesh into clusters of up to max_triangles
+// neighbouring triangles and fill in the mesh's clusters. Triangles are
+// reordered so each cluster is one index range, but they keep their
+// order within a cluster, so the vertex cache optimization survives.
+// Clusters are grown to stay round and to keep their normals together,
+// which is what makes them worth culling. Returns false (and leaves the
+// mesh alone) if it has no positions or isn't a triangle list.
+bool buildClusters(DrawableMesh*, size_t max_triangles=128, ClusterStats* stats=0);
+
+#endif // SENSE_MESH_CLUSTER_HPP
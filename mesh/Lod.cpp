@@ -0,0 +1,67 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Lod.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+  // how far past the threshold we have to be before switching levels
+  const float lod_hysteresis = 0.25f;
+}
+
+float projectedSize(const DrawableMesh::Bounds& b, const glm::mat4& transform)
+{
+  const glm::vec4 center = transform * glm::vec4(b.center, 1.f);
+  // worst case scale of the transform, as seen on screen
+  float scale = 0.f;
+  for(int c = 0; c < 3; ++c)
+    scale = std::max(scale, glm::length(glm::vec2(transform[c][0], transform[c][1])));
+  const float radius = b.radius * scale;
+  if(center.w <= radius)
+    return std::numeric_limits<float>::max();
+  return radius / center.w;
+}
+
+size_t selectLod(const DrawableMesh* m, const glm::mat4& transform, size_t current, float threshold)
+{
+  if(m->lods.size() <= 1 || m->bounds.radius <= 0.f)
+    return 0;
+  current = std::min(current, m->lods.size() - 1);
+
+  // object-space error to NDC
+  const float size = projectedSize(m->bounds, transform);
+  if(size == std::numeric_limits<float>::max())
+    return 0;
+  const float scale = size / m->bounds.radius;
+
+  size_t best = 0;
+  for(size_t i = 1; i < m->lods.size(); ++i) {
+    if(m->lods[i].error * scale <= threshold)
+      best = i;
+  }
+
+  if(best > current) {
+    // only go coarser once the level is comfortably under the threshold
+    while(best > current && m->lods[best].error * scale > threshold * (1.f - lod_hysteresis))
+      --best;
+  } else if(best < current) {
+    // and only go finer once the current level is clearly too coarse
+    if(m->lods[current].error * scale <= threshold * (1.f + lod_hysteresis))
+      best = current;
+  }
+  return best;
+}
@@ -0,0 +1,35 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_MESH_LOD_HPP
+#define SENSE_MESH_LOD_HPP
+
+#include "pipeline/Drawable.hpp"
+
+#include <cstddef>
+
+// Radius of the bounds after transform, in normalized device
+// coordinates (1.0 is half the viewport). transform is whatever the
+// mesh is drawn with, all the way to clip space. Returns a huge
+// number if the viewer is inside the bounds.
+float projectedSize(const DrawableMesh::Bounds&, const glm::mat4& transform);
+
+// Pick the coarsest LOD whose error stays under threshold (in NDC units,
+// so 1/540 is about a pixel at 1080p) when drawn with transform.
+// current is the LOD picked last frame; it is kept until another level
+// is a clear improvement, so objects near a threshold don't flicker
+// between levels.
+size_t selectLod(const DrawableMesh*, const glm::mat4& transform, size_t current, float threshold=1.f/540.f);
+
+#endif // SENSE_MESH_LOD_HPP
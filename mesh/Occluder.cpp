@@ -0,0 +1,56 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Occluder.hpp"
+#include "VertexData.hpp"
+
+void buildOccluder(const DrawableMesh* m, OccluderMesh& out, float max_error)
+{
+  out.positions.clear();
+  out.indices.clear();
+  const DrawableMesh::Attribute* pos = findAttribute(m, DrawableMesh::Pos);
+  if(!pos)
+    return;
+
+  std::vector<uint32_t> indices;
+  readIndices(m, indices);
+  size_t start = 0;
+  size_t count = indices.size();
+  if(!m->lods.empty()) {
+    size_t level = 0;
+    for(size_t i = m->lods.size() - 1; i > 0 && !level; --i) {
+      if(m->lods[i].error <= max_error * m->bounds.radius)
+        level = i;
+    }
+    start = m->lods[level].index_start;
+    count = m->lods[level].index_count;
+  }
+  count -= count % 3;
+
+  std::vector<float> positions;
+  fetchAttributeArray(m, *pos, 3, positions);
+
+  // pull out the vertices this level uses, in the order it uses them
+  std::vector<uint32_t> remap(positions.size() / 3, uint32_t(-1));
+  out.indices.resize(count);
+  for(size_t i = 0; i < count; ++i) {
+    uint32_t& v = remap[indices[start + i]];
+    if(v == uint32_t(-1)) {
+      v = out.positions.size();
+      const float* p = &positions[indices[start + i] * 3];
+      out.positions.push_back(glm::vec3(p[0], p[1], p[2]));
+    }
+    out.indices[i] = v;
+  }
+}
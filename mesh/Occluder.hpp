@@ -0,0 +1,39 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_MESH_OCCLUDER_HPP
+#define SENSE_MESH_OCCLUDER_HPP
+
+#include "3rdparty/glm/glm.hpp"
+#include "pipeline/Drawable.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Bare triangles for the software occlusion rasterizer: positions only,
+// with just the vertices the triangles use.
+struct OccluderMesh
+{
+  std::vector<glm::vec3> positions;
+  std::vector<uint32_t> indices;
+};
+
+// Build an occluder from the coarsest LOD that stays within max_error
+// (a fraction of the mesh's bounding radius) of the full mesh.
+// Simplified levels can bulge past the real surface, and anything an
+// occluder covers that the real mesh doesn't gets wrongly culled, so
+// keep max_error small. Meshes without positions give an empty occluder.
+void buildOccluder(const DrawableMesh*, OccluderMesh&, float max_error=0.01f);
+
+#endif // SENSE_MESH_OCCLUDER_HPP
@@ -0,0 +1,416 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Optimize.hpp"
+#include "VertexData.hpp"
+
+#include "util/hash.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace {
+  // Tuning values for the Forsyth scoring function, straight from the paper
+  const size_t forsyth_cache_size = 32;
+  const size_t forsyth_max_valence = 32;
+  const float forsyth_decay_power = 1.5f;
+  const float forsyth_last_tri_score = 0.75f;
+  const float forsyth_valence_scale = 2.0f;
+  const float forsyth_valence_power = 0.5f;
+
+  // cache size used to find cluster boundaries for the overdraw pass
+  const size_t overdraw_cache_size = 16;
+
+  struct ForsythScores {
+    float cache[forsyth_cache_size];
+    float valence[forsyth_max_valence];
+
+    ForsythScores() {
+      for(size_t i = 0; i < forsyth_cache_size; ++i) {
+        if(i < 3) {
+          // the last triangle's vertices get a fixed score, so we
+          // don't just keep picking the triangle next to the last one
+          cache[i] = forsyth_last_tri_score;
+        } else {
+          const float scale = 1.f / (forsyth_cache_size - 3);
+          cache[i] = std::pow(1.f - (i - 3) * scale, forsyth_decay_power);
+        }
+      }
+      valence[0] = 0.f;
+      for(size_t i = 1; i < forsyth_max_valence; ++i)
+        valence[i] = forsyth_valence_scale * std::pow(float(i), -forsyth_valence_power);
+    }
+
+    float operator()(int cache_pos, uint32_t live) const {
+      if(live == 0)
+        return -1.f; // nothing left to draw with this vertex
+      float score = cache_pos >= 0 ? cache[cache_pos] : 0.f;
+      return score + valence[std::min<size_t>(live, forsyth_max_valence - 1)];
+    }
+  };
+
+  // Run one triangle through a FIFO cache model. Returns the number of misses.
+  unsigned simulateTriangle(const uint32_t* tri, std::vector<uint32_t>& timestamps, uint32_t& time, size_t cache_size) {
+    unsigned misses = 0;
+    for(size_t k = 0; k < 3; ++k) {
+      if(time - timestamps[tri[k]] > cache_size) {
+        timestamps[tri[k]] = time++;
+        misses++;
+      }
+    }
+    return misses;
+  }
+
+  void triangleNormal(const float* positions, const uint32_t* tri, float out[3], float centroid[3]) {
+    const float* a = positions + tri[0] * 3;
+    const float* b = positions + tri[1] * 3;
+    const float* c = positions + tri[2] * 3;
+    float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    out[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    out[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    out[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    for(size_t k = 0; k < 3; ++k)
+      centroid[k] = (a[k] + b[k] + c[k]) / 3.f;
+  }
+}
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t index_count, size_t vertex_count, size_t cache_size)
+{
+  std::vector<uint32_t> timestamps(vertex_count, 0);
+  uint32_t time = cache_size + 1;
+  size_t misses = 0;
+  for(size_t i = 0; i < index_count; ++i) {
+    if(time - timestamps[indices[i]] > cache_size) {
+      timestamps[indices[i]] = time++;
+      misses++;
+    }
+  }
+  size_t referenced = 0;
+  for(size_t i = 0; i < vertex_count; ++i) {
+    if(timestamps[i])
+      referenced++;
+  }
+
+  VertexCacheStats s;
+  s.acmr = index_count ? float(misses) / (index_count / 3) : 0.f;
+  s.atvr = referenced ? float(misses) / referenced : 0.f;
+  return s;
+}
+
+size_t deduplicateVertices(std::vector<uint32_t>& remap, const void* vertices, size_t vertex_count, size_t stride)
+{
+  remap.resize(vertex_count);
+  size_t table_size = 1;
+  while(table_size < vertex_count * 2)
+    table_size <<= 1;
+  const size_t mask = table_size - 1;
+  std::vector<uint32_t> table(table_size, ~0u);
+
+  const char* data = (const char*)vertices;
+  size_t unique = 0;
+  for(size_t v = 0; v < vertex_count; ++v) {
+    const char* vtx = data + v * stride;
+    size_t slot = hashBytes(vtx, stride) & mask;
+    for(;;) {
+      uint32_t existing = table[slot];
+      if(existing == ~0u) {
+        table[slot] = v;
+        remap[v] = v;
+        unique++;
+        break;
+      }
+      if(memcmp(vtx, data + existing * stride, stride) == 0) {
+        remap[v] = existing;
+        break;
+      }
+      slot = (slot + 1) & mask;
+    }
+  }
+  return unique;
+}
+
+void optimizeVertexCache(uint32_t* indices, size_t index_count, size_t vertex_count)
+{
+  const size_t tri_count = index_count / 3;
+  if(!tri_count)
+    return;
+  static const ForsythScores score;
+
+  // vertex->triangle adjacency. live[v] is how many of the triangles in
+  // v's list haven't been emitted yet; emitted ones get swapped to the end.
+  std::vector<uint32_t> live(vertex_count, 0);
+  for(size_t i = 0; i < tri_count * 3; ++i)
+    live[indices[i]]++;
+  std::vector<uint32_t> offsets(vertex_count + 1, 0);
+  for(size_t v = 0; v < vertex_count; ++v)
+    offsets[v + 1] = offsets[v] + live[v];
+  std::vector<uint32_t> adjacency(tri_count * 3);
+  {
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for(size_t t = 0; t < tri_count; ++t)
+      for(size_t k = 0; k < 3; ++k)
+        adjacency[fill[indices[t * 3 + k]]++] = t;
+  }
+
+  std::vector<int> cache_pos(vertex_count, -1);
+  std::vector<float> vtx_score(vertex_count);
+  for(size_t v = 0; v < vertex_count; ++v)
+    vtx_score[v] = score(-1, live[v]);
+
+  std::vector<float> tri_score(tri_count);
+  std::vector<bool> emitted(tri_count, false);
+  size_t best = 0;
+  for(size_t t = 0; t < tri_count; ++t) {
+    const uint32_t* tri = indices + t * 3;
+    tri_score[t] = vtx_score[tri[0]] + vtx_score[tri[1]] + vtx_score[tri[2]];
+    if(tri_score[t] > tri_score[best])
+      best = t;
+  }
+
+  std::vector<uint32_t> output;
+  output.reserve(tri_count * 3);
+  uint32_t cache[forsyth_cache_size + 3];
+  size_t cache_count = 0;
+  size_t scan = 0;
+
+  while(best != tri_count) {
+    emitted[best] = true;
+    const uint32_t tri[3] = { indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2] };
+    output.insert(output.end(), tri, tri + 3);
+
+    // the new triangle goes to the front of the LRU cache
+    uint32_t new_cache[forsyth_cache_size + 3];
+    size_t new_count = 0;
+    for(size_t k = 0; k < 3; ++k) {
+      if(std::find(new_cache, new_cache + new_count, tri[k]) == new_cache + new_count)
+        new_cache[new_count++] = tri[k];
+    }
+    for(size_t i = 0; i < cache_count; ++i) {
+      if(cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+        new_cache[new_count++] = cache[i];
+    }
+
+    for(size_t k = 0; k < 3; ++k) {
+      uint32_t* list = &adjacency[offsets[tri[k]]];
+      uint32_t* list_end = list + live[tri[k]];
+      uint32_t* it = std::find(list, list_end, (uint32_t)best);
+      std::swap(*it, *(list_end - 1));
+      live[tri[k]]--;
+    }
+
+    // rescore everything that was in the cache, including vertices that
+    // just fell out of it, and the triangles that use them
+    for(size_t i = 0; i < new_count; ++i) {
+      uint32_t v = new_cache[i];
+      cache_pos[v] = i < forsyth_cache_size ? int(i) : -1;
+      vtx_score[v] = score(cache_pos[v], live[v]);
+    }
+    best = tri_count;
+    float best_score = -1.f;
+    for(size_t i = 0; i < new_count; ++i) {
+      uint32_t v = new_cache[i];
+      const uint32_t* list = &adjacency[offsets[v]];
+      for(size_t j = 0; j < live[v]; ++j) {
+        const uint32_t t = list[j];
+        const uint32_t* other = indices + t * 3;
+        tri_score[t] = vtx_score[other[0]] + vtx_score[other[1]] + vtx_score[other[2]];
+        if(tri_score[t] > best_score) {
+          best_score = tri_score[t];
+          best = t;
+        }
+      }
+    }
+
+    cache_count = std::min(new_count, forsyth_cache_size);
+    std::copy(new_cache, new_cache + cache_count, cache);
+
+    if(best == tri_count) {
+      // Nothing in the cache has any triangles left. Pick up the next
+      // unemitted triangle; the scores don't matter much at this point.
+      while(scan < tri_count && emitted[scan])
+        scan++;
+      best = scan;
+    }
+  }
+
+  std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t* indices, size_t index_count, const float* positions, size_t vertex_count, float threshold)
+{
+  const size_t tri_count = index_count / 3;
+  if(!tri_count)
+    return;
+
+  std::vector<uint32_t> timestamps(vertex_count, 0);
+  uint32_t time = overdraw_cache_size + 1;
+
+  // Hard boundaries are where the cache order starts over anyways
+  // (every vertex of the triangle misses)
+  std::vector<size_t> hard;
+  for(size_t t = 0; t < tri_count; ++t) {
+    if(simulateTriangle(indices + t * 3, timestamps, time, overdraw_cache_size) == 3 || t == 0)
+      hard.push_back(t);
+  }
+  hard.push_back(tri_count);
+
+  // Soft boundaries split hard clusters further, as long as each piece
+  // stays within threshold of the ACMR of the cluster it came from
+  std::vector<size_t> clusters;
+  for(size_t h = 0; h + 1 < hard.size(); ++h) {
+    const size_t start = hard[h];
+    const size_t end = hard[h + 1];
+
+    time += overdraw_cache_size + 1;
+    size_t cluster_misses = 0;
+    for(size_t t = start; t < end; ++t)
+      cluster_misses += simulateTriangle(indices + t * 3, timestamps, time, overdraw_cache_size);
+    const float target = threshold * cluster_misses / (end - start);
+
+    time += overdraw_cache_size + 1;
+    clusters.push_back(start);
+    size_t cluster_start = start;
+    size_t misses = 0;
+    for(size_t t = start; t < end; ++t) {
+      misses += simulateTriangle(indices + t * 3, timestamps, time, overdraw_cache_size);
+      if(t + 1 < end && float(misses) / (t - cluster_start + 1) <= target) {
+        clusters.push_back(t + 1);
+        cluster_start = t + 1;
+        misses = 0;
+        time += overdraw_cache_size + 1;
+      }
+    }
+  }
+  clusters.push_back(tri_count);
+  const size_t cluster_count = clusters.size() - 1;
+
+  float mesh_centroid[3] = { 0.f, 0.f, 0.f };
+  for(size_t v = 0; v < vertex_count; ++v)
+    for(size_t k = 0; k < 3; ++k)
+      mesh_centroid[k] += positions[v * 3 + k];
+  for(size_t k = 0; k < 3; ++k)
+    mesh_centroid[k] /= vertex_count;
+
+  // Sort key is how far each cluster faces away from the mesh center.
+  // Clusters on the outside go first.
+  std::vector<std::pair<float, size_t> > order(cluster_count);
+  for(size_t c = 0; c < cluster_count; ++c) {
+    float centroid[3] = { 0.f, 0.f, 0.f };
+    float normal[3] = { 0.f, 0.f, 0.f };
+    float area = 0.f;
+    for(size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+      float n[3], tc[3];
+      triangleNormal(positions, indices + t * 3, n, tc);
+      float a = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      for(size_t k = 0; k < 3; ++k) {
+        centroid[k] += tc[k] * a;
+        normal[k] += n[k];
+      }
+      area += a;
+    }
+    float key = 0.f;
+    float nlen = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if(area > 0.f && nlen > 0.f) {
+      for(size_t k = 0; k < 3; ++k)
+        key += (centroid[k] / area - mesh_centroid[k]) * normal[k] / nlen;
+    }
+    order[c] = std::make_pair(-key, c);
+  }
+  std::stable_sort(order.begin(), order.end());
+
+  std::vector<uint32_t> output;
+  output.reserve(index_count);
+  for(size_t i = 0; i < cluster_count; ++i) {
+    const size_t c = order[i].second;
+    output.insert(output.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+  }
+  std::copy(output.begin(), output.end(), indices);
+}
+
+size_t optimizeVertexFetch(void* dest, uint32_t* indices, size_t index_count, const void* vertices, size_t vertex_count, size_t stride)
+{
+  std::vector<uint32_t> remap(vertex_count, ~0u);
+  const char* src = (const char*)vertices;
+  char* dst = (char*)dest;
+  uint32_t next = 0;
+  for(size_t i = 0; i < index_count; ++i) {
+    const uint32_t v = indices[i];
+    if(remap[v] == ~0u) {
+      remap[v] = next;
+      memcpy(dst + next * stride, src + v * stride, stride);
+      next++;
+    }
+    indices[i] = remap[v];
+  }
+  return next;
+}
+
+bool optimizeMesh(DrawableMesh* m, MeshOptimizeStats* stats)
+{
+  const size_t vertex_count = vertexCount(m);
+  std::vector<uint32_t> indices;
+  readIndices(m, indices);
+  if(indices.empty() || indices.size() % 3 != 0)
+    return false;
+
+  MeshOptimizeStats s;
+  s.vertices_before = vertex_count;
+  s.before = analyzeVertexCache(&indices[0], indices.size(), vertex_count);
+
+  std::vector<uint32_t> remap;
+  deduplicateVertices(remap, m->data, vertex_count, m->data_stride);
+  for(size_t i = 0; i < indices.size(); ++i)
+    indices[i] = remap[indices[i]];
+
+  // Triangles can't move between submeshes, so each one is optimized on its own
+  std::vector<std::pair<size_t, size_t> > ranges;
+  for(auto i = m->submeshes.begin(); i != m->submeshes.end(); ++i) {
+    if(i->index_start + i->index_count > indices.size() || i->index_count % 3 != 0)
+      return false;
+    ranges.push_back(std::make_pair(i->index_start, i->index_count));
+  }
+  if(ranges.empty())
+    ranges.push_back(std::make_pair(size_t(0), m->lods.empty() ? indices.size() : m->lods[0].index_count));
+  // coarser LODs were already optimized when they were built
+
+  const DrawableMesh::Attribute* pos = findAttribute(m, DrawableMesh::Pos);
+  std::vector<float> positions;
+  if(pos)
+    fetchAttributeArray(m, *pos, 3, positions);
+
+  for(auto i = ranges.begin(); i != ranges.end(); ++i) {
+    if(!i->second)
+      continue;
+    optimizeVertexCache(&indices[i->first], i->second, vertex_count);
+    if(pos)
+      optimizeOverdraw(&indices[i->first], i->second, &positions[0], vertex_count);
+  }
+
+  char* data = new char[m->data_size];
+  size_t new_count = optimizeVertexFetch(data, &indices[0], indices.size(), m->data, vertex_count, m->data_stride);
+  delete[] (char*)m->data;
+  m->data = data;
+  m->data_size = new_count * m->data_stride;
+  writeIndices(m, indices, new_count);
+  m->clusters.clear(); // their triangles moved
+
+  s.vertices_after = new_count;
+  s.after = analyzeVertexCache(&indices[0], indices.size(), new_count);
+  if(stats)
+    *stats = s;
+  return true;
+}
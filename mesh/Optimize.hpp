@@ -0,0 +1,68 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_MESH_OPTIMIZE_HPP
+#define SENSE_MESH_OPTIMIZE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct DrawableMesh;
+
+struct VertexCacheStats
+{
+  float acmr; // transformed vertices per triangle. 0.5 is the best case for a regular grid; 3.0 is no reuse at all
+  float atvr; // transformed vertices per referenced vertex. 1.0 is ideal
+};
+
+struct MeshOptimizeStats
+{
+  VertexCacheStats before;
+  VertexCacheStats after;
+  size_t vertices_before;
+  size_t vertices_after;
+};
+
+// Simulate a FIFO post-transform cache over a triangle list. 16 entries is
+// roughly what most current hardware has, so that's what we report against.
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t index_count, size_t vertex_count, size_t cache_size=16);
+
+// Collapse vertices with bit-identical data. Fills remap with the first
+// occurrence of each vertex and returns the number of unique vertices.
+size_t deduplicateVertices(std::vector<uint32_t>& remap, const void* vertices, size_t vertex_count, size_t stride);
+
+// Reorder triangles for the post-transform cache (Tom Forsyth's linear-speed algorithm)
+void optimizeVertexCache(uint32_t* indices, size_t index_count, size_t vertex_count);
+
+// Split an already cache-optimized triangle list into clusters and sort
+// them outside-in, so that the parts of the mesh most likely to be
+// visible are drawn first. threshold is how much ACMR we're willing to
+// give up for more (smaller) clusters; 1.05 is a good default.
+void optimizeOverdraw(uint32_t* indices, size_t index_count, const float* positions, size_t vertex_count, float threshold=1.05f);
+
+// Reorder vertices in the order the index list first touches them, and
+// drop any that aren't referenced. Indices are rewritten in place.
+// Returns the number of vertices written to dest.
+size_t optimizeVertexFetch(void* dest, uint32_t* indices, size_t index_count, const void* vertices, size_t vertex_count, size_t stride);
+
+// Run the whole set on a loaded mesh: dedupe, vertex cache, overdraw,
+// then vertex fetch. Unindexed meshes get an index list generated for
+// them. The attribute layout is untouched, so the mesh's attributes stay
+// valid. Submeshes keep their index ranges and are optimized one at a
+// time. Returns false (and leaves the mesh alone) if the mesh isn't
+// a plain triangle list.
+bool optimizeMesh(DrawableMesh*, MeshOptimizeStats* stats=0);
+
+#endif // SENSE_MESH_OPTIMIZE_HPP
@@ -0,0 +1,52 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "Prepare.hpp"
+#include "Cluster.hpp"
+#include "Optimize.hpp"
+#include "Quantize.hpp"
+#include "Simplify.hpp"
+
+#include "pipeline/Drawable.hpp"
+
+void prepareMesh(DrawableMesh* msh, const std::string& name, std::ostream& log)
+{
+  MeshOptimizeStats stats;
+  if(optimizeMesh(msh, &stats)) {
+    log << "Optimized mesh " << name << ": ACMR " << stats.before.acmr << " -> " << stats.after.acmr
+        << ", ATVR " << stats.before.atvr << " -> " << stats.after.atvr
+        << ", " << stats.vertices_before << " -> " << stats.vertices_after << " vertices" << std::endl;
+  }
+
+  if(generateLods(msh)) {
+    log << "Generated LODs for mesh " << name << ":";
+    for(size_t i = 0; i < msh->lods.size(); ++i)
+      log << (i ? " -> " : " ") << msh->lods[i].index_count / 3;
+    log << " triangles" << std::endl;
+  }
+
+  // LOD 0's triangles get reordered, so this has to come after anything
+  // else that looks at their order
+  ClusterStats cstats;
+  if(buildClusters(msh, 128, &cstats)) {
+    log << "Clustered mesh " << name << ": " << cstats.clusters << " clusters of " << cstats.triangles
+        << " triangles, " << cstats.cones << " with normal cones" << std::endl;
+  }
+
+  QuantizeStats qstats;
+  if(quantizeMesh(msh, QuantizeOptions(), &qstats)) {
+    log << "Quantized mesh " << name << ": " << qstats.stride_before << " -> " << qstats.stride_after << " bytes/vertex"
+        << ", max error position " << qstats.max_position_error << ", normal " << qstats.max_normal_error
+        << " deg, tangent " << qstats.max_tangent_error << " deg, texcoord " << qstats.max_texcoord_error << std::endl;
+  }
+}
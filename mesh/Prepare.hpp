@@ -0,0 +1,28 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SENSE_MESH_PREPARE_HPP
+#define SENSE_MESH_PREPARE_HPP
+
+#include <ostream>
+#include <string>
+
+struct DrawableMesh;
+
+// Everything we do to a freshly read source mesh before it's fit for
+// the renderer: optimize, build LODs, cluster, quantize. The cooker
+// runs this offline; the data manager runs it on meshes that weren't
+// cooked. Stats go to log, tagged with name.
+void prepareMesh(DrawableMesh*, const std::string& name, std::ostream& log);
+
+#endif // SENSE_MESH_PREPARE_HPP
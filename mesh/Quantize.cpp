@@ -0,0 +1,402 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Quantize.hpp"
+#include "VertexData.hpp"
+
+#include "util/simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+  // Scalar versions of the conversion kernels, used for the tail end of
+  // arrays and on platforms without SSE2.
+  uint16_t floatToHalf1(float f) {
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    const uint32_t sign = x & 0x80000000u;
+    x ^= sign;
+    uint16_t o;
+    if(x >= 0x47800000u) {
+      // overflow, infinity or NaN
+      o = x > 0x7f800000u ? 0x7e00 : 0x7c00;
+    } else if(x < 0x38800000u) {
+      // denormal or zero. Let the FPU do the shifting for us.
+      float fx;
+      memcpy(&fx, &x, 4);
+      fx += 0.5f;
+      uint32_t r;
+      memcpy(&r, &fx, 4);
+      o = r - 0x3f000000u;
+    } else {
+      const uint32_t mant_odd = (x >> 13) & 1;
+      x += 0xc8000fffu; // rebias the exponent and round
+      x += mant_odd; // ...to nearest even
+      o = x >> 13;
+    }
+    return o | (sign >> 16);
+  }
+
+  int roundNearest(float f) {
+    return int(std::floor(f + 0.5f));
+  }
+
+  void octahedral1(float* dst, const float* n) {
+    const float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+    float x = n[0] / l1;
+    float y = n[1] / l1;
+    if(n[2] < 0.f) {
+      const float fx = (1.f - std::fabs(y)) * (x >= 0.f ? 1.f : -1.f);
+      const float fy = (1.f - std::fabs(x)) * (y >= 0.f ? 1.f : -1.f);
+      x = fx;
+      y = fy;
+    }
+    dst[0] = x;
+    dst[1] = y;
+  }
+
+  float angleBetween(const float* a, const float* b) {
+    float la = std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    float lb = std::sqrt(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+    if(la == 0.f || lb == 0.f)
+      return 0.f;
+    float d = (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / (la * lb);
+    return std::acos(std::min(1.f, std::max(-1.f, d))) * 180.f / 3.14159265f;
+  }
+
+  struct QuantizedAttrib {
+    DrawableMesh::Attribute attr;
+    size_t bytes; // per vertex, including padding
+    std::vector<char> data;
+  };
+}
+
+void floatToHalf(uint16_t* dst, const float* src, size_t count)
+{
+  size_t i = 0;
+#ifdef SENSE_SSE2
+  const __m128i sign_mask = _mm_set1_epi32((int)0x80000000u);
+  const __m128i f16_max = _mm_set1_epi32(0x47800000);
+  const __m128i f32_infinity = _mm_set1_epi32(0x7f800000);
+  const __m128i nan_bit = _mm_set1_epi32(0x200);
+  const __m128i f16_infinity = _mm_set1_epi32(0x7c00);
+  const __m128i min_normal = _mm_set1_epi32(0x38800000);
+  const __m128i denorm_magic = _mm_set1_epi32(0x3f000000);
+  const __m128i normal_bias = _mm_set1_epi32((int)0xc8000fffu);
+  for(; i + 4 <= count; i += 4) {
+    const __m128i f = _mm_castps_si128(_mm_loadu_ps(src + i));
+    const __m128i sign = _mm_and_si128(f, sign_mask);
+    const __m128i absf = _mm_xor_si128(f, sign);
+
+    const __m128i is_nan = _mm_cmpgt_epi32(absf, f32_infinity);
+    const __m128i is_regular = _mm_cmpgt_epi32(f16_max, absf);
+    const __m128i is_denorm = _mm_cmpgt_epi32(min_normal, absf);
+    const __m128i inf_or_nan = _mm_or_si128(_mm_and_si128(is_nan, nan_bit), f16_infinity);
+
+    const __m128 denorm1 = _mm_add_ps(_mm_castsi128_ps(absf), _mm_castsi128_ps(denorm_magic));
+    const __m128i denorm = _mm_sub_epi32(_mm_castps_si128(denorm1), denorm_magic);
+
+    const __m128i mant_odd = _mm_srai_epi32(_mm_slli_epi32(absf, 18), 31); // -1 if odd
+    const __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absf, normal_bias), mant_odd), 13);
+
+    const __m128i finite = _mm_or_si128(_mm_and_si128(is_denorm, denorm), _mm_andnot_si128(is_denorm, normal));
+    const __m128i joined = _mm_or_si128(_mm_and_si128(is_regular, finite), _mm_andnot_si128(is_regular, inf_or_nan));
+    // arithmetic shift keeps everything in int16 range for the signed pack
+    const __m128i result = _mm_or_si128(joined, _mm_srai_epi32(sign, 16));
+    _mm_storel_epi64((__m128i*)(dst + i), _mm_packs_epi32(result, result));
+  }
+#endif
+  for(; i < count; ++i)
+    dst[i] = floatToHalf1(src[i]);
+}
+
+float halfToFloat(uint16_t h)
+{
+  uint32_t sign = (h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  uint32_t bits;
+  if(exp == 0) {
+    if(mant == 0) {
+      bits = sign;
+    } else {
+      // denormal; renormalize it
+      exp = 127 - 15 + 1;
+      while(!(mant & 0x400)) {
+        mant <<= 1;
+        exp--;
+      }
+      bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    }
+  } else if(exp == 31) {
+    bits = sign | 0x7f800000 | (mant << 13);
+  } else {
+    bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+  }
+  float f;
+  memcpy(&f, &bits, 4);
+  return f;
+}
+
+void floatToUnorm16(uint16_t* dst, const float* src, size_t count)
+{
+  size_t i = 0;
+#ifdef SENSE_SSE2
+  // There's no unsigned saturating pack until SSE4.1, so shift into
+  // signed range, pack, and shift back
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 scale = _mm_set1_ps(65535.f);
+  const __m128i bias = _mm_set1_epi32(32768);
+  const __m128i unbias = _mm_set1_epi16(-32768);
+  for(; i + 8 <= count; i += 8) {
+    __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one);
+    __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), zero), one);
+    __m128i ia = _mm_sub_epi32(_mm_cvtps_epi32(_mm_mul_ps(a, scale)), bias);
+    __m128i ib = _mm_sub_epi32(_mm_cvtps_epi32(_mm_mul_ps(b, scale)), bias);
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_packs_epi32(ia, ib), unbias));
+  }
+#endif
+  for(; i < count; ++i)
+    dst[i] = roundNearest(std::min(1.f, std::max(0.f, src[i])) * 65535.f);
+}
+
+void floatToSnorm16(int16_t* dst, const float* src, size_t count)
+{
+  size_t i = 0;
+#ifdef SENSE_SSE2
+  const __m128 lo = _mm_set1_ps(-1.f);
+  const __m128 hi = _mm_set1_ps(1.f);
+  const __m128 scale = _mm_set1_ps(32767.f);
+  for(; i + 8 <= count; i += 8) {
+    __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo), hi);
+    __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), lo), hi);
+    __m128i ia = _mm_cvtps_epi32(_mm_mul_ps(a, scale));
+    __m128i ib = _mm_cvtps_epi32(_mm_mul_ps(b, scale));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(ia, ib));
+  }
+#endif
+  for(; i < count; ++i)
+    dst[i] = roundNearest(std::min(1.f, std::max(-1.f, src[i])) * 32767.f);
+}
+
+void encodeOctahedral(float* dst, const float* src, size_t count)
+{
+  size_t i = 0;
+#ifdef SENSE_SSE2
+  const __m128 sign_mask = _mm_set1_ps(-0.f);
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 zero = _mm_setzero_ps();
+  for(; i + 4 <= count; i += 4) {
+    const float* n = src + i * 3;
+    __m128 x = _mm_set_ps(n[9], n[6], n[3], n[0]);
+    __m128 y = _mm_set_ps(n[10], n[7], n[4], n[1]);
+    __m128 z = _mm_set_ps(n[11], n[8], n[5], n[2]);
+    __m128 ax = _mm_andnot_ps(sign_mask, x);
+    __m128 ay = _mm_andnot_ps(sign_mask, y);
+    __m128 az = _mm_andnot_ps(sign_mask, z);
+    __m128 inv = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(ax, ay), az));
+    x = _mm_mul_ps(x, inv);
+    y = _mm_mul_ps(y, inv);
+    ax = _mm_mul_ps(ax, inv);
+    ay = _mm_mul_ps(ay, inv);
+
+    // fold the lower hemisphere over the diagonals
+    __m128 sx = _mm_or_ps(_mm_and_ps(x, sign_mask), one);
+    __m128 sy = _mm_or_ps(_mm_and_ps(y, sign_mask), one);
+    __m128 fx = _mm_mul_ps(_mm_sub_ps(one, ay), sx);
+    __m128 fy = _mm_mul_ps(_mm_sub_ps(one, ax), sy);
+    __m128 lower = _mm_cmplt_ps(z, zero);
+    x = _mm_or_ps(_mm_and_ps(lower, fx), _mm_andnot_ps(lower, x));
+    y = _mm_or_ps(_mm_and_ps(lower, fy), _mm_andnot_ps(lower, y));
+
+    _mm_storeu_ps(dst + i * 2, _mm_unpacklo_ps(x, y));
+    _mm_storeu_ps(dst + i * 2 + 4, _mm_unpackhi_ps(x, y));
+  }
+#endif
+  for(; i < count; ++i)
+    octahedral1(dst + i * 2, src + i * 3);
+}
+
+void decodeOctahedral(float dst[3], float x, float y)
+{
+  float z = 1.f - std::fabs(x) - std::fabs(y);
+  if(z < 0.f) {
+    const float fx = (1.f - std::fabs(y)) * (x >= 0.f ? 1.f : -1.f);
+    const float fy = (1.f - std::fabs(x)) * (y >= 0.f ? 1.f : -1.f);
+    x = fx;
+    y = fy;
+  }
+  const float len = std::sqrt(x * x + y * y + z * z);
+  dst[0] = x / len;
+  dst[1] = y / len;
+  dst[2] = z / len;
+}
+
+bool quantizeMesh(DrawableMesh* m, const QuantizeOptions& opts, QuantizeStats* stats)
+{
+  const size_t count = vertexCount(m);
+  if(m->quant_flags || !count)
+    return false;
+
+  uint32_t flags = 0;
+  float pos_scale[3] = { 1.f, 1.f, 1.f };
+  float pos_bias[3] = { 0.f, 0.f, 0.f };
+  std::vector<QuantizedAttrib> out(m->attributes.size());
+  std::vector<float> f, tmp;
+
+  for(size_t i = 0; i < m->attributes.size(); ++i) {
+    const DrawableMesh::Attribute& a = m->attributes[i];
+    QuantizedAttrib& q = out[i];
+    q.attr = a;
+    const bool is_float = a.type == DrawableMesh::Float || a.type == DrawableMesh::Double;
+
+    if(a.loc == DrawableMesh::Pos && is_float && a.size >= 3 && opts.positions != QuantizeOptions::PositionFloat) {
+      fetchAttributeArray(m, a, 3, f);
+      q.attr.size = 3;
+      q.bytes = 8; // 3 components plus a pad to keep everything 4-byte aligned
+      q.data.assign(count * q.bytes, 0);
+      std::vector<uint16_t> packed(count * 3);
+      if(opts.positions == QuantizeOptions::PositionUnorm16) {
+        for(size_t c = 0; c < 3; ++c) {
+          float lo = f[c], hi = f[c];
+          for(size_t v = 1; v < count; ++v) {
+            lo = std::min(lo, f[v * 3 + c]);
+            hi = std::max(hi, f[v * 3 + c]);
+          }
+          pos_bias[c] = lo;
+          pos_scale[c] = hi > lo ? hi - lo : 1.f;
+          for(size_t v = 0; v < count; ++v)
+            f[v * 3 + c] = (f[v * 3 + c] - lo) / pos_scale[c];
+        }
+        floatToUnorm16(&packed[0], &f[0], count * 3);
+        q.attr.type = DrawableMesh::UShort;
+        q.attr.special = DrawableMesh::Normalize;
+        flags |= DrawableMesh::QuantPosition;
+      } else {
+        floatToHalf(&packed[0], &f[0], count * 3);
+        q.attr.type = DrawableMesh::Half;
+        q.attr.special = DrawableMesh::None;
+      }
+      for(size_t v = 0; v < count; ++v)
+        memcpy(&q.data[v * q.bytes], &packed[v * 3], 6);
+    } else if((a.loc == DrawableMesh::Nor || a.loc == DrawableMesh::Tan) && is_float && a.size == 3 && opts.octahedral_normals) {
+      fetchAttributeArray(m, a, 3, f);
+      for(size_t v = 0; v < count; ++v) {
+        float* n = &f[v * 3];
+        if(n[0] == 0.f && n[1] == 0.f && n[2] == 0.f)
+          n[2] = 1.f; // degenerate; any direction will do
+      }
+      tmp.resize(count * 2);
+      encodeOctahedral(&tmp[0], &f[0], count);
+      q.attr.type = DrawableMesh::Short;
+      q.attr.size = 2;
+      q.attr.special = DrawableMesh::Normalize;
+      q.bytes = 4;
+      q.data.resize(count * q.bytes);
+      floatToSnorm16((int16_t*)&q.data[0], &tmp[0], count * 2);
+      flags |= a.loc == DrawableMesh::Nor ? DrawableMesh::QuantOctNormal : DrawableMesh::QuantOctTangent;
+    } else if((a.loc == DrawableMesh::Te0 || a.loc == DrawableMesh::Te1) && is_float && a.size == 2 && opts.compact_texcoords) {
+      fetchAttributeArray(m, a, 2, f);
+      bool unit = true;
+      for(size_t v = 0; v < count * 2 && unit; ++v)
+        unit = f[v] >= 0.f && f[v] <= 1.f;
+      q.bytes = 4;
+      q.data.resize(count * q.bytes);
+      if(unit) {
+        floatToUnorm16((uint16_t*)&q.data[0], &f[0], count * 2);
+        q.attr.type = DrawableMesh::UShort;
+        q.attr.special = DrawableMesh::Normalize;
+      } else {
+        floatToHalf((uint16_t*)&q.data[0], &f[0], count * 2);
+        q.attr.type = DrawableMesh::Half;
+        q.attr.special = DrawableMesh::None;
+      }
+    } else {
+      // Anything else is copied through untouched
+      const size_t bytes = attribTypeSize(a.type) * a.size;
+      q.bytes = (bytes + 3) & ~3;
+      q.data.assign(count * q.bytes, 0);
+      for(size_t v = 0; v < count; ++v)
+        memcpy(&q.data[v * q.bytes], (const char*)m->data + v * m->data_stride + a.start, bytes);
+    }
+  }
+
+  size_t stride = 0;
+  for(size_t i = 0; i < out.size(); ++i) {
+    out[i].attr.start = stride;
+    stride += out[i].bytes;
+  }
+  if(stride >= m->data_stride)
+    return false; // nothing we know how to shrink
+
+  char* data = new char[count * stride];
+  for(size_t i = 0; i < out.size(); ++i) {
+    const QuantizedAttrib& q = out[i];
+    for(size_t v = 0; v < count; ++v)
+      memcpy(data + v * stride + q.attr.start, &q.data[v * q.bytes], q.bytes);
+  }
+
+  DrawableMesh old = *m;
+  m->data = data;
+  m->data_size = count * stride;
+  m->data_stride = stride;
+  m->quant_flags = flags;
+  std::copy(pos_scale, pos_scale + 3, m->pos_scale);
+  std::copy(pos_bias, pos_bias + 3, m->pos_bias);
+  for(size_t i = 0; i < out.size(); ++i)
+    m->attributes[i] = out[i].attr;
+
+  if(stats) {
+    QuantizeStats s;
+    s.stride_before = old.data_stride;
+    s.stride_after = stride;
+    s.max_position_error = s.max_normal_error = s.max_tangent_error = s.max_texcoord_error = 0.f;
+    for(size_t i = 0; i < out.size(); ++i) {
+      const DrawableMesh::Attribute& a = old.attributes[i];
+      const DrawableMesh::Attribute& b = m->attributes[i];
+      for(size_t v = 0; v < count; ++v) {
+        float fa[4], fb[4];
+        fetchAttribute(&old, a, v, fa);
+        fetchAttribute(m, b, v, fb);
+        switch(a.loc) {
+        case DrawableMesh::Pos:
+          {
+            float d[3] = { fa[0] - fb[0], fa[1] - fb[1], fa[2] - fb[2] };
+            s.max_position_error = std::max(s.max_position_error, std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+            break;
+          }
+        case DrawableMesh::Nor:
+          s.max_normal_error = std::max(s.max_normal_error, angleBetween(fa, fb));
+          break;
+        case DrawableMesh::Tan:
+          s.max_tangent_error = std::max(s.max_tangent_error, angleBetween(fa, fb));
+          break;
+        case DrawableMesh::Te0:
+        case DrawableMesh::Te1:
+          s.max_texcoord_error = std::max(s.max_texcoord_error, std::max(std::fabs(fa[0] - fb[0]), std::fabs(fa[1] - fb[1])));
+          break;
+        default:
+          break;
+        }
+      }
+    }
+    *stats = s;
+  }
+
+  delete[] (char*)old.data;
+  return true;
+}
@@ -0,0 +1,63 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_MESH_QUANTIZE_HPP
+#define SENSE_MESH_QUANTIZE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+struct DrawableMesh;
+
+// Conversion kernels. These all work on tightly packed arrays and use
+// SSE2 when it's available.
+void floatToHalf(uint16_t* dst, const float* src, size_t count);
+float halfToFloat(uint16_t);
+// Values are clamped to [0, 1] and [-1, 1] respectively
+void floatToUnorm16(uint16_t* dst, const float* src, size_t count);
+void floatToSnorm16(int16_t* dst, const float* src, size_t count);
+// Unit vectors (3 floats each) to 2-component octahedral encoding in [-1, 1]
+void encodeOctahedral(float* dst, const float* src, size_t count);
+void decodeOctahedral(float dst[3], float x, float y);
+
+struct QuantizeOptions
+{
+  enum PositionFormat {
+    PositionFloat,
+    PositionHalf,
+    PositionUnorm16, // with a per-mesh scale and bias
+  };
+
+  PositionFormat positions;
+  bool octahedral_normals; // also applies to tangents
+  bool compact_texcoords; // UNORM16 if they fit in [0, 1], half floats otherwise
+
+  QuantizeOptions() : positions(PositionUnorm16), octahedral_normals(true), compact_texcoords(true) {}
+};
+
+struct QuantizeStats
+{
+  size_t stride_before;
+  size_t stride_after;
+  float max_position_error; // object-space units
+  float max_normal_error; // degrees
+  float max_tangent_error; // degrees
+  float max_texcoord_error;
+};
+
+// Rewrite the vertex data of a mesh into a more compact layout. Meshes
+// that are already quantized are left alone (and false is returned).
+bool quantizeMesh(DrawableMesh*, const QuantizeOptions& opts=QuantizeOptions(), QuantizeStats* stats=0);
+
+#endif // SENSE_MESH_QUANTIZE_HPP
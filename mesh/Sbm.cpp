@@ -0,0 +1,526 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Sbm.hpp"
+#include "Bounds.hpp"
+#include "TangentSpace.hpp"
+#include "VertexData.hpp"
+
+#include "pipeline/Drawable.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#pragma pack(push, 1)
+namespace {
+  static const char sbm_magic[] = "SBM\0";
+  static const char sbm2_magic[] = "SBM2";
+  const uint32_t sbm2_version = 2;
+  const uint32_t sbm2_clusters_version = 3; // adds Sbm2ClusterHeader
+  const unsigned sbm_hasIndices = 0x01;
+  const unsigned sbm_streamData = 0x02;
+  const unsigned sbm_calcNormal = 0x06;
+  const unsigned sbm_calcTangent = 0x0A;
+  const unsigned sbm_calcNorTan = 0x0C; // intentionally not masking Stream here
+  // just the calc bits, without Stream
+  const unsigned sbm_calcNormalBit = sbm_calcNormal & sbm_calcNorTan;
+  const unsigned sbm_calcTangentBit = sbm_calcTangent & sbm_calcNorTan;
+  const unsigned sbm_quantized = 0x10;
+
+  const unsigned sbm_attr_normalized = 0x80;
+  const unsigned sbm_attr_integer = 0x40;
+  const unsigned sbm_sizemask = 0x07; // TODO: save ourselves a bit here
+
+  struct SbmHeader {
+    char magic[4];
+    uint32_t num_verts;
+    uint16_t num_attribs;
+    uint16_t vert_stride;
+    uint16_t flags;
+  };
+
+  struct SbmAttrib {
+    uint16_t type;
+    uint16_t id;
+    uint16_t start_offset;
+    uint8_t size; // 1-4. Normalized/Integer are encoded in this field
+  };
+
+  // Follows the attributes when sbm_quantized is set
+  struct SbmQuant {
+    uint32_t flags;
+    float pos_scale[3];
+    float pos_bias[3];
+  };
+
+  // Version 2. Every section starts on a 16-byte boundary (relative to
+  // the start of the file) and is found through the offsets in the
+  // header, so the whole thing can be used straight out of an mmap.
+  // Header flags use the same bits as v1.
+  struct Sbm2Bounds {
+    float min[4]; // w unused
+    float max[4]; // w unused
+    float sphere[4]; // center, radius
+  };
+
+  struct Sbm2Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t num_attribs;
+
+    uint32_t num_verts;
+    uint32_t vert_stride;
+    uint32_t idx_count;
+    uint32_t idx_type;
+
+    uint32_t num_submeshes;
+    uint32_t quant_flags;
+    uint32_t num_lods;
+    uint32_t lod_offset;
+
+    float pos_scale[4]; // w unused
+    float pos_bias[4]; // w unused
+    Sbm2Bounds bounds;
+
+    uint32_t attrib_offset;
+    uint32_t submesh_offset;
+    uint32_t vertex_offset;
+    uint32_t index_offset;
+  };
+
+  struct Sbm2Attrib {
+    uint32_t start_offset;
+    uint16_t type;
+    uint16_t id;
+    uint8_t size; // 1-4. Normalized/Integer are encoded the same as v1
+    uint8_t reserved[7];
+  };
+
+  struct Sbm2Submesh {
+    uint32_t idx_start;
+    uint32_t idx_count;
+    uint32_t material;
+    uint32_t reserved;
+    Sbm2Bounds bounds;
+  };
+
+  // LOD 0 is the full mesh, and submeshes index into it
+  struct Sbm2Lod {
+    uint32_t idx_start;
+    uint32_t idx_count;
+    float error;
+    uint32_t reserved;
+  };
+
+  // Version 3 has this right after the header
+  struct Sbm2ClusterHeader {
+    uint32_t num_clusters;
+    uint32_t cluster_offset;
+    uint32_t reserved[2];
+  };
+
+  struct Sbm2Cluster {
+    uint32_t idx_start;
+    uint32_t idx_count;
+    float cone_cos;
+    uint32_t reserved;
+    float sphere[4]; // center, radius
+    float cone_axis[4]; // w unused
+  };
+
+  static_assert(sizeof(Sbm2ClusterHeader) == 16, "SBM2 cluster header must be 16 bytes");
+  static_assert(sizeof(Sbm2Cluster) % 16 == 0, "SBM2 clusters must be 16-byte aligned");
+  static_assert(sizeof(Sbm2Header) % 16 == 0, "SBM2 header must be 16-byte aligned");
+  static_assert(sizeof(Sbm2Attrib) == 16, "SBM2 attributes must be 16 bytes");
+  static_assert(sizeof(Sbm2Submesh) % 16 == 0, "SBM2 submeshes must be 16-byte aligned");
+  static_assert(sizeof(Sbm2Lod) == 16, "SBM2 LODs must be 16 bytes");
+}
+#pragma pack(pop)
+
+namespace {
+  uint32_t align16(uint32_t offset) {
+    return (offset + 15) & ~15u;
+  }
+
+  uint8_t packAttribSize(const DrawableMesh::Attribute& a) {
+    uint8_t size = a.size & sbm_sizemask;
+    if(a.special == DrawableMesh::Normalize)
+      size |= sbm_attr_normalized;
+    else if(a.special == DrawableMesh::Integer)
+      size |= sbm_attr_integer;
+    return size;
+  }
+
+  void unpackAttribSize(DrawableMesh::Attribute& a, uint8_t size) {
+    a.size = size & sbm_sizemask;
+    if(size & sbm_attr_normalized)
+      a.special = DrawableMesh::Normalize;
+    else if(size & sbm_attr_integer)
+      a.special = DrawableMesh::Integer;
+    else
+      a.special = DrawableMesh::None;
+  }
+
+  void packBounds(Sbm2Bounds& dst, const DrawableMesh::Bounds& src) {
+    for(int c = 0; c < 3; ++c) {
+      dst.min[c] = src.min[c];
+      dst.max[c] = src.max[c];
+      dst.sphere[c] = src.center[c];
+    }
+    dst.min[3] = dst.max[3] = 0.f;
+    dst.sphere[3] = src.radius;
+  }
+
+  void unpackBounds(DrawableMesh::Bounds& dst, const Sbm2Bounds& src) {
+    dst.min = glm::vec3(src.min[0], src.min[1], src.min[2]);
+    dst.max = glm::vec3(src.max[0], src.max[1], src.max[2]);
+    dst.center = glm::vec3(src.sphere[0], src.sphere[1], src.sphere[2]);
+    dst.radius = src.sphere[3];
+  }
+
+  void writePadding(std::ostream& stream, uint32_t& pos, uint32_t target) {
+    static const char zeros[16] = { 0 };
+    stream.write(zeros, target - pos);
+    pos = target;
+  }
+
+  // Fill in whatever the file asked us to calculate
+  void generateAttributes(DrawableMesh* msh, unsigned flags) {
+    if(flags & sbm_calcNormalBit)
+      generateNormals(msh);
+    if(flags & sbm_calcTangentBit)
+      generateTangents(msh);
+  }
+
+  void readSbm2(std::istream& stream, std::streampos base, DrawableMesh* msh) {
+    Sbm2Header head;
+    stream.seekg(base);
+    stream.read((char*)&head, sizeof(Sbm2Header));
+    if(!stream)
+      throw std::runtime_error("SBM file is truncated");
+    if(head.version != sbm2_version && head.version != sbm2_clusters_version)
+      throw std::runtime_error("Unsupported SBM version");
+    Sbm2ClusterHeader cluster_head;
+    memset(&cluster_head, 0, sizeof(Sbm2ClusterHeader));
+    if(head.version >= sbm2_clusters_version)
+      stream.read((char*)&cluster_head, sizeof(Sbm2ClusterHeader));
+
+    msh->attributes.clear();
+    stream.seekg(base + std::streamoff(head.attrib_offset));
+    for(size_t i = 0; i < head.num_attribs; ++i) {
+      Sbm2Attrib attr;
+      stream.read((char*)&attr, sizeof(Sbm2Attrib));
+      DrawableMesh::Attribute a;
+      a.type = (DrawableMesh::AttribType)attr.type;
+      a.loc = (DrawableMesh::AttribLocation)attr.id;
+      a.start = attr.start_offset;
+      unpackAttribSize(a, attr.size);
+      msh->attributes.push_back(a);
+    }
+
+    msh->submeshes.clear();
+    stream.seekg(base + std::streamoff(head.submesh_offset));
+    for(size_t i = 0; i < head.num_submeshes; ++i) {
+      Sbm2Submesh sub;
+      stream.read((char*)&sub, sizeof(Sbm2Submesh));
+      if(uint64_t(sub.idx_start) + sub.idx_count > head.idx_count)
+        throw std::runtime_error("SBM submesh is out of range");
+      DrawableMesh::Submesh s;
+      s.index_start = sub.idx_start;
+      s.index_count = sub.idx_count;
+      s.material = sub.material;
+      unpackBounds(s.bounds, sub.bounds);
+      msh->submeshes.push_back(s);
+    }
+    unpackBounds(msh->bounds, head.bounds);
+
+    msh->lods.clear();
+    stream.seekg(base + std::streamoff(head.lod_offset));
+    for(size_t i = 0; i < head.num_lods; ++i) {
+      Sbm2Lod lod;
+      stream.read((char*)&lod, sizeof(Sbm2Lod));
+      if(uint64_t(lod.idx_start) + lod.idx_count > head.idx_count)
+        throw std::runtime_error("SBM LOD is out of range");
+      DrawableMesh::Lod l;
+      l.index_start = lod.idx_start;
+      l.index_count = lod.idx_count;
+      l.error = lod.error;
+      msh->lods.push_back(l);
+    }
+
+    msh->clusters.clear();
+    stream.seekg(base + std::streamoff(cluster_head.cluster_offset));
+    for(size_t i = 0; i < cluster_head.num_clusters; ++i) {
+      Sbm2Cluster cl;
+      stream.read((char*)&cl, sizeof(Sbm2Cluster));
+      if(uint64_t(cl.idx_start) + cl.idx_count > head.idx_count)
+        throw std::runtime_error("SBM cluster is out of range");
+      DrawableMesh::Cluster c;
+      c.index_start = cl.idx_start;
+      c.index_count = cl.idx_count;
+      c.center = glm::vec3(cl.sphere[0], cl.sphere[1], cl.sphere[2]);
+      c.radius = cl.sphere[3];
+      c.cone_axis = glm::vec3(cl.cone_axis[0], cl.cone_axis[1], cl.cone_axis[2]);
+      c.cone_cos = cl.cone_cos;
+      msh->clusters.push_back(c);
+    }
+
+    msh->quant_flags = head.quant_flags;
+    memcpy(msh->pos_scale, head.pos_scale, sizeof(msh->pos_scale));
+    memcpy(msh->pos_bias, head.pos_bias, sizeof(msh->pos_bias));
+
+    msh->data_size = size_t(head.num_verts)*head.vert_stride;
+    msh->data_stride = head.vert_stride;
+    msh->data = new char[msh->data_size];
+    stream.seekg(base + std::streamoff(head.vertex_offset));
+    stream.read((char*)msh->data, msh->data_size);
+
+    if(head.flags & sbm_hasIndices) {
+      msh->index_type = (DrawableMesh::AttribType)head.idx_type;
+      msh->index_count = head.idx_count;
+      switch(msh->index_type) {
+      case DrawableMesh::UByte:
+      case DrawableMesh::UShort:
+      case DrawableMesh::UInt:
+        break;
+      default:
+        throw std::runtime_error("Can't read SBM indices: bad index type");
+      }
+      const size_t idx_size = msh->index_count * attribTypeSize(msh->index_type);
+      msh->index_data = new char[idx_size];
+      stream.seekg(base + std::streamoff(head.index_offset));
+      stream.read((char*)msh->index_data, idx_size);
+    } else {
+      msh->index_data = 0;
+      msh->index_count = 0;
+    }
+
+    if(!stream)
+      throw std::runtime_error("SBM file is truncated");
+
+    generateAttributes(msh, head.flags);
+  }
+}
+
+void readSbm(std::istream& stream, DrawableMesh* msh)
+{
+  const std::streampos base = stream.tellg();
+  char magic[4];
+  stream.read(magic, 4);
+  if(stream && memcmp(magic, sbm2_magic, 4) == 0) {
+    readSbm2(stream, base, msh);
+    return;
+  }
+
+  // Version 1. There's no bounds or submesh info, so work it out here.
+  SbmHeader head;
+  stream.seekg(base);
+  stream.read((char*)&head, sizeof(SbmHeader));
+  if(!stream || memcmp(head.magic, sbm_magic, 4) != 0)
+    throw std::runtime_error("SBM signature verification failed");
+  msh->data_size = head.num_verts*head.vert_stride;
+  msh->data_stride = head.vert_stride;
+  msh->data = new char[msh->data_size];
+  stream.read((char*)msh->data, msh->data_size);
+
+  if(head.flags & sbm_hasIndices) {
+    uint16_t idx_count;
+    uint16_t idx_type;
+    stream.read((char*)&idx_count, 2);
+    stream.read((char*)&idx_type, 2);
+    msh->index_type = (DrawableMesh::AttribType)idx_type;
+    msh->index_count = idx_count;
+    switch(msh->index_type) {
+    case DrawableMesh::UByte:
+      msh->index_data = new char[idx_count];
+      stream.read((char*)msh->index_data, idx_count);
+      break;
+    case DrawableMesh::UShort:
+      msh->index_data = new char[idx_count*2];
+      stream.read((char*)msh->index_data, idx_count*2);
+      break;
+    default:
+      throw std::runtime_error("Can't read SBM indices: bad index type");
+    }
+  } else {
+    msh->index_data = 0;
+    msh->index_count = 0;
+  }
+
+  msh->attributes.clear();
+  for(size_t i = 0; i < head.num_attribs; ++i) {
+    SbmAttrib attr;
+    stream.read((char*)&attr, sizeof(SbmAttrib));
+    DrawableMesh::Attribute a;
+    a.type = (DrawableMesh::AttribType)attr.type;
+    a.loc = (DrawableMesh::AttribLocation)attr.id;
+    a.start = attr.start_offset;
+    unpackAttribSize(a, attr.size);
+    msh->attributes.push_back(a);
+  }
+
+  msh->quant_flags = 0;
+  for(size_t c = 0; c < 3; ++c) {
+    msh->pos_scale[c] = 1.f;
+    msh->pos_bias[c] = 0.f;
+  }
+  if(head.flags & sbm_quantized) {
+    SbmQuant quant;
+    stream.read((char*)&quant, sizeof(SbmQuant));
+    msh->quant_flags = quant.flags;
+    memcpy(msh->pos_scale, quant.pos_scale, sizeof(quant.pos_scale));
+    memcpy(msh->pos_bias, quant.pos_bias, sizeof(quant.pos_bias));
+  }
+
+  if(!stream)
+    throw std::runtime_error("SBM file is truncated");
+
+  generateAttributes(msh, head.flags);
+  msh->submeshes.clear();
+  msh->lods.clear();
+  msh->clusters.clear();
+  computeMeshBounds(msh);
+}
+
+namespace {
+  void writeSbm2(std::ostream& stream, const DrawableMesh* msh, unsigned calc_flags) {
+    Sbm2Header head;
+    memset(&head, 0, sizeof(Sbm2Header));
+    memcpy(head.magic, sbm2_magic, 4);
+    head.version = sbm2_clusters_version;
+    head.flags = (msh->index_data ? sbm_hasIndices : 0) | calc_flags;
+    head.num_attribs = msh->attributes.size();
+    head.num_verts = vertexCount(msh);
+    head.vert_stride = msh->data_stride;
+    head.idx_count = msh->index_data ? msh->index_count : 0;
+    head.idx_type = msh->index_data ? msh->index_type : DrawableMesh::UShort;
+    head.num_submeshes = msh->submeshes.size();
+    head.num_lods = msh->lods.size();
+    head.quant_flags = msh->quant_flags;
+    memcpy(head.pos_scale, msh->pos_scale, sizeof(msh->pos_scale));
+    memcpy(head.pos_bias, msh->pos_bias, sizeof(msh->pos_bias));
+    packBounds(head.bounds, msh->bounds);
+
+    Sbm2ClusterHeader cluster_head;
+    memset(&cluster_head, 0, sizeof(Sbm2ClusterHeader));
+    cluster_head.num_clusters = msh->clusters.size();
+
+    head.attrib_offset = sizeof(Sbm2Header) + sizeof(Sbm2ClusterHeader);
+    head.submesh_offset = align16(head.attrib_offset + head.num_attribs * sizeof(Sbm2Attrib));
+    head.lod_offset = align16(head.submesh_offset + head.num_submeshes * sizeof(Sbm2Submesh));
+    cluster_head.cluster_offset = align16(head.lod_offset + head.num_lods * sizeof(Sbm2Lod));
+    head.vertex_offset = align16(cluster_head.cluster_offset + cluster_head.num_clusters * sizeof(Sbm2Cluster));
+    const uint32_t vertex_size = head.num_verts * head.vert_stride;
+    head.index_offset = align16(head.vertex_offset + vertex_size);
+
+    uint32_t pos = sizeof(Sbm2Header) + sizeof(Sbm2ClusterHeader);
+    stream.write((const char*)&head, sizeof(Sbm2Header));
+    stream.write((const char*)&cluster_head, sizeof(Sbm2ClusterHeader));
+
+    for(auto i = msh->attributes.begin(); i != msh->attributes.end(); ++i) {
+      Sbm2Attrib attr;
+      memset(&attr, 0, sizeof(Sbm2Attrib));
+      attr.start_offset = i->start;
+      attr.type = i->type;
+      attr.id = i->loc;
+      attr.size = packAttribSize(*i);
+      stream.write((const char*)&attr, sizeof(Sbm2Attrib));
+      pos += sizeof(Sbm2Attrib);
+    }
+
+    writePadding(stream, pos, head.submesh_offset);
+    for(auto i = msh->submeshes.begin(); i != msh->submeshes.end(); ++i) {
+      Sbm2Submesh sub;
+      memset(&sub, 0, sizeof(Sbm2Submesh));
+      sub.idx_start = i->index_start;
+      sub.idx_count = i->index_count;
+      sub.material = i->material;
+      packBounds(sub.bounds, i->bounds);
+      stream.write((const char*)&sub, sizeof(Sbm2Submesh));
+      pos += sizeof(Sbm2Submesh);
+    }
+
+    writePadding(stream, pos, head.lod_offset);
+    for(auto i = msh->lods.begin(); i != msh->lods.end(); ++i) {
+      Sbm2Lod lod;
+      memset(&lod, 0, sizeof(Sbm2Lod));
+      lod.idx_start = i->index_start;
+      lod.idx_count = i->index_count;
+      lod.error = i->error;
+      stream.write((const char*)&lod, sizeof(Sbm2Lod));
+      pos += sizeof(Sbm2Lod);
+    }
+
+    writePadding(stream, pos, cluster_head.cluster_offset);
+    for(auto i = msh->clusters.begin(); i != msh->clusters.end(); ++i) {
+      Sbm2Cluster cl;
+      memset(&cl, 0, sizeof(Sbm2Cluster));
+      cl.idx_start = i->index_start;
+      cl.idx_count = i->index_count;
+      cl.cone_cos = i->cone_cos;
+      for(int c = 0; c < 3; ++c) {
+        cl.sphere[c] = i->center[c];
+        cl.cone_axis[c] = i->cone_axis[c];
+      }
+      cl.sphere[3] = i->radius;
+      stream.write((const char*)&cl, sizeof(Sbm2Cluster));
+      pos += sizeof(Sbm2Cluster);
+    }
+
+    writePadding(stream, pos, head.vertex_offset);
+    stream.write((const char*)msh->data, vertex_size);
+    pos += vertex_size;
+
+    if(msh->index_data) {
+      writePadding(stream, pos, head.index_offset);
+      stream.write((const char*)msh->index_data, head.idx_count * attribTypeSize(msh->index_type));
+    }
+
+    if(!stream)
+      throw std::runtime_error("Failed writing SBM");
+  }
+}
+
+void writeSbm(std::ostream& stream, const DrawableMesh* msh, unsigned flags)
+{
+  if(!(flags & (SbmStripNormals | SbmStripTangents))) {
+    writeSbm2(stream, msh, 0);
+    return;
+  }
+
+  // Work on a copy with the attributes taken out. Tangents are
+  // generated from normals, so they can't stay if normals go.
+  if(flags & SbmStripNormals)
+    flags |= SbmStripTangents;
+  unsigned calc_flags = 0;
+  DrawableMesh stripped = *msh;
+  stripped.data = new char[msh->data_size];
+  memcpy(stripped.data, msh->data, msh->data_size);
+  try {
+    if((flags & SbmStripTangents) && findAttribute(&stripped, DrawableMesh::Tan)) {
+      removeAttribute(&stripped, DrawableMesh::Tan);
+      calc_flags |= sbm_calcTangentBit;
+    }
+    if((flags & SbmStripNormals) && findAttribute(&stripped, DrawableMesh::Nor)) {
+      removeAttribute(&stripped, DrawableMesh::Nor);
+      calc_flags |= sbm_calcNormalBit;
+    }
+    writeSbm2(stream, &stripped, calc_flags);
+  } catch(...) {
+    delete[] (char*)stripped.data;
+    throw;
+  }
+  delete[] (char*)stripped.data;
+}
@@ -0,0 +1,39 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_MESH_SBM_HPP
+#define SENSE_MESH_SBM_HPP
+
+#include <istream>
+#include <ostream>
+
+struct DrawableMesh;
+
+// Read a mesh from an SBM stream, any version. Vertex and index data
+// are allocated with new[]. Version 1 files get a single submesh and
+// have their bounds computed on the spot. Throws std::runtime_error if
+// the file is malformed. The stream must be seekable.
+void readSbm(std::istream&, DrawableMesh*);
+
+enum SbmWriteFlags {
+  SbmStripNormals = 0x01, // leave normals (and tangents) out and have them generated on load
+  SbmStripTangents = 0x02, // same, just for tangents
+};
+
+// Write a mesh out as SBM version 3 (version 2 plus clusters). Quantized
+// meshes keep their quantization. Submeshes, bounds and clusters are
+// written as they are, so make sure they're up to date.
+void writeSbm(std::ostream&, const DrawableMesh*, unsigned flags=0);
+
+#endif // SENSE_MESH_SBM_HPP
@@ -0,0 +1,672 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Simplify.hpp"
+#include "Optimize.hpp"
+#include "VertexData.hpp"
+
+#include "pipeline/Drawable.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+  // Sum of squared distances to a set of planes: p'Ap + 2b'p + c, plus
+  // the total weight so the error can be turned back into a distance
+  struct Quadric {
+    double a00, a11, a22, a01, a02, a12;
+    double b0, b1, b2;
+    double c;
+    double w;
+  };
+
+  void addQuadric(Quadric& q, const Quadric& o) {
+    q.a00 += o.a00; q.a11 += o.a11; q.a22 += o.a22;
+    q.a01 += o.a01; q.a02 += o.a02; q.a12 += o.a12;
+    q.b0 += o.b0; q.b1 += o.b1; q.b2 += o.b2;
+    q.c += o.c;
+    q.w += o.w;
+  }
+
+  // Plane quadric of a triangle, weighted by its area
+  Quadric triangleQuadric(const float* p0, const float* p1, const float* p2) {
+    const double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    const double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+    const double len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    Quadric q = Quadric();
+    if(len == 0.)
+      return q;
+    n[0] /= len; n[1] /= len; n[2] /= len;
+    const double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+    const double w = len * 0.5;
+    q.a00 = w * n[0] * n[0]; q.a11 = w * n[1] * n[1]; q.a22 = w * n[2] * n[2];
+    q.a01 = w * n[0] * n[1]; q.a02 = w * n[0] * n[2]; q.a12 = w * n[1] * n[2];
+    q.b0 = w * n[0] * d; q.b1 = w * n[1] * d; q.b2 = w * n[2] * d;
+    q.c = w * d * d;
+    q.w = w;
+    return q;
+  }
+
+  // Mean squared distance from p to the planes in a and b combined
+  double collapseError(const Quadric& a, const Quadric& b, const float* p) {
+    Quadric q = a;
+    addQuadric(q, b);
+    if(q.w == 0.)
+      return 0.;
+    const double x = p[0], y = p[1], z = p[2];
+    const double e = x * x * q.a00 + y * y * q.a11 + z * z * q.a22
+      + 2. * (x * y * q.a01 + x * z * q.a02 + y * z * q.a12)
+      + 2. * (x * q.b0 + y * q.b1 + z * q.b2) + q.c;
+    return std::max(e / q.w, 0.);
+  }
+
+  void triangleNormal(double* n, const float* p0, const float* p1, const float* p2) {
+    const double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    const double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+  }
+
+  struct Collapse {
+    uint32_t from, to;
+    double error;
+    bool operator<(const Collapse& o) const { return error < o.error; }
+  };
+
+  // Vertex -> triangle lists for the current index list
+  struct Adjacency {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+
+    void build(const std::vector<uint32_t>& indices, size_t vertex_count) {
+      offsets.assign(vertex_count + 1, 0);
+      for(size_t i = 0; i < indices.size(); ++i)
+        offsets[indices[i] + 1]++;
+      for(size_t v = 0; v < vertex_count; ++v)
+        offsets[v + 1] += offsets[v];
+      triangles.resize(indices.size());
+      std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+      for(size_t i = 0; i < indices.size(); ++i)
+        triangles[cursor[indices[i]]++] = i / 3;
+    }
+  };
+
+  // Would moving from onto to turn any of from's remaining triangles over?
+  bool flipsTriangles(const Collapse& c, const std::vector<uint32_t>& indices, const Adjacency& adj, const float* positions) {
+    for(size_t i = adj.offsets[c.from]; i < adj.offsets[c.from + 1]; ++i) {
+      const uint32_t* tri = &indices[adj.triangles[i] * 3];
+      if(tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+        continue; // this one goes away
+      const float* p[3];
+      const float* q[3];
+      for(size_t k = 0; k < 3; ++k) {
+        p[k] = positions + tri[k] * 3;
+        q[k] = positions + (tri[k] == c.from ? c.to : tri[k]) * 3;
+      }
+      double before[3], after[3];
+      triangleNormal(before, p[0], p[1], p[2]);
+      triangleNormal(after, q[0], q[1], q[2]);
+      if(before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.)
+        return true;
+    }
+    return false;
+  }
+
+  double dot3(const double* a, const double* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  }
+
+  // Distance from p to the triangle abc
+  double pointTriangle(const double* p, const float* a, const float* b, const float* c) {
+    const double ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    const double ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    const double ap[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+    const double bp[3] = { p[0] - b[0], p[1] - b[1], p[2] - b[2] };
+    const double cp[3] = { p[0] - c[0], p[1] - c[1], p[2] - c[2] };
+    const double d1 = dot3(ab, ap), d2 = dot3(ac, ap);
+    const double d3 = dot3(ab, bp), d4 = dot3(ac, bp);
+    const double d5 = dot3(ab, cp), d6 = dot3(ac, cp);
+    const double va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+    // barycentrics of the closest point, by which region p projects to
+    double v, w;
+    if(d1 <= 0. && d2 <= 0.) {
+      v = 0.; w = 0.;
+    } else if(d3 >= 0. && d4 <= d3) {
+      v = 1.; w = 0.;
+    } else if(d6 >= 0. && d5 <= d6) {
+      v = 0.; w = 1.;
+    } else if(vc <= 0. && d1 >= 0. && d3 <= 0.) {
+      v = d1 / (d1 - d3); w = 0.;
+    } else if(vb <= 0. && d2 >= 0. && d6 <= 0.) {
+      v = 0.; w = d2 / (d2 - d6);
+    } else if(va <= 0. && d4 - d3 >= 0. && d5 - d6 >= 0.) {
+      w = (d4 - d3) / ((d4 - d3) + (d5 - d6)); v = 1. - w;
+    } else {
+      const double denom = 1. / (va + vb + vc);
+      v = vb * denom; w = vc * denom;
+    }
+    const double d[3] = { ap[0] - ab[0] * v - ac[0] * w, ap[1] - ab[1] * v - ac[1] * w, ap[2] - ab[2] * v - ac[2] * w };
+    return std::sqrt(dot3(d, d));
+  }
+
+  // The input triangles bucketed in a uniform grid, for measuring how far
+  // a point is from the original surface
+  struct SurfaceGrid {
+    const uint32_t* indices;
+    const float* positions;
+    double origin[3];
+    double cell;
+    int dims[3];
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+
+    void build(const std::vector<uint32_t>& tris, const float* pos, double reach) {
+      indices = tris.empty() ? 0 : &tris[0];
+      positions = pos;
+      double hi[3] = { -1e30, -1e30, -1e30 };
+      origin[0] = origin[1] = origin[2] = 1e30;
+      for(size_t i = 0; i < tris.size(); ++i) {
+        for(size_t k = 0; k < 3; ++k) {
+          origin[k] = std::min(origin[k], double(pos[tris[i] * 3 + k]));
+          hi[k] = std::max(hi[k], double(pos[tris[i] * 3 + k]));
+        }
+      }
+      // cells at least as big as a query, and no more than 64 a side
+      const double extent = std::max(hi[0] - origin[0], std::max(hi[1] - origin[1], hi[2] - origin[2]));
+      cell = std::max(reach, extent / 64.);
+      if(cell <= 0.)
+        cell = 1.;
+      for(size_t k = 0; k < 3; ++k)
+        dims[k] = std::min(int((hi[k] - origin[k]) / cell) + 1, 64);
+
+      offsets.assign(size_t(dims[0]) * dims[1] * dims[2] + 1, 0);
+      for(int pass = 0; pass < 2; ++pass) {
+        std::vector<uint32_t> cursor;
+        if(pass) {
+          for(size_t c = 1; c < offsets.size(); ++c)
+            offsets[c] += offsets[c - 1];
+          triangles.resize(offsets.back());
+          cursor.assign(offsets.begin(), offsets.end() - 1);
+        }
+        for(size_t t = 0; t < tris.size() / 3; ++t) {
+          double lo[3] = { 1e30, 1e30, 1e30 }, up[3] = { -1e30, -1e30, -1e30 };
+          for(size_t i = 0; i < 3; ++i) {
+            for(size_t k = 0; k < 3; ++k) {
+              lo[k] = std::min(lo[k], double(pos[tris[t * 3 + i] * 3 + k]));
+              up[k] = std::max(up[k], double(pos[tris[t * 3 + i] * 3 + k]));
+            }
+          }
+          int first[3], last[3];
+          cellRange(lo, up, first, last);
+          for(int z = first[2]; z <= last[2]; ++z)
+            for(int y = first[1]; y <= last[1]; ++y)
+              for(int x = first[0]; x <= last[0]; ++x) {
+                const size_t c = (size_t(z) * dims[1] + y) * dims[0] + x;
+                if(pass)
+                  triangles[cursor[c]++] = t;
+                else
+                  offsets[c + 1]++;
+              }
+        }
+      }
+    }
+
+    void cellRange(const double* lo, const double* hi, int* first, int* last) const {
+      for(size_t k = 0; k < 3; ++k) {
+        first[k] = std::max(0, std::min(int((lo[k] - origin[k]) / cell), dims[k] - 1));
+        last[k] = std::max(0, std::min(int((hi[k] - origin[k]) / cell), dims[k] - 1));
+      }
+    }
+
+    // Distance from p to the nearest triangle, if one is within reach.
+    // Anything up to enough is taken as is, since the exact answer
+    // doesn't matter then.
+    double distance(const double* p, double reach, double enough) const {
+      const double lo[3] = { p[0] - reach, p[1] - reach, p[2] - reach };
+      const double hi[3] = { p[0] + reach, p[1] + reach, p[2] + reach };
+      int first[3], last[3], home[3];
+      cellRange(lo, hi, first, last);
+      cellRange(p, p, home, home);
+      // p's own cell first, then only the cells that could still hold
+      // something nearer
+      double best = cellDistance(home, p, 1e30, enough);
+      for(int z = first[2]; z <= last[2]; ++z)
+        for(int y = first[1]; y <= last[1]; ++y)
+          for(int x = first[0]; x <= last[0]; ++x) {
+            if(best <= enough)
+              return best;
+            const int c[3] = { x, y, z };
+            if(c[0] == home[0] && c[1] == home[1] && c[2] == home[2])
+              continue;
+            double gap = 0.;
+            for(size_t k = 0; k < 3; ++k) {
+              const double d = std::max(origin[k] + c[k] * cell - p[k], p[k] - origin[k] - (c[k] + 1) * cell);
+              if(d > 0.)
+                gap += d * d;
+            }
+            if(gap < best * best)
+              best = cellDistance(c, p, best, enough);
+          }
+      return best;
+    }
+
+    double cellDistance(const int* c, const double* p, double best, double enough) const {
+      const size_t i = (size_t(c[2]) * dims[1] + c[1]) * dims[0] + c[0];
+      for(size_t t = offsets[i]; t < offsets[i + 1] && best > enough; ++t) {
+        const uint32_t* tri = indices + triangles[t] * 3;
+        best = std::min(best, pointTriangle(p, positions + tri[0] * 3, positions + tri[1] * 3, positions + tri[2] * 3));
+      }
+      return best;
+    }
+  };
+
+  const uint32_t no_sample = ~0u;
+
+  // Points on the input surface: its vertices, edge middles and triangle
+  // centers. Each one is within the error reached of an anchor triangle
+  // in the current mesh, and is owned by one of that triangle's corners,
+  // in a list per vertex. Only a collapse that changes the anchor can
+  // move the surface away from it.
+  struct Samples {
+    std::vector<double> points;
+    std::vector<uint32_t> anchors; // 3 per sample
+    std::vector<uint32_t> next;
+    std::vector<uint32_t> first;
+    std::vector<uint32_t> last;
+    std::vector<char> moving;
+
+    void add(uint32_t owner, const uint32_t* anchor, const double* p) {
+      points.insert(points.end(), p, p + 3);
+      anchors.insert(anchors.end(), anchor, anchor + 3);
+      next.push_back(no_sample);
+      moving.push_back(0);
+      link(owner, next.size() - 1);
+    }
+
+    void unlinkMoving(uint32_t owner) {
+      uint32_t s = first[owner];
+      first[owner] = last[owner] = no_sample;
+      while(s != no_sample) {
+        const uint32_t n = next[s];
+        if(!moving[s])
+          link(owner, s);
+        s = n;
+      }
+    }
+
+    void link(uint32_t owner, uint32_t s) {
+      next[s] = no_sample;
+      if(first[owner] == no_sample)
+        first[owner] = s;
+      else
+        next[last[owner]] = s;
+      last[owner] = s;
+    }
+  };
+
+  void sampleSurface(Samples& samples, const std::vector<uint32_t>& indices, const float* positions, size_t vertex_count) {
+    samples.first.assign(vertex_count, no_sample);
+    samples.last.assign(vertex_count, no_sample);
+    std::vector<char> seen(vertex_count, 0);
+    // a shared edge only needs its middle once
+    std::unordered_set<uint64_t> edges;
+    for(size_t i = 0; i < indices.size(); i += 3) {
+      for(size_t k = 0; k < 3; ++k)
+        edges.insert((uint64_t(indices[i + k]) << 32) | indices[i + (k + 1) % 3]);
+    }
+    for(size_t i = 0; i < indices.size(); i += 3) {
+      const uint32_t* tri = &indices[i];
+      const float* p[3] = { positions + tri[0] * 3, positions + tri[1] * 3, positions + tri[2] * 3 };
+      for(size_t k = 0; k < 3; ++k) {
+        const uint32_t next = tri[(k + 1) % 3];
+        const float* a = p[k];
+        const float* b = p[(k + 1) % 3];
+        if(!seen[tri[k]]) {
+          seen[tri[k]] = 1;
+          const double corner[3] = { a[0], a[1], a[2] };
+          samples.add(tri[k], tri, corner);
+        }
+        if(tri[k] < next || !edges.count((uint64_t(next) << 32) | tri[k])) {
+          const double middle[3] = { (a[0] + b[0]) * 0.5, (a[1] + b[1]) * 0.5, (a[2] + b[2]) * 0.5 };
+          samples.add(tri[k], tri, middle);
+        }
+      }
+      const double center[3] = {
+        (double(p[0][0]) + p[1][0] + p[2][0]) / 3., (double(p[0][1]) + p[1][1] + p[2][1]) / 3., (double(p[0][2]) + p[1][2] + p[2][2]) / 3.
+      };
+      samples.add(tri[0], tri, center);
+    }
+  }
+
+  // How far collapsing from onto to would leave the surface from the
+  // input: the samples anchored on from's triangles against what's
+  // around them once it's done, and the new triangles against the input.
+  // Anything over limit means the collapse is out. Otherwise moved gets
+  // (sample, owner, anchor) for each of those samples, re-anchored on
+  // the triangle now nearest and owned by its nearest corner.
+  double collapseDeviation(const Collapse& c, const std::vector<uint32_t>& indices, const Adjacency& adj, const std::vector<uint32_t>& remap, const float* positions,
+                           const Samples& samples, const SurfaceGrid& grid, double limit, double enough, std::vector<uint32_t>& moved) {
+    std::vector<uint32_t> around(1, c.from);
+    for(size_t i = adj.offsets[c.from]; i < adj.offsets[c.from + 1]; ++i) {
+      const uint32_t* tri = &indices[adj.triangles[i] * 3];
+      for(size_t k = 0; k < 3; ++k) {
+        if(std::find(around.begin(), around.end(), tri[k]) == around.end())
+          around.push_back(tri[k]);
+      }
+    }
+
+    // everything touching the collapse once from has moved, leaving out
+    // the triangles that go away. Earlier collapses this pass can have
+    // moved some corners; triangles they added aren't in adj, which only
+    // makes distances come out longer.
+    std::vector<uint32_t> region;
+    for(auto v = around.begin(); v != around.end(); ++v)
+      region.insert(region.end(), adj.triangles.begin() + adj.offsets[*v], adj.triangles.begin() + adj.offsets[*v + 1]);
+    std::sort(region.begin(), region.end());
+    region.erase(std::unique(region.begin(), region.end()), region.end());
+    std::vector<uint32_t> tris;
+    for(auto t = region.begin(); t != region.end(); ++t) {
+      uint32_t q[3];
+      for(size_t k = 0; k < 3; ++k)
+        q[k] = indices[*t * 3 + k] == c.from ? c.to : remap[indices[*t * 3 + k]];
+      if(q[0] != q[1] && q[1] != q[2] && q[0] != q[2])
+        tris.insert(tris.end(), q, q + 3);
+    }
+
+    double worst = 0.;
+    moved.clear();
+    // anchors on from's triangles all have a corner around the collapse
+    for(auto v = around.begin(); v != around.end(); ++v) {
+      for(uint32_t s = samples.first[*v]; s != no_sample; s = samples.next[s]) {
+        const uint32_t* anchor = &samples.anchors[s * 3];
+        if(anchor[0] != c.from && anchor[1] != c.from && anchor[2] != c.from)
+          continue;
+        const double* p = &samples.points[s * 3];
+        double best = 1e30;
+        size_t nearest = 0;
+        for(size_t i = 0; i < tris.size() && best > enough; i += 3) {
+          const double d = pointTriangle(p, positions + tris[i] * 3, positions + tris[i + 1] * 3, positions + tris[i + 2] * 3);
+          if(d < best) {
+            best = d;
+            nearest = i;
+          }
+        }
+        if(best > limit)
+          return best;
+        worst = std::max(worst, best);
+
+        uint32_t owner = tris[nearest];
+        double owner_distance = 1e30;
+        for(size_t k = 0; k < 3; ++k) {
+          const float* q = positions + tris[nearest + k] * 3;
+          const double d[3] = { p[0] - q[0], p[1] - q[1], p[2] - q[2] };
+          if(dot3(d, d) < owner_distance) {
+            owner_distance = dot3(d, d);
+            owner = tris[nearest + k];
+          }
+        }
+        const uint32_t entry[5] = { s, owner, tris[nearest], tris[nearest + 1], tris[nearest + 2] };
+        moved.insert(moved.end(), entry, entry + 5);
+      }
+    }
+
+    // the corners of the new triangles are input vertices; check between
+    for(size_t i = adj.offsets[c.from]; i < adj.offsets[c.from + 1]; ++i) {
+      const uint32_t* tri = &indices[adj.triangles[i] * 3];
+      if(tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+        continue;
+      const float* p[3];
+      for(size_t k = 0; k < 3; ++k)
+        p[k] = positions + (tri[k] == c.from ? c.to : tri[k]) * 3;
+      double points[4][3];
+      for(size_t j = 0; j < 3; ++j) {
+        for(size_t k = 0; k < 3; ++k)
+          points[k][j] = (double(p[k][j]) + p[(k + 1) % 3][j]) * 0.5;
+        points[3][j] = (double(p[0][j]) + p[1][j] + p[2][j]) / 3.;
+      }
+      for(size_t k = 0; k < 4; ++k) {
+        const double d = grid.distance(points[k], limit, enough);
+        if(d > limit)
+          return d;
+        worst = std::max(worst, d);
+      }
+    }
+    return worst;
+  }
+}
+
+size_t simplifyMesh(uint32_t* dest, const uint32_t* indices, size_t index_count, const float* positions, size_t vertex_count,
+                    size_t target_index_count, float target_error, float* result_error)
+{
+  std::vector<uint32_t> result(indices, indices + index_count - index_count % 3);
+
+  // Vertices that share a position are the same point as far as the
+  // surface goes; group them so borders and quadrics are seen right
+  std::vector<uint32_t> group;
+  deduplicateVertices(group, positions, vertex_count, sizeof(float) * 3);
+
+  std::vector<uint32_t> group_size(vertex_count, 0);
+  std::vector<char> used(vertex_count, 0);
+  for(size_t i = 0; i < result.size(); ++i) {
+    if(!used[result[i]]) {
+      used[result[i]] = 1;
+      group_size[group[result[i]]]++;
+    }
+  }
+
+  // Edges that don't have exactly two triangles are borders (or worse)
+  std::unordered_map<uint64_t, uint32_t> edges;
+  for(size_t i = 0; i < result.size(); i += 3) {
+    for(size_t k = 0; k < 3; ++k) {
+      uint64_t a = group[result[i + k]], b = group[result[i + (k + 1) % 3]];
+      if(a > b)
+        std::swap(a, b);
+      edges[(a << 32) | b]++;
+    }
+  }
+  std::vector<char> locked(vertex_count, 0);
+  for(auto i = edges.begin(); i != edges.end(); ++i) {
+    if(i->second != 2) {
+      locked[i->first >> 32] = 1;
+      locked[i->first & 0xffffffff] = 1;
+    }
+  }
+  for(size_t v = 0; v < vertex_count; ++v) {
+    if(group_size[group[v]] > 1 || locked[group[v]])
+      locked[v] = 1;
+  }
+
+  std::vector<Quadric> quadrics(vertex_count, Quadric());
+  for(size_t i = 0; i < result.size(); i += 3) {
+    const Quadric q = triangleQuadric(positions + result[i] * 3, positions + result[i + 1] * 3, positions + result[i + 2] * 3);
+    for(size_t k = 0; k < 3; ++k)
+      addQuadric(quadrics[group[result[i + k]]], q);
+  }
+
+  // quadrics only order the collapses; whether one goes ahead is down
+  // to how far it actually moves the surface from the input
+  Samples samples;
+  sampleSurface(samples, result, positions, vertex_count);
+  const std::vector<uint32_t> input(result);
+  SurfaceGrid grid;
+  grid.build(input, positions, target_error);
+
+  const double max_error = double(target_error) * target_error;
+  double reached = 0.;
+  Adjacency adj;
+  std::vector<Collapse> collapses;
+  std::vector<uint32_t> remap(vertex_count);
+  std::vector<char> touched(vertex_count);
+  std::vector<uint32_t> moved;
+
+  while(result.size() > target_index_count) {
+    adj.build(result, vertex_count);
+
+    collapses.clear();
+    for(size_t i = 0; i < result.size(); i += 3) {
+      for(size_t k = 0; k < 3; ++k) {
+        const uint32_t a = result[i + k], b = result[i + (k + 1) % 3];
+        if(!locked[a]) {
+          Collapse c = { a, b, collapseError(quadrics[group[a]], quadrics[group[b]], positions + b * 3) };
+          collapses.push_back(c);
+        }
+        if(!locked[b]) {
+          Collapse c = { b, a, collapseError(quadrics[group[a]], quadrics[group[b]], positions + a * 3) };
+          collapses.push_back(c);
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end());
+
+    // Take the cheapest collapses that don't touch each other. Each one
+    // removes the (usually two) triangles on the collapsed edge.
+    for(size_t v = 0; v < vertex_count; ++v)
+      remap[v] = v;
+    std::fill(touched.begin(), touched.end(), 0);
+    size_t remaining = result.size();
+    size_t applied = 0;
+    for(auto c = collapses.begin(); c != collapses.end() && remaining > target_index_count; ++c) {
+      if(c->error > max_error)
+        break;
+      if(touched[c->from] || touched[c->to])
+        continue;
+      if(flipsTriangles(*c, result, adj, positions))
+        continue;
+      const double deviation = collapseDeviation(*c, result, adj, remap, positions, samples, grid, target_error, reached, moved);
+      if(deviation > target_error)
+        continue;
+
+      size_t removed = 0;
+      for(size_t i = adj.offsets[c->from]; i < adj.offsets[c->from + 1]; ++i) {
+        const uint32_t* tri = &result[adj.triangles[i] * 3];
+        if(tri[0] == c->to || tri[1] == c->to || tri[2] == c->to)
+          ++removed;
+        // everything around the collapse is off limits until the next pass
+        touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+      }
+      remap[c->from] = c->to;
+      addQuadric(quadrics[group[c->to]], quadrics[group[c->from]]);
+      // the samples that moved come out of their old owners' lists
+      for(size_t i = 0; i < moved.size(); i += 5)
+        samples.moving[moved[i]] = 1;
+      for(size_t i = adj.offsets[c->from]; i < adj.offsets[c->from + 1]; ++i) {
+        const uint32_t* tri = &result[adj.triangles[i] * 3];
+        for(size_t k = 0; k < 3; ++k)
+          samples.unlinkMoving(tri[k]);
+      }
+      for(size_t i = 0; i < moved.size(); i += 5) {
+        samples.moving[moved[i]] = 0;
+        std::copy(moved.begin() + i + 2, moved.begin() + i + 5, samples.anchors.begin() + moved[i] * 3);
+        samples.link(moved[i + 1], moved[i]);
+      }
+      reached = std::max(reached, deviation);
+      remaining -= std::min(remaining, removed * 3);
+      ++applied;
+    }
+    if(!applied)
+      break;
+
+    size_t out = 0;
+    for(size_t i = 0; i < result.size(); i += 3) {
+      const uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+      if(a == b || b == c || a == c)
+        continue;
+      result[out++] = a;
+      result[out++] = b;
+      result[out++] = c;
+    }
+    result.resize(out);
+  }
+
+  std::copy(result.begin(), result.end(), dest);
+  if(result_error)
+    *result_error = float(reached);
+  return result.size();
+}
+
+size_t generateLods(DrawableMesh* m, const LodOptions& opts)
+{
+  if(!m->lods.empty())
+    return 0;
+  const DrawableMesh::Attribute* pos = findAttribute(m, DrawableMesh::Pos);
+  if(!pos)
+    return 0;
+  const size_t vertex_count = vertexCount(m);
+  std::vector<uint32_t> indices;
+  readIndices(m, indices);
+  if(indices.empty() || indices.size() % 3 != 0)
+    return 0;
+  std::vector<float> positions;
+  fetchAttributeArray(m, *pos, 3, positions);
+
+  // Each submesh is simplified on its own so the levels keep submesh
+  // order, and material boundaries don't get collapsed across
+  std::vector<std::vector<uint32_t> > parts;
+  for(auto i = m->submeshes.begin(); i != m->submeshes.end(); ++i) {
+    if(i->index_start + i->index_count > indices.size())
+      return 0;
+    parts.push_back(std::vector<uint32_t>(indices.begin() + i->index_start, indices.begin() + i->index_start + i->index_count));
+  }
+  if(parts.empty())
+    parts.push_back(indices);
+
+  DrawableMesh::Lod lod;
+  lod.index_start = 0;
+  lod.index_count = indices.size();
+  lod.error = 0.f;
+  std::vector<DrawableMesh::Lod> lods(1, lod);
+
+  size_t prev_count = indices.size();
+  float level_error = opts.max_error * m->bounds.radius;
+  for(size_t level = 0; level < opts.max_lods; ++level, level_error *= 2.f) {
+    std::vector<std::vector<uint32_t> > next(parts.size());
+    size_t count = 0;
+    float error = 0.f;
+    for(size_t p = 0; p < parts.size(); ++p) {
+      if(parts[p].empty())
+        continue;
+      const size_t target = size_t(parts[p].size() / 3 * opts.reduction) * 3;
+      float part_error;
+      next[p].resize(parts[p].size());
+      next[p].resize(simplifyMesh(&next[p][0], &parts[p][0], parts[p].size(), &positions[0], vertex_count,
+                                  target, level_error, &part_error));
+      if(!next[p].empty())
+        optimizeVertexCache(&next[p][0], next[p].size(), vertex_count);
+      count += next[p].size();
+      error = std::max(error, part_error);
+    }
+    if(count > prev_count * 0.85f || count / 3 < opts.min_triangles)
+      break;
+
+    lod.index_start = indices.size();
+    lod.index_count = count;
+    lod.error = lods.back().error + error; // errors from successive passes can add up
+    lods.push_back(lod);
+    for(size_t p = 0; p < next.size(); ++p)
+      indices.insert(indices.end(), next[p].begin(), next[p].end());
+    parts.swap(next);
+    prev_count = count;
+  }
+
+  if(lods.size() == 1)
+    return 0;
+  writeIndices(m, indices, vertex_count);
+  m->lods.swap(lods);
+  return m->lods.size() - 1;
+}
@@ -0,0 +1,55 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_MESH_SIMPLIFY_HPP
+#define SENSE_MESH_SIMPLIFY_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+struct DrawableMesh;
+
+// Quadric error metric simplification by edge collapse. Vertices are
+// only ever collapsed onto their neighbours, so the result indexes the
+// same vertex data and LODs can share one vertex buffer. Vertices on
+// open borders and attribute seams (several vertices at one position)
+// are never moved, which keeps silhouettes and UV layouts intact at
+// the cost of some reduction.
+//
+// Writes at most index_count indices to dest and returns how many were
+// written. Stops once target_index_count is reached or no collapse is
+// left that keeps the surface within target_error (object-space) of the
+// input. That's measured both ways at points sampled on the triangles
+// (corners, edge middles and centers), and the furthest it got goes in
+// result_error.
+size_t simplifyMesh(uint32_t* dest, const uint32_t* indices, size_t index_count, const float* positions, size_t vertex_count,
+                    size_t target_index_count, float target_error, float* result_error=0);
+
+struct LodOptions
+{
+  size_t max_lods; // not counting the full detail mesh
+  float reduction; // triangle ratio between successive levels
+  float max_error; // for the first level, relative to the bounding radius. Doubles every level
+  size_t min_triangles; // don't bother going below this
+
+  LodOptions() : max_lods(4), reduction(0.5f), max_error(0.02f), min_triangles(32) {}
+};
+
+// Build an LOD chain by repeatedly simplifying each submesh, and append
+// it to the index data. Levels that don't save at least 15% over the
+// previous one are dropped. Meshes that already have LODs are left
+// alone. Returns the number of levels added (not counting LOD 0).
+size_t generateLods(DrawableMesh*, const LodOptions& opts=LodOptions());
+
+#endif // SENSE_MESH_SIMPLIFY_HPP
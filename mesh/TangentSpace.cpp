@@ -0,0 +1,292 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "TangentSpace.hpp"
+#include "VertexData.hpp"
+
+#include "pipeline/Drawable.hpp"
+
+#include "util/parallel.hpp"
+#include "util/simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+  // Anything smaller than this per thread isn't worth a thread
+  const size_t parallel_chunk = 4096;
+
+  // For each vertex, the list of triangle corners (index list positions) that use it
+  struct CornerAdjacency {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> corners;
+
+    CornerAdjacency(const uint32_t* indices, size_t index_count, size_t vertex_count)
+      : offsets(vertex_count + 1, 0), corners(index_count) {
+      for(size_t i = 0; i < index_count; ++i) {
+        if(indices[i] >= vertex_count)
+          throw std::runtime_error("Mesh index out of range");
+        offsets[indices[i] + 1]++;
+      }
+      for(size_t v = 0; v < vertex_count; ++v)
+        offsets[v + 1] += offsets[v];
+      std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+      for(size_t i = 0; i < index_count; ++i)
+        corners[cursor[indices[i]]++] = i;
+    }
+  };
+
+  inline void sub3(float* d, const float* a, const float* b) {
+    d[0] = a[0] - b[0]; d[1] = a[1] - b[1]; d[2] = a[2] - b[2];
+  }
+
+  inline float dot3(const float* a, const float* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  }
+
+  inline bool normalize3(float* v) {
+    const float len = std::sqrt(dot3(v, v));
+    if(len <= 1e-20f)
+      return false;
+    const float inv = 1.f / len;
+    v[0] *= inv; v[1] *= inv; v[2] *= inv;
+    return true;
+  }
+
+  // Remove the component of v along the unit vector n
+  inline void project3(float* v, const float* n) {
+    const float d = dot3(v, n);
+    v[0] -= n[0] * d; v[1] -= n[1] * d; v[2] -= n[2] * d;
+  }
+
+  // Any unit vector perpendicular to n
+  void perpendicular(float* out, const float* n) {
+    const float axis[3] = { std::fabs(n[0]) < 0.9f ? 1.f : 0.f, std::fabs(n[0]) < 0.9f ? 0.f : 1.f, 0.f };
+    out[0] = axis[0]; out[1] = axis[1]; out[2] = axis[2];
+    project3(out, n);
+    normalize3(out);
+  }
+
+  // Unnormalized triangle normals (so twice the area in length), 4 floats per triangle
+  void faceNormals(float* faces, const float* positions, const uint32_t* indices, size_t begin, size_t end) {
+    size_t t = begin;
+#ifdef SENSE_SSE2
+    // four triangles at a time, one per lane
+    for(; t + 4 <= end; t += 4) {
+      const uint32_t* idx = indices + t * 3;
+      const float* a[4] = { positions + idx[0] * 3, positions + idx[3] * 3, positions + idx[6] * 3, positions + idx[9] * 3 };
+      const float* b[4] = { positions + idx[1] * 3, positions + idx[4] * 3, positions + idx[7] * 3, positions + idx[10] * 3 };
+      const float* c[4] = { positions + idx[2] * 3, positions + idx[5] * 3, positions + idx[8] * 3, positions + idx[11] * 3 };
+      __m128 ax = _mm_setr_ps(a[0][0], a[1][0], a[2][0], a[3][0]);
+      __m128 ay = _mm_setr_ps(a[0][1], a[1][1], a[2][1], a[3][1]);
+      __m128 az = _mm_setr_ps(a[0][2], a[1][2], a[2][2], a[3][2]);
+      __m128 e1x = _mm_sub_ps(_mm_setr_ps(b[0][0], b[1][0], b[2][0], b[3][0]), ax);
+      __m128 e1y = _mm_sub_ps(_mm_setr_ps(b[0][1], b[1][1], b[2][1], b[3][1]), ay);
+      __m128 e1z = _mm_sub_ps(_mm_setr_ps(b[0][2], b[1][2], b[2][2], b[3][2]), az);
+      __m128 e2x = _mm_sub_ps(_mm_setr_ps(c[0][0], c[1][0], c[2][0], c[3][0]), ax);
+      __m128 e2y = _mm_sub_ps(_mm_setr_ps(c[0][1], c[1][1], c[2][1], c[3][1]), ay);
+      __m128 e2z = _mm_sub_ps(_mm_setr_ps(c[0][2], c[1][2], c[2][2], c[3][2]), az);
+      __m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+      __m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+      __m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+      __m128 nw = _mm_setzero_ps();
+      _MM_TRANSPOSE4_PS(nx, ny, nz, nw);
+      _mm_storeu_ps(faces + t * 4, nx);
+      _mm_storeu_ps(faces + t * 4 + 4, ny);
+      _mm_storeu_ps(faces + t * 4 + 8, nz);
+      _mm_storeu_ps(faces + t * 4 + 12, nw);
+    }
+#endif
+    for(; t < end; ++t) {
+      const float* a = positions + indices[t * 3] * 3;
+      const float* b = positions + indices[t * 3 + 1] * 3;
+      const float* c = positions + indices[t * 3 + 2] * 3;
+      float e1[3], e2[3];
+      sub3(e1, b, a);
+      sub3(e2, c, a);
+      float* n = faces + t * 4;
+      n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+      n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+      n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+      n[3] = 0.f;
+    }
+  }
+
+  // Sum the 4-float corner (or face) vectors around each vertex. Face
+  // vectors are looked up with corner / 3.
+  void gather(float* out, const float* vectors, bool per_face, const CornerAdjacency& adj, size_t v) {
+    const uint32_t* c = adj.corners.data() + adj.offsets[v];
+    const uint32_t* c_end = adj.corners.data() + adj.offsets[v + 1];
+#ifdef SENSE_SSE2
+    __m128 sum = _mm_setzero_ps();
+    for(; c != c_end; ++c)
+      sum = _mm_add_ps(sum, _mm_loadu_ps(vectors + (per_face ? *c / 3 : *c) * 4));
+    float tmp[4];
+    _mm_storeu_ps(tmp, sum);
+    out[0] = tmp[0]; out[1] = tmp[1]; out[2] = tmp[2];
+#else
+    out[0] = out[1] = out[2] = 0.f;
+    for(; c != c_end; ++c) {
+      const float* s = vectors + (per_face ? *c / 3 : *c) * 4;
+      out[0] += s[0]; out[1] += s[1]; out[2] += s[2];
+    }
+#endif
+  }
+
+  // Normalized tangent contributions for each corner, weighted by the corner angle
+  void cornerTangents(float* out, const float* positions, const float* normals, const float* texcoords,
+                      const uint32_t* indices, size_t begin, size_t end) {
+    for(size_t t = begin; t < end; ++t) {
+      const uint32_t* idx = indices + t * 3;
+      const float* p[3] = { positions + idx[0] * 3, positions + idx[1] * 3, positions + idx[2] * 3 };
+      const float* uv[3] = { texcoords + idx[0] * 2, texcoords + idx[1] * 2, texcoords + idx[2] * 2 };
+
+      float e1[3], e2[3];
+      sub3(e1, p[1], p[0]);
+      sub3(e2, p[2], p[0]);
+      const float s1 = uv[1][0] - uv[0][0], t1 = uv[1][1] - uv[0][1];
+      const float s2 = uv[2][0] - uv[0][0], t2 = uv[2][1] - uv[0][1];
+      const float area = s1 * t2 - s2 * t1;
+
+      float face[3] = { t2 * e1[0] - t1 * e2[0], t2 * e1[1] - t1 * e2[1], t2 * e1[2] - t1 * e2[2] };
+      const bool valid = std::fabs(area) > 1e-20f;
+      if(area < 0.f) {
+        face[0] = -face[0]; face[1] = -face[1]; face[2] = -face[2];
+      }
+
+      for(size_t k = 0; k < 3; ++k) {
+        float* dst = out + (t * 3 + k) * 4;
+        dst[0] = dst[1] = dst[2] = dst[3] = 0.f;
+        if(!valid)
+          continue;
+        const float* n = normals + idx[k] * 3;
+        float tan[3] = { face[0], face[1], face[2] };
+        project3(tan, n);
+        if(!normalize3(tan))
+          continue;
+
+        // corner angle, measured in the vertex's tangent plane
+        float a[3], b[3];
+        sub3(a, p[(k + 1) % 3], p[k]);
+        sub3(b, p[(k + 2) % 3], p[k]);
+        project3(a, n);
+        project3(b, n);
+        if(!normalize3(a) || !normalize3(b))
+          continue;
+        const float angle = std::acos(std::min(1.f, std::max(-1.f, dot3(a, b))));
+        dst[0] = tan[0] * angle;
+        dst[1] = tan[1] * angle;
+        dst[2] = tan[2] * angle;
+      }
+    }
+  }
+
+  // Only LOD 0 counts; the coarser levels reuse its vertices
+  void readBaseIndices(const DrawableMesh* m, std::vector<uint32_t>& indices) {
+    readIndices(m, indices);
+    if(!m->lods.empty())
+      indices.resize(std::min(indices.size(), m->lods[0].index_count));
+    if(indices.size() % 3 != 0)
+      throw std::runtime_error("Can't generate tangent space: mesh isn't a triangle list");
+  }
+}
+
+void computeNormals(float* normals, const float* positions, const uint32_t* indices, size_t index_count, size_t vertex_count)
+{
+  const size_t tri_count = index_count / 3;
+  const CornerAdjacency adj(indices, tri_count * 3, vertex_count);
+  std::vector<float> faces(tri_count * 4 + 4);
+
+  parallelFor(tri_count, parallel_chunk, [&](size_t begin, size_t end) {
+      faceNormals(&faces[0], positions, indices, begin, end);
+    });
+  parallelFor(vertex_count, parallel_chunk, [&](size_t begin, size_t end) {
+      for(size_t v = begin; v < end; ++v) {
+        float* n = normals + v * 3;
+        gather(n, &faces[0], true, adj, v);
+        if(!normalize3(n)) {
+          n[0] = n[1] = 0.f;
+          n[2] = 1.f;
+        }
+      }
+    });
+}
+
+void computeTangents(float* tangents, const float* positions, const float* normals, const float* texcoords,
+                     const uint32_t* indices, size_t index_count, size_t vertex_count)
+{
+  const size_t tri_count = index_count / 3;
+  const CornerAdjacency adj(indices, tri_count * 3, vertex_count);
+  std::vector<float> corners(tri_count * 12 + 4);
+
+  parallelFor(tri_count, parallel_chunk, [&](size_t begin, size_t end) {
+      cornerTangents(&corners[0], positions, normals, texcoords, indices, begin, end);
+    });
+  parallelFor(vertex_count, parallel_chunk, [&](size_t begin, size_t end) {
+      for(size_t v = begin; v < end; ++v) {
+        float* t = tangents + v * 3;
+        const float* n = normals + v * 3;
+        gather(t, &corners[0], false, adj, v);
+        project3(t, n);
+        if(!normalize3(t))
+          perpendicular(t, n);
+      }
+    });
+}
+
+void generateNormals(DrawableMesh* m)
+{
+  const DrawableMesh::Attribute* pos = findAttribute(m, DrawableMesh::Pos);
+  if(!pos)
+    throw std::runtime_error("Can't generate normals: mesh has no positions");
+  std::vector<uint32_t> indices;
+  readBaseIndices(m, indices);
+  const size_t count = vertexCount(m);
+  if(!count)
+    return;
+
+  std::vector<float> positions;
+  fetchAttributeArray(m, *pos, 3, positions);
+  std::vector<float> normals(count * 3);
+  computeNormals(&normals[0], &positions[0], indices.empty() ? 0 : &indices[0], indices.size(), count);
+  setAttribute(m, DrawableMesh::Nor, &normals[0], 3);
+}
+
+void generateTangents(DrawableMesh* m)
+{
+  const DrawableMesh::Attribute* pos = findAttribute(m, DrawableMesh::Pos);
+  const DrawableMesh::Attribute* nor = findAttribute(m, DrawableMesh::Nor);
+  const DrawableMesh::Attribute* tex = findAttribute(m, DrawableMesh::Te0);
+  if(!pos || !nor || !tex)
+    throw std::runtime_error("Can't generate tangents: mesh needs positions, normals and texture coordinates");
+  std::vector<uint32_t> indices;
+  readBaseIndices(m, indices);
+  const size_t count = vertexCount(m);
+  if(!count)
+    return;
+
+  std::vector<float> positions, normals, texcoords;
+  fetchAttributeArray(m, *pos, 3, positions);
+  fetchAttributeArray(m, *nor, 3, normals);
+  fetchAttributeArray(m, *tex, 2, texcoords);
+  // stored normals might not be unit length
+  for(size_t v = 0; v < count; ++v)
+    normalize3(&normals[v * 3]);
+  std::vector<float> tangents(count * 3);
+  computeTangents(&tangents[0], &positions[0], &normals[0], &texcoords[0],
+                  indices.empty() ? 0 : &indices[0], indices.size(), count);
+  setAttribute(m, DrawableMesh::Tan, &tangents[0], 3);
+}
@@ -0,0 +1,41 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_MESH_TANGENTSPACE_HPP
+#define SENSE_MESH_TANGENTSPACE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+struct DrawableMesh;
+
+// Area-weighted vertex normals for an indexed triangle list. Writes
+// vertex_count * 3 floats.
+void computeNormals(float* normals, const float* positions, const uint32_t* indices, size_t index_count, size_t vertex_count);
+
+// Per-vertex tangents following the MikkTSpace rules: the per-triangle
+// tangent is projected onto each vertex's normal plane, normalized and
+// weighted by the corner angle before being summed. Writes vertex_count * 3
+// floats. Handedness isn't returned, since shaders rebuild the bitangent
+// as cross(normal, tangent).
+void computeTangents(float* tangents, const float* positions, const float* normals, const float* texcoords,
+                     const uint32_t* indices, size_t index_count, size_t vertex_count);
+
+// Generate the attribute from the mesh's own data and store it as
+// floats. Tangents need normals and Te0, and throw std::runtime_error
+// without them.
+void generateNormals(DrawableMesh*);
+void generateTangents(DrawableMesh*);
+
+#endif // SENSE_MESH_TANGENTSPACE_HPP
@@ -0,0 +1,238 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "VertexData.hpp"
+#include "Quantize.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+  size_t attribBytes(const DrawableMesh::Attribute& a) {
+    return (attribTypeSize(a.type) * a.size + 3) & ~size_t(3);
+  }
+
+  // Rebuild the vertex data without the attribute at loc, leaving
+  // extra_bytes of space at the end of each vertex
+  void repack(DrawableMesh* m, DrawableMesh::AttribLocation loc, size_t extra_bytes) {
+    const size_t count = vertexCount(m);
+    std::vector<DrawableMesh::Attribute> attribs;
+    size_t stride = 0;
+    for(auto i = m->attributes.begin(); i != m->attributes.end(); ++i) {
+      if(i->loc == loc)
+        continue;
+      DrawableMesh::Attribute a = *i;
+      a.start = stride;
+      stride += attribBytes(a);
+      attribs.push_back(a);
+    }
+    const size_t new_stride = stride + extra_bytes;
+    char* data = new char[count * new_stride];
+    memset(data, 0, count * new_stride);
+    for(size_t i = 0, j = 0; i < m->attributes.size(); ++i) {
+      if(m->attributes[i].loc == loc)
+        continue;
+      const size_t bytes = attribTypeSize(attribs[j].type) * attribs[j].size;
+      const char* src = (const char*)m->data + m->attributes[i].start;
+      char* dst = data + attribs[j].start;
+      for(size_t v = 0; v < count; ++v)
+        memcpy(dst + v * new_stride, src + v * m->data_stride, bytes);
+      ++j;
+    }
+    if(m->data)
+      delete[] (char*)m->data;
+    m->data = data;
+    m->data_stride = new_stride;
+    m->data_size = count * new_stride;
+    m->attributes.swap(attribs);
+
+    if(loc == DrawableMesh::Pos)
+      m->quant_flags &= ~DrawableMesh::QuantPosition;
+    else if(loc == DrawableMesh::Nor)
+      m->quant_flags &= ~DrawableMesh::QuantOctNormal;
+    else if(loc == DrawableMesh::Tan)
+      m->quant_flags &= ~DrawableMesh::QuantOctTangent;
+  }
+
+  template <typename T>
+  float readComponent(const char* src, bool normalize, float scale) {
+    T v;
+    memcpy(&v, src, sizeof(T));
+    if(normalize)
+      return std::max(float(v) / scale, -1.f);
+    return float(v);
+  }
+}
+
+const DrawableMesh::Attribute* findAttribute(const DrawableMesh* m, DrawableMesh::AttribLocation loc)
+{
+  for(auto i = m->attributes.begin(); i != m->attributes.end(); ++i) {
+    if(i->loc == loc)
+      return &(*i);
+  }
+  return 0;
+}
+
+size_t vertexCount(const DrawableMesh* m)
+{
+  if(!m->data_stride)
+    return 0;
+  return m->data_size / m->data_stride;
+}
+
+size_t attribTypeSize(DrawableMesh::AttribType type)
+{
+  switch(type) {
+  case DrawableMesh::Byte:
+  case DrawableMesh::UByte:
+    return 1;
+  case DrawableMesh::Short:
+  case DrawableMesh::UShort:
+  case DrawableMesh::Half:
+    return 2;
+  case DrawableMesh::Int:
+  case DrawableMesh::UInt:
+  case DrawableMesh::Float:
+    return 4;
+  case DrawableMesh::Double:
+    return 8;
+  }
+  return 0;
+}
+
+void readIndices(const DrawableMesh* m, std::vector<uint32_t>& out)
+{
+  if(!m->index_data) {
+    out.resize(vertexCount(m));
+    for(size_t i = 0; i < out.size(); ++i)
+      out[i] = i;
+    return;
+  }
+  out.resize(m->index_count);
+  switch(m->index_type) {
+  case DrawableMesh::UByte:
+    {
+      const uint8_t* src = (const uint8_t*)m->index_data;
+      std::copy(src, src + m->index_count, out.begin());
+      break;
+    }
+  case DrawableMesh::UShort:
+    {
+      const uint16_t* src = (const uint16_t*)m->index_data;
+      std::copy(src, src + m->index_count, out.begin());
+      break;
+    }
+  case DrawableMesh::UInt:
+    {
+      const uint32_t* src = (const uint32_t*)m->index_data;
+      std::copy(src, src + m->index_count, out.begin());
+      break;
+    }
+  default:
+    throw std::runtime_error("Can't read mesh indices: bad index type");
+  }
+}
+
+void writeIndices(DrawableMesh* m, const std::vector<uint32_t>& indices, size_t vertex_count)
+{
+  char* data;
+  if(vertex_count <= 0x10000) {
+    uint16_t* dst = new uint16_t[indices.size()];
+    std::copy(indices.begin(), indices.end(), dst);
+    data = (char*)dst;
+    m->index_type = DrawableMesh::UShort;
+  } else {
+    uint32_t* dst = new uint32_t[indices.size()];
+    std::copy(indices.begin(), indices.end(), dst);
+    data = (char*)dst;
+    m->index_type = DrawableMesh::UInt;
+  }
+  if(m->index_data)
+    delete[] (char*)m->index_data;
+  m->index_data = data;
+  m->index_count = indices.size();
+}
+
+void fetchAttribute(const DrawableMesh* m, const DrawableMesh::Attribute& a, size_t vertex, float out[4])
+{
+  out[0] = out[1] = out[2] = 0.f;
+  out[3] = 1.f;
+  const char* src = (const char*)m->data + vertex * m->data_stride + a.start;
+  const bool n = a.special == DrawableMesh::Normalize;
+  const size_t csize = attribTypeSize(a.type);
+  for(size_t c = 0; c < a.size && c < 4; ++c, src += csize) {
+    switch(a.type) {
+    case DrawableMesh::Byte: out[c] = readComponent<int8_t>(src, n, 127.f); break;
+    case DrawableMesh::UByte: out[c] = readComponent<uint8_t>(src, n, 255.f); break;
+    case DrawableMesh::Short: out[c] = readComponent<int16_t>(src, n, 32767.f); break;
+    case DrawableMesh::UShort: out[c] = readComponent<uint16_t>(src, n, 65535.f); break;
+    case DrawableMesh::Int: out[c] = readComponent<int32_t>(src, n, 2147483647.f); break;
+    case DrawableMesh::UInt: out[c] = readComponent<uint32_t>(src, n, 4294967295.f); break;
+    case DrawableMesh::Float: out[c] = readComponent<float>(src, false, 1.f); break;
+    case DrawableMesh::Double: out[c] = readComponent<double>(src, false, 1.f); break;
+    case DrawableMesh::Half:
+      {
+        uint16_t h;
+        memcpy(&h, src, 2);
+        out[c] = halfToFloat(h);
+        break;
+      }
+    }
+  }
+
+  // undo any mesh-level quantization
+  if(a.loc == DrawableMesh::Pos && (m->quant_flags & DrawableMesh::QuantPosition)) {
+    for(size_t c = 0; c < 3; ++c)
+      out[c] = out[c] * m->pos_scale[c] + m->pos_bias[c];
+  } else if((a.loc == DrawableMesh::Nor && (m->quant_flags & DrawableMesh::QuantOctNormal)) ||
+            (a.loc == DrawableMesh::Tan && (m->quant_flags & DrawableMesh::QuantOctTangent))) {
+    decodeOctahedral(out, out[0], out[1]);
+  }
+}
+
+void fetchAttributeArray(const DrawableMesh* m, const DrawableMesh::Attribute& a, size_t components, std::vector<float>& out)
+{
+  const size_t count = vertexCount(m);
+  out.resize(count * components);
+  float tmp[4];
+  for(size_t i = 0; i < count; ++i) {
+    fetchAttribute(m, a, i, tmp);
+    for(size_t c = 0; c < components; ++c)
+      out[i * components + c] = tmp[c];
+  }
+}
+
+void setAttribute(DrawableMesh* m, DrawableMesh::AttribLocation loc, const float* values, uint8_t components)
+{
+  const size_t count = vertexCount(m);
+  const size_t bytes = components * sizeof(float);
+  repack(m, loc, bytes);
+  DrawableMesh::Attribute a;
+  a.type = DrawableMesh::Float;
+  a.loc = loc;
+  a.start = m->data_stride - bytes;
+  a.size = components;
+  a.special = DrawableMesh::None;
+  m->attributes.push_back(a);
+  char* dst = (char*)m->data + a.start;
+  for(size_t v = 0; v < count; ++v)
+    memcpy(dst + v * m->data_stride, values + v * components, bytes);
+}
+
+void removeAttribute(DrawableMesh* m, DrawableMesh::AttribLocation loc)
+{
+  if(findAttribute(m, loc))
+    repack(m, loc, 0);
+}
@@ -0,0 +1,57 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_MESH_VERTEXDATA_HPP
+#define SENSE_MESH_VERTEXDATA_HPP
+
+#include "pipeline/Drawable.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Helpers for poking at the raw data in a DrawableMesh. These are
+// meant for load-time and cook-time processing, not for anything
+// that runs per frame.
+
+// Find the attribute bound to the given location, or NULL if the mesh doesn't have one
+const DrawableMesh::Attribute* findAttribute(const DrawableMesh*, DrawableMesh::AttribLocation);
+
+size_t vertexCount(const DrawableMesh*);
+size_t attribTypeSize(DrawableMesh::AttribType);
+
+// Read the index list as 32-bit indices. Unindexed meshes get a trivial 0..n list.
+void readIndices(const DrawableMesh*, std::vector<uint32_t>&);
+
+// Replace the index data of the mesh, using the smallest index type
+// that can address vertex_count vertices.
+void writeIndices(DrawableMesh*, const std::vector<uint32_t>&, size_t vertex_count);
+
+// Decode a single attribute of a single vertex into floats. Components
+// the attribute doesn't store are filled in from (0, 0, 0, 1), same as GL.
+// Quantized positions and normals come back in their decoded form.
+void fetchAttribute(const DrawableMesh*, const DrawableMesh::Attribute&, size_t vertex, float out[4]);
+
+// Decode an attribute for every vertex into a tightly packed array
+// with the given number of components per vertex.
+void fetchAttributeArray(const DrawableMesh*, const DrawableMesh::Attribute&, size_t components, std::vector<float>&);
+
+// Store per-vertex floats as an attribute at the given location, replacing
+// any attribute already there. The vertex data is repacked, so this is
+// not cheap. Clears the matching quantization flag.
+void setAttribute(DrawableMesh*, DrawableMesh::AttribLocation, const float* values, uint8_t components);
+
+// Drop the attribute at the given location (if any) and repack the vertex data
+void removeAttribute(DrawableMesh*, DrawableMesh::AttribLocation);
+
+#endif // SENSE_MESH_VERTEXDATA_HPP
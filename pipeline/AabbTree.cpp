@@ -0,0 +1,347 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "AabbTree.hpp"
+
+#include <algorithm>
+
+namespace {
+  // leaves collected before a batch goes through testAabbs
+  const size_t batch_size = 64;
+
+  Aabb merge(const Aabb& a, const Aabb& b) {
+    Aabb r;
+    r.min = glm::min(a.min, b.min);
+    r.max = glm::max(a.max, b.max);
+    return r;
+  }
+
+  bool contains(const Aabb& outer, const Aabb& inner) {
+    return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::greaterThanEqual(outer.max, inner.max));
+  }
+
+  // surface area heuristic; half the real area, which doesn't change any comparison
+  float area(const Aabb& b) {
+    const glm::vec3 d = b.max - b.min;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+  }
+}
+
+const AabbTree::NodeId AabbTree::none;
+
+AabbTree::AabbTree(float margin)
+  : m_root(none), m_free(none), m_leaves(0), m_margin(margin)
+{}
+
+AabbTree::NodeId AabbTree::insert(const Aabb& box, uint32_t user)
+{
+  const NodeId id = allocate();
+  Node& n = m_nodes[id];
+  m_tight[id] = box;
+  n.box = fatten(box);
+  n.user = user;
+  insertLeaf(id);
+  m_leaves++;
+  return id;
+}
+
+void AabbTree::remove(NodeId id)
+{
+  removeLeaf(id);
+  release(id);
+  m_leaves--;
+}
+
+bool AabbTree::move(NodeId id, const Aabb& box)
+{
+  m_tight[id] = box;
+  if(contains(m_nodes[id].box, box))
+    return false;
+  removeLeaf(id);
+  m_nodes[id].box = fatten(box);
+  insertLeaf(id);
+  return true;
+}
+
+void AabbTree::setBox(NodeId id, const Aabb& box)
+{
+  m_tight[id] = box;
+  m_nodes[id].box = fatten(box);
+}
+
+void AabbTree::refit()
+{
+  if(m_root != none)
+    refitNode(m_root);
+}
+
+void AabbTree::clear()
+{
+  m_nodes.clear();
+  m_tight.clear();
+  m_root = m_free = none;
+  m_leaves = 0;
+}
+
+void AabbTree::query(const Frustum& f, std::vector<uint32_t>& users)
+{
+  if(m_root == none)
+    return;
+  m_batch_users.clear();
+  for(int i = 0; i < 6; ++i)
+    m_batch[i].clear();
+  m_stack.clear();
+  m_stack.push_back(m_root);
+  while(!m_stack.empty()) {
+    const NodeId id = m_stack.back();
+    m_stack.pop_back();
+    const Node& n = m_nodes[id];
+    if(n.leaf()) {
+      // leaves are the bulk of the tree, so they're left for the batch
+      const Aabb& b = m_tight[id];
+      m_batch[0].push_back(b.min.x);
+      m_batch[1].push_back(b.min.y);
+      m_batch[2].push_back(b.min.z);
+      m_batch[3].push_back(b.max.x);
+      m_batch[4].push_back(b.max.y);
+      m_batch[5].push_back(b.max.z);
+      m_batch_users.push_back(n.user);
+      if(m_batch_users.size() == batch_size)
+        flushBatch(f, users);
+      continue;
+    }
+    switch(testAabb(f, n.box)) {
+    case CullOutside:
+      break;
+    case CullInside:
+      takeSubtree(id, users);
+      break;
+    case CullIntersects:
+      m_stack.push_back(n.child[0]);
+      m_stack.push_back(n.child[1]);
+      break;
+    }
+  }
+  flushBatch(f, users);
+}
+
+AabbTree::NodeId AabbTree::allocate()
+{
+  NodeId id;
+  if(m_free != none) {
+    id = m_free;
+    m_free = m_nodes[id].parent;
+  } else {
+    id = m_nodes.size();
+    m_nodes.push_back(Node());
+    m_tight.push_back(Aabb());
+  }
+  Node& n = m_nodes[id];
+  n.parent = none;
+  n.child[0] = n.child[1] = none;
+  n.height = 0;
+  n.user = 0;
+  return id;
+}
+
+void AabbTree::release(NodeId id)
+{
+  m_nodes[id].parent = m_free;
+  m_nodes[id].height = -1;
+  m_free = id;
+}
+
+Aabb AabbTree::fatten(const Aabb& box) const
+{
+  const glm::vec3 grow = (box.max - box.min) * m_margin;
+  Aabb r;
+  r.min = box.min - grow;
+  r.max = box.max + grow;
+  return r;
+}
+
+void AabbTree::insertLeaf(NodeId leaf)
+{
+  if(m_root == none) {
+    m_root = leaf;
+    m_nodes[leaf].parent = none;
+    return;
+  }
+
+  // Walk down to the cheapest sibling: the cost of a node is the area
+  // it would grow by, plus what its ancestors already grew
+  const Aabb box = m_nodes[leaf].box;
+  NodeId index = m_root;
+  while(!m_nodes[index].leaf()) {
+    const Node& n = m_nodes[index];
+    const float combined = area(merge(n.box, box));
+    const float cost = 2.f * combined;
+    const float inherited = 2.f * (combined - area(n.box));
+    float child_cost[2];
+    for(int c = 0; c < 2; ++c) {
+      const Node& child = m_nodes[n.child[c]];
+      const float grown = area(merge(box, child.box));
+      child_cost[c] = (child.leaf() ? grown : grown - area(child.box)) + inherited;
+    }
+    if(cost < child_cost[0] && cost < child_cost[1])
+      break;
+    index = child_cost[0] < child_cost[1] ? n.child[0] : n.child[1];
+  }
+
+  const NodeId sibling = index;
+  const NodeId old_parent = m_nodes[sibling].parent;
+  const NodeId new_parent = allocate();
+  Node& p = m_nodes[new_parent];
+  p.parent = old_parent;
+  p.box = merge(box, m_nodes[sibling].box);
+  p.height = m_nodes[sibling].height + 1;
+  p.child[0] = sibling;
+  p.child[1] = leaf;
+  m_nodes[sibling].parent = new_parent;
+  m_nodes[leaf].parent = new_parent;
+  if(old_parent == none) {
+    m_root = new_parent;
+  } else {
+    Node& op = m_nodes[old_parent];
+    op.child[op.child[0] == sibling ? 0 : 1] = new_parent;
+  }
+  fixUpwards(m_nodes[leaf].parent);
+}
+
+void AabbTree::removeLeaf(NodeId leaf)
+{
+  if(leaf == m_root) {
+    m_root = none;
+    return;
+  }
+  const NodeId parent = m_nodes[leaf].parent;
+  const NodeId grandparent = m_nodes[parent].parent;
+  const NodeId sibling = m_nodes[parent].child[m_nodes[parent].child[0] == leaf ? 1 : 0];
+  if(grandparent == none) {
+    m_root = sibling;
+    m_nodes[sibling].parent = none;
+    release(parent);
+    return;
+  }
+  Node& g = m_nodes[grandparent];
+  g.child[g.child[0] == parent ? 0 : 1] = sibling;
+  m_nodes[sibling].parent = grandparent;
+  release(parent);
+  fixUpwards(grandparent);
+}
+
+// Rebalance and refit from index to the root
+void AabbTree::fixUpwards(NodeId index)
+{
+  while(index != none) {
+    index = balance(index);
+    Node& n = m_nodes[index];
+    const Node& a = m_nodes[n.child[0]];
+    const Node& b = m_nodes[n.child[1]];
+    n.height = 1 + std::max(a.height, b.height);
+    n.box = merge(a.box, b.box);
+    index = n.parent;
+  }
+}
+
+// If one child of a is more than a level taller than the other, rotate
+// it up to take a's place. Returns whichever node is now where a was.
+AabbTree::NodeId AabbTree::balance(NodeId ia)
+{
+  Node& a = m_nodes[ia];
+  if(a.leaf() || a.height < 2)
+    return ia;
+
+  // side is the taller child, which comes up; other stays under a
+  const int balance = m_nodes[a.child[1]].height - m_nodes[a.child[0]].height;
+  if(balance >= -1 && balance <= 1)
+    return ia;
+  const int side = balance > 1 ? 1 : 0;
+  const NodeId iup = a.child[side];
+  const NodeId iother = a.child[side ^ 1];
+  Node& up = m_nodes[iup];
+  const NodeId ibig = up.child[0], ismall = up.child[1];
+  const bool first_taller = m_nodes[ibig].height > m_nodes[ismall].height;
+  const NodeId ikeep = first_taller ? ibig : ismall; // stays with up
+  const NodeId igive = first_taller ? ismall : ibig; // goes to a
+
+  // up takes a's place under a's parent, with a as its first child
+  up.child[0] = ia;
+  up.parent = a.parent;
+  a.parent = iup;
+  if(up.parent == none) {
+    m_root = iup;
+  } else {
+    Node& p = m_nodes[up.parent];
+    p.child[p.child[0] == ia ? 0 : 1] = iup;
+  }
+  up.child[1] = ikeep;
+  a.child[side] = igive;
+  m_nodes[igive].parent = ia;
+
+  const Node& other = m_nodes[iother];
+  const Node& give = m_nodes[igive];
+  const Node& keep = m_nodes[ikeep];
+  a.box = merge(other.box, give.box);
+  a.height = 1 + std::max(other.height, give.height);
+  up.box = merge(a.box, keep.box);
+  up.height = 1 + std::max(a.height, keep.height);
+  return iup;
+}
+
+void AabbTree::refitNode(NodeId id)
+{
+  Node& n = m_nodes[id];
+  if(n.leaf())
+    return;
+  refitNode(n.child[0]);
+  refitNode(n.child[1]);
+  n.box = merge(m_nodes[n.child[0]].box, m_nodes[n.child[1]].box);
+}
+
+void AabbTree::takeSubtree(NodeId id, std::vector<uint32_t>& users)
+{
+  const size_t base = m_stack.size();
+  m_stack.push_back(id);
+  while(m_stack.size() > base) {
+    const Node& n = m_nodes[m_stack.back()];
+    m_stack.pop_back();
+    if(n.leaf()) {
+      users.push_back(n.user);
+    } else {
+      m_stack.push_back(n.child[0]);
+      m_stack.push_back(n.child[1]);
+    }
+  }
+}
+
+void AabbTree::flushBatch(const Frustum& f, std::vector<uint32_t>& users)
+{
+  const size_t count = m_batch_users.size();
+  if(!count)
+    return;
+  m_batch_visible.resize(count);
+  const float* bounds[6];
+  for(int i = 0; i < 6; ++i)
+    bounds[i] = &m_batch[i][0];
+  testAabbs(f, bounds, count, &m_batch_visible[0]);
+  for(size_t i = 0; i < count; ++i) {
+    if(m_batch_visible[i])
+      users.push_back(m_batch_users[i]);
+  }
+  m_batch_users.clear();
+  for(int i = 0; i < 6; ++i)
+    m_batch[i].clear();
+}
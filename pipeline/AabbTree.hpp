@@ -0,0 +1,102 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SENSE_PIPELINE_AABBTREE_HPP
+#define SENSE_PIPELINE_AABBTREE_HPP
+
+#include "Culling.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Dynamic bounding volume hierarchy over boxes that come, go and move
+// around. Leaves hold a box grown by a margin, so small moves don't
+// touch the tree at all; bigger ones reinsert the leaf. Inserts and
+// removes rebalance with AVL style rotations on the way back up, so the
+// tree stays shallow no matter what order things arrive in. For moving
+// most of the leaves at once (a camera move, with draw transforms that
+// go to clip space) setBox() and one refit() is cheaper than moving
+// them one by one.
+class AabbTree
+{
+public:
+  typedef int32_t NodeId;
+  static const NodeId none = -1;
+
+  // Leaves are grown by margin times their size on every side
+  explicit AabbTree(float margin = 0.1f);
+
+  NodeId insert(const Aabb&, uint32_t user);
+  void remove(NodeId);
+  // Returns true if the leaf had to be reinserted
+  bool move(NodeId, const Aabb&);
+  // Change a leaf's box without fixing up its ancestors; call refit()
+  // before the next query
+  void setBox(NodeId, const Aabb&);
+  void refit();
+  void clear();
+
+  // Append the user value of every leaf whose box touches the frustum.
+  // Whole subtrees inside the frustum are taken without testing their
+  // leaves; leaves that need testing go through testAabbs in batches.
+  void query(const Frustum&, std::vector<uint32_t>& users);
+
+  // A leaf's box as given, without the margin
+  const Aabb& leafBox(NodeId id) const { return m_tight[id]; }
+
+  size_t size() const { return m_leaves; }
+  int height() const { return m_root == none ? 0 : m_nodes[m_root].height; }
+
+private:
+  struct Node
+  {
+    Aabb box; // fattened, for leaves
+    NodeId parent; // next free node, for free ones
+    NodeId child[2]; // none for leaves
+    int32_t height; // 0 for leaves
+    uint32_t user;
+
+    bool leaf() const { return child[0] == none; }
+  };
+
+  std::vector<Node> m_nodes;
+  // the leaves' real boxes, by node; kept apart so walking the tree
+  // doesn't drag them through the cache
+  std::vector<Aabb> m_tight;
+  NodeId m_root;
+  NodeId m_free;
+  size_t m_leaves;
+  float m_margin;
+
+  // query scratch
+  std::vector<NodeId> m_stack;
+  std::vector<float> m_batch[6];
+  std::vector<uint32_t> m_batch_users;
+  std::vector<uint8_t> m_batch_visible;
+
+  NodeId allocate();
+  void release(NodeId);
+  Aabb fatten(const Aabb&) const;
+  void insertLeaf(NodeId);
+  void removeLeaf(NodeId);
+  void fixUpwards(NodeId);
+  NodeId balance(NodeId);
+  void refitNode(NodeId);
+  void takeSubtree(NodeId, std::vector<uint32_t>&);
+  void flushBatch(const Frustum&, std::vector<uint32_t>&);
+};
+
+#endif // SENSE_PIPELINE_AABBTREE_HPP
@@ -0,0 +1,147 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ClusterCulling.hpp"
+#include "Drawable.hpp"
+#include "util/simd.hpp"
+
+#include <cmath>
+
+ClusterView clusterViewFromMatrix(const glm::mat4& m)
+{
+  ClusterView v;
+  v.frustum = frustumFromMatrix(m);
+  // The eye is the point that lands on x = y = w = 0 in clip space.
+  // glm indexes columns first.
+  glm::mat3 a;
+  glm::vec3 b;
+  const int rows[3] = {0, 1, 3};
+  for(int r = 0; r < 3; ++r) {
+    for(int c = 0; c < 3; ++c)
+      a[c][r] = m[c][rows[r]];
+    b[r] = m[3][rows[r]];
+  }
+  const float det = glm::determinant(a);
+  v.has_eye = det != 0.f && std::isfinite(det);
+  v.eye = v.has_eye ? glm::inverse(a) * -b : glm::vec3(0.f);
+  return v;
+}
+
+ClusterSet::ClusterSet(const DrawableMesh* mesh)
+{
+  const size_t count = mesh->clusters.size();
+  const size_t padded = (count + 3) & ~size_t(3);
+  for(int i = 0; i < 9; ++i)
+    m_bounds[i].assign(padded, 0.f);
+  m_visible.resize(padded);
+  for(size_t i = 0; i < count; ++i) {
+    const DrawableMesh::Cluster& c = mesh->clusters[i];
+    for(int a = 0; a < 3; ++a) {
+      m_bounds[a][i] = c.center[a];
+      m_bounds[a + 4][i] = c.cone_axis[a];
+    }
+    m_bounds[3][i] = c.radius;
+    m_bounds[7][i] = c.cone_cos;
+    // no cone (cos 0) makes the facing test come out negative
+    m_bounds[8][i] = std::sqrt(std::max(1.f - c.cone_cos * c.cone_cos, 0.f));
+    m_start.push_back(c.index_start);
+    m_count.push_back(c.index_count);
+  }
+}
+
+// A sphere is out if it's entirely behind any plane. A cluster faces
+// away if, for every point p in its sphere and every normal n in its
+// cone, dot(p - eye, n) > 0. The worst case of that works out to
+// d cos(a) - sqrt(|v|^2 - d^2) sin(a) > radius, where v runs from the
+// eye to the center and d is how far along the cone axis it goes.
+size_t ClusterSet::cull(const ClusterView& view, std::vector<DrawCommand>& out)
+{
+  const size_t count = size();
+  const float* cx = &m_bounds[0][0];
+  const float* cy = &m_bounds[1][0];
+  const float* cz = &m_bounds[2][0];
+  const float* radius = &m_bounds[3][0];
+  const float* ax = &m_bounds[4][0];
+  const float* ay = &m_bounds[5][0];
+  const float* az = &m_bounds[6][0];
+  const float* cone_cos = &m_bounds[7][0];
+  const float* cone_sin = &m_bounds[8][0];
+  const glm::vec4* planes = view.frustum.planes;
+
+  size_t i = 0;
+#ifdef SENSE_SSE2
+  for(; i < count; i += 4) {
+    const __m128 x = _mm_loadu_ps(cx + i);
+    const __m128 y = _mm_loadu_ps(cy + i);
+    const __m128 z = _mm_loadu_ps(cz + i);
+    const __m128 r = _mm_loadu_ps(radius + i);
+    const __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), r);
+    __m128 culled = _mm_setzero_ps();
+    for(int p = 0; p < 6; ++p) {
+      __m128 d = _mm_set1_ps(planes[p].w);
+      d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[p].x), x));
+      d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[p].y), y));
+      d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[p].z), z));
+      culled = _mm_or_ps(culled, _mm_cmplt_ps(d, neg_r));
+    }
+    if(view.has_eye) {
+      const __m128 vx = _mm_sub_ps(x, _mm_set1_ps(view.eye.x));
+      const __m128 vy = _mm_sub_ps(y, _mm_set1_ps(view.eye.y));
+      const __m128 vz = _mm_sub_ps(z, _mm_set1_ps(view.eye.z));
+      __m128 d = _mm_mul_ps(vx, _mm_loadu_ps(ax + i));
+      d = _mm_add_ps(d, _mm_mul_ps(vy, _mm_loadu_ps(ay + i)));
+      d = _mm_add_ps(d, _mm_mul_ps(vz, _mm_loadu_ps(az + i)));
+      const __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+      const __m128 side = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(len2, _mm_mul_ps(d, d)), _mm_setzero_ps()));
+      const __m128 away = _mm_sub_ps(_mm_mul_ps(d, _mm_loadu_ps(cone_cos + i)), _mm_mul_ps(side, _mm_loadu_ps(cone_sin + i)));
+      culled = _mm_or_ps(culled, _mm_cmpgt_ps(away, r));
+    }
+    const int mask = _mm_movemask_ps(culled);
+    for(int j = 0; j < 4; ++j)
+      m_visible[i + j] = !(mask & (1 << j));
+  }
+#endif
+  for(; i < count; ++i) {
+    bool culled = false;
+    for(int p = 0; p < 6 && !culled; ++p)
+      culled = planes[p].x * cx[i] + planes[p].y * cy[i] + planes[p].z * cz[i] + planes[p].w < -radius[i];
+    if(!culled && view.has_eye) {
+      const glm::vec3 v = glm::vec3(cx[i], cy[i], cz[i]) - view.eye;
+      const float d = glm::dot(v, glm::vec3(ax[i], ay[i], az[i]));
+      const float side = std::sqrt(std::max(glm::dot(v, v) - d * d, 0.f));
+      culled = d * cone_cos[i] - side * cone_sin[i] > radius[i];
+    }
+    m_visible[i] = !culled;
+  }
+
+  const size_t first = out.size();
+  size_t kept = 0;
+  for(i = 0; i < count; ++i) {
+    if(!m_visible[i])
+      continue;
+    ++kept;
+    if(out.size() > first && out.back().first_index + out.back().count == m_start[i]) {
+      out.back().count += m_count[i];
+      continue;
+    }
+    DrawCommand c;
+    c.count = m_count[i];
+    c.instance_count = 1;
+    c.first_index = m_start[i];
+    c.base_vertex = 0;
+    c.base_instance = 0;
+    out.push_back(c);
+  }
+  return kept;
+}
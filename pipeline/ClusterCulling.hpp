@@ -0,0 +1,71 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_PIPELINE_CLUSTERCULLING_HPP
+#define SENSE_PIPELINE_CLUSTERCULLING_HPP
+
+#include "3rdparty/glm/glm.hpp"
+#include "Culling.hpp"
+#include "DrawCommands.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct DrawableMesh;
+
+// Where a mesh is being looked at from, in its own object space
+struct ClusterView
+{
+  Frustum frustum;
+  glm::vec3 eye;
+  // false for orthographic projections, which have no eye point, so
+  // nothing gets culled for facing away
+  bool has_eye;
+};
+
+// Pulled straight out of the transform a mesh is drawn with, all the
+// way to clip space
+ClusterView clusterViewFromMatrix(const glm::mat4&);
+
+// A mesh's clusters laid out as separate arrays, for testing four at
+// a time with SSE2. Clusters are dropped if their bounding sphere is
+// outside the frustum, or if all their triangles face away from the
+// eye. Facing goes by counter-clockwise winding in object space, so a
+// transform that mirrors the mesh keeps the side that faces the eye,
+// though it's clockwise on screen; nothing culls back faces on the GPU.
+class ClusterSet
+{
+public:
+  explicit ClusterSet(const DrawableMesh*);
+
+  size_t size() const { return m_start.size(); }
+
+  // Append the clusters that survive as draw commands (in the layout
+  // of GL's indirect commands), merging neighbours that are next to each
+  // other in the index list. Commands are relative to the mesh: add its
+  // first index and base vertex to draw them. Returns how many clusters
+  // survived.
+  size_t cull(const ClusterView&, std::vector<DrawCommand>& out);
+
+private:
+  // center xyz, radius, cone axis xyz, cos and sin of the cone angle;
+  // padded to a multiple of four
+  std::vector<float> m_bounds[9];
+  std::vector<uint32_t> m_start;
+  std::vector<uint32_t> m_count;
+  std::vector<uint8_t> m_visible;
+};
+
+#endif // SENSE_PIPELINE_CLUSTERCULLING_HPP
@@ -0,0 +1,142 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "Culling.hpp"
+#include "util/simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+Frustum frustumFromMatrix(const glm::mat4& m)
+{
+  // rows of the matrix; glm indexes columns first
+  glm::vec4 r[4];
+  for(int i = 0; i < 4; ++i)
+    r[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+  Frustum f;
+  f.planes[0] = r[3] + r[0];
+  f.planes[1] = r[3] - r[0];
+  f.planes[2] = r[3] + r[1];
+  f.planes[3] = r[3] - r[1];
+  f.planes[4] = r[3] + r[2];
+  f.planes[5] = r[3] - r[2];
+  for(int i = 0; i < 6; ++i) {
+    const float len = glm::length(glm::vec3(f.planes[i]));
+    if(len > 0.f)
+      f.planes[i] /= len;
+  }
+  return f;
+}
+
+bool transformBounds(const DrawableMesh::Bounds& b, const glm::mat4& m, Aabb& out)
+{
+  // Affine transforms (everything but a projection) can move the
+  // center and grow the extents, no corners needed
+  if(m[0][3] == 0.f && m[1][3] == 0.f && m[2][3] == 0.f && m[3][3] == 1.f) {
+    const glm::vec3 c = (b.min + b.max) * 0.5f;
+    const glm::vec3 e = (b.max - b.min) * 0.5f;
+    const glm::vec3 center = glm::vec3(m * glm::vec4(c, 1.f));
+    glm::vec3 extent;
+    for(int i = 0; i < 3; ++i)
+      extent[i] = std::abs(m[0][i]) * e.x + std::abs(m[1][i]) * e.y + std::abs(m[2][i]) * e.z;
+    out.min = center - extent;
+    out.max = center + extent;
+    return true;
+  }
+
+  out.min = glm::vec3(INFINITY);
+  out.max = glm::vec3(-INFINITY);
+  for(int i = 0; i < 8; ++i) {
+    const glm::vec4 corner((i & 1) ? b.max.x : b.min.x, (i & 2) ? b.max.y : b.min.y, (i & 4) ? b.max.z : b.min.z, 1.f);
+    const glm::vec4 p = m * corner;
+    if(p.w <= 1e-6f)
+      return false;
+    const glm::vec3 v = glm::vec3(p) / p.w;
+    out.min = glm::min(out.min, v);
+    out.max = glm::max(out.max, v);
+  }
+  return true;
+}
+
+CullResult testAabb(const Frustum& f, const Aabb& b)
+{
+  CullResult result = CullInside;
+  for(int i = 0; i < 6; ++i) {
+    const glm::vec4& p = f.planes[i];
+    // the corners furthest along and against the plane normal
+    const glm::vec3 pos(p.x >= 0.f ? b.max.x : b.min.x, p.y >= 0.f ? b.max.y : b.min.y, p.z >= 0.f ? b.max.z : b.min.z);
+    const glm::vec3 neg(p.x >= 0.f ? b.min.x : b.max.x, p.y >= 0.f ? b.min.y : b.max.y, p.z >= 0.f ? b.min.z : b.max.z);
+    if(glm::dot(glm::vec3(p), pos) + p.w < 0.f)
+      return CullOutside;
+    if(glm::dot(glm::vec3(p), neg) + p.w < 0.f)
+      result = CullIntersects;
+  }
+  return result;
+}
+
+// Only the corner furthest along each plane's normal matters for
+// rejection, and which corner that is depends on the plane alone. So
+// for each plane the right min or max array is picked up front and the
+// boxes themselves need no shuffling.
+void testAabbs(const Frustum& f, const float* const bounds[6], size_t count, uint8_t* visible)
+{
+  const float* corner[6][3];
+  for(int i = 0; i < 6; ++i) {
+    for(int a = 0; a < 3; ++a)
+      corner[i][a] = f.planes[i][a] >= 0.f ? bounds[a + 3] : bounds[a];
+  }
+
+  size_t i = 0;
+#ifdef SENSE_AVX
+  for(; i + 8 <= count; i += 8) {
+    __m256 outside = _mm256_setzero_ps();
+    for(int p = 0; p < 6; ++p) {
+      const glm::vec4& pl = f.planes[p];
+      __m256 d = _mm256_set1_ps(pl.w);
+      d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(pl.x), _mm256_loadu_ps(corner[p][0] + i)));
+      d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(pl.y), _mm256_loadu_ps(corner[p][1] + i)));
+      d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(pl.z), _mm256_loadu_ps(corner[p][2] + i)));
+      outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+    const int mask = _mm256_movemask_ps(outside);
+    for(int j = 0; j < 8; ++j)
+      visible[i + j] = !(mask & (1 << j));
+  }
+#endif
+#ifdef SENSE_SSE2
+  for(; i + 4 <= count; i += 4) {
+    __m128 outside = _mm_setzero_ps();
+    for(int p = 0; p < 6; ++p) {
+      const glm::vec4& pl = f.planes[p];
+      __m128 d = _mm_set1_ps(pl.w);
+      d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(pl.x), _mm_loadu_ps(corner[p][0] + i)));
+      d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(pl.y), _mm_loadu_ps(corner[p][1] + i)));
+      d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(pl.z), _mm_loadu_ps(corner[p][2] + i)));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_setzero_ps()));
+    }
+    const int mask = _mm_movemask_ps(outside);
+    for(int j = 0; j < 4; ++j)
+      visible[i + j] = !(mask & (1 << j));
+  }
+#endif
+  for(; i < count; ++i) {
+    bool outside = false;
+    for(int p = 0; p < 6 && !outside; ++p) {
+      const glm::vec4& pl = f.planes[p];
+      outside = pl.x * corner[p][0][i] + pl.y * corner[p][1][i] + pl.z * corner[p][2][i] + pl.w < 0.f;
+    }
+    visible[i] = !outside;
+  }
+}
@@ -0,0 +1,61 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SENSE_PIPELINE_CULLING_HPP
+#define SENSE_PIPELINE_CULLING_HPP
+
+#include "3rdparty/glm/glm.hpp"
+#include "Drawable.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+struct Aabb
+{
+  glm::vec3 min;
+  glm::vec3 max;
+};
+
+// Planes as (inward normal, distance), so a point is inside all of
+// them when dot(xyz, p) + w >= 0. Left, right, bottom, top, near, far.
+struct Frustum
+{
+  glm::vec4 planes[6];
+};
+
+// The volume the matrix maps onto GL's clip cube. The identity gives the
+// [-1, 1] cube itself, which is what draw transforms that go straight to
+// clip space need.
+Frustum frustumFromMatrix(const glm::mat4&);
+
+// Box around a mesh's bounds once transformed. Transforms with a
+// projection go through the divide; if the box crosses w = 0 it has no
+// finite bounds, and this returns false (count it as visible).
+bool transformBounds(const DrawableMesh::Bounds&, const glm::mat4&, Aabb&);
+
+enum CullResult {
+  CullOutside,
+  CullIntersects,
+  CullInside,
+};
+
+CullResult testAabb(const Frustum&, const Aabb&);
+
+// Test count boxes laid out as separate arrays of min x, y, z and max
+// x, y, z, setting visible[i] to 1 if box i touches the frustum and 0
+// if not. Does 8 boxes at a time with AVX, 4 with SSE2.
+void testAabbs(const Frustum&, const float* const bounds[6], size_t count, uint8_t* visible);
+
+#endif // SENSE_PIPELINE_CULLING_HPP
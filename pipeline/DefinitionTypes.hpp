@@ -15,6 +15,7 @@
 #ifndef SENSE_PIPELINE_DEFINITIONTYPES_HPP
 #define SENSE_PIPELINE_DEFINITIONTYPES_HPP
 
+#include <map>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -45,6 +46,10 @@ namespace std {
   };
 }
 
+// Preprocessor definitions for building a shader variant. Ordered, so
+// the same set always produces the same source text.
+typedef std::map<std::string, std::string> ShaderDefines;
+
 struct UniformDef {
   enum Type {
     Texture,
@@ -72,6 +77,7 @@ struct UniformDef {
 
 struct MaterialDef {
   ShaderKey shaders;
+  ShaderDefines defines; // applied to every stage
   std::unordered_map<std::string, UniformDef> uniforms;
 };
 
@@ -0,0 +1,44 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "DrawCommands.hpp"
+
+void DrawCommandList::begin(uint32_t instance_stride)
+{
+  m_commands.clear();
+  m_stride = instance_stride;
+}
+
+void DrawCommandList::add(uint32_t count, uint32_t first_index, int32_t base_vertex, uint32_t instance)
+{
+  if(!m_commands.empty()) {
+    DrawCommand& last = m_commands.back();
+    if(last.count == count && last.first_index == first_index && last.base_vertex == base_vertex) {
+      if(!m_stride)
+        return;
+      if(last.base_instance + last.instance_count * m_stride == instance) {
+        last.instance_count++;
+        return;
+      }
+    }
+  }
+  DrawCommand c;
+  c.count = count;
+  c.instance_count = 1;
+  c.first_index = first_index;
+  c.base_vertex = base_vertex;
+  c.base_instance = instance;
+  m_commands.push_back(c);
+}
@@ -0,0 +1,62 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SENSE_PIPELINE_DRAWCOMMANDS_HPP
+#define SENSE_PIPELINE_DRAWCOMMANDS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Same layout as GL's DrawElementsIndirectCommand, so a list of these
+// can go into an indirect buffer untouched.
+struct DrawCommand
+{
+  uint32_t count;
+  uint32_t instance_count;
+  uint32_t first_index;
+  int32_t base_vertex;
+  uint32_t base_instance;
+};
+
+// Builds the commands for one bucket of draws that share a program,
+// material and vertex buffers. Draws come in one instance at a time, in
+// the order their instance data was written.
+class DrawCommandList
+{
+public:
+  DrawCommandList() : m_stride(0) {}
+
+  // instance_stride is how far apart consecutive instances are in the
+  // instance buffer. 0 means the program has no per-instance data, so
+  // repeats of the same geometry are dropped instead of instanced.
+  void begin(uint32_t instance_stride);
+
+  // A draw of the index range [first_index, first_index + count) whose
+  // instance data starts at instance. It's folded into the previous
+  // command if that draws the same range and its instances run up to
+  // this one.
+  void add(uint32_t count, uint32_t first_index, int32_t base_vertex, uint32_t instance);
+
+  const std::vector<DrawCommand>& commands() const { return m_commands; }
+  size_t size() const { return m_commands.size(); }
+  bool empty() const { return m_commands.empty(); }
+
+private:
+  std::vector<DrawCommand> m_commands;
+  uint32_t m_stride;
+};
+
+#endif // SENSE_PIPELINE_DRAWCOMMANDS_HPP
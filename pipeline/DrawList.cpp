@@ -0,0 +1,155 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "DrawList.hpp"
+
+#include <algorithm>
+
+DrawList::DrawList()
+  : m_records(m_arena), m_keys(m_arena), m_transforms(m_arena), m_sorted_keys(0), m_sorted(true)
+{}
+
+uint64_t DrawList::makeKey(uint32_t pass, uint32_t program, uint32_t material, uint32_t mesh, uint32_t lod, uint32_t depth)
+{
+  return (uint64_t(pass & 0x7) << 61) |
+         (uint64_t(program & 0x7ff) << 50) |
+         (uint64_t(material & 0x3fff) << 36) |
+         (uint64_t(mesh & 0xffff) << 20) |
+         (uint64_t(lod & 0xf) << 16) |
+         uint64_t(depth & 0xffff);
+}
+
+uint32_t DrawList::depthBucket(const glm::mat4& transform)
+{
+  // the transforms go straight to clip space, so the translation
+  // column is where the object's origin ends up
+  const float w = transform[3][3];
+  float z = w > 0.f ? transform[3][2] / w : 1.f;
+  z = std::min(std::max(z * 0.5f + 0.5f, 0.f), 1.f);
+  return uint32_t(z * 65535.f);
+}
+
+void DrawList::add(uint64_t key, DrawableMesh* mesh, Material* mat, uint32_t lod, const glm::mat4& transform)
+{
+  Record r;
+  r.mesh = mesh;
+  r.mat = mat;
+  r.lod = lod;
+  r.transform_start = m_transforms.size();
+  r.transform_count = 1;
+  r.skinned = false;
+  m_transforms.push_back(transform);
+  SortKey k;
+  k.key = key;
+  k.index = m_records.size();
+  m_records.push_back(r);
+  m_keys.push_back(k);
+  m_sorted = false;
+}
+
+void DrawList::add(uint64_t key, DrawableMesh* mesh, Material* mat, uint32_t lod, const std::vector<glm::mat4>& transforms)
+{
+  Record r;
+  r.mesh = mesh;
+  r.mat = mat;
+  r.lod = lod;
+  r.transform_start = m_transforms.size();
+  r.transform_count = transforms.size();
+  r.skinned = true;
+  m_transforms.append(transforms.begin(), transforms.end());
+  SortKey k;
+  k.key = key;
+  k.index = m_records.size();
+  m_records.push_back(r);
+  m_keys.push_back(k);
+  m_sorted = false;
+}
+
+void DrawList::append(const DrawList& other)
+{
+  if(!other.size())
+    return;
+  const uint32_t record_base = m_records.size();
+  const uint32_t transform_base = m_transforms.size();
+  m_records.reserve(m_records.size() + other.m_records.size());
+  m_keys.reserve(m_keys.size() + other.m_keys.size());
+  for(size_t i = 0; i < other.m_records.size(); ++i) {
+    Record r = other.m_records[i];
+    r.transform_start += transform_base;
+    m_records.push_back(r);
+  }
+  // keys go in unsorted, in the other list's recording order
+  for(size_t i = 0; i < other.m_keys.size(); ++i) {
+    SortKey k = other.m_keys[i];
+    k.index += record_base;
+    m_keys.push_back(k);
+  }
+  m_transforms.append(other.m_transforms.data(), other.m_transforms.data() + other.m_transforms.size());
+  m_sorted = false;
+}
+
+void DrawList::setLod(size_t key_index, uint32_t lod)
+{
+  SortKey& k = m_sorted_keys[key_index];
+  m_records[k.index].lod = lod;
+  k.key = (k.key & ~(uint64_t(0xf) << 16)) | (uint64_t(lod & 0xf) << 16);
+}
+
+void DrawList::sort()
+{
+  if(m_sorted)
+    return;
+  SortKey* scratch = m_arena.allocate<SortKey>(m_keys.size());
+  m_sorted_keys = radixSort(m_keys.data(), scratch, m_keys.size());
+  m_sorted = true;
+}
+
+namespace {
+  bool keyLess(const SortKey& a, const SortKey& b) {
+    return a.key < b.key;
+  }
+}
+
+void DrawList::passRange(uint32_t pass, size_t& begin, size_t& end)
+{
+  sort();
+  SortKey lo, hi;
+  lo.key = makeKey(pass, 0, 0, 0, 0, 0);
+  hi.key = makeKey(pass + 1, 0, 0, 0, 0, 0);
+  const SortKey* first = m_sorted_keys;
+  const SortKey* last = m_sorted_keys + m_keys.size();
+  begin = std::lower_bound(first, last, lo, keyLess) - first;
+  // the last pass wraps around to 0 in the key, so it runs to the end
+  if(hi.key <= lo.key)
+    end = m_keys.size();
+  else
+    end = std::lower_bound(first + begin, last, hi, keyLess) - first;
+}
+
+void DrawList::clear()
+{
+  const size_t records = m_records.size();
+  const size_t transforms = m_transforms.size();
+  m_arena.reset();
+  m_records.clear();
+  m_keys.clear();
+  m_transforms.clear();
+  m_sorted_keys = 0;
+  m_sorted = true;
+  // frames tend to look like the last one; size for that up front so
+  // the arrays don't leave a trail of outgrown copies in the arena
+  m_records.reserve(records);
+  m_keys.reserve(records);
+  m_transforms.reserve(transforms);
+}
@@ -0,0 +1,99 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_PIPELINE_DRAWLIST_HPP
+#define SENSE_PIPELINE_DRAWLIST_HPP
+
+#include "3rdparty/glm/glm.hpp"
+#include "util/arena.hpp"
+#include "util/radix.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct DrawableMesh;
+struct Material;
+
+// One frame's worth of draws, kept flat and sorted by a packed 64-bit
+// key so the pipeline walks them with as few state changes as possible.
+// From the top bit down the key is:
+//
+//   pass:3 program:11 material:14 mesh:16 lod:4 depth:16
+//
+// Ids wider than their field are truncated. That only costs some
+// sorting quality; batching compares the real pointers.
+//
+// Everything lives in the list's own linearArena, so clear() is O(1)
+// and a list that's been through a frame or two doesn't allocate again
+// unless the scene grows.
+class DrawList
+{
+public:
+  struct Record
+  {
+    DrawableMesh* mesh;
+    Material* mat;
+    uint32_t lod;
+    uint32_t transform_start; // into transforms()
+    uint32_t transform_count; // 1, or the bone count for skinned draws
+    bool skinned;
+  };
+
+  DrawList();
+
+  static uint64_t makeKey(uint32_t pass, uint32_t program, uint32_t material, uint32_t mesh, uint32_t lod, uint32_t depth);
+  // Map a transform's clip-space origin depth into the depth field
+  static uint32_t depthBucket(const glm::mat4&);
+
+  void add(uint64_t key, DrawableMesh*, Material*, uint32_t lod, const glm::mat4& transform);
+  void add(uint64_t key, DrawableMesh*, Material*, uint32_t lod, const std::vector<glm::mat4>& transforms);
+
+  // Add every record of another list, keys and all. Lists recorded on
+  // separate threads get stitched together this way before sorting.
+  void append(const DrawList&);
+
+  // Change one record's lod, in its key too, without sorting again.
+  // The key only moves within its mesh's run, so like a stale depth
+  // that only costs some sorting quality.
+  void setLod(size_t key_index, uint32_t lod);
+
+  // Sort if anything was added since the last sort
+  void sort();
+  // Sorted keys for one pass, as [begin, end) indices into keys(). Sorts first.
+  void passRange(uint32_t pass, size_t& begin, size_t& end);
+
+  const SortKey* keys() const { return m_sorted_keys; }
+  const Record& record(size_t key_index) const { return m_records[m_sorted_keys[key_index].index]; }
+  const glm::mat4* transforms(const Record& r) const { return &m_transforms[r.transform_start]; }
+  size_t size() const { return m_records.size(); }
+
+  // Forget this frame's draws but keep the memory
+  void clear();
+  size_t memoryUsed() const { return m_arena.used(); }
+  size_t memoryReserved() const { return m_arena.capacity(); }
+
+private:
+  linearArena m_arena;
+  arenaArray<Record> m_records;
+  arenaArray<SortKey> m_keys;
+  arenaArray<glm::mat4> m_transforms;
+  SortKey* m_sorted_keys; // m_keys, or the radix sort's scratch space
+  bool m_sorted;
+
+  DrawList(const DrawList&);
+  DrawList& operator=(const DrawList&);
+};
+
+#endif // SENSE_PIPELINE_DRAWLIST_HPP
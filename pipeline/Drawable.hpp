@@ -15,6 +15,12 @@
 #ifndef SENSE_PIPELINE_DRAWABLE_HPP
 #define SENSE_PIPELINE_DRAWABLE_HPP
 
+#include "3rdparty/glm/glm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
 struct DrawableBuffer;
 
 struct DrawableMesh {
@@ -48,6 +54,12 @@ struct DrawableMesh {
     Integer,
   };
 
+  enum QuantFlags {
+    QuantPosition = 0x01, // UNORM16 positions, decoded with pos_scale and pos_bias
+    QuantOctNormal = 0x02, // 2-component octahedral normals
+    QuantOctTangent = 0x04, // 2-component octahedral tangents
+  };
+
   struct Attribute 
   {
     AttribType type;
@@ -57,15 +69,67 @@ struct DrawableMesh {
     AttribSpecial special;
   };
 
+  // Object-space bounds. The sphere isn't minimal, just a cheap fit around the box.
+  struct Bounds
+  {
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 center;
+    float radius;
+  };
+
+  // A contiguous range of the index list drawn with one material
+  struct Submesh
+  {
+    size_t index_start;
+    size_t index_count;
+    uint32_t material; // slot in the owner's material list
+    Bounds bounds;
+  };
+
+  // A level of detail is another range of the index list, indexing the
+  // same vertices. error is how far (object-space) it strays from the
+  // full detail mesh.
+  struct Lod
+  {
+    size_t index_start;
+    size_t index_count;
+    float error;
+  };
+
+  // A run of around a hundred neighbouring triangles of LOD 0, for
+  // culling the parts of a mesh that are out of view or face away (see
+  // mesh/Cluster.hpp). Every triangle's normal (going by counter-clockwise
+  // winding) is within the cone around cone_axis; cone_cos is the cosine
+  // of its half angle, or 0 if it's too wide to ever face away all at once.
+  struct Cluster
+  {
+    size_t index_start;
+    size_t index_count;
+    glm::vec3 center;
+    float radius;
+    glm::vec3 cone_axis;
+    float cone_cos;
+  };
+
   std::vector<Attribute> attributes;
   void* data;
   size_t data_size;
   size_t data_stride;
 
+  uint32_t quant_flags;
+  float pos_scale[3];
+  float pos_bias[3];
+
   void* index_data;
   size_t index_count;
   AttribType index_type;
 
+  std::vector<Submesh> submeshes; // index ranges are within LOD 0
+  std::vector<Lod> lods; // either empty, or LOD 0 (the full mesh) followed by coarser levels
+  std::vector<Cluster> clusters; // cover LOD 0 in index order, none crossing a submesh; may be empty
+  Bounds bounds;
+
   DrawableBuffer* buffer;
 
   size_t refcnt;
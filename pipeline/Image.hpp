@@ -31,6 +31,7 @@ struct Image
   Texture* tex;
 
   unsigned int width, height;
+  unsigned int mip_count; // levels stored in data, largest first and tightly packed
   bool pipe_build_mips;
 };
 
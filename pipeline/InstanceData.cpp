@@ -0,0 +1,120 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "InstanceData.hpp"
+#include "util/simd.hpp"
+
+#include <cmath>
+#include <cstring>
+
+size_t instanceTexels(InstanceFormat format)
+{
+  switch(format) {
+  case InstanceAffine:
+    return 3;
+  case InstanceQuat:
+    return 2;
+  default:
+    return 4;
+  }
+}
+
+void packInstances(InstanceFormat format, float* dst, const glm::mat4* src, size_t count)
+{
+  switch(format) {
+  case InstanceAffine:
+    packAffine(dst, src, count);
+    break;
+  case InstanceQuat:
+    packQuat(dst, src, count);
+    break;
+  default:
+    memcpy(dst, src, count * sizeof(glm::mat4));
+    break;
+  }
+}
+
+// glm is column major, so the rows we want are a transpose away
+void packAffine(float* dst, const glm::mat4* src, size_t count)
+{
+  for(size_t i = 0; i < count; ++i, dst += 12) {
+    const float* m = &src[i][0][0];
+#ifdef SENSE_SSE2
+    __m128 c0 = _mm_loadu_ps(m);
+    __m128 c1 = _mm_loadu_ps(m + 4);
+    __m128 c2 = _mm_loadu_ps(m + 8);
+    __m128 c3 = _mm_loadu_ps(m + 12);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    _mm_storeu_ps(dst, c0);
+    _mm_storeu_ps(dst + 4, c1);
+    _mm_storeu_ps(dst + 8, c2);
+#else
+    for(size_t r = 0; r < 3; ++r) {
+      for(size_t c = 0; c < 4; ++c)
+        dst[r * 4 + c] = m[c * 4 + r];
+    }
+#endif
+  }
+}
+
+// texel 0 is the rotation as (x, y, z, w), texel 1 is (translation, scale)
+void packQuat(float* dst, const glm::mat4* src, size_t count)
+{
+  for(size_t i = 0; i < count; ++i, dst += 8) {
+    const glm::mat4& m = src[i];
+    const float s = glm::length(glm::vec3(m[0]));
+    const float inv = s > 0.f ? 1.f / s : 0.f;
+    const glm::vec3 x = glm::vec3(m[0]) * inv;
+    const glm::vec3 y = glm::vec3(m[1]) * inv;
+    const glm::vec3 z = glm::vec3(m[2]) * inv;
+
+    // pick the largest component to divide by, so it stays stable
+    float q[4];
+    const float trace = x.x + y.y + z.z;
+    if(trace > 0.f) {
+      const float t = std::sqrt(trace + 1.f) * 2.f;
+      q[3] = 0.25f * t;
+      q[0] = (y.z - z.y) / t;
+      q[1] = (z.x - x.z) / t;
+      q[2] = (x.y - y.x) / t;
+    } else if(x.x > y.y && x.x > z.z) {
+      const float t = std::sqrt(1.f + x.x - y.y - z.z) * 2.f;
+      q[3] = (y.z - z.y) / t;
+      q[0] = 0.25f * t;
+      q[1] = (y.x + x.y) / t;
+      q[2] = (z.x + x.z) / t;
+    } else if(y.y > z.z) {
+      const float t = std::sqrt(1.f + y.y - x.x - z.z) * 2.f;
+      q[3] = (z.x - x.z) / t;
+      q[0] = (y.x + x.y) / t;
+      q[1] = 0.25f * t;
+      q[2] = (z.y + y.z) / t;
+    } else {
+      const float t = std::sqrt(1.f + z.z - x.x - y.y) * 2.f;
+      q[3] = (x.y - y.x) / t;
+      q[0] = (z.x + x.z) / t;
+      q[1] = (z.y + y.z) / t;
+      q[2] = 0.25f * t;
+    }
+    // renormalize so the shader doesn't have to
+    const float l = 1.f / std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for(size_t c = 0; c < 4; ++c)
+      dst[c] = q[c] * l;
+    dst[4] = m[3][0];
+    dst[5] = m[3][1];
+    dst[6] = m[3][2];
+    dst[7] = s;
+  }
+}
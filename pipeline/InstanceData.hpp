@@ -0,0 +1,42 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SENSE_PIPELINE_INSTANCEDATA_HPP
+#define SENSE_PIPELINE_INSTANCEDATA_HPP
+
+#include "3rdparty/glm/glm.hpp"
+
+#include <cstddef>
+
+// How a draw's model-view matrix is laid out in the instance buffer.
+// Each format is a whole number of 4-float texels per instance. Shaders
+// pick one by which decode function they call (see docs/shaders.rst).
+enum InstanceFormat
+{
+  InstanceMatrix, // full 4x4; 64 bytes. Needed if the transform has a projection in it
+  InstanceAffine, // top three rows, 48 bytes
+  InstanceQuat, // rotation, translation and uniform scale; 32 bytes
+};
+
+size_t instanceTexels(InstanceFormat);
+
+// Pack count matrices into dst, which needs instanceTexels() * 4
+// floats per matrix. The quaternion format assumes uniform scale and
+// no shear; anything else comes out as the nearest rotation.
+void packInstances(InstanceFormat, float* dst, const glm::mat4* src, size_t count);
+void packAffine(float* dst, const glm::mat4* src, size_t count);
+void packQuat(float* dst, const glm::mat4* src, size_t count);
+
+#endif // SENSE_PIPELINE_INSTANCEDATA_HPP
@@ -0,0 +1,41 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_PIPELINE_LAMP_HPP
+#define SENSE_PIPELINE_LAMP_HPP
+
+#include "3rdparty/glm/glm.hpp"
+
+// A light for the lighting pass (see Pipeline::addLamp). Positions and
+// directions are in the space draw transforms end up in, the one the
+// matrix given to Pipeline::setFrustum takes to clip space.
+struct Lamp
+{
+  enum Type {
+    Point,
+    Spot,
+  };
+
+  Type type;
+  glm::vec3 position;
+  glm::vec3 color; // linear, already scaled by intensity
+  float radius; // falls off to nothing here
+  // spots only
+  glm::vec3 direction; // unit length
+  float spot_cos; // cosine of the cone's half angle
+
+  Lamp() : type(Point), position(0.f), color(1.f), radius(1.f), direction(0.f, 0.f, -1.f), spot_cos(0.f) {}
+};
+
+#endif // SENSE_PIPELINE_LAMP_HPP
@@ -0,0 +1,312 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "LightGrid.hpp"
+#include "util/parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+const size_t LightGrid::max_lamps;
+const size_t LightGrid::lamp_texels;
+
+namespace {
+  // Views with infinite far planes still need somewhere to stop the
+  // slices; everything past this goes in the last one
+  const float max_depth_range = 10000.f;
+
+  // The sphere a lamp's light fits in. Spots narrower than 90 degrees
+  // get the smallest sphere around their cone, capped at the radius.
+  void lampSphere(const Lamp& l, glm::vec3& center, float& radius) {
+    center = l.position;
+    radius = l.radius;
+    if(l.type != Lamp::Spot || l.spot_cos <= 0.f)
+      return;
+    if(l.spot_cos < 0.70710678f) {
+      center += l.direction * (l.radius * l.spot_cos);
+      radius = l.radius * std::sqrt(1.f - l.spot_cos * l.spot_cos);
+    } else {
+      radius = l.radius / (2.f * l.spot_cos);
+      center += l.direction * radius;
+    }
+  }
+
+  uint16_t tileOf(double ndc, size_t tiles) {
+    const double t = std::floor((ndc + 1.) * 0.5 * tiles);
+    return uint16_t(std::min(std::max(t, 0.), double(tiles - 1)));
+  }
+}
+
+LightGrid::LightGrid(size_t tiles_x, size_t tiles_y, size_t slices)
+  : m_tiles_x(tiles_x), m_tiles_y(tiles_y), m_slices(slices),
+    m_slice_scale(0.f), m_slice_bias(0.f), m_near(0.f), m_far(0.f),
+    m_cells(tiles_x * tiles_y * slices * 2), m_culled(0),
+    m_spans(parallelSlots()), m_culled_slots(parallelSlots())
+{
+  if(!tiles_x || !tiles_y || !slices || slices > 0xffff || tiles_x > 0xffff || tiles_y > 0xffff)
+    throw std::runtime_error("Bad light grid size");
+}
+
+size_t LightGrid::slice(float w) const
+{
+  if(!(w > 0.f))
+    return 0;
+  const float s = std::floor(std::log(w) * m_slice_scale + m_slice_bias);
+  return size_t(std::min(std::max(s, 0.f), float(m_slices - 1)));
+}
+
+void LightGrid::build(const glm::mat4& view_projection, const std::vector<Lamp>& lamps, bool threaded)
+{
+  if(lamps.size() > max_lamps)
+    throw std::runtime_error("Too many lamps for the light grid");
+  m_matrix = view_projection;
+  m_frustum = frustumFromMatrix(view_projection);
+
+  // The ends of the frustum are where the points at normalized device
+  // z = -1 and 1 come from, and their clip w is one over the w those
+  // points have before the divide
+  const glm::mat4 inverse = glm::inverse(view_projection);
+  const float near_h = (inverse * glm::vec4(0.f, 0.f, -1.f, 1.f)).w;
+  const float far_h = (inverse * glm::vec4(0.f, 0.f, 1.f, 1.f)).w;
+  const glm::vec3 w_row(view_projection[0][3], view_projection[1][3], view_projection[2][3]);
+  m_near = near_h > 0.f ? 1.f / near_h : 0.f;
+  m_far = far_h > 0.f ? std::min(1.f / far_h, m_near * max_depth_range) : m_near * max_depth_range;
+  if(glm::dot(w_row, w_row) > 0.f && m_near > 0.f && m_far > m_near * 1.001f && std::isfinite(m_far)) {
+    m_slice_scale = m_slices / std::log(m_far / m_near);
+    m_slice_bias = -std::log(m_near) * m_slice_scale;
+    m_slice_w.resize(m_slices + 1);
+    for(size_t z = 0; z <= m_slices; ++z)
+      m_slice_w[z] = std::exp((z - m_slice_bias) / m_slice_scale);
+    // the ends reach all the way out
+    m_slice_w[0] = -INFINITY;
+    m_slice_w[m_slices] = INFINITY;
+  } else {
+    m_near = m_far = 0.f;
+    m_slice_scale = m_slice_bias = 0.f;
+  }
+
+  m_lamp_data.resize(lamps.size() * lamp_texels * 4);
+  for(size_t s = 0; s < m_spans.size(); ++s) {
+    m_spans[s].clear();
+    m_culled_slots[s] = 0;
+  }
+  auto binRange = [&](size_t slot, size_t begin, size_t end) {
+    binLamps(lamps, begin, end, m_spans[slot], m_culled_slots[slot]);
+  };
+  if(threaded)
+    parallelForSlots(lamps.size(), 256, binRange);
+  else
+    binRange(0, 0, lamps.size());
+
+  // Sort the spans by slice. Slots are in lamp order, and so are the
+  // spans within each, so lamps stay in order within a slice.
+  m_culled = 0;
+  m_slice_starts.assign(m_slices + 1, 0);
+  for(size_t s = 0; s < m_spans.size(); ++s) {
+    m_culled += m_culled_slots[s];
+    for(auto i = m_spans[s].begin(); i != m_spans[s].end(); ++i)
+      ++m_slice_starts[i->z + 1];
+  }
+  for(size_t z = 0; z < m_slices; ++z)
+    m_slice_starts[z + 1] += m_slice_starts[z];
+  m_sorted.resize(m_slice_starts[m_slices]);
+  std::vector<size_t> cursor(m_slice_starts.begin(), m_slice_starts.end() - 1);
+  for(size_t s = 0; s < m_spans.size(); ++s) {
+    for(auto i = m_spans[s].begin(); i != m_spans[s].end(); ++i)
+      m_sorted[cursor[i->z]++] = *i;
+  }
+
+  // Count the lamps in each cluster, lay the lists out one after the
+  // other, then fill them in. Slices are independent, so both of the
+  // passes over them go wide.
+  auto countRange = [this](size_t begin, size_t end) { fillSlices(begin, end, true); };
+  auto fillRange = [this](size_t begin, size_t end) { fillSlices(begin, end, false); };
+  if(threaded)
+    parallelFor(m_slices, 4, countRange);
+  else
+    countRange(0, m_slices);
+  uint32_t offset = 0;
+  for(size_t c = 0; c < clusterCount(); ++c) {
+    m_cells[c * 2] = offset;
+    offset += m_cells[c * 2 + 1];
+  }
+  m_indices.resize(offset);
+  if(threaded)
+    parallelFor(m_slices, 4, fillRange);
+  else
+    fillRange(0, m_slices);
+}
+
+void LightGrid::binLamps(const std::vector<Lamp>& lamps, size_t begin, size_t end, std::vector<Span>& spans, size_t& culled)
+{
+  const glm::vec3 w_row(m_matrix[0][3], m_matrix[1][3], m_matrix[2][3]);
+  const float w_len = std::sqrt(glm::dot(w_row, w_row));
+  const bool perspective = m_slice_scale != 0.f;
+
+  for(size_t i = begin; i < end; ++i) {
+    const Lamp& l = lamps[i];
+    float* data = &m_lamp_data[i * lamp_texels * 4];
+    const bool spot = l.type == Lamp::Spot;
+    const float packed[] = {
+      l.position.x, l.position.y, l.position.z, l.radius,
+      l.color.r, l.color.g, l.color.b, 0.f,
+      spot ? l.direction.x : 0.f, spot ? l.direction.y : 0.f, spot ? l.direction.z : 0.f, spot ? l.spot_cos : -1.f,
+    };
+    std::copy(packed, packed + lamp_texels * 4, data);
+
+    glm::vec3 center;
+    float radius;
+    lampSphere(l, center, radius);
+    // most lamps are nowhere near the view, and the planes are a much
+    // quicker way to find that out
+    bool outside = !(radius > 0.f);
+    for(int p = 0; p < 6 && !outside; ++p)
+      outside = glm::dot(glm::vec3(m_frustum.planes[p]), center) + m_frustum.planes[p].w < -radius * 1.001f;
+    glm::vec4 rect;
+    if(outside || !screenRect(center, radius, rect)) {
+      ++culled;
+      continue;
+    }
+
+    // Slices it reaches, going by the clip w of the sphere's nearest
+    // and furthest points
+    const float wc = glm::dot(w_row, center) + m_matrix[3][3];
+    const float dw = radius * w_len;
+    size_t z0 = 0, z1 = 0;
+    if(perspective) {
+      if(wc + dw < m_near || wc - dw > m_far) {
+        ++culled;
+        continue;
+      }
+      z0 = slice(std::max(wc - dw, m_near));
+      z1 = slice(wc + dw);
+    }
+
+    for(size_t z = z0; z <= z1; ++z) {
+      glm::vec4 r = rect;
+      if(z0 != z1) {
+        // Past the ends of the slice, the sphere is cut down to a cap,
+        // and the cap fits in a smaller sphere centered on the cut
+        const float lo = m_slice_w[z];
+        const float hi = m_slice_w[z + 1];
+        if(wc < lo || wc > hi) {
+          const float d = ((wc < lo ? lo : hi) - wc) / w_len;
+          const float cap2 = radius * radius - d * d;
+          if(cap2 <= 0.f)
+            continue;
+          glm::vec4 cap;
+          if(!screenRect(center + w_row * (d / w_len), std::sqrt(cap2), cap))
+            continue;
+          r = glm::vec4(std::max(r.x, cap.x), std::max(r.y, cap.y), std::min(r.z, cap.z), std::min(r.w, cap.w));
+        }
+      }
+      Span s;
+      s.lamp = i;
+      s.z = z;
+      s.x0 = tileOf(r.x, m_tiles_x);
+      s.y0 = tileOf(r.y, m_tiles_y);
+      s.x1 = tileOf(r.z, m_tiles_x);
+      s.y1 = tileOf(r.w, m_tiles_y);
+      spans.push_back(s);
+    }
+  }
+}
+
+// The normalized device x and y range a sphere covers, as (min x, min
+// y, max x, max y) clamped to the screen. False if it's entirely off
+// screen or outside the depth range.
+//
+// For each of x, y and z, the extremes of row . p / w . p over the
+// sphere are where a plane (row - t w) . p = 0 just touches it, which
+// is a quadratic in t. That has two roots as long as the sphere is in
+// front of the eye; otherwise the range is unbounded. The coefficients
+// cancel a lot for small, far away spheres, hence the doubles.
+bool LightGrid::screenRect(const glm::vec3& center, float radius, glm::vec4& rect) const
+{
+  const glm::dvec4 w_row(m_matrix[0][3], m_matrix[1][3], m_matrix[2][3], m_matrix[3][3]);
+  const glm::dvec3 c(center);
+  const double r2 = double(radius) * radius;
+  const double wc = glm::dot(glm::dvec3(w_row), c) + w_row.w;
+  const double a = wc * wc - r2 * glm::dot(glm::dvec3(w_row), glm::dvec3(w_row));
+  double lo[3], hi[3];
+  for(int axis = 0; axis < 3; ++axis) {
+    lo[axis] = -1.;
+    hi[axis] = 1.;
+    if(a <= 0.)
+      continue; // reaches behind the eye
+    const glm::dvec4 row(m_matrix[0][axis], m_matrix[1][axis], m_matrix[2][axis], m_matrix[3][axis]);
+    const double xc = glm::dot(glm::dvec3(row), c) + row.w;
+    const double b = xc * wc - r2 * glm::dot(glm::dvec3(row), glm::dvec3(w_row));
+    const double cc = xc * xc - r2 * glm::dot(glm::dvec3(row), glm::dvec3(row));
+    const double root = std::sqrt(std::max(b * b - a * cc, 0.));
+    const double t0 = (b - root) / a;
+    const double t1 = (b + root) / a;
+    if(t1 < -1. || t0 > 1.)
+      return false;
+    lo[axis] = std::max(t0, -1.);
+    hi[axis] = std::min(t1, 1.);
+  }
+  rect = glm::vec4(lo[0], lo[1], hi[0], hi[1]);
+  return true;
+}
+
+// Count (or, once the lists are laid out, fill in) the lamps of every
+// cluster in slices [begin, end). Counting marks the corners of each
+// rectangle and sums them up after, so it doesn't have to touch every
+// cluster a lamp covers.
+void LightGrid::fillSlices(size_t begin, size_t end, bool count)
+{
+  const size_t per_slice = m_tiles_x * m_tiles_y;
+  const size_t stride = m_tiles_x + 1;
+  std::vector<int32_t> corners;
+  for(size_t z = begin; z < end; ++z) {
+    uint32_t* cells = &m_cells[z * per_slice * 2];
+    if(count) {
+      corners.assign(stride * (m_tiles_y + 1), 0);
+      for(size_t i = m_slice_starts[z]; i < m_slice_starts[z + 1]; ++i) {
+        const Span& s = m_sorted[i];
+        ++corners[s.y0 * stride + s.x0];
+        --corners[s.y0 * stride + s.x1 + 1];
+        --corners[(s.y1 + 1) * stride + s.x0];
+        ++corners[(s.y1 + 1) * stride + s.x1 + 1];
+      }
+      for(size_t y = 0; y < m_tiles_y; ++y) {
+        int32_t row = 0;
+        for(size_t x = 0; x < m_tiles_x; ++x) {
+          row += corners[y * stride + x];
+          // the row below already has its sums, and they carry up
+          if(y)
+            corners[y * stride + x] = row + corners[(y - 1) * stride + x];
+          else
+            corners[y * stride + x] = row;
+          cells[(y * m_tiles_x + x) * 2 + 1] = corners[y * stride + x];
+        }
+      }
+      continue;
+    }
+
+    for(size_t c = 0; c < per_slice; ++c)
+      cells[c * 2 + 1] = 0;
+    for(size_t i = m_slice_starts[z]; i < m_slice_starts[z + 1]; ++i) {
+      const Span& s = m_sorted[i];
+      for(size_t y = s.y0; y <= s.y1; ++y) {
+        uint32_t* cell = cells + (y * m_tiles_x + s.x0) * 2;
+        uint16_t* out = &m_indices[0];
+        for(size_t x = s.x0; x <= s.x1; ++x, cell += 2)
+          out[cell[0] + cell[1]++] = s.lamp;
+      }
+    }
+  }
+}
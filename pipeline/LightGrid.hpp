@@ -0,0 +1,108 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_PIPELINE_LIGHTGRID_HPP
+#define SENSE_PIPELINE_LIGHTGRID_HPP
+
+#include "3rdparty/glm/glm.hpp"
+#include "Culling.hpp"
+#include "Lamp.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lamps binned into a grid of clusters over the view frustum, so the
+// lighting pass only looks at the lamps that can reach each pixel.
+//
+// Clusters are screen tiles in x and y, and slices of clip w (distance
+// along the view direction) spaced exponentially from the near plane to
+// the far one. Views without perspective have nothing to space slices
+// by, so they get a single slice and it's plain tiled lighting.
+//
+// Each lamp is bounded by a sphere, and each slice it touches gets the
+// exact screen rectangle of the part of that sphere within the slice.
+// The lists are built in lamp order, so the same lamps always give the
+// same lists.
+class LightGrid
+{
+public:
+  // Index lists are 16 bits
+  static const size_t max_lamps = 0x10000;
+  // Each lamp takes this many RGBA32F texels in lampData():
+  // position and radius; color; spot direction and cosine
+  static const size_t lamp_texels = 3;
+
+  LightGrid(size_t tiles_x=16, size_t tiles_y=8, size_t slices=24);
+
+  // Bin lamps for a view. The matrix takes lamp space to clip space, as
+  // for Pipeline::setFrustum. Lamps are binned in parallel unless
+  // threaded is false.
+  void build(const glm::mat4& view_projection, const std::vector<Lamp>&, bool threaded=true);
+
+  size_t tilesX() const { return m_tiles_x; }
+  size_t tilesY() const { return m_tiles_y; }
+  size_t slices() const { return m_slices; }
+  size_t clusterCount() const { return m_tiles_x * m_tiles_y * m_slices; }
+  // Cluster (x, y, z) is at (z * tilesY() + y) * tilesX() + x. Tiles go
+  // left to right and bottom to top across normalized device coordinates.
+  size_t cluster(size_t x, size_t y, size_t z) const { return (z * m_tiles_y + y) * m_tiles_x + x; }
+  // The slice a clip w falls in is log(w) * scale + bias, clamped to
+  // the grid
+  float sliceScale() const { return m_slice_scale; }
+  float sliceBias() const { return m_slice_bias; }
+  size_t slice(float w) const;
+
+  // First entry of indices() and count, for each cluster
+  const std::vector<uint32_t>& cells() const { return m_cells; }
+  const std::vector<uint16_t>& indices() const { return m_indices; }
+  const std::vector<float>& lampData() const { return m_lamp_data; }
+  // Lamps that didn't touch the view at all in the last build
+  size_t culledLamps() const { return m_culled; }
+
+private:
+  // A lamp's screen rectangle in one slice, in tiles, inclusive
+  struct Span
+  {
+    uint32_t lamp;
+    uint16_t z;
+    uint16_t x0, y0, x1, y1;
+  };
+
+  size_t m_tiles_x;
+  size_t m_tiles_y;
+  size_t m_slices;
+  float m_slice_scale;
+  float m_slice_bias;
+  float m_near, m_far; // clip w at either end, for views with perspective
+  std::vector<float> m_slice_w; // where each slice starts, and the last one ends
+  glm::mat4 m_matrix;
+  Frustum m_frustum;
+
+  std::vector<uint32_t> m_cells;
+  std::vector<uint16_t> m_indices;
+  std::vector<float> m_lamp_data;
+  size_t m_culled;
+
+  std::vector<std::vector<Span> > m_spans; // per thread slot
+  std::vector<size_t> m_culled_slots;
+  std::vector<Span> m_sorted; // by slice, then lamp
+  std::vector<size_t> m_slice_starts;
+
+  void binLamps(const std::vector<Lamp>&, size_t begin, size_t end, std::vector<Span>&, size_t& culled);
+  bool screenRect(const glm::vec3& center, float radius, glm::vec4& rect) const;
+  void fillSlices(size_t begin, size_t end, bool count);
+};
+
+#endif // SENSE_PIPELINE_LIGHTGRID_HPP
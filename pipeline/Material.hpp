@@ -18,9 +18,11 @@
 #include "DefinitionTypes.hpp"
 
 struct ShaderProgram;
+struct MaterialBindings;
 
 struct Uniform
 {
+  std::string name;
   UniformDef::Type type;
   boost::any value;
   boost::any pipe_id;
@@ -30,7 +32,12 @@ struct Material
 {
   ShaderProgram* shaders;
   std::vector<Uniform> uniforms;
+  // The uniforms baked down for the pipeline (see Loader::compileBindings).
+  // This is all the renderer looks at; it carries its own program so it
+  // can be swapped in one go.
+  MaterialBindings* bindings;
   uint32_t refcnt;
+  uint32_t id; // small and unique, for draw sorting
 };
 
 
@@ -0,0 +1,304 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Occlusion.hpp"
+#include "mesh/Occluder.hpp"
+#include "util/parallel.hpp"
+#include "util/simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+const size_t OcclusionBuffer::tile_width;
+const size_t OcclusionBuffer::tile_height;
+
+namespace {
+  const uint32_t full_tile = 0xffffffffu;
+
+  // Coverage bit for pixel (x, y) of a tile is y * 8 + x, so rows
+  // first to last (inclusive) of a tile are these bits
+  const uint32_t row_bits[4][4] = {
+    {0x000000ffu, 0x0000ffffu, 0x00ffffffu, 0xffffffffu},
+    {0, 0x0000ff00u, 0x00ffff00u, 0xffffff00u},
+    {0, 0, 0x00ff0000u, 0xffff0000u},
+    {0, 0, 0, 0xff000000u},
+  };
+}
+
+OcclusionBuffer::OcclusionBuffer(size_t width, size_t height)
+  : m_tiles_x((width + tile_width - 1) / tile_width),
+    m_tiles_y((height + tile_height - 1) / tile_height),
+    m_z0(m_tiles_x * m_tiles_y),
+    m_z1(m_tiles_x * m_tiles_y),
+    m_mask(m_tiles_x * m_tiles_y),
+    m_triangles(parallelSlots())
+{
+  clear();
+}
+
+void OcclusionBuffer::clear()
+{
+  std::fill(m_z0.begin(), m_z0.end(), 1.f);
+  std::fill(m_z1.begin(), m_z1.end(), 0.f);
+  std::fill(m_mask.begin(), m_mask.end(), 0);
+  m_occluders.clear();
+}
+
+void OcclusionBuffer::addOccluder(const OccluderMesh* mesh, const glm::mat4& transform)
+{
+  if(mesh->indices.empty())
+    return;
+  Occluder o;
+  o.mesh = mesh;
+  o.transform = transform;
+  m_occluders.push_back(o);
+}
+
+void OcclusionBuffer::rasterize(bool threaded)
+{
+  for(auto i = m_triangles.begin(); i != m_triangles.end(); ++i)
+    i->clear();
+
+  auto setupRange = [this](size_t slot, size_t begin, size_t end) {
+    std::vector<glm::vec4> clip;
+    for(size_t i = begin; i < end; ++i)
+      setup(m_occluders[i], clip, m_triangles[slot]);
+  };
+  auto drawRange = [this](size_t begin, size_t end) {
+    drawRows(begin, end);
+  };
+  if(threaded) {
+    parallelForSlots(m_occluders.size(), 16, setupRange);
+    parallelFor(m_tiles_y, 2, drawRange);
+  } else {
+    setupRange(0, 0, m_occluders.size());
+    drawRange(0, m_tiles_y);
+  }
+}
+
+size_t OcclusionBuffer::triangles() const
+{
+  size_t count = 0;
+  for(auto i = m_triangles.begin(); i != m_triangles.end(); ++i)
+    count += i->size();
+  return count;
+}
+
+void OcclusionBuffer::setup(const Occluder& o, std::vector<glm::vec4>& clip, std::vector<Triangle>& out) const
+{
+  const OccluderMesh& m = *o.mesh;
+  clip.resize(m.positions.size());
+  for(size_t i = 0; i < clip.size(); ++i)
+    clip[i] = o.transform * glm::vec4(m.positions[i], 1.f);
+
+  const float w = float(width());
+  const float h = float(height());
+  for(size_t i = 0; i + 2 < m.indices.size(); i += 3) {
+    glm::vec3 p[3];
+    bool clipped = false;
+    for(int v = 0; v < 3 && !clipped; ++v) {
+      const glm::vec4& c = clip[m.indices[i + v]];
+      // The GPU clips anything in front of the near plane, so that part
+      // hides nothing. Rather than clip, leave the whole triangle out.
+      clipped = c.w <= 1e-6f || c.z < -c.w;
+      const float inv = 1.f / c.w;
+      p[v] = glm::vec3((c.x * inv * 0.5f + 0.5f) * w, (c.y * inv * 0.5f + 0.5f) * h, c.z * inv * 0.5f + 0.5f);
+    }
+    if(clipped)
+      continue;
+
+    // either winding will do
+    double area = double(p[1].x - p[0].x) * (p[2].y - p[0].y) - double(p[2].x - p[0].x) * (p[1].y - p[0].y);
+    if(!(std::abs(area) > 1e-8))
+      continue;
+    if(area < 0.) {
+      std::swap(p[1], p[2]);
+      area = -area;
+    }
+
+    Triangle t;
+    t.x0 = std::max(int32_t(std::floor(std::min(std::min(p[0].x, p[1].x), p[2].x))), 0);
+    t.y0 = std::max(int32_t(std::floor(std::min(std::min(p[0].y, p[1].y), p[2].y))), 0);
+    t.x1 = std::min(int32_t(std::ceil(std::max(std::max(p[0].x, p[1].x), p[2].x))), int32_t(width()));
+    t.y1 = std::min(int32_t(std::ceil(std::max(std::max(p[0].y, p[1].y), p[2].y))), int32_t(height()));
+    const float zmin = std::min(std::min(p[0].z, p[1].z), p[2].z);
+    if(t.x0 >= t.x1 || t.y0 >= t.y1 || zmin >= 1.f)
+      continue;
+    t.zmax = std::max(std::max(p[0].z, p[1].z), p[2].z);
+
+    for(int e = 0; e < 3; ++e) {
+      const glm::vec3& a = p[e];
+      const glm::vec3& b = p[(e + 1) % 3];
+      t.a[e] = a.y - b.y;
+      t.b[e] = b.x - a.x;
+      t.c[e] = double(a.x) * b.y - double(a.y) * b.x;
+    }
+    const double dz1 = p[1].z - p[0].z;
+    const double dz2 = p[2].z - p[0].z;
+    t.dzdx = (dz1 * (p[2].y - p[0].y) - dz2 * (p[1].y - p[0].y)) / area;
+    t.dzdy = (dz2 * (p[1].x - p[0].x) - dz1 * (p[2].x - p[0].x)) / area;
+    t.z0 = p[0].z - t.dzdx * p[0].x - t.dzdy * p[0].y;
+    out.push_back(t);
+  }
+}
+
+void OcclusionBuffer::drawRows(size_t begin, size_t end)
+{
+  for(auto s = m_triangles.begin(); s != m_triangles.end(); ++s) {
+    for(auto t = s->begin(); t != s->end(); ++t) {
+      const size_t ty0 = std::max(size_t(t->y0) / tile_height, begin);
+      const size_t ty1 = std::min((size_t(t->y1) + tile_height - 1) / tile_height, end);
+      const size_t tx0 = size_t(t->x0) / tile_width;
+      const size_t tx1 = (size_t(t->x1) + tile_width - 1) / tile_width;
+      for(size_t ty = ty0; ty < ty1; ++ty) {
+        for(size_t tx = tx0; tx < tx1; ++tx)
+          drawTile(*t, tx, ty);
+      }
+    }
+  }
+}
+
+void OcclusionBuffer::drawTile(const Triangle& t, size_t tx, size_t ty)
+{
+  const size_t tile = ty * m_tiles_x + tx;
+  const int32_t px = int32_t(tx * tile_width);
+  const int32_t py = int32_t(ty * tile_height);
+
+  // Depth is linear over the triangle, so the farthest it gets over the
+  // pixels it can cover here is at a corner of their bounds
+  const int32_t rx0 = std::max(px, t.x0);
+  const int32_t ry0 = std::max(py, t.y0);
+  const int32_t rx1 = std::min(px + int32_t(tile_width), t.x1);
+  const int32_t ry1 = std::min(py + int32_t(tile_height), t.y1);
+  double deepest = t.z0 + t.dzdx * rx0 + t.dzdy * ry0;
+  deepest += std::max(t.dzdx * (rx1 - rx0), 0.) + std::max(t.dzdy * (ry1 - ry0), 0.);
+  const float z = std::min(float(deepest), t.zmax);
+  if(z >= m_z0[tile])
+    return;
+
+  // which pixel centers are inside all three edges
+  uint32_t cover = full_tile;
+  for(int e = 0; e < 3; ++e) {
+    const float a = t.a[e];
+    const float b = t.b[e];
+    float row = float(t.a[e] * double(px) + t.b[e] * (double(py) + 0.5) + t.c[e]);
+    uint32_t inside = 0;
+#ifdef SENSE_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 step = _mm_set1_ps(b);
+    __m128 lo = _mm_add_ps(_mm_set1_ps(row), _mm_mul_ps(_mm_set1_ps(a), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f)));
+    __m128 hi = _mm_add_ps(_mm_set1_ps(row), _mm_mul_ps(_mm_set1_ps(a), _mm_setr_ps(4.5f, 5.5f, 6.5f, 7.5f)));
+    for(size_t r = 0; r < tile_height; ++r) {
+      const uint32_t bits = _mm_movemask_ps(_mm_cmpgt_ps(lo, zero)) | (_mm_movemask_ps(_mm_cmpgt_ps(hi, zero)) << 4);
+      inside |= bits << (r * 8);
+      lo = _mm_add_ps(lo, step);
+      hi = _mm_add_ps(hi, step);
+    }
+#else
+    for(size_t r = 0; r < tile_height; ++r, row += b) {
+      for(size_t x = 0; x < tile_width; ++x) {
+        if(row + a * (x + 0.5f) > 0.f)
+          inside |= 1u << (r * 8 + x);
+      }
+    }
+#endif
+    cover &= inside;
+    if(!cover)
+      return;
+  }
+
+  float& z0 = m_z0[tile];
+  float& z1 = m_z1[tile];
+  uint32_t& mask = m_mask[tile];
+  if(cover == full_tile) {
+    // covers the whole tile by itself; what was in the mask is only
+    // worth keeping if it's nearer still
+    z0 = z;
+    if(z1 >= z0) {
+      mask = 0;
+      z1 = 0.f;
+    }
+    return;
+  }
+  mask |= cover;
+  z1 = std::max(z1, z);
+  if(mask == full_tile) {
+    z0 = z1;
+    mask = 0;
+    z1 = 0.f;
+  }
+}
+
+bool OcclusionBuffer::testAabb(const Aabb& box) const
+{
+  if(box.min.z < -1.f)
+    return true;
+  const float w = float(width());
+  const float h = float(height());
+  const float fx0 = (box.min.x * 0.5f + 0.5f) * w;
+  const float fx1 = (box.max.x * 0.5f + 0.5f) * w;
+  const float fy0 = (box.min.y * 0.5f + 0.5f) * h;
+  const float fy1 = (box.max.y * 0.5f + 0.5f) * h;
+  if(fx1 < 0.f || fy1 < 0.f || fx0 >= w || fy0 >= h)
+    return false;
+  // every pixel the box touches, inclusive
+  const int32_t x0 = int32_t(std::max(fx0, 0.f));
+  const int32_t y0 = int32_t(std::max(fy0, 0.f));
+  const int32_t x1 = std::min(int32_t(fx1), int32_t(width()) - 1);
+  const int32_t y1 = std::min(int32_t(fy1), int32_t(height()) - 1);
+  const float z = box.min.z * 0.5f + 0.5f;
+
+  const int32_t tx0 = x0 / tile_width, tx1 = x1 / tile_width;
+  const int32_t ty0 = y0 / tile_height, ty1 = y1 / tile_height;
+  for(int32_t ty = ty0; ty <= ty1; ++ty) {
+    const int32_t first_row = ty == ty0 ? y0 % tile_height : 0;
+    const int32_t last_row = ty == ty1 ? y1 % tile_height : tile_height - 1;
+    const uint32_t rows = row_bits[first_row][last_row];
+    const float* z0 = &m_z0[ty * m_tiles_x];
+    int32_t tx = tx0;
+#ifdef SENSE_SSE2
+    // skip past runs of tiles that are all nearer than the box
+    const __m128 box_z = _mm_set1_ps(z);
+    while(tx + 4 <= tx1 + 1 && !_mm_movemask_ps(_mm_cmplt_ps(box_z, _mm_loadu_ps(z0 + tx))))
+      tx += 4;
+#endif
+    for(; tx <= tx1; ++tx) {
+      if(z >= z0[tx])
+        continue;
+      // nearer than z0, so it shows unless everything it touches here
+      // is in the mask, and nearer than z1 too
+      const int32_t first_col = tx == tx0 ? x0 % tile_width : 0;
+      const int32_t last_col = tx == tx1 ? x1 % tile_width : tile_width - 1;
+      const uint32_t cols = (0xffu >> (tile_width - 1 - last_col)) & (0xffu << first_col);
+      const size_t tile = ty * m_tiles_x + tx;
+      if((cols * rows) & ~m_mask[tile])
+        return true;
+      if(z < m_z1[tile])
+        return true;
+    }
+  }
+  return false;
+}
+
+void OcclusionBuffer::depthImage(std::vector<float>& out) const
+{
+  out.resize(width() * height());
+  for(size_t y = 0; y < height(); ++y) {
+    for(size_t x = 0; x < width(); ++x) {
+      const size_t tile = (y / tile_height) * m_tiles_x + x / tile_width;
+      const uint32_t bit = 1u << ((y % tile_height) * tile_width + x % tile_width);
+      out[y * width() + x] = (m_mask[tile] & bit) ? m_z1[tile] : m_z0[tile];
+    }
+  }
+}
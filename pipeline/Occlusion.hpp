@@ -0,0 +1,105 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_PIPELINE_OCCLUSION_HPP
+#define SENSE_PIPELINE_OCCLUSION_HPP
+
+#include "3rdparty/glm/glm.hpp"
+#include "Culling.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct OccluderMesh;
+
+// A small depth buffer rasterized on the CPU, for throwing out draws
+// that are hidden behind big occluders before they are submitted.
+//
+// It's kept in tiles of 8x4 pixels. Rather than a depth per pixel, a
+// tile has a coverage mask and two depths: every pixel is covered by
+// something at least as near as z0, and the pixels in the mask by
+// something at least as near as z1. Triangles only raise z1 and add to
+// the mask, and when the mask fills up z1 becomes the new z0. That
+// loses some detail compared to a real depth buffer, but it only ever
+// errs on the far side, so nothing visible gets culled; and testing a
+// box against a tile mostly needs just z0. Depth is normalized device
+// z mapped to [0, 1], with 1 far, and rows go bottom to top.
+class OcclusionBuffer
+{
+public:
+  static const size_t tile_width = 8;
+  static const size_t tile_height = 4;
+
+  // Rounded up to whole tiles
+  OcclusionBuffer(size_t width=256, size_t height=128);
+
+  size_t width() const { return m_tiles_x * tile_width; }
+  size_t height() const { return m_tiles_y * tile_height; }
+
+  // Forget the queued occluders and reset the depth to far
+  void clear();
+  // Queue an occluder drawn with transform (all the way to clip space).
+  // The mesh has to stay around until rasterize() is done with it.
+  void addOccluder(const OccluderMesh*, const glm::mat4& transform);
+  // Set up and draw everything queued since clear(). Both steps are
+  // split across threads unless threaded is false; the drawing goes by
+  // bands of tile rows, so threads never share a tile.
+  void rasterize(bool threaded=true);
+
+  // Whether any of a box in normalized device coordinates could be in
+  // front of the occluders. Boxes crossing the near plane always are.
+  bool testAabb(const Aabb&) const;
+
+  // The depth each pixel is known to be covered at, width() * height()
+  // values. For comparing against a reference rasterizer.
+  void depthImage(std::vector<float>&) const;
+
+  // Triangles that made it through setup in the last rasterize()
+  size_t triangles() const;
+
+private:
+  struct Occluder
+  {
+    const OccluderMesh* mesh;
+    glm::mat4 transform;
+  };
+
+  // A triangle after setup, wound so the edge functions are positive
+  // inside. Edge constants are doubles so triangles reaching far off
+  // screen keep their precision; each tile steps from there in floats.
+  struct Triangle
+  {
+    float a[3], b[3];
+    double c[3];
+    double z0, dzdx, dzdy; // depth plane, from pixel (0, 0)
+    float zmax;
+    int32_t x0, y0, x1, y1; // pixel bounds, exclusive at the top
+  };
+
+  size_t m_tiles_x;
+  size_t m_tiles_y;
+  std::vector<float> m_z0;
+  std::vector<float> m_z1;
+  std::vector<uint32_t> m_mask;
+
+  std::vector<Occluder> m_occluders;
+  std::vector<std::vector<Triangle> > m_triangles; // per thread slot
+
+  void setup(const Occluder&, std::vector<glm::vec4>& clip, std::vector<Triangle>&) const;
+  void drawRows(size_t begin, size_t end);
+  void drawTile(const Triangle&, size_t tx, size_t ty);
+};
+
+#endif // SENSE_PIPELINE_OCCLUSION_HPP
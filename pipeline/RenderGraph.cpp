@@ -0,0 +1,224 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "RenderGraph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+const uint32_t RenderGraph::none;
+
+RenderGraph::RenderGraph()
+  : m_compiled(false)
+{
+}
+
+void RenderGraph::clear()
+{
+  m_passes.clear();
+  m_targets.clear();
+  m_versions.clear();
+  m_schedule.clear();
+  m_physical.clear();
+  m_compiled = false;
+}
+
+RenderGraph::Handle RenderGraph::createTarget(const std::string& name, const TargetDesc& desc)
+{
+  return addTarget(name, desc, false);
+}
+
+RenderGraph::Handle RenderGraph::importTarget(const std::string& name)
+{
+  return addTarget(name, TargetDesc(), true);
+}
+
+RenderGraph::Handle RenderGraph::addTarget(const std::string& name, const TargetDesc& desc, bool imported)
+{
+  Target t;
+  t.name = name;
+  t.desc = desc;
+  t.imported = imported;
+  t.latest = m_versions.size();
+  t.first = t.last = none;
+  t.physical = none;
+  Version v;
+  v.target = m_targets.size();
+  v.writer = none;
+  m_targets.push_back(t);
+  m_versions.push_back(v);
+  m_compiled = false;
+  return t.latest;
+}
+
+RenderGraph::PassId RenderGraph::addPass(const std::string& name, const Execute& execute)
+{
+  Pass p;
+  p.name = name;
+  p.execute = execute;
+  p.keep = false;
+  p.live = false;
+  p.position = none;
+  m_passes.push_back(p);
+  m_compiled = false;
+  return m_passes.size() - 1;
+}
+
+void RenderGraph::checkPass(PassId p) const
+{
+  if(p >= m_passes.size())
+    throw std::runtime_error("RenderGraph: bad pass id");
+}
+
+void RenderGraph::checkHandle(Handle h) const
+{
+  if(h >= m_versions.size())
+    throw std::runtime_error("RenderGraph: bad target handle");
+}
+
+void RenderGraph::read(PassId p, Handle h)
+{
+  checkPass(p);
+  checkHandle(h);
+  const Version& v = m_versions[h];
+  // passes only ever look back, so the order they were added in is
+  // already a valid order to run them in
+  if(v.writer != none && v.writer >= p)
+    throw std::runtime_error("RenderGraph: pass " + m_passes[p].name + " reads " + m_targets[v.target].name + " from a later pass");
+  m_passes[p].reads.push_back(h);
+  m_compiled = false;
+}
+
+RenderGraph::Handle RenderGraph::write(PassId p, Handle h)
+{
+  checkPass(p);
+  checkHandle(h);
+  Target& t = m_targets[m_versions[h].target];
+  if(t.latest != h)
+    throw std::runtime_error("RenderGraph: pass " + m_passes[p].name + " writes an old version of " + t.name);
+  if(m_versions[h].writer != none && m_versions[h].writer > p)
+    throw std::runtime_error("RenderGraph: pass " + m_passes[p].name + " writes " + t.name + " before a later pass");
+  Version v;
+  v.target = m_versions[h].target;
+  v.writer = p;
+  t.latest = m_versions.size();
+  m_versions.push_back(v);
+  m_passes[p].writes.push_back(t.latest);
+  m_compiled = false;
+  return t.latest;
+}
+
+RenderGraph::Handle RenderGraph::modify(PassId p, Handle h)
+{
+  read(p, h);
+  return write(p, h);
+}
+
+void RenderGraph::keep(PassId p)
+{
+  checkPass(p);
+  m_passes[p].keep = true;
+  m_compiled = false;
+}
+
+void RenderGraph::compile()
+{
+  // Passes that touch the outside world are the roots. Walking back
+  // from the last pass, anything a live pass reads from is live too.
+  for(size_t i = 0; i < m_passes.size(); ++i) {
+    Pass& p = m_passes[i];
+    p.live = p.keep;
+    for(size_t w = 0; w < p.writes.size() && !p.live; ++w)
+      p.live = m_targets[m_versions[p.writes[w]].target].imported;
+  }
+  for(size_t i = m_passes.size(); i-- > 0;) {
+    const Pass& p = m_passes[i];
+    if(!p.live)
+      continue;
+    for(size_t r = 0; r < p.reads.size(); ++r) {
+      const PassId writer = m_versions[p.reads[r]].writer;
+      if(writer != none)
+        m_passes[writer].live = true;
+    }
+  }
+
+  m_schedule.clear();
+  for(size_t i = 0; i < m_passes.size(); ++i) {
+    if(m_passes[i].live) {
+      m_passes[i].position = m_schedule.size();
+      m_schedule.push_back(i);
+    }
+  }
+  for(size_t i = m_passes.size(), next = m_schedule.size(); i-- > 0;) {
+    if(m_passes[i].live)
+      next = m_passes[i].position;
+    else
+      m_passes[i].position = next;
+  }
+
+  // lifetimes, in schedule positions
+  for(size_t i = 0; i < m_targets.size(); ++i) {
+    m_targets[i].first = m_targets[i].last = none;
+    m_targets[i].physical = none;
+  }
+  for(size_t s = 0; s < m_schedule.size(); ++s) {
+    const Pass& p = m_passes[m_schedule[s]];
+    for(size_t k = 0; k < p.reads.size() + p.writes.size(); ++k) {
+      const Handle h = k < p.reads.size() ? p.reads[k] : p.writes[k - p.reads.size()];
+      Target& t = m_targets[m_versions[h].target];
+      if(t.first == none)
+        t.first = s;
+      t.last = s;
+    }
+  }
+
+  // Hand out slots in order of first use. A slot can be reused once the
+  // last pass using it has run, by a target that looks the same.
+  m_order.clear();
+  for(size_t i = 0; i < m_targets.size(); ++i) {
+    if(!m_targets[i].imported && m_targets[i].first != none)
+      m_order.push_back(i);
+  }
+  std::stable_sort(m_order.begin(), m_order.end(), [this](TargetId a, TargetId b) {
+      return m_targets[a].first < m_targets[b].first;
+    });
+  m_physical.clear();
+  for(size_t i = 0; i < m_order.size(); ++i) {
+    Target& t = m_targets[m_order[i]];
+    size_t slot = 0;
+    while(slot < m_physical.size() && (m_physical[slot].desc != t.desc || m_physical[slot].last >= t.first))
+      ++slot;
+    if(slot == m_physical.size()) {
+      Slot s;
+      s.desc = t.desc;
+      m_physical.push_back(s);
+    }
+    m_physical[slot].last = t.last;
+    t.physical = slot;
+  }
+  m_compiled = true;
+}
+
+void RenderGraph::execute(size_t begin, size_t end)
+{
+  if(!m_compiled)
+    throw std::runtime_error("RenderGraph: executed without compiling");
+  end = std::min(end, m_schedule.size());
+  for(size_t i = begin; i < end; ++i) {
+    const Pass& p = m_passes[m_schedule[i]];
+    if(p.execute)
+      p.execute();
+  }
+}
@@ -0,0 +1,163 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_PIPELINE_RENDERGRAPH_HPP
+#define SENSE_PIPELINE_RENDERGRAPH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The passes of a frame and the targets they draw to, declared up front
+// and compiled before anything runs. Knows nothing about GL: the
+// pipeline builds one of these every frame, and makes textures for
+// whatever physical slots compile() hands out.
+//
+// Every write makes a new version of its target, and passes read
+// versions, so the order passes are added in is the order things
+// happen in. Passes that nothing live reads from are culled. Live
+// passes are the ones that touch an imported target (something that
+// outlives the frame, like the screen) or are kept explicitly, plus
+// everything they read from. Transient targets only need to exist from
+// the first live pass that uses them to the last, and ones with the
+// same description whose lifetimes don't overlap share a slot.
+class RenderGraph
+{
+public:
+  typedef uint32_t PassId;
+  typedef uint32_t TargetId;
+  typedef uint32_t Handle; // a version of a target
+  static const uint32_t none = uint32_t(-1);
+
+  enum Format {
+    RGBA8,
+    RG16F,
+    RGBA16F,
+    Depth24Stencil8
+  };
+
+  struct TargetDesc
+  {
+    uint32_t width, height;
+    Format format;
+    uint32_t samples;
+
+    TargetDesc() : width(0), height(0), format(RGBA8), samples(1) {}
+    TargetDesc(uint32_t w, uint32_t h, Format f, uint32_t s=1) : width(w), height(h), format(f), samples(s) {}
+    bool operator==(const TargetDesc& o) const {
+      return width == o.width && height == o.height && format == o.format && samples == o.samples;
+    }
+    bool operator!=(const TargetDesc& o) const { return !(*this == o); }
+  };
+
+  typedef std::function<void()> Execute;
+
+  RenderGraph();
+
+  // Forget every pass and target
+  void clear();
+
+  // Targets come back as a handle to their first version. What's in a
+  // transient target before the first write is undefined.
+  Handle createTarget(const std::string& name, const TargetDesc&);
+  Handle importTarget(const std::string& name);
+
+  PassId addPass(const std::string& name, const Execute& execute=Execute());
+  void read(PassId, Handle);
+  // Overwrite a target, returning the version later passes should use.
+  // Only the latest version of a target can be written.
+  Handle write(PassId, Handle);
+  // Same, but the pass draws on top of what's there, so it reads it too
+  Handle modify(PassId, Handle);
+  // Never cull this pass, for work with side effects outside the graph
+  void keep(PassId);
+
+  void compile();
+  // Run the live passes in schedule()[begin, end)
+  void execute(size_t begin=0, size_t end=size_t(-1));
+
+  // Results of compile()
+  size_t passCount() const { return m_passes.size(); }
+  const std::string& passName(PassId p) const { return m_passes[p].name; }
+  bool culled(PassId p) const { return !m_passes[p].live; }
+  size_t culledCount() const { return m_passes.size() - m_schedule.size(); }
+  const std::vector<PassId>& schedule() const { return m_schedule; }
+  // Where the pass runs in the schedule; a culled pass gives the
+  // position of the next live one
+  size_t position(PassId p) const { return m_passes[p].position; }
+
+  size_t targetCount() const { return m_targets.size(); }
+  TargetId target(Handle h) const { return m_versions[h].target; }
+  const std::string& targetName(TargetId t) const { return m_targets[t].name; }
+  bool imported(TargetId t) const { return m_targets[t].imported; }
+  const TargetDesc& targetDesc(TargetId t) const { return m_targets[t].desc; }
+  // Schedule positions of the first and last live pass using the
+  // target, or none if nothing live does
+  size_t firstUse(TargetId t) const { return m_targets[t].first; }
+  size_t lastUse(TargetId t) const { return m_targets[t].last; }
+  // The slot backing a transient target, or none for imported and unused ones
+  uint32_t physical(TargetId t) const { return m_targets[t].physical; }
+  size_t physicalCount() const { return m_physical.size(); }
+  const TargetDesc& physicalDesc(uint32_t slot) const { return m_physical[slot].desc; }
+
+private:
+  struct Pass
+  {
+    std::string name;
+    Execute execute;
+    std::vector<Handle> reads;
+    std::vector<Handle> writes;
+    bool keep;
+    bool live;
+    size_t position;
+  };
+
+  struct Target
+  {
+    std::string name;
+    TargetDesc desc;
+    bool imported;
+    Handle latest;
+    size_t first, last;
+    uint32_t physical;
+  };
+
+  struct Version
+  {
+    TargetId target;
+    PassId writer; // none for what the target starts out with
+  };
+
+  struct Slot
+  {
+    TargetDesc desc;
+    size_t last;
+  };
+
+  std::vector<Pass> m_passes;
+  std::vector<Target> m_targets;
+  std::vector<Version> m_versions;
+  std::vector<PassId> m_schedule;
+  std::vector<Slot> m_physical;
+  std::vector<TargetId> m_order; // scratch for compile()
+  bool m_compiled;
+
+  Handle addTarget(const std::string&, const TargetDesc&, bool imported);
+  void checkPass(PassId) const;
+  void checkHandle(Handle) const;
+};
+
+#endif // SENSE_PIPELINE_RENDERGRAPH_HPP
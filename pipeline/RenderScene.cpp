@@ -0,0 +1,116 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "RenderScene.hpp"
+
+const RenderScene::ProxyId RenderScene::none;
+
+RenderScene::RenderScene()
+  : m_layout_changed(false)
+{}
+
+RenderScene::ProxyId RenderScene::add(DrawableMesh* mesh, Material* mat, const glm::mat4& transform, uint32_t pass, uint32_t lod)
+{
+  ProxyId id;
+  if(m_free.empty()) {
+    id = m_proxies.size();
+    m_proxies.push_back(Proxy());
+  } else {
+    id = m_free.back();
+    m_free.pop_back();
+  }
+  Proxy& p = m_proxies[id];
+  p.mesh = mesh;
+  p.mat = mat;
+  p.pass = pass;
+  p.lod = lod;
+  p.transform = transform;
+  p.occluder = false;
+  p.live = true;
+  p.moved = false;
+  p.relod = false;
+  m_layout_changed = true;
+  return id;
+}
+
+void RenderScene::remove(ProxyId id)
+{
+  if(id == none || !m_proxies[id].live)
+    return;
+  m_proxies[id].live = false;
+  m_free.push_back(id);
+  m_layout_changed = true;
+}
+
+void RenderScene::setTransform(ProxyId id, const glm::mat4& transform)
+{
+  Proxy& p = m_proxies[id];
+  p.transform = transform;
+  if(!p.moved) {
+    p.moved = true;
+    m_moved.push_back(id);
+  }
+}
+
+void RenderScene::setMesh(ProxyId id, DrawableMesh* mesh)
+{
+  if(m_proxies[id].mesh == mesh)
+    return;
+  m_proxies[id].mesh = mesh;
+  m_layout_changed = true;
+}
+
+void RenderScene::setMaterial(ProxyId id, Material* mat)
+{
+  if(m_proxies[id].mat == mat)
+    return;
+  m_proxies[id].mat = mat;
+  m_layout_changed = true;
+}
+
+void RenderScene::setLod(ProxyId id, uint32_t lod)
+{
+  Proxy& p = m_proxies[id];
+  if(p.lod == lod)
+    return;
+  p.lod = lod;
+  if(!p.relod) {
+    p.relod = true;
+    m_relod.push_back(id);
+  }
+}
+
+void RenderScene::setOccluder(ProxyId id, bool occluder)
+{
+  Proxy& p = m_proxies[id];
+  if(p.occluder == occluder)
+    return;
+  p.occluder = occluder;
+  if(!p.moved) {
+    p.moved = true;
+    m_moved.push_back(id);
+  }
+}
+
+void RenderScene::clearChanges()
+{
+  for(auto i = m_moved.begin(); i != m_moved.end(); ++i)
+    m_proxies[*i].moved = false;
+  m_moved.clear();
+  for(auto i = m_relod.begin(); i != m_relod.end(); ++i)
+    m_proxies[*i].relod = false;
+  m_relod.clear();
+  m_layout_changed = false;
+}
@@ -0,0 +1,94 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SENSE_PIPELINE_RENDERSCENE_HPP
+#define SENSE_PIPELINE_RENDERSCENE_HPP
+
+#include "3rdparty/glm/glm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct DrawableMesh;
+struct Material;
+
+// Draws that stay put from frame to frame. Something that wants to be
+// drawn every frame adds a proxy once and only touches it again when it
+// changes; the pipeline looks at what changed since the last frame
+// instead of getting every draw resubmitted. Main thread only.
+//
+// Changes come in two kinds. Adding, removing or swapping the mesh or
+// material of a proxy changes the layout, and the pipeline rebuilds its
+// sorted list. Moving a proxy or switching its lod only patches its
+// instance data or its record, so the depth and lod parts of its sort
+// key go stale until the next rebuild; that only costs some sorting
+// quality.
+class RenderScene
+{
+public:
+  typedef uint32_t ProxyId;
+  static const ProxyId none = ProxyId(-1);
+
+  struct Proxy
+  {
+    DrawableMesh* mesh;
+    Material* mat;
+    uint32_t pass; // one of the user passes in Pipeline::RenderPass
+    uint32_t lod;
+    glm::mat4 transform;
+    bool occluder; // drawn into the occlusion buffer (see Occlusion.hpp)
+    bool live;
+    bool moved; // already in moved()
+    bool relod; // already in lodChanged()
+  };
+
+  RenderScene();
+
+  ProxyId add(DrawableMesh*, Material*, const glm::mat4& transform, uint32_t pass=0, uint32_t lod=0);
+  void remove(ProxyId);
+
+  void setTransform(ProxyId, const glm::mat4&);
+  void setMesh(ProxyId, DrawableMesh*);
+  void setMaterial(ProxyId, Material*);
+  void setLod(ProxyId, uint32_t lod);
+  // Occluders hide what's behind them from the other proxies. Only big,
+  // solid things are worth it. Counts as a move, not a layout change.
+  void setOccluder(ProxyId, bool);
+
+  // Ids run up to capacity(); check live for the ones that are in use
+  size_t capacity() const { return m_proxies.size(); }
+  size_t size() const { return m_proxies.size() - m_free.size(); }
+  const Proxy& proxy(ProxyId id) const { return m_proxies[id]; }
+
+  // What happened since the last clearChanges(). Proxies in moved() and
+  // lodChanged() can have been removed since; check live.
+  bool layoutChanged() const { return m_layout_changed; }
+  const std::vector<ProxyId>& moved() const { return m_moved; }
+  const std::vector<ProxyId>& lodChanged() const { return m_relod; }
+  void clearChanges();
+
+private:
+  std::vector<Proxy> m_proxies;
+  std::vector<ProxyId> m_free;
+  std::vector<ProxyId> m_moved;
+  std::vector<ProxyId> m_relod;
+  bool m_layout_changed;
+
+  RenderScene(const RenderScene&);
+  RenderScene& operator=(const RenderScene&);
+};
+
+#endif // SENSE_PIPELINE_RENDERSCENE_HPP
@@ -0,0 +1,99 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "TargetPool.hpp"
+
+TargetPool::TargetPool(size_t keep_frames)
+  : m_keep_frames(keep_frames), m_frame(0), m_textures(0), m_bytes(0),
+    m_allocated(0), m_reused(0), m_freed(0)
+{
+  snapshot();
+}
+
+size_t TargetPool::bytes(const Desc& desc)
+{
+  size_t texel = 4;
+  if(desc.format == RenderGraph::RGBA16F)
+    texel = 8;
+  return size_t(desc.width) * desc.height * desc.samples * texel;
+}
+
+uint32_t TargetPool::acquire(const Desc& desc)
+{
+  // newest first, so a texture released and acquired every frame keeps
+  // going to the same place
+  for(size_t i = m_idle.size(); i-- > 0;) {
+    if(m_idle[i].desc == desc) {
+      const uint32_t id = m_idle[i].id;
+      m_idle.erase(m_idle.begin() + i);
+      ++m_reused;
+      return id;
+    }
+  }
+  return 0;
+}
+
+void TargetPool::add(const Desc& desc)
+{
+  ++m_textures;
+  m_bytes += bytes(desc);
+  ++m_allocated;
+}
+
+void TargetPool::release(const Desc& desc, uint32_t id)
+{
+  Idle i;
+  i.desc = desc;
+  i.id = id;
+  i.since = m_frame;
+  m_idle.push_back(i);
+}
+
+void TargetPool::expire(size_t i, std::vector<uint32_t>& expired)
+{
+  expired.push_back(m_idle[i].id);
+  --m_textures;
+  m_bytes -= bytes(m_idle[i].desc);
+  ++m_freed;
+  m_idle.erase(m_idle.begin() + i);
+}
+
+void TargetPool::endFrame(std::vector<uint32_t>& expired)
+{
+  ++m_frame;
+  for(size_t i = m_idle.size(); i-- > 0;) {
+    if(m_frame - m_idle[i].since > m_keep_frames)
+      expire(i, expired);
+  }
+  snapshot();
+  m_allocated = m_reused = m_freed = 0;
+}
+
+void TargetPool::drain(std::vector<uint32_t>& expired)
+{
+  for(size_t i = m_idle.size(); i-- > 0;)
+    expire(i, expired);
+  snapshot();
+}
+
+void TargetPool::snapshot()
+{
+  m_stats.textures = m_textures;
+  m_stats.idle = m_idle.size();
+  m_stats.bytes = m_bytes;
+  m_stats.allocated = m_allocated;
+  m_stats.reused = m_reused;
+  m_stats.freed = m_freed;
+}
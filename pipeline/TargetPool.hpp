@@ -0,0 +1,85 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SENSE_PIPELINE_TARGETPOOL_HPP
+#define SENSE_PIPELINE_TARGETPOOL_HPP
+
+#include "RenderGraph.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Textures for render targets, kept after they're released so the next
+// target with the same size, format and sample count can have one
+// instead of a new allocation. Released textures that stay idle for
+// keep_frames frames are handed back to be freed. Ids are whatever the
+// pipeline makes; this doesn't touch GL.
+class TargetPool
+{
+public:
+  typedef RenderGraph::TargetDesc Desc;
+
+  struct Stats
+  {
+    size_t textures; // held, in use or idle
+    size_t idle; // of those, waiting to be reused or freed
+    size_t bytes; // roughly what they all take
+    size_t allocated; // new textures over the last frame
+    size_t reused;
+    size_t freed;
+  };
+
+  explicit TargetPool(size_t keep_frames=4);
+
+  // An idle texture like desc, or 0 if there's none and the caller has
+  // to make one, which it then tells the pool about with add()
+  uint32_t acquire(const Desc&);
+  void add(const Desc&);
+  // Give back a texture from acquire() or add()
+  void release(const Desc&, uint32_t id);
+
+  // Ages the idle textures. Ones that have gone unused for long enough
+  // are appended to expired for the caller to free.
+  void endFrame(std::vector<uint32_t>& expired);
+  // Every idle texture goes to expired, whatever its age
+  void drain(std::vector<uint32_t>& expired);
+
+  // As of the last endFrame()
+  const Stats& stats() const { return m_stats; }
+
+  static size_t bytes(const Desc&);
+
+private:
+  struct Idle
+  {
+    Desc desc;
+    uint32_t id;
+    size_t since; // frame it was released in
+  };
+
+  std::vector<Idle> m_idle;
+  size_t m_keep_frames;
+  size_t m_frame;
+  size_t m_textures;
+  size_t m_bytes;
+  size_t m_allocated, m_reused, m_freed; // this frame
+  Stats m_stats;
+
+  void expire(size_t i, std::vector<uint32_t>& expired);
+  void snapshot();
+};
+
+#endif // SENSE_PIPELINE_TARGETPOOL_HPP
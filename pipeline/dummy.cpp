@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "interface.hpp"
+#include "RenderScene.hpp"
 
 Loader::Loader()
 {}
@@ -20,8 +21,11 @@ Loader::Loader()
 Loader::~Loader()
 {}
 
-void Loader::loadMesh(DrawableMesh*)
-{}
+void Loader::loadMesh(DrawableMesh*, UploadDone done)
+{
+  if(done)
+    done();
+}
 
 void Loader::mainThreadLoadMesh(DrawableMesh*)
 {}
@@ -34,7 +38,7 @@ boost::any Loader::queryUniform(ShaderProgram*, std::string)
   return -1;
 }
 
-ShaderProgram* Loader::loadProgram(std::string, std::string, std::string)
+ShaderProgram* Loader::loadProgram(const ShaderSource&, const ShaderSource&, const ShaderSource&)
 {
   return 0;
 }
@@ -48,6 +52,9 @@ void Loader::updateTexture(Image*)
 void Loader::releaseTexture(Image*)
 {}
 
+void Loader::pollUploads()
+{}
+
 bool Loader::isThreaded()
 {
   return false;
@@ -56,13 +63,37 @@ bool Loader::isThreaded()
 void Loader::releaseProgram(ShaderProgram*)
 {}
 
+MaterialBindings* Loader::compileBindings(ShaderProgram*, const std::vector<Uniform>&)
+{
+  return 0;
+}
+
+void Loader::releaseBindings(MaterialBindings*)
+{}
+
 Pipeline::Pipeline()
 {}
 
 Pipeline::~Pipeline()
 {}
 
-void Pipeline::addDrawTask(DrawableMesh*, Material*, glm::mat4, Pipeline::RenderPass)
+void Pipeline::addDrawTask(DrawableMesh*, Material*, glm::mat4, Pipeline::RenderPass, size_t)
+{}
+
+DrawBucket* Pipeline::drawBucket(size_t)
+{ return 0; }
+
+void Pipeline::setFrustum(const glm::mat4&)
+{}
+
+RenderScene& Pipeline::scene()
+{
+  // nothing ever gets drawn, but callers still need somewhere to keep proxies
+  static RenderScene dummy_scene;
+  return dummy_scene;
+}
+
+void Pipeline::addDrawTask(DrawBucket*, DrawableMesh*, Material*, glm::mat4, Pipeline::RenderPass, size_t)
 {}
 
 void Pipeline::addLamp(Lamp*)
@@ -88,3 +119,9 @@ void Pipeline::setViewport(uint32_t, uint32_t)
 
 Loader* Pipeline::createLoader()
 { return 0; }
+
+const Pipeline::FrameStats& Pipeline::frameStats() const
+{
+  static const FrameStats stats = FrameStats();
+  return stats;
+}
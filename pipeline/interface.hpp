@@ -17,17 +17,24 @@
 
 #include "3rdparty/glm/glm.hpp"
 #include "DefinitionTypes.hpp"
+#include "shader/Preprocessor.hpp"
 
 #include <boost/filesystem/path.hpp>
 
+#include <functional>
+
 struct DrawBuffer;
 struct Material;
 struct DrawableMesh;
 struct ShaderProgram;
+struct MaterialBindings;
+struct Uniform;
 struct Texture;
 struct RenderTarget;
 struct Image;
 struct Lamp;
+struct DrawBucket;
+class RenderScene;
 
 struct LoaderImpl;
 struct PipelineImpl;
@@ -40,22 +47,44 @@ public:
   Loader();
   ~Loader();
 
-  // Load the mesh of the given name into a GPU buffer object
-  void loadMesh(DrawableMesh*);
+  // Called on the loader thread once an upload has finished on the GPU
+  typedef std::function<void()> UploadDone;
+
+  // Load the mesh of the given name into a GPU buffer object. This
+  // returns once the upload is issued; done runs from pollUploads() when
+  // it has completed, and the mesh mustn't be handed to the main thread
+  // before that.
+  void loadMesh(DrawableMesh*, UploadDone done=UploadDone());
   void mainThreadLoadMesh(DrawableMesh*);
+  // Main thread only, like mainThreadLoadMesh. The loader thread queues
+  // it as a main thread job. The mesh's GPU space is reused once frames
+  // that drew it are done, from pollUploads().
   void releaseMesh(DrawableMesh*);
 
-  // Load the given shader strings into a GPU program.
+  // Load the given preprocessed shaders into a GPU program. Stages
+  // are compiled once per unique source hash and shared between programs.
   boost::any queryUniform(ShaderProgram* prog, std::string uni);
-  ShaderProgram* loadProgram(std::string vert, std::string frag, std::string geom="");
+  ShaderProgram* loadProgram(const ShaderSource& vert, const ShaderSource& frag, const ShaderSource& geom=ShaderSource());
   void releaseProgram(ShaderProgram*);
 
-  // Load the given image object into a GPU texture
+  // Bake a material's uniforms into a flat binding table for the given
+  // program. Sampler units are assigned and the program is validated
+  // here, once, instead of at draw time. Release must happen on the
+  // main thread, since the renderer may still be holding the old table.
+  MaterialBindings* compileBindings(ShaderProgram*, const std::vector<Uniform>&);
+  void releaseBindings(MaterialBindings*);
+
+  // Load the given image object into a GPU texture. Like meshes, the
+  // image only gets its Texture once pollUploads() sees it finish.
   void loadTexture(Image*);
   // perform any needed updates on the Texture object
   void updateTexture(Image*);
   void releaseTexture(Image*);
 
+  // Publish whatever uploads the GPU has finished since the last call.
+  // The loader thread should call this regularly.
+  void pollUploads();
+
   static bool isThreaded();
 
 private:
@@ -88,10 +117,31 @@ public:
   // If the platform implementation supports instancing, use_instancing can be set to false to disable
   // that feature. If instancing is not supported, use_instancing has no effect. Instancing is enabled
   // by default for performance reasons.
-  void addDrawTask(DrawableMesh* data, Material* mat, glm::mat4 transform, RenderPass pass=PassStandard);
+  // lod picks which of the mesh's levels of detail to draw; it's ignored for meshes without LODs.
+  void addDrawTask(DrawableMesh* data, Material* mat, glm::mat4 transform, RenderPass pass=PassStandard, size_t lod=0);
   void addSkinnedDrawTask(DrawableMesh* data, Material* mat, std::vector<glm::mat4>& bones, RenderPass pass=PassStandard);
 
-  // Add a lamp to be used for rendering this frame
+  // addDrawTask is main thread only. Threads recording draws in parallel
+  // each record into their own bucket instead, which render() merges
+  // into the frame in slot order. Buckets are created on first use and
+  // that isn't thread safe, so get every bucket you need before going wide.
+  DrawBucket* drawBucket(size_t slot);
+  void addDrawTask(DrawBucket* bucket, DrawableMesh* data, Material* mat, glm::mat4 transform, RenderPass pass=PassStandard, size_t lod=0);
+
+  // Draws that persist between frames (see RenderScene.hpp). These are
+  // drawn every frame without being resubmitted, ahead of the draws
+  // added for this frame.
+  RenderScene& scene();
+  // What the RenderScene gets culled against: the matrix that takes the
+  // space draw transforms end up in to clip space. Those transforms go
+  // all the way to clip space today, so the default is the identity.
+  // Occlusion culling works in the clip space this leads to.
+  void setFrustum(const glm::mat4& view_projection);
+
+  // Add a lamp to be used for rendering this frame (see Lamp.hpp). It's
+  // copied, so it can go away once this returns. Lamps get binned into
+  // clusters of the view frustum set with setFrustum, and frames with
+  // any lamps are lit by them instead of the flat lighting.
   void addLamp(Lamp* lamp);
 
   // Render the current set of objects to the active RenderTarget
@@ -103,7 +153,9 @@ public:
   // Create a RenderTarget of the specified dimensions
   RenderTarget* createRenderTarget(uint32_t width, uint32_t height, bool mipmap=true); // TODO: enable user selection of render target bit depth
 
-  // Clean up a RenderTarget
+  // Clean up a RenderTarget. Its texture is kept for a few frames in
+  // case a target of the same size comes along, so destroying and
+  // recreating one is cheap if the size didn't change.
   void destroyRenderTarget(RenderTarget*);
 
   // Set the active RenderTarget
@@ -118,6 +170,31 @@ public:
   // Load any resources the pipeline needs to have direct references to
   void loadPipelineData(DataManager*);
 
+  // Counters for the last finished frame
+  struct FrameStats {
+    size_t draws; // draw tasks submitted, plus the RenderScene's
+    size_t culled; // RenderScene draws left out by frustum culling
+    size_t occluded; // and by occlusion culling
+    size_t cluster_hidden; // and because every one of their clusters was
+    size_t clusters_culled; // clusters of big RenderScene meshes left out
+    size_t lamps; // lamps added for the frame
+    size_t lamps_culled; // of those, how many were out of view
+    size_t passes; // render graph passes that ran
+    size_t passes_culled; // and ones nothing needed
+    size_t targets; // transient targets used by those passes
+    size_t target_slots; // textures behind them, after aliasing
+    size_t pool_textures; // render target textures held, in use or not
+    size_t pool_idle; // of those, ones waiting to be reused or freed
+    size_t pool_bytes; // roughly what they all take
+    size_t pool_allocated; // textures made this frame
+    size_t pool_reused; // requests served from idle ones instead
+    size_t pool_freed; // idle ones freed this frame
+    size_t batches; // draw calls issued after instancing
+    size_t state_changes; // GL state calls that went through
+    size_t state_changes_skipped; // redundant ones that were filtered out
+  };
+  const FrameStats& frameStats() const;
+
 private:
   PipelineImpl* self;
 };
@@ -0,0 +1,170 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "GlState.hpp"
+
+#include <cstring>
+
+size_t GlState::Stats::totalIssued() const
+{
+  size_t total = 0;
+  for(size_t i = 0; i < CallCount; ++i)
+    total += issued[i];
+  return total;
+}
+
+size_t GlState::Stats::totalSkipped() const
+{
+  size_t total = 0;
+  for(size_t i = 0; i < CallCount; ++i)
+    total += skipped[i];
+  return total;
+}
+
+GlState::GlState(const GlFunctions& gl)
+  : m_gl(gl)
+{
+  resetStats();
+  invalidate();
+}
+
+void GlState::useProgram(GLuint program)
+{
+  if(issue(UseProgram, program != m_program)) {
+    m_gl.useProgram(program);
+    m_program = program;
+  }
+}
+
+void GlState::bindVertexArray(GLuint vao)
+{
+  if(issue(BindVertexArray, vao != m_vao)) {
+    m_gl.bindVertexArray(vao);
+    m_vao = vao;
+  }
+}
+
+void GlState::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+  int slot;
+  switch(target) {
+  case GL_TEXTURE_2D: slot = Tex2D; break;
+  case GL_TEXTURE_2D_MULTISAMPLE: slot = Tex2DMultisample; break;
+  default: slot = -1; break; // not tracked, always goes through
+  }
+  const bool tracked = slot >= 0 && unit < max_texture_units;
+  if(!issue(BindTexture, !tracked || m_textures[unit][slot] != texture))
+    return;
+  if(issue(ActiveTexture, unit != m_active_unit)) {
+    m_gl.activeTexture(GL_TEXTURE0 + unit);
+    m_active_unit = unit;
+  }
+  m_gl.bindTexture(target, texture);
+  if(tracked)
+    m_textures[unit][slot] = texture;
+}
+
+void GlState::bindFramebuffer(GLenum target, GLuint fbo)
+{
+  bool needed;
+  switch(target) {
+  case GL_DRAW_FRAMEBUFFER: needed = fbo != m_draw_fbo; break;
+  case GL_READ_FRAMEBUFFER: needed = fbo != m_read_fbo; break;
+  default: needed = fbo != m_draw_fbo || fbo != m_read_fbo; break;
+  }
+  if(!issue(BindFramebuffer, needed))
+    return;
+  m_gl.bindFramebuffer(target, fbo);
+  if(target != GL_READ_FRAMEBUFFER)
+    m_draw_fbo = fbo;
+  if(target != GL_DRAW_FRAMEBUFFER)
+    m_read_fbo = fbo;
+}
+
+void GlState::setEnabled(GLenum cap, bool enabled)
+{
+  auto i = m_caps.find(cap);
+  if(!issue(Enable, i == m_caps.end() || i->second != enabled))
+    return;
+  if(enabled)
+    m_gl.enable(cap);
+  else
+    m_gl.disable(cap);
+  m_caps[cap] = enabled;
+}
+
+void GlState::depthMask(bool mask)
+{
+  if(issue(DepthMask, m_depth_mask != GLuint(mask))) {
+    m_gl.depthMask(mask ? GL_TRUE : GL_FALSE);
+    m_depth_mask = mask;
+  }
+}
+
+void GlState::blendFunc(GLenum src, GLenum dst)
+{
+  if(issue(BlendFunc, src != m_blend_src || dst != m_blend_dst)) {
+    m_gl.blendFunc(src, dst);
+    m_blend_src = src;
+    m_blend_dst = dst;
+  }
+}
+
+bool GlState::uniformChanged(GLint location, const void* value, size_t size)
+{
+  if(location < 0 || m_program == unknown)
+    return issue(Uniform, true);
+  const uint64_t key = (uint64_t(m_program) << 32) | uint32_t(location);
+  UniformValue v;
+  memset(&v, 0, sizeof(v));
+  memcpy(v.bits, value, size);
+  auto i = m_uniforms.find(key);
+  if(i != m_uniforms.end() && memcmp(&i->second, &v, sizeof(v)) == 0)
+    return issue(Uniform, false);
+  m_uniforms[key] = v;
+  return issue(Uniform, true);
+}
+
+void GlState::uniform1i(GLint location, GLint value)
+{
+  if(uniformChanged(location, &value, sizeof(value)))
+    m_gl.uniform1i(location, value);
+}
+
+void GlState::uniform3fv(GLint location, const GLfloat value[3])
+{
+  if(uniformChanged(location, value, sizeof(GLfloat) * 3))
+    m_gl.uniform3fv(location, 1, value);
+}
+
+void GlState::invalidate()
+{
+  m_program = unknown;
+  m_vao = unknown;
+  m_active_unit = unknown;
+  for(size_t i = 0; i < max_texture_units; ++i) {
+    for(size_t j = 0; j < TargetCount; ++j)
+      m_textures[i][j] = unknown;
+  }
+  m_draw_fbo = unknown;
+  m_read_fbo = unknown;
+  m_depth_mask = unknown;
+  m_blend_src = m_blend_dst = unknown;
+  m_caps.clear();
+}
+
+void GlState::resetStats()
+{
+  memset(&m_stats, 0, sizeof(m_stats));
+}
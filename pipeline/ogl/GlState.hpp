@@ -0,0 +1,152 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_PIPELINE_OGL_GLSTATE_HPP
+#define SENSE_PIPELINE_OGL_GLSTATE_HPP
+
+#include "GL/glew.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// The GL entry points GlState forwards to. The pipeline fills this
+// from GLEW; anything with the same signatures will do, so the
+// filtering can be exercised against a mock without a context.
+struct GlFunctions
+{
+  void (GLAPIENTRY *useProgram)(GLuint);
+  void (GLAPIENTRY *bindVertexArray)(GLuint);
+  void (GLAPIENTRY *activeTexture)(GLenum);
+  void (GLAPIENTRY *bindTexture)(GLenum, GLuint);
+  void (GLAPIENTRY *bindFramebuffer)(GLenum, GLuint);
+  void (GLAPIENTRY *enable)(GLenum);
+  void (GLAPIENTRY *disable)(GLenum);
+  void (GLAPIENTRY *depthMask)(GLboolean);
+  void (GLAPIENTRY *blendFunc)(GLenum, GLenum);
+  void (GLAPIENTRY *uniform1i)(GLint, GLint);
+  void (GLAPIENTRY *uniform3fv)(GLint, GLsizei, const GLfloat*);
+
+  // Only valid once GLEW has been initialized. Inline so that GlState.cpp
+  // itself doesn't need GL to link.
+  static GlFunctions fromGlew() {
+    GlFunctions f;
+    f.useProgram = glUseProgram;
+    f.bindVertexArray = glBindVertexArray;
+    f.activeTexture = glActiveTexture;
+    f.bindTexture = glBindTexture;
+    f.bindFramebuffer = glBindFramebuffer;
+    f.enable = glEnable;
+    f.disable = glDisable;
+    f.depthMask = glDepthMask;
+    f.blendFunc = glBlendFunc;
+    f.uniform1i = glUniform1i;
+    f.uniform3fv = glUniform3fv;
+    return f;
+  }
+};
+
+// Shadow copy of the GL state the pipeline touches per draw. Calls
+// that wouldn't change anything are dropped. Anything that changes
+// state behind its back (the loader, render target setup) has to be
+// followed by invalidate().
+class GlState
+{
+public:
+  enum Call {
+    UseProgram,
+    BindVertexArray,
+    ActiveTexture,
+    BindTexture,
+    BindFramebuffer,
+    Enable, // glEnable and glDisable
+    DepthMask,
+    BlendFunc,
+    Uniform,
+    CallCount
+  };
+
+  struct Stats
+  {
+    size_t issued[CallCount];
+    size_t skipped[CallCount];
+
+    size_t totalIssued() const;
+    size_t totalSkipped() const;
+  };
+
+  static const size_t max_texture_units = 32;
+
+  explicit GlState(const GlFunctions&);
+
+  void useProgram(GLuint);
+  void bindVertexArray(GLuint);
+  // Handles glActiveTexture too; the active unit is only changed when
+  // a bind actually has to happen
+  void bindTexture(GLuint unit, GLenum target, GLuint texture);
+  // GL_FRAMEBUFFER sets both the draw and read bindings
+  void bindFramebuffer(GLenum target, GLuint);
+  void setEnabled(GLenum cap, bool);
+  void depthMask(bool);
+  void blendFunc(GLenum src, GLenum dst);
+  // Uniform values belong to the program, so these go to the one from
+  // the last useProgram
+  void uniform1i(GLint location, GLint);
+  void uniform3fv(GLint location, const GLfloat value[3]);
+
+  // Forget all the bindings and capabilities. Uniform values are
+  // kept: programs are never relinked or deleted (releaseProgram only
+  // drops the refcount), so a program name always means the same
+  // program, and the loader only sets samplers, which don't come
+  // through here. If programs ever get freed, their values have to go.
+  void invalidate();
+
+  const Stats& stats() const { return m_stats; }
+  void resetStats();
+
+private:
+  GlFunctions m_gl;
+  Stats m_stats;
+
+  // values we know nothing about
+  static const GLuint unknown = ~0u;
+  enum { Tex2D, Tex2DMultisample, TargetCount };
+
+  GLuint m_program;
+  GLuint m_vao;
+  GLuint m_active_unit;
+  GLuint m_textures[max_texture_units][TargetCount];
+  GLuint m_draw_fbo;
+  GLuint m_read_fbo;
+  GLuint m_depth_mask;
+  GLenum m_blend_src, m_blend_dst;
+  std::unordered_map<GLenum, bool> m_caps;
+
+  struct UniformValue
+  {
+    uint32_t bits[3];
+  };
+  std::unordered_map<uint64_t, UniformValue> m_uniforms; // keyed by program and location
+
+  bool issue(Call call, bool needed) {
+    if(needed)
+      m_stats.issued[call]++;
+    else
+      m_stats.skipped[call]++;
+    return needed;
+  }
+  bool uniformChanged(GLint location, const void* value, size_t size);
+};
+
+#endif // SENSE_PIPELINE_OGL_GLSTATE_HPP
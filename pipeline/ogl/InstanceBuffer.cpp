@@ -0,0 +1,70 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "InstanceBuffer.hpp"
+#include "glexcept.hpp"
+
+#include <algorithm>
+
+namespace {
+  const size_t texel_size = 16; // RGBA32F
+}
+
+InstanceBuffer::InstanceBuffer()
+{
+  GLint max_texels;
+  GL_CHECK(glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels));
+  m_max_size = size_t(max_texels) * texel_size;
+  GL_CHECK(glGenBuffers(1, &m_buffer));
+  GL_CHECK(glGenTextures(1, &m_texture));
+  GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, m_buffer));
+  GL_CHECK(glBufferData(GL_TEXTURE_BUFFER, texel_size, 0, GL_DYNAMIC_DRAW));
+  GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+  GL_CHECK(glBindTexture(GL_TEXTURE_BUFFER, m_texture));
+  GL_CHECK(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_buffer));
+  GL_CHECK(glBindTexture(GL_TEXTURE_BUFFER, 0));
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+  glDeleteTextures(1, &m_texture);
+  glDeleteBuffers(1, &m_buffer);
+}
+
+float* InstanceBuffer::map(size_t texels)
+{
+  const size_t bytes = std::max(texels, size_t(1)) * texel_size;
+  if(bytes > m_max_size)
+    throw std::runtime_error("Too many retained instances for a buffer texture");
+  GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, m_buffer));
+  GL_CHECK(glBufferData(GL_TEXTURE_BUFFER, bytes, 0, GL_DYNAMIC_DRAW));
+  void* ptr = GL_CHECK(glMapBufferRange(GL_TEXTURE_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+  if(!ptr)
+    throw std::runtime_error("Couldn't map the retained instance buffer");
+  return (float*)ptr;
+}
+
+void InstanceBuffer::unmap()
+{
+  GL_CHECK(glUnmapBuffer(GL_TEXTURE_BUFFER));
+  GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+}
+
+void InstanceBuffer::update(size_t base, const float* data, size_t texels)
+{
+  GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, m_buffer));
+  GL_CHECK(glBufferSubData(GL_TEXTURE_BUFFER, base * texel_size, texels * texel_size, data));
+  GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+}
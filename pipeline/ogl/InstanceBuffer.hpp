@@ -0,0 +1,50 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SENSE_PIPELINE_OGL_INSTANCEBUFFER_HPP
+#define SENSE_PIPELINE_OGL_INSTANCEBUFFER_HPP
+
+#include "GL/glew.h"
+
+#include <cstddef>
+
+// Instance data that outlives a frame, for the retained RenderScene.
+// Same RGBA32F buffer texture layout as InstanceRing, but filled once
+// when the scene is rebuilt and then patched in place as proxies move.
+class InstanceBuffer
+{
+public:
+  InstanceBuffer();
+  ~InstanceBuffer();
+
+  // Respecify the whole buffer with room for texels and map it. What
+  // was there before is orphaned, not waited on.
+  float* map(size_t texels);
+  void unmap();
+  // Overwrite texels starting at base
+  void update(size_t base, const float* data, size_t texels);
+
+  GLuint texture() const { return m_texture; }
+
+private:
+  GLuint m_buffer;
+  GLuint m_texture;
+  size_t m_max_size;
+
+  InstanceBuffer(const InstanceBuffer&);
+  InstanceBuffer& operator=(const InstanceBuffer&);
+};
+
+#endif // SENSE_PIPELINE_OGL_INSTANCEBUFFER_HPP
@@ -0,0 +1,125 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "InstanceRing.hpp"
+#include "glexcept.hpp"
+
+#include <algorithm>
+
+namespace {
+  // enough for a few frames of several thousand instances
+  const size_t initial_size = 1 << 20;
+  const size_t texel_size = 16; // RGBA32F
+}
+
+InstanceRing::InstanceRing()
+  : m_buffer(0), m_texture(0), m_frame(0)
+{
+  GLint max_texels;
+  GL_CHECK(glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels));
+  m_max_size = size_t(max_texels) * texel_size;
+  GL_CHECK(glGenBuffers(1, &m_buffer));
+  GL_CHECK(glGenTextures(1, &m_texture));
+  grow(std::min(initial_size, m_max_size));
+}
+
+InstanceRing::~InstanceRing()
+{
+  for(auto i = m_fences.begin(); i != m_fences.end(); ++i)
+    glDeleteSync(i->second);
+  glDeleteTextures(1, &m_texture);
+  glDeleteBuffers(1, &m_buffer);
+}
+
+float* InstanceRing::map(size_t texels, GLint& base)
+{
+  const size_t bytes = texels * texel_size;
+  if(bytes > m_max_size)
+    throw std::runtime_error("Too many instances in one frame for a buffer texture");
+  retire(false);
+  size_t offset;
+  while((offset = m_ring.allocate(bytes, texel_size)) == ringAllocator::npos) {
+    if(m_fences.empty())
+      grow(bytes);
+    else
+      retire(true);
+  }
+  base = offset / texel_size;
+  GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, m_buffer));
+  // the fences already guarantee nobody is reading this range
+  void* ptr = GL_CHECK(glMapBufferRange(GL_TEXTURE_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+  if(!ptr)
+    throw std::runtime_error("Couldn't map the instance buffer");
+  return (float*)ptr;
+}
+
+void InstanceRing::unmap()
+{
+  GL_CHECK(glUnmapBuffer(GL_TEXTURE_BUFFER));
+  GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+}
+
+void InstanceRing::fence()
+{
+  GLsync sync = GL_CHECK(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+  m_ring.fence(++m_frame);
+  m_fences.push_back(std::make_pair(m_frame, sync));
+}
+
+// Release the regions of every frame the GPU is done with. If wait is
+// set, block until at least the oldest one is done.
+void InstanceRing::retire(bool wait)
+{
+  while(!m_fences.empty()) {
+    GLsync sync = m_fences.front().second;
+    GLenum status;
+    if(wait) {
+      do {
+        status = GL_CHECK(glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000));
+      } while(status == GL_TIMEOUT_EXPIRED);
+      wait = false;
+    } else {
+      status = GL_CHECK(glClientWaitSync(sync, 0, 0));
+    }
+    if(status == GL_TIMEOUT_EXPIRED)
+      break;
+    if(status == GL_WAIT_FAILED)
+      throw std::runtime_error("Waiting on an instance buffer fence failed");
+    m_ring.retire(m_fences.front().first);
+    glDeleteSync(sync);
+    m_fences.pop_front();
+  }
+}
+
+// Respecify the buffer with at least min_size bytes. The old storage is
+// orphaned, so frames still drawing from it don't need to be waited on.
+void InstanceRing::grow(size_t min_size)
+{
+  size_t size = std::max(m_ring.size(), initial_size);
+  while(size < min_size)
+    size *= 2;
+  size = std::min(size, m_max_size);
+  for(auto i = m_fences.begin(); i != m_fences.end(); ++i)
+    glDeleteSync(i->second);
+  m_fences.clear();
+  m_ring.reset(size);
+
+  GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, m_buffer));
+  GL_CHECK(glBufferData(GL_TEXTURE_BUFFER, size, 0, GL_STREAM_DRAW));
+  GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+  GL_CHECK(glBindTexture(GL_TEXTURE_BUFFER, m_texture));
+  GL_CHECK(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_buffer));
+  GL_CHECK(glBindTexture(GL_TEXTURE_BUFFER, 0));
+}
@@ -0,0 +1,61 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SENSE_PIPELINE_OGL_INSTANCERING_HPP
+#define SENSE_PIPELINE_OGL_INSTANCERING_HPP
+
+#include "GL/glew.h"
+#include "util/ring.hpp"
+
+#include <deque>
+#include <utility>
+
+// Per-instance transforms for the whole frame, in one RGBA32F buffer
+// texture that vertex shaders read through sense_modelview(). Each
+// frame maps a fresh stretch of the ring unsynchronized and writes all
+// of its matrices in one go; fences keep it from reusing space the GPU
+// hasn't finished drawing from.
+class InstanceRing
+{
+public:
+  InstanceRing();
+  ~InstanceRing();
+
+  // Room for count texels. base is the index of the first one, which
+  // is what the shader's instance base uniforms are relative to. The
+  // buffer is bound to GL_TEXTURE_BUFFER until unmap().
+  float* map(size_t texels, GLint& base);
+  void unmap();
+  // Call after the last draw that reads what was mapped this frame
+  void fence();
+
+  GLuint texture() const { return m_texture; }
+
+private:
+  ringAllocator m_ring;
+  GLuint m_buffer;
+  GLuint m_texture;
+  size_t m_max_size;
+  uint64_t m_frame;
+  std::deque<std::pair<uint64_t, GLsync> > m_fences;
+
+  void retire(bool wait);
+  void grow(size_t min_size);
+
+  InstanceRing(const InstanceRing&);
+  InstanceRing& operator=(const InstanceRing&);
+};
+
+#endif // SENSE_PIPELINE_OGL_INSTANCERING_HPP
@@ -0,0 +1,61 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "LightBuffers.hpp"
+#include "glexcept.hpp"
+#include "../LightGrid.hpp"
+
+#include <algorithm>
+
+LightBuffers::LightBuffers()
+{
+  GLint max_texels;
+  GL_CHECK(glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels));
+  m_max_texels = max_texels;
+  GL_CHECK(glGenBuffers(BufferCount, m_buffers));
+  GL_CHECK(glGenTextures(BufferCount, m_textures));
+  static const GLenum formats[] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+  static const size_t texel_sizes[] = { 16, 8, 2 };
+  for(size_t b = 0; b < BufferCount; ++b) {
+    GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[b]));
+    GL_CHECK(glBufferData(GL_TEXTURE_BUFFER, texel_sizes[b], 0, GL_STREAM_DRAW));
+    GL_CHECK(glBindTexture(GL_TEXTURE_BUFFER, m_textures[b]));
+    GL_CHECK(glTexBuffer(GL_TEXTURE_BUFFER, formats[b], m_buffers[b]));
+  }
+  GL_CHECK(glBindTexture(GL_TEXTURE_BUFFER, 0));
+  GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+}
+
+LightBuffers::~LightBuffers()
+{
+  glDeleteTextures(BufferCount, m_textures);
+  glDeleteBuffers(BufferCount, m_buffers);
+}
+
+void LightBuffers::upload(const LightGrid& grid)
+{
+  upload(Lamps, grid.lampData().data(), grid.lampData().size() / 4, 16);
+  upload(Cells, grid.cells().data(), grid.cells().size() / 2, 8);
+  upload(Indices, grid.indices().data(), grid.indices().size(), 2);
+  GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+}
+
+void LightBuffers::upload(Buffer b, const void* data, size_t texels, size_t texel_size)
+{
+  if(texels > m_max_texels)
+    throw std::runtime_error("Too many lamps for a buffer texture");
+  GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[b]));
+  // empty lists still need some storage behind the texture
+  GL_CHECK(glBufferData(GL_TEXTURE_BUFFER, std::max(texels, size_t(1)) * texel_size, texels ? data : 0, GL_STREAM_DRAW));
+}
@@ -0,0 +1,55 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_PIPELINE_OGL_LIGHTBUFFERS_HPP
+#define SENSE_PIPELINE_OGL_LIGHTBUFFERS_HPP
+
+#include "GL/glew.h"
+
+class LightGrid;
+
+// A LightGrid on the GPU, as the three buffer textures shaders read
+// through sense_lamp_list() and sense_lamp(): the lamps (RGBA32F), each
+// cluster's first index and count (RG32UI), and the index lists
+// (R16UI). Lamps change every frame, so each upload respecifies the
+// buffers and the old storage is orphaned rather than waited on.
+class LightBuffers
+{
+public:
+  enum Buffer {
+    Lamps,
+    Cells,
+    Indices,
+    BufferCount
+  };
+
+  LightBuffers();
+  ~LightBuffers();
+
+  void upload(const LightGrid&);
+
+  GLuint texture(Buffer b) const { return m_textures[b]; }
+
+private:
+  GLuint m_buffers[BufferCount];
+  GLuint m_textures[BufferCount];
+  size_t m_max_texels;
+
+  void upload(Buffer, const void* data, size_t texels, size_t texel_size);
+
+  LightBuffers(const LightBuffers&);
+  LightBuffers& operator=(const LightBuffers&);
+};
+
+#endif // SENSE_PIPELINE_OGL_LIGHTBUFFERS_HPP
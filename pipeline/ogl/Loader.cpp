@@ -18,29 +18,136 @@
 #include "../interface.hpp"
 #include "../Drawable.hpp"
 #include "../Image.hpp"
+#include "../Material.hpp"
+#include "image/Mipmap.hpp"
+#include "mesh/VertexData.hpp"
 #include "glexcept.hpp"
+#include "util/hash.hpp"
 // #include "Webview.hpp"
 
+#include <algorithm>
 #include <sstream>
 
+namespace {
+  // Big enough for any of the stock assets in one go; anything larger
+  // is uploaded straight from client memory
+  const size_t staging_size = 8 << 20;
+}
+
 Loader::Loader()
   : self(new LoaderImpl)
 {
+  self->next_page_id = 0;
+  self->uploads = new UploadQueue(FenceFunctions::fromGlew());
+  self->staging = new StagingBuffer(staging_size, BufferFunctions::fromGlew());
   std::stringstream ss;
   ss << "#version 150" << std::endl;
-  ss << "#define SENSE_MAX_INSTANCES " << SENSE_MAX_INSTANCES << std::endl;
+  ss << std::endl;
+  // Decoding for quantized vertex data (see mesh/Quantize.hpp). The
+  // pipeline fills in these uniforms per draw for programs that use them.
+  ss << "uniform int sense_vtxfmt;" << std::endl;
+  ss << "uniform vec3 sense_pos_scale;" << std::endl;
+  ss << "uniform vec3 sense_pos_bias;" << std::endl;
+  ss << "vec3 sense_decode_oct(vec2 e) {" << std::endl;
+  ss << "  vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));" << std::endl;
+  ss << "  if(v.z < 0.0)" << std::endl;
+  ss << "    v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);" << std::endl;
+  ss << "  return normalize(v);" << std::endl;
+  ss << "}" << std::endl;
+  ss << "vec3 sense_position(vec3 p) { return (sense_vtxfmt & " << DrawableMesh::QuantPosition << ") != 0 ? p * sense_pos_scale + sense_pos_bias : p; }" << std::endl;
+  ss << "vec3 sense_normal(vec3 n) { return (sense_vtxfmt & " << DrawableMesh::QuantOctNormal << ") != 0 ? sense_decode_oct(n.xy) : n; }" << std::endl;
+  ss << "vec3 sense_tangent(vec3 t) { return (sense_vtxfmt & " << DrawableMesh::QuantOctTangent << ") != 0 ? sense_decode_oct(t.xy) : t; }" << std::endl;
   ss << std::endl;
   self->shader_header = ss.str();
+
+  // Instance transforms come out of a buffer texture the pipeline fills
+  // once per frame (see InstanceRing.hpp). Which of these a shader calls
+  // decides how its instances get packed (see pipeline/InstanceData.hpp);
+  // the bases are in texels.
+  ss.str("");
+  ss << "uniform samplerBuffer sense_instances;" << std::endl;
+  ss << "uniform int sense_matrix_base;" << std::endl;
+  ss << "uniform int sense_affine_base;" << std::endl;
+  ss << "uniform int sense_quat_base;" << std::endl;
+  ss << "mat4 sense_modelview() {" << std::endl;
+  ss << "  int i = sense_matrix_base + gl_InstanceID * 4;" << std::endl;
+  ss << "  return mat4(texelFetch(sense_instances, i), texelFetch(sense_instances, i + 1)," << std::endl;
+  ss << "              texelFetch(sense_instances, i + 2), texelFetch(sense_instances, i + 3));" << std::endl;
+  ss << "}" << std::endl;
+  ss << "mat4 sense_modelview_affine() {" << std::endl;
+  ss << "  int i = sense_affine_base + gl_InstanceID * 3;" << std::endl;
+  ss << "  return transpose(mat4(texelFetch(sense_instances, i), texelFetch(sense_instances, i + 1)," << std::endl;
+  ss << "                        texelFetch(sense_instances, i + 2), vec4(0.0, 0.0, 0.0, 1.0)));" << std::endl;
+  ss << "}" << std::endl;
+  ss << "mat4 sense_modelview_quat() {" << std::endl;
+  ss << "  int i = sense_quat_base + gl_InstanceID * 2;" << std::endl;
+  ss << "  vec4 q = texelFetch(sense_instances, i);" << std::endl;
+  ss << "  vec4 ts = texelFetch(sense_instances, i + 1);" << std::endl;
+  ss << "  vec3 q2 = q.xyz * 2.0;" << std::endl;
+  ss << "  vec3 d = q.xyz * q2;" << std::endl; // xx, yy, zz
+  ss << "  vec3 c = q.xxy * q2.yzz;" << std::endl; // xy, xz, yz
+  ss << "  vec3 w = q.w * q2;" << std::endl; // wx, wy, wz
+  ss << "  return mat4(vec4(1.0 - d.y - d.z, c.x + w.z, c.y - w.y, 0.0) * ts.w," << std::endl;
+  ss << "              vec4(c.x - w.z, 1.0 - d.x - d.z, c.z + w.x, 0.0) * ts.w," << std::endl;
+  ss << "              vec4(c.y + w.y, c.z - w.x, 1.0 - d.x - d.y, 0.0) * ts.w," << std::endl;
+  ss << "              vec4(ts.xyz, 1.0));" << std::endl;
+  ss << "}" << std::endl;
+  ss << std::endl;
+  self->vertex_header = ss.str();
+
+  // Lamps for the lighting pass, binned into clusters of screen tiles
+  // and depth slices (see pipeline/LightGrid.hpp). The pipeline fills in
+  // these uniforms for programs that use them.
+  ss.str("");
+  ss << "uniform samplerBuffer sense_lamps;" << std::endl;
+  ss << "uniform usamplerBuffer sense_lamp_cells;" << std::endl;
+  ss << "uniform usamplerBuffer sense_lamp_indices;" << std::endl;
+  ss << "uniform ivec3 sense_lamp_grid;" << std::endl; // tiles across, tiles up, slices
+  ss << "uniform vec2 sense_lamp_slices;" << std::endl; // slice is log(clip w) * x + y
+  ss << "uniform vec2 sense_viewport;" << std::endl;
+  ss << "uniform mat4 sense_clip_to_lamp;" << std::endl;
+  ss << "uniform int sense_samples;" << std::endl; // per pixel in the G-buffer
+  // Where the lamps reaching a window position at the given clip w are
+  // in sense_lamp_indices: x is the first, y how many
+  ss << "uvec2 sense_lamp_list(vec2 frag_coord, float clip_w) {" << std::endl;
+  ss << "  ivec2 tile = clamp(ivec2(frag_coord / sense_viewport * vec2(sense_lamp_grid.xy)), ivec2(0), sense_lamp_grid.xy - 1);" << std::endl;
+  ss << "  int slice = clip_w > 0.0 ? clamp(int(floor(log(clip_w) * sense_lamp_slices.x + sense_lamp_slices.y)), 0, sense_lamp_grid.z - 1) : 0;" << std::endl;
+  ss << "  return texelFetch(sense_lamp_cells, (slice * sense_lamp_grid.y + tile.y) * sense_lamp_grid.x + tile.x).xy;" << std::endl;
+  ss << "}" << std::endl;
+  ss << "int sense_lamp_index(uint i) { return int(texelFetch(sense_lamp_indices, int(i)).x); }" << std::endl;
+  // Light from a lamp reaching point p, with normal n, in lamp space
+  ss << "vec3 sense_lamp(int lamp, vec3 p, vec3 n) {" << std::endl;
+  ss << "  vec4 pos = texelFetch(sense_lamps, lamp * " << LightGrid::lamp_texels << ");" << std::endl;
+  ss << "  vec3 color = texelFetch(sense_lamps, lamp * " << LightGrid::lamp_texels << " + 1).rgb;" << std::endl;
+  ss << "  vec4 spot = texelFetch(sense_lamps, lamp * " << LightGrid::lamp_texels << " + 2);" << std::endl;
+  ss << "  vec3 l = pos.xyz - p;" << std::endl;
+  ss << "  float dist = length(l);" << std::endl;
+  ss << "  l /= max(dist, 1e-5);" << std::endl;
+  ss << "  float falloff = clamp(1.0 - dist / pos.w, 0.0, 1.0);" << std::endl;
+  // point lamps have no direction and a cosine of -1, so this is 1
+  ss << "  float cone = smoothstep(spot.w, mix(spot.w, 1.0, 0.1), dot(-l, spot.xyz));" << std::endl;
+  ss << "  return color * (max(dot(n, l), 0.0) * falloff * falloff * cone);" << std::endl;
+  ss << "}" << std::endl;
+  ss << std::endl;
+  self->fragment_header = ss.str();
 }
 
 Loader::~Loader()
-{}
+{
+  // don't leave the GPU reading out of a deleted staging buffer
+  while(!self->uploads->empty())
+    self->uploads->poll(true);
+  self->freeRetiredMeshes(true);
+  delete self->staging;
+  delete self->uploads;
+}
 
-GlShader* LoaderImpl::loadShader(std::string shader_source, GLenum gl_shader_type) {
-  if(shader_source.empty())
+GlShader* LoaderImpl::loadShader(const ShaderSource& source, GLenum gl_shader_type) {
+  if(source.empty())
     return NULL;
 
-  auto it = shaders.find(shader_source);
+  const uint64_t key = hashBytes(&gl_shader_type, sizeof(gl_shader_type), source.hash);
+  auto it = shaders.find(key);
   if(it != shaders.end()) {
     it->second->refcnt++;
     return it->second;
@@ -49,10 +156,15 @@ GlShader* LoaderImpl::loadShader(std::string shader_source, GLenum gl_shader_typ
   GlShader* shader = new GlShader;
   shader->refcnt = 1;
   shader->gl_id = GL_CHECK(glCreateShader(gl_shader_type));
-  const char* sources[2];
+  const char* sources[3];
   sources[0] = shader_header.c_str();
-  sources[1] = shader_source.c_str();
-  GL_CHECK(glShaderSource(shader->gl_id, 2, sources, 0));
+  sources[1] = "";
+  if(gl_shader_type == GL_VERTEX_SHADER)
+    sources[1] = vertex_header.c_str();
+  else if(gl_shader_type == GL_FRAGMENT_SHADER)
+    sources[1] = fragment_header.c_str();
+  sources[2] = source.text.c_str();
+  GL_CHECK(glShaderSource(shader->gl_id, 3, sources, 0));
   GL_CHECK(glCompileShader(shader->gl_id));
   int compile_status;
   GL_CHECK(glGetShaderiv(shader->gl_id, GL_COMPILE_STATUS, &compile_status));
@@ -63,52 +175,160 @@ GlShader* LoaderImpl::loadShader(std::string shader_source, GLenum gl_shader_typ
     GL_CHECK(glGetShaderInfoLog(shader->gl_id, info_log_length, &info_log_length, log));
     std::string infolog = log;
     delete[] log;
-    throw std::runtime_error("Error compiling shader:\n" + infolog);
+    std::stringstream files;
+    for(size_t i = 0; i < source.files.size(); ++i)
+      files << "  " << i + 1 << ": " << source.files[i] << std::endl;
+    throw std::runtime_error("Error compiling shader:\n" + files.str() + infolog);
   }
-  
+  shaders.insert(std::make_pair(key, shader));
+
   return shader;
 }
 
-void Loader::loadMesh(DrawableMesh* m)
+namespace {
+  // new pages get at least this much room
+  const size_t page_bytes = 4 << 20;
+  const size_t page_indices = 1 << 20;
+}
+
+void LoaderImpl::allocateMesh(const DrawableMesh* m, DrawableBuffer* b, size_t vertices, size_t indices)
 {
-  GLuint vtx_buf, idx_buf=0;
-  GLenum idx_type = 0;
-  GL_CHECK(glGenBuffers(1, &vtx_buf));
-  GL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, vtx_buf));
-  GL_CHECK(glBufferData(GL_COPY_WRITE_BUFFER, m->data_size, m->data, GL_STATIC_DRAW));
-
-  if(m->index_data) {
-    GLuint idx_stride;
-    switch(m->index_type) {
-    case DrawableMesh::UByte: idx_stride = 1; idx_type = GL_UNSIGNED_BYTE; break;
-    case DrawableMesh::UShort: idx_stride = 2; idx_type = GL_UNSIGNED_SHORT; break;
-    default: idx_stride = 0; break;
+  // the key is everything that goes into the VAO
+  uint64_t key = hashBytes(&b->idx_type, sizeof(b->idx_type));
+  key = hashBytes(&m->data_stride, sizeof(m->data_stride), key);
+  for(auto i = m->attributes.begin(); i != m->attributes.end(); ++i) {
+    const uint64_t fields[] = { uint64_t(i->type), uint64_t(i->loc), uint64_t(i->start), uint64_t(i->size), uint64_t(i->special) };
+    key = hashBytes(fields, sizeof(fields), key);
+  }
+  std::vector<MeshPage*>& pages = mesh_pages[key];
+  for(auto i = pages.begin(); i != pages.end(); ++i) {
+    MeshPage* p = *i;
+    b->vtx_alloc = p->vertices.allocate(vertices);
+    if(b->vtx_alloc == tlsfAllocator::none)
+      continue;
+    b->idx_alloc = p->indices.allocate(indices);
+    if(b->idx_alloc == tlsfAllocator::none) {
+      p->vertices.free(b->vtx_alloc);
+      continue;
     }
-
-    GL_CHECK(glGenBuffers(1, &idx_buf));
-    GL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, idx_buf));
-    GL_CHECK(glBufferData(GL_COPY_WRITE_BUFFER, m->index_count*idx_stride, m->index_data, GL_STATIC_DRAW));
+    b->page = p;
+    return;
   }
 
-  // make sure the data is actually ready before giving it to the main thread
-  GL_CHECK(glFinish());
+  MeshPage* p = new MeshPage;
+  p->vao = 0;
+  p->idx_type = b->idx_type;
+  p->id = next_page_id++;
+  const size_t vtx_capacity = std::max(page_bytes / std::max(m->data_stride, size_t(1)), vertices);
+  const size_t idx_capacity = std::max(page_indices, indices);
+  p->vertices.grow(vtx_capacity);
+  p->indices.grow(idx_capacity);
+  p->meshes = 0;
+  GL_CHECK(glGenBuffers(1, &p->vtxbuffer));
+  GL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, p->vtxbuffer));
+  GL_CHECK(glBufferData(GL_COPY_WRITE_BUFFER, vtx_capacity * m->data_stride, 0, GL_STATIC_DRAW));
+  GL_CHECK(glGenBuffers(1, &p->idxbuffer));
+  GL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, p->idxbuffer));
+  GL_CHECK(glBufferData(GL_COPY_WRITE_BUFFER, idx_capacity * (b->idx_type == GL_UNSIGNED_INT ? 4 : 2), 0, GL_STATIC_DRAW));
+  pages.push_back(p);
+  b->page = p;
+  b->vtx_alloc = p->vertices.allocate(vertices);
+  b->idx_alloc = p->indices.allocate(indices);
+}
+
+void Loader::loadMesh(DrawableMesh* m, UploadDone done)
+{
+  const size_t vertices = vertexCount(m);
+  // Pages only hold 16 and 32-bit indices, and everything is drawn
+  // indexed, so unindexed meshes get the trivial list
+  std::vector<uint32_t> indices;
+  readIndices(m, indices);
+  std::vector<uint16_t> short_indices;
+  GLenum idx_type = GL_UNSIGNED_INT;
+  size_t idx_size = 4;
+  const void* idx_data = indices.data();
+  if(vertices <= 0x10000) {
+    short_indices.assign(indices.begin(), indices.end());
+    idx_type = GL_UNSIGNED_SHORT;
+    idx_size = 2;
+    idx_data = short_indices.data();
+  }
+  const size_t idx_count = indices.size();
 
   DrawableBuffer* b = new DrawableBuffer;
   b->vao = 0;
-  b->vtxbuffer = vtx_buf;
-  b->idxbuffer = idx_buf;
   b->idx_type = idx_type;
+  b->index_count = idx_count;
+  self->allocateMesh(m, b, vertices, idx_count);
+  MeshPage* page = b->page;
+  b->base_vertex = page->vertices.offset(b->vtx_alloc);
+  b->first_index = page->indices.offset(b->idx_alloc);
+  b->sort_id = (page->id << 10) | (page->meshes++ & 0x3ff);
+
+  GL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, page->vtxbuffer));
+  self->upload(GL_COPY_WRITE_BUFFER, b->base_vertex * m->data_stride, vertices * m->data_stride, m->data);
+  GL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, page->idxbuffer));
+  self->upload(GL_COPY_WRITE_BUFFER, b->first_index * idx_size, idx_count * idx_size, idx_data);
+
+  // the mesh isn't usable until the copies are done, so only publish it then
+  self->finishUpload([=] {
+      m->buffer = b;
+      if(done)
+        done();
+    });
+}
 
-  m->buffer = b;
+// Main thread only, between frames. The mesh stops being drawn right
+// away, but its space only goes back to its page once the GPU is past
+// every frame that might have drawn it; pollUploads() sees to that on
+// the loader thread. The page and its VAO stay around for the next mesh
+// with the same layout.
+void Loader::releaseMesh(DrawableMesh* m)
+{
+  DrawableBuffer* b = m->buffer;
+  if(!b)
+    return;
+  m->buffer = 0; // draws check for this
+  RetiredMesh r;
+  r.buffer = b;
+  r.fence = GL_CHECK(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+  // the loader waits from its own context, which can't flush this one
+  GL_CHECK(glFlush());
+  boost::mutex::scoped_lock lock(self->retired_lock);
+  self->retired.push_back(r);
+}
+
+void LoaderImpl::freeRetiredMeshes(bool wait)
+{
+  boost::mutex::scoped_lock lock(retired_lock);
+  while(!retired.empty()) {
+    const RetiredMesh& r = retired.front();
+    // fences pass in order, so the first one that hasn't holds up the rest
+    const GLenum status = GL_CHECK(glClientWaitSync(r.fence, 0, wait ? GL_TIMEOUT_IGNORED : 0));
+    if(status == GL_TIMEOUT_EXPIRED)
+      break;
+    GL_CHECK(glDeleteSync(r.fence));
+    DrawableBuffer* b = r.buffer;
+    b->page->vertices.free(b->vtx_alloc);
+    b->page->indices.free(b->idx_alloc);
+    delete b;
+    retired.pop_front();
+  }
 }
 
 void Loader::mainThreadLoadMesh(DrawableMesh* m)
 {
+  MeshPage* page = m->buffer->page;
+  if(page->vao) {
+    m->buffer->vao = page->vao;
+    return;
+  }
+
   GLuint vao;
   GL_CHECK(glGenVertexArrays(1, &vao));
   GL_CHECK(glBindVertexArray(vao));
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m->buffer->vtxbuffer));
-  GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->buffer->idxbuffer));
+  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, page->vtxbuffer));
+  GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page->idxbuffer));
 
   std::set<DrawableMesh::AttribLocation> used_locs;
   auto end = m->attributes.end();
@@ -163,6 +383,7 @@ void Loader::mainThreadLoadMesh(DrawableMesh* m)
   if(!used_locs.count(DrawableMesh::SkinWeight))
     GL_CHECK(glVertexAttrib4f(DrawableMesh::SkinWeight, 0.f, 0.f, 0.f, 0.f));
 
+  page->vao = vao;
   m->buffer->vao = vao;
 }
 
@@ -171,7 +392,7 @@ boost::any Loader::queryUniform(ShaderProgram* prog, std::string name)
   return boost::any(glGetUniformLocation(prog->gl_id, name.c_str()));
 }
 
-ShaderProgram* Loader::loadProgram(std::string vert, std::string frag, std::string geom) {
+ShaderProgram* Loader::loadProgram(const ShaderSource& vert, const ShaderSource& frag, const ShaderSource& geom) {
   ShaderSet s;
   s.vert = self->loadShader(vert, GL_VERTEX_SHADER);
   s.frag = self->loadShader(frag, GL_FRAGMENT_SHADER);
@@ -235,6 +456,38 @@ ShaderProgram* Loader::loadProgram(std::string vert, std::string frag, std::stri
     delete[] log;
     throw std::runtime_error("Error linking program: \n" + infolog);
   }
+  prog->vtxfmt_loc = GL_CHECK(glGetUniformLocation(prog->gl_id, "sense_vtxfmt"));
+  prog->pos_scale_loc = GL_CHECK(glGetUniformLocation(prog->gl_id, "sense_pos_scale"));
+  prog->pos_bias_loc = GL_CHECK(glGetUniformLocation(prog->gl_id, "sense_pos_bias"));
+  static const char* instance_bases[] = { "sense_matrix_base", "sense_affine_base", "sense_quat_base" };
+  static const InstanceFormat instance_formats[] = { InstanceMatrix, InstanceAffine, InstanceQuat };
+  prog->instance_base_loc = -1;
+  prog->instance_format = InstanceMatrix;
+  for(size_t i = 0; i < 3; ++i) {
+    GLint loc = GL_CHECK(glGetUniformLocation(prog->gl_id, instance_bases[i]));
+    if(loc == -1)
+      continue;
+    if(prog->instance_base_loc != -1)
+      throw std::runtime_error("Error linking program: more than one sense_modelview variant is used");
+    prog->instance_base_loc = loc;
+    prog->instance_format = instance_formats[i];
+  }
+  prog->lamp_grid_loc = GL_CHECK(glGetUniformLocation(prog->gl_id, "sense_lamp_grid"));
+  prog->lamp_slices_loc = GL_CHECK(glGetUniformLocation(prog->gl_id, "sense_lamp_slices"));
+  prog->viewport_loc = GL_CHECK(glGetUniformLocation(prog->gl_id, "sense_viewport"));
+  prog->clip_to_lamp_loc = GL_CHECK(glGetUniformLocation(prog->gl_id, "sense_clip_to_lamp"));
+  prog->samples_loc = GL_CHECK(glGetUniformLocation(prog->gl_id, "sense_samples"));
+  // the pipeline's own buffers sit on fixed units
+  static const char* fixed_samplers[] = { "sense_instances", "sense_lamps", "sense_lamp_cells", "sense_lamp_indices" };
+  static const GLint fixed_units[] = { SENSE_INSTANCE_UNIT, SENSE_LIGHT_UNIT + LightBuffers::Lamps, SENSE_LIGHT_UNIT + LightBuffers::Cells, SENSE_LIGHT_UNIT + LightBuffers::Indices };
+  GL_CHECK(glUseProgram(prog->gl_id));
+  for(size_t i = 0; i < 4; ++i) {
+    GLint loc = GL_CHECK(glGetUniformLocation(prog->gl_id, fixed_samplers[i]));
+    if(loc != -1) {
+      GL_CHECK(glUniform1i(loc, fixed_units[i]));
+    }
+  }
+  GL_CHECK(glUseProgram(0));
   self->programs.insert(std::make_pair(s, prog));
   return prog;
 }
@@ -246,6 +499,92 @@ void Loader::releaseProgram(ShaderProgram* program)
   // No actual resource freeing is done yet. Garbage collection is handled when needed.
 }
 
+MaterialBindings* Loader::compileBindings(ShaderProgram* prog, const std::vector<Uniform>& uniforms)
+{
+  if(!prog)
+    return 0;
+
+  MaterialBindings* b = new MaterialBindings;
+  b->program = prog;
+  b->bones_loc = -1;
+
+  // samplers get fixed units, so they're set on the program once here
+  // rather than every time the material is bound
+  GL_CHECK(glUseProgram(prog->gl_id));
+  for(auto i = uniforms.begin(); i != uniforms.end(); ++i) {
+    GLint loc = boost::any_cast<int>(i->pipe_id);
+    TextureBinding t;
+    t.target = GL_TEXTURE_2D_MULTISAMPLE;
+    t.texture = 0;
+    t.image = 0;
+    switch(i->type) {
+    case UniformDef::Texture:
+      t.source = TextureBinding::FromImage;
+      t.target = GL_TEXTURE_2D;
+      t.image = boost::any_cast<Image*>(i->value);
+      if(t.image->tex)
+        t.texture = t.image->tex->id;
+      break;
+    case UniformDef::GBufColor:
+      t.source = TextureBinding::GBufColor;
+      break;
+    case UniformDef::GBufNormal:
+      t.source = TextureBinding::GBufNormal;
+      break;
+    case UniformDef::GBufMatProp:
+      t.source = TextureBinding::GBufMatProp;
+      break;
+    case UniformDef::DepthInfo:
+      t.source = TextureBinding::GBufDepth;
+      break;
+    case UniformDef::ModelView:
+      continue; // instance transforms come from the instance buffer now
+    case UniformDef::LightColor:
+    case UniformDef::LightRadius:
+    case UniformDef::LightPosition:
+      continue; // and lamps from the light grid, through sense_lamp()
+    case UniformDef::BoneMatrices:
+      b->bones_loc = loc;
+      continue;
+    default:
+      b->unsupported = i->name;
+      continue;
+    }
+    auto unit = prog->sampler_units.find(loc);
+    if(unit == prog->sampler_units.end()) {
+      if(prog->sampler_units.size() >= SENSE_LIGHT_UNIT) {
+        b->unsupported = i->name;
+        continue;
+      }
+      unit = prog->sampler_units.insert(std::make_pair(loc, GLuint(prog->sampler_units.size()))).first;
+      GL_CHECK(glUniform1i(loc, unit->second));
+    }
+    t.unit = unit->second;
+    b->textures.push_back(t);
+  }
+  GL_CHECK(glUseProgram(0));
+
+  GL_CHECK(glValidateProgram(prog->gl_id));
+  GLint status;
+  GL_CHECK(glGetProgramiv(prog->gl_id, GL_VALIDATE_STATUS, &status));
+  if(status == GL_FALSE) {
+    int info_log_length;
+    GL_CHECK(glGetProgramiv(prog->gl_id, GL_INFO_LOG_LENGTH, &info_log_length));
+    char *log = new char[info_log_length];
+    GL_CHECK(glGetProgramInfoLog(prog->gl_id, info_log_length, &info_log_length, log));
+    std::string infolog = log;
+    delete[] log;
+    delete b;
+    throw std::runtime_error("Error validating shader: " + infolog);
+  }
+  return b;
+}
+
+void Loader::releaseBindings(MaterialBindings* b)
+{
+  delete b;
+}
+
 void Loader::loadTexture(Image* img) {
   GLenum internal_format, format;
   GLuint texid;
@@ -258,15 +597,53 @@ void Loader::loadTexture(Image* img) {
 
   GL_CHECK(glGenTextures(1, &texid));
   GL_CHECK(glBindTexture(GL_TEXTURE_2D, texid));
-  GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, internal_format, img->width, img->height, 0, format, GL_UNSIGNED_BYTE, img->data));
+  // small mip levels of RGB images won't be 4-byte aligned
+  GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+  const unsigned int levels = std::max(img->mip_count, 1u);
+  size_t chain_size = 0;
+  for(unsigned int level = 0; level < levels; ++level)
+    chain_size += mipSize(img, level);
+  // With the chain staged, the level pointers are offsets into the
+  // unpack buffer and glTexImage2D doesn't have to wait for the copy
+  const char* level_data = img->data;
+  const size_t staged = self->staging->stage(img->data, chain_size, *self->uploads);
+  if(staged != ringAllocator::npos) {
+    GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, self->staging->buffer()));
+    level_data = (const char*)0 + staged;
+  }
+  for(unsigned int level = 0; level < levels; ++level) {
+    GL_CHECK(glTexImage2D(GL_TEXTURE_2D, level, internal_format, mipWidth(img, level), mipHeight(img, level), 0, format, GL_UNSIGNED_BYTE, level_data));
+    level_data += mipSize(img, level);
+  }
+  GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
   GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
   GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
   if(img->pipe_build_mips) {
     GL_CHECK(glGenerateMipmap(GL_TEXTURE_2D));
   }
-  GL_CHECK(glFinish());
-  img->tex = new Texture;
-  img->tex->id = texid;
+  self->finishUpload([=] {
+      img->tex = new Texture;
+      img->tex->id = texid;
+    });
+}
+
+void Loader::pollUploads() {
+  self->staging->retire(self->uploads->poll());
+  self->freeRetiredMeshes(false);
+}
+
+void LoaderImpl::upload(GLenum target, size_t offset, size_t size, const void* data) {
+  const size_t staged = staging->stage(data, size, *uploads);
+  if(staged == ringAllocator::npos) {
+    GL_CHECK(glBufferSubData(target, offset, size, data));
+    return;
+  }
+  GL_CHECK(glBindBuffer(GL_COPY_READ_BUFFER, staging->buffer()));
+  GL_CHECK(glCopyBufferSubData(GL_COPY_READ_BUFFER, target, staged, offset, size));
+}
+
+void LoaderImpl::finishUpload(const Loader::UploadDone& done) {
+  staging->fence(uploads->submit(done));
 }
 
 bool Loader::isThreaded() {
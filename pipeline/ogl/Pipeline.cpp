@@ -19,13 +19,53 @@
 #include "../Drawable.hpp"
 #include "../Image.hpp"
 
+#include "mesh/Occluder.hpp"
 #include "world/DataManager.hpp"
 
 #include <boost/foreach.hpp>
+#include <algorithm>
+#include <cstring>
+
+// Meshes with fewer clusters than this aren't worth splitting into
+// several draws
+static const size_t min_culled_clusters = 8;
+
+static size_t indexSize(GLenum type)
+{
+  switch(type) {
+  case GL_UNSIGNED_BYTE:
+    return 1;
+  case GL_UNSIGNED_SHORT:
+    return 2;
+  default:
+    return 4;
+  }
+}
 
 Pipeline::Pipeline()
   : self(new PipelineImpl)
 {
+  self->recording = 0;
+  self->current_framebuffer = 0;
+  self->gl = new GlState(GlFunctions::fromGlew());
+  self->instances = new InstanceRing;
+  self->retained_buffer = new InstanceBuffer;
+  self->retained_texels = 0;
+  self->frustum = frustumFromMatrix(glm::mat4(1.f));
+  self->retained_culled = false;
+  self->cull_matrix = glm::mat4(1.f);
+  self->occlusion = new OcclusionBuffer;
+  self->occluded = 0;
+  self->clusters_culled = 0;
+  self->cluster_hidden = 0;
+  self->light_grid = new LightGrid;
+  self->light_buffers = new LightBuffers;
+  self->frame_lamps = 0;
+  self->graph_split = 0;
+  std::fill(self->gbuf_textures, self->gbuf_textures + 4, 0);
+  self->batches = 0;
+  self->stats = Pipeline::FrameStats();
+
   // Get information on FSAA availability
   int dsamples, csamples;
   GL_CHECK(glGetIntegerv(GL_MAX_DEPTH_TEXTURE_SAMPLES, &dsamples));
@@ -40,10 +80,10 @@ Pipeline::Pipeline()
     self->fsaa_levels.insert(1);
 
   // Enable some standard state
-  GL_CHECK(glEnable(GL_MULTISAMPLE));
-  GL_CHECK(glEnable(GL_FRAMEBUFFER_SRGB));
-  GL_CHECK(glEnable(GL_SAMPLE_ALPHA_TO_COVERAGE));
-  GL_CHECK(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+  GL_CHECK(self->gl->setEnabled(GL_MULTISAMPLE, true));
+  GL_CHECK(self->gl->setEnabled(GL_FRAMEBUFFER_SRGB, true));
+  GL_CHECK(self->gl->setEnabled(GL_SAMPLE_ALPHA_TO_COVERAGE, true));
+  GL_CHECK(self->gl->blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
   GL_CHECK(glDepthFunc(GL_LEQUAL));
   // cull face disabled until I make sure everything is consistently wound
 //  GL_CHECK(glEnable(GL_CULL_FACE));
@@ -52,130 +92,166 @@ Pipeline::Pipeline()
 }
 
 Pipeline::~Pipeline()
-{}
+{
+  for(size_t i = 0; i < self->buckets.size(); ++i)
+    delete self->buckets[i];
+  delete self->retained_buffer;
+  delete self->occlusion;
+  for(auto i = self->occluder_meshes.begin(); i != self->occluder_meshes.end(); ++i)
+    delete i->second;
+  for(auto i = self->cluster_sets.begin(); i != self->cluster_sets.end(); ++i)
+    delete i->second;
+  delete self->light_buffers;
+  delete self->light_grid;
+  for(auto i = self->graph_fbos.begin(); i != self->graph_fbos.end(); ++i)
+    glDeleteFramebuffers(1, &i->second);
+  self->releaseGraphTargets();
+  std::vector<uint32_t> idle;
+  self->target_pool.drain(idle);
+  for(size_t i = 0; i < idle.size(); ++i)
+    glDeleteTextures(1, &idle[i]);
+  delete self->instances;
+  delete self->gl;
+}
+
+void Pipeline::addDrawTask(DrawableMesh* mesh, Material* mat, glm::mat4 mv, RenderPass pass, size_t lod)
+{
+  if(pass >= Pipeline::PassLighting)
+    throw std::logic_error("Tried to add user mesh for non-user pass");
+  self->addDrawTask(mesh, mat, mv, pass, lod);
+}
+
+DrawBucket* Pipeline::drawBucket(size_t slot)
+{
+  while(self->buckets.size() <= slot)
+    self->buckets.push_back(new DrawBucket);
+  return self->buckets[slot];
+}
 
-void Pipeline::addDrawTask(DrawableMesh* mesh, Material* mat, glm::mat4 mv, RenderPass pass)
+void Pipeline::addDrawTask(DrawBucket* bucket, DrawableMesh* mesh, Material* mat, glm::mat4 mv, RenderPass pass, size_t lod)
 {
   if(pass >= Pipeline::PassLighting)
     throw std::logic_error("Tried to add user mesh for non-user pass");
-  self->addDrawTask(mesh, mat, mv, pass);
+  bucket->draws.add(self->drawKey(mesh, mat, mv, pass, lod), mesh, mat, lod, mv);
+}
+
+RenderScene& Pipeline::scene()
+{
+  return self->scene;
+}
+
+void Pipeline::setFrustum(const glm::mat4& view_projection)
+{
+  self->frustum = frustumFromMatrix(view_projection);
+  self->cull_matrix = view_projection;
+  self->retained_culled = false;
+}
+
+void Pipeline::addLamp(Lamp* lamp)
+{
+  self->lamps[self->recording].push_back(*lamp);
 }
 
 void Pipeline::addSkinnedDrawTask(DrawableMesh* mesh, Material* mat, std::vector<glm::mat4>& bones, RenderPass pass)
 {
-  DrawTaskObject d;
-  d.mesh = mesh;
-  d.mat = mat;
-  DrawTaskData dt;
-  dt.transforms = bones;
-  self->tasks[pass].insert(std::make_pair(d, dt));
+  if(bones.empty())
+    return;
+  self->recordingFrame().add(self->drawKey(mesh, mat, bones[0], pass, 0), mesh, mat, 0, bones);
 }
 
 void Pipeline::render()
 {
+  // pull in whatever the workers recorded; slot order keeps equal keys
+  // in a stable order from frame to frame
+  for(size_t i = 0; i < self->buckets.size(); ++i) {
+    self->recordingFrame().append(self->buckets[i]->draws);
+    self->buckets[i]->draws.clear();
+  }
+  // queue the lighting quad up front so the draw list only gets sorted once
+  Material* light = self->lamps[self->recording].empty() ? self->flatLight : self->lampLight;
+  self->addDrawTask(self->screenQuad, light, glm::mat4(1.f), Pipeline::PassLighting);
+  // what was recorded is now this frame; start recording the next one
+  self->recording ^= 1;
+  self->recordingFrame().clear();
+  self->lamps[self->recording].clear();
+  self->graph.clear();
   if(!self->current_framebuffer)
     return; // Skip rendering if there is no framebuffer
-  GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, self->current_framebuffer->gbuffer_id));
-  GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
-  GL_CHECK(glEnable(GL_DEPTH_TEST));
-  GL_CHECK(glDepthMask(GL_TRUE));
-  self->doRenderPass(Pipeline::PassStandard);
-  GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, self->current_framebuffer->lbuffer_id));
-  GL_CHECK(glClear(GL_COLOR_BUFFER_BIT));
-  GL_CHECK(glDepthMask(GL_FALSE));
-  GL_CHECK(glDisable(GL_DEPTH_TEST));
-  self->addDrawTask(self->screenQuad, self->flatLight, glm::mat4(1.f), Pipeline::PassLighting);
-  self->doRenderPass(Pipeline::PassLighting);
-  self->doRenderPass(Pipeline::PassPostLighting);
+  self->uploadInstances();
+  self->updateRetained();
+  // the loader and main thread jobs bind things between frames
+  self->gl->invalidate();
+  self->gl->resetStats();
+  self->batches = 0;
+  self->buildLightGrid();
+  self->buildGraph();
+  self->graph.execute(0, self->graph_split);
   self->current_framebuffer->dirty = true;
 }
   
 void Pipeline::endFrame()
 {
-  GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, self->current_framebuffer->lbuffer_id));
-  self->doRenderPass(Pipeline::PassPostEffect);
-  GL_CHECK(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0));
-  GL_CHECK(glBlitFramebuffer(0, 0, self->current_framebuffer->width, self->current_framebuffer->height, 0, 0, self->width, self->height, GL_COLOR_BUFFER_BIT, GL_NEAREST));
-}
+  // render() left an empty graph if it had nowhere to draw
+  if(self->graph.passCount())
+    self->graph.execute(self->graph_split);
+  // nothing else reads this frame's instances
+  self->instances->fence();
+  // The frame's transient textures go back for the next one. Whatever
+  // has sat in the pool unused for a while gets freed.
+  self->releaseGraphTargets();
+  std::vector<uint32_t> expired;
+  self->target_pool.endFrame(expired);
+  self->freeTextures(expired);
 
-// Here's our render target documentation!
-// R,G,B,A = color
-// X,Y,Z = Normal components
-// S = Specular Blend
-// Em = emission
-// Se = specular exponent
-// 0: [R][G][B][A]
-// 1: [X][Y][Z][S]
-// 2: [Em  ][Se  ]
-//
-// This is also (shockingly enough) the packing that the default material shader will expect for texture files
-// Alpha is stored even though we'll never use it directly, because it's needed for alpha-to-coverage support
+  const GlState::Stats& gl_stats = self->gl->stats();
+  self->stats.draws = self->renderingFrame().size() + self->retained.size();
+  // retained_visible is 0 for all three ways of being left out
+  self->stats.culled = std::count(self->retained_visible.begin(), self->retained_visible.end(), 0) - self->occluded - self->cluster_hidden;
+  self->stats.occluded = self->occluded;
+  self->stats.cluster_hidden = self->cluster_hidden;
+  self->stats.clusters_culled = self->clusters_culled;
+  self->stats.lamps = self->frame_lamps;
+  self->stats.lamps_culled = self->light_grid->culledLamps();
+  self->stats.passes = self->graph.schedule().size();
+  self->stats.passes_culled = self->graph.culledCount();
+  self->stats.targets = 0;
+  for(size_t i = 0; i < self->graph.targetCount(); ++i) {
+    if(self->graph.physical(i) != RenderGraph::none)
+      ++self->stats.targets;
+  }
+  self->stats.target_slots = self->graph.physicalCount();
+  const TargetPool::Stats& pool = self->target_pool.stats();
+  self->stats.pool_textures = pool.textures;
+  self->stats.pool_idle = pool.idle;
+  self->stats.pool_bytes = pool.bytes;
+  self->stats.pool_allocated = pool.allocated;
+  self->stats.pool_reused = pool.reused;
+  self->stats.pool_freed = pool.freed;
+  self->stats.batches = self->batches;
+  self->stats.state_changes = gl_stats.totalIssued();
+  self->stats.state_changes_skipped = gl_stats.totalSkipped();
+}
 
-static GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
 RenderTarget* Pipeline::createRenderTarget(uint32_t width, uint32_t height, bool mipmap)
 {
-  GLuint texids[5];
-  GLuint fboids[2];
-  glGenFramebuffers(2, fboids);
-  glGenTextures(5, texids);
-  RenderTarget rt;
-  rt.depth_id = texids[0];
-  rt.color_id = texids[1];
-  rt.normal_id = texids[2];
-  rt.matprop_id = texids[3];
-  rt.lighting_id = texids[4];
-  rt.lbuffer_id = fboids[0];
-  rt.gbuffer_id = fboids[1];
-
-  rt.build_mips = mipmap;
-  rt.dirty = true;
-
-  rt.width = width;
-  rt.height = height;
-
-  GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, rt.lbuffer_id));
-  GL_CHECK(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, rt.lighting_id));
-  GL_CHECK(glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, self->cur_fsaa, GL_RGBA16F, width, height, GL_FALSE));
-  GL_CHECK(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, rt.depth_id));
-  GL_CHECK(glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, self->cur_fsaa, GL_DEPTH24_STENCIL8, width, height, GL_FALSE));
-  GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, rt.lighting_id, 0));
-  GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D_MULTISAMPLE, rt.depth_id, 0));
-  GL_CHECK(glViewport(0, 0, width, height));
-  FBO_CHECK;
-  
-  GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, rt.gbuffer_id));
-  GL_CHECK(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, rt.color_id));
-  GL_CHECK(glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, self->cur_fsaa, GL_RGBA8, width, height, GL_FALSE));
-  GL_CHECK(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, rt.normal_id));
-  GL_CHECK(glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, self->cur_fsaa, GL_RGBA8, width, height, GL_FALSE));
-  GL_CHECK(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, rt.matprop_id));
-  GL_CHECK(glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, self->cur_fsaa, GL_RG16F, width, height, GL_FALSE));
-  GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, rt.color_id, 0));
-  GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D_MULTISAMPLE, rt.normal_id, 0));
-  GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D_MULTISAMPLE, rt.matprop_id, 0));
-  GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D_MULTISAMPLE, rt.depth_id, 0));
-  GL_CHECK(glViewport(0, 0, width, height));
-  GL_CHECK(glDrawBuffers(3, buffers));
-  FBO_CHECK;
+  RenderTarget* rt = new RenderTarget;
+  rt->build_mips = mipmap;
+  rt->dirty = true;
+  rt->width = width;
+  rt->height = height;
 
-  RenderTarget* result = new RenderTarget;
-  *result = rt;
-  return result;
+  rt->lighting_desc = RenderGraph::TargetDesc(width, height, RenderGraph::RGBA16F, self->cur_fsaa);
+  rt->lighting_id = self->acquireTexture(rt->lighting_desc);
+  return rt;
 }
 
+// The texture goes back to the pool rather than being freed, so a
+// target made soon after at the same size can have it
 void Pipeline::destroyRenderTarget(RenderTarget* rt)
 {
-  GLuint texids[5];
-  GLuint fboids[2];
-  texids[0] = rt->depth_id;
-  texids[1] = rt->color_id;
-  texids[2] = rt->normal_id;
-  texids[3] = rt->matprop_id;
-  texids[4] = rt->lighting_id;
-  fboids[0] = rt->lbuffer_id;
-  fboids[1] = rt->gbuffer_id;
-  GL_CHECK(glDeleteTextures(4, texids));
-  GL_CHECK(glDeleteFramebuffers(2, fboids));
+  self->target_pool.release(rt->lighting_desc, rt->lighting_id);
+  if(self->current_framebuffer == rt)
+    self->current_framebuffer = 0;
   delete rt;
 }
 
@@ -188,7 +264,7 @@ void Pipeline::setViewport(uint32_t width, uint32_t height)
 {
   self->width = width;
   self->height = height;
-  GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+  GL_CHECK(self->gl->bindFramebuffer(GL_FRAMEBUFFER, 0));
   GL_CHECK(glViewport(0, 0, width, height));
 }
 
@@ -197,143 +273,737 @@ Loader* Pipeline::createLoader()
   return new Loader;
 }
 
+const Pipeline::FrameStats& Pipeline::frameStats() const
+{
+  return self->stats;
+}
+
 void Pipeline::loadPipelineData(DataManager* mgr)
 {
   self->screenQuad = mgr->loadMesh("__quad__");
   self->flatLight = mgr->loadMaterial("flatlight");
+  self->lampLight = mgr->loadMaterial("lamplight");
+}
+
+uint64_t PipelineImpl::drawKey(DrawableMesh* mesh, Material* mat, const glm::mat4& mv, Pipeline::RenderPass pass, size_t lod)
+{
+  // things that aren't loaded yet get skipped at draw time; their ids don't matter
+  const uint32_t program = mat->shaders ? mat->shaders->gl_id : 0;
+  const uint32_t mesh_id = mesh->buffer ? mesh->buffer->sort_id : 0;
+  return DrawList::makeKey(pass, program, mat->id, mesh_id, lod, DrawList::depthBucket(mv));
+}
+
+void PipelineImpl::addDrawTask(DrawableMesh* mesh, Material* mat, glm::mat4 mv, Pipeline::RenderPass pass, size_t lod)
+{
+  recordingFrame().add(drawKey(mesh, mat, mv, pass, lod), mesh, mat, lod, mv);
+}
+
+// Every record's transform goes into the instance buffer in sorted
+// order, packed the way its program wants it. Batches are runs of the
+// same material, so their instances come out contiguous.
+void PipelineImpl::uploadInstances()
+{
+  DrawList& draws = renderingFrame();
+  const size_t count = draws.size();
+  // the loader can swap a material's bindings at any time, so the frame
+  // sticks with whatever it packed for
+  frame_bindings.resize(count);
+  frame_instances.resize(count);
+  size_t texels = 0;
+  for(size_t i = 0; i < count; ++i) {
+    MaterialBindings* b = draws.record(i).mat->bindings;
+    frame_bindings[i] = b;
+    frame_instances[i] = texels;
+    if(b && b->program->instance_base_loc != -1)
+      texels += instanceTexels(b->program->instance_format);
+  }
+  if(!texels)
+    return;
+  GLint base;
+  float* dst = instances->map(texels, base);
+  for(size_t i = 0; i < count; ++i) {
+    const MaterialBindings* b = frame_bindings[i];
+    frame_instances[i] += base;
+    if(b && b->program->instance_base_loc != -1) {
+      const InstanceFormat format = b->program->instance_format;
+      packInstances(format, dst, draws.transforms(draws.record(i)), 1);
+      dst += instanceTexels(format) * 4;
+    }
+  }
+  instances->unmap();
+}
+
+// Whether anything the retained list was built from has changed under
+// it: the loader swapped a material's bindings, or a mesh finished
+// loading. Only looks at each material and mesh once, not every draw.
+bool PipelineImpl::retainedStale() const
+{
+  for(auto i = retained_materials.begin(); i != retained_materials.end(); ++i) {
+    if(i->first->bindings != i->second)
+      return true;
+  }
+  for(auto i = retained_meshes.begin(); i != retained_meshes.end(); ++i) {
+    const DrawableBuffer* b = i->first->buffer;
+    if((b ? b->vao : 0) != i->second)
+      return true;
+  }
+  return false;
+}
+
+void PipelineImpl::rebuildRetained()
+{
+  retained.clear();
+  record_proxies.clear();
+  proxy_records.assign(scene.capacity(), ~0u);
+  retained_materials.clear();
+  retained_meshes.clear();
+  for(RenderScene::ProxyId id = 0; id < scene.capacity(); ++id) {
+    const RenderScene::Proxy& p = scene.proxy(id);
+    if(!p.live)
+      continue;
+    retained.add(drawKey(p.mesh, p.mat, p.transform, Pipeline::RenderPass(p.pass), p.lod), p.mesh, p.mat, p.lod, p.transform);
+    record_proxies.push_back(id);
+  }
+  retained.sort();
+
+  const size_t count = retained.size();
+  retained_bindings.resize(count);
+  retained_instances.resize(count);
+  size_t texels = 0;
+  for(size_t i = 0; i < count; ++i) {
+    const DrawList::Record& r = retained.record(i);
+    MaterialBindings* b = r.mat->bindings;
+    retained_bindings[i] = b;
+    retained_instances[i] = texels;
+    proxy_records[record_proxies[retained.keys()[i].index]] = i;
+    if(b && b->program->instance_base_loc != -1)
+      texels += instanceTexels(b->program->instance_format);
+    retained_materials.push_back(std::make_pair(r.mat, b));
+    retained_meshes.push_back(std::make_pair(r.mesh, r.mesh->buffer ? r.mesh->buffer->vao : 0));
+  }
+  std::sort(retained_materials.begin(), retained_materials.end());
+  retained_materials.erase(std::unique(retained_materials.begin(), retained_materials.end()), retained_materials.end());
+  std::sort(retained_meshes.begin(), retained_meshes.end());
+  retained_meshes.erase(std::unique(retained_meshes.begin(), retained_meshes.end()), retained_meshes.end());
+  retained_texels = texels;
+  repackRetained();
+
+  // the records came back in a new order, so the old results don't line up
+  retained_culled = false;
+  cull_tree.clear();
+  proxy_leaves.assign(scene.capacity(), AabbTree::none);
+  for(RenderScene::ProxyId id = 0; id < scene.capacity(); ++id) {
+    if(scene.proxy(id).live)
+      placeProxy(id, false);
+  }
+  pruneMeshCaches();
+}
+
+// Write every retained instance from the scene's current transforms
+void PipelineImpl::repackRetained()
+{
+  float* dst = retained_buffer->map(retained_texels);
+  for(size_t i = 0; i < retained.size(); ++i) {
+    const MaterialBindings* b = retained_bindings[i];
+    if(b && b->program->instance_base_loc != -1) {
+      const InstanceFormat format = b->program->instance_format;
+      packInstances(format, dst, &scene.proxy(record_proxies[retained.keys()[i].index]).transform, 1);
+      dst += instanceTexels(format) * 4;
+    }
+  }
+  retained_buffer->unmap();
 }
 
-void PipelineImpl::addDrawTask(DrawableMesh* mesh, Material* mat, glm::mat4 mv, Pipeline::RenderPass pass)
+// Put a proxy's leaf in the cull tree where its bounds are now. Proxies
+// without bounds (mesh not loaded yet, or straddling the eye plane)
+// have no leaf and are always drawn. With refit set, leaves that stay
+// in the tree are only resized and refit() has to follow.
+void PipelineImpl::placeProxy(RenderScene::ProxyId id, bool refit)
 {
-  DrawTaskObject d;
-  d.mesh = mesh;
-  d.mat = mat;
-  auto i = tasks[pass].find(d);
-  if(i != tasks[pass].end()) {
-    i->second.transforms.push_back(mv);
+  const RenderScene::Proxy& p = scene.proxy(id);
+  AabbTree::NodeId& leaf = proxy_leaves[id];
+  Aabb box;
+  const bool bounded = p.mesh->buffer && transformBounds(p.mesh->bounds, p.transform, box);
+  if(!bounded) {
+    if(leaf != AabbTree::none)
+      cull_tree.remove(leaf);
+    leaf = AabbTree::none;
+  } else if(leaf == AabbTree::none) {
+    leaf = cull_tree.insert(box, id);
+  } else if(refit) {
+    cull_tree.setBox(leaf, box);
   } else {
-    DrawTaskData dt;
-    dt.transforms.push_back(mv);
-    tasks[pass].insert(std::make_pair(d, dt));
+    cull_tree.move(leaf, box);
+  }
+}
+
+// Bring the retained list up to date with the scene. Nothing changing
+// costs one look at each material and mesh; a few moves only rewrite
+// the instances of what moved, and lod switches only their records.
+void PipelineImpl::updateRetained()
+{
+  const std::vector<RenderScene::ProxyId>& moved = scene.moved();
+  const std::vector<RenderScene::ProxyId>& relod = scene.lodChanged();
+  if(scene.layoutChanged() || retainedStale()) {
+    rebuildRetained();
+  } else {
+    for(auto i = relod.begin(); i != relod.end(); ++i)
+      retained.setLod(proxy_records[*i], scene.proxy(*i).lod);
+    if(moved.size() * 4 > retained.size()) {
+      // past a point, repacking everything beats patching piecemeal, and
+      // refitting the tree beats moving leaves one by one
+      repackRetained();
+      for(auto i = moved.begin(); i != moved.end(); ++i)
+        placeProxy(*i, true);
+      cull_tree.refit();
+    } else {
+      for(auto i = moved.begin(); i != moved.end(); ++i) {
+        placeProxy(*i, false);
+        const uint32_t record = proxy_records[*i];
+        const MaterialBindings* b = retained_bindings[record];
+        if(!b || b->program->instance_base_loc == -1)
+          continue;
+        const InstanceFormat format = b->program->instance_format;
+        const size_t texels = instanceTexels(format);
+        instance_scratch.resize(texels * 4);
+        packInstances(format, &instance_scratch[0], &scene.proxy(*i).transform, 1);
+        retained_buffer->update(retained_instances[record], &instance_scratch[0], texels);
+      }
+    }
+  }
+  // cluster culling only looks at full detail draws, so lods count too
+  if(!moved.empty() || !relod.empty() || !retained_culled)
+    cullRetained();
+  scene.clearChanges();
+}
+
+void PipelineImpl::cullRetained()
+{
+  const size_t count = retained.size();
+  retained_visible.resize(count);
+  for(size_t i = 0; i < count; ++i)
+    retained_visible[i] = proxy_leaves[record_proxies[retained.keys()[i].index]] == AabbTree::none;
+  visible_proxies.clear();
+  cull_tree.query(frustum, visible_proxies);
+  for(auto i = visible_proxies.begin(); i != visible_proxies.end(); ++i)
+    retained_visible[proxy_records[*i]] = 1;
+  occludeRetained();
+  cullClusters();
+  retained_culled = true;
+}
+
+// Hide what's behind the occluders, out of what the frustum kept
+void PipelineImpl::occludeRetained()
+{
+  occluded = 0;
+  occlusion->clear();
+  bool any = false;
+  for(auto i = visible_proxies.begin(); i != visible_proxies.end(); ++i) {
+    const RenderScene::Proxy& p = scene.proxy(*i);
+    if(p.occluder && p.mesh->buffer) {
+      occlusion->addOccluder(occluderFor(p.mesh), cull_matrix * p.transform);
+      any = true;
+    }
+  }
+  if(!any)
+    return;
+  occlusion->rasterize();
+
+  for(auto i = visible_proxies.begin(); i != visible_proxies.end(); ++i) {
+    const RenderScene::Proxy& p = scene.proxy(*i);
+    if(p.occluder)
+      continue;
+    // the tree's boxes are in the space the frustum came from
+    const Aabb& leaf = cull_tree.leafBox(proxy_leaves[*i]);
+    DrawableMesh::Bounds bounds;
+    bounds.min = leaf.min;
+    bounds.max = leaf.max;
+    Aabb box;
+    if(!transformBounds(bounds, cull_matrix, box) || occlusion->testAabb(box))
+      continue;
+    retained_visible[proxy_records[*i]] = 0;
+    ++occluded;
+  }
+}
+
+OccluderMesh* PipelineImpl::occluderFor(DrawableMesh* mesh)
+{
+  OccluderMesh*& o = occluder_meshes[mesh];
+  if(!o) {
+    o = new OccluderMesh;
+    buildOccluder(mesh, *o);
   }
+  return o;
 }
 
+// Cull the clusters of what's still visible and drawn at full detail
+void PipelineImpl::cullClusters()
+{
+  clusters_culled = 0;
+  cluster_hidden = 0;
+  cluster_commands.clear();
+  retained_ranges.assign(retained.size(), std::make_pair(0u, 0u));
+  for(auto i = visible_proxies.begin(); i != visible_proxies.end(); ++i) {
+    const RenderScene::Proxy& p = scene.proxy(*i);
+    const uint32_t record = proxy_records[*i];
+    if(!retained_visible[record] || p.lod != 0 || p.mesh->clusters.size() < min_culled_clusters || !p.mesh->buffer)
+      continue;
+    ClusterSet* set = clusterSetFor(p.mesh);
+    const uint32_t begin = cluster_commands.size();
+    const size_t kept = set->cull(clusterViewFromMatrix(cull_matrix * p.transform), cluster_commands);
+    clusters_culled += set->size() - kept;
+    if(kept) {
+      retained_ranges[record] = std::make_pair(begin, uint32_t(cluster_commands.size()));
+    } else {
+      retained_visible[record] = 0;
+      ++cluster_hidden;
+    }
+  }
+}
+
+ClusterSet* PipelineImpl::clusterSetFor(DrawableMesh* mesh)
+{
+  ClusterSet*& set = cluster_sets[mesh];
+  if(!set)
+    set = new ClusterSet(mesh);
+  return set;
+}
+
+template <typename T>
+static void pruneMeshCache(std::unordered_map<DrawableMesh*, T*>& cache, const std::unordered_set<DrawableMesh*>& used)
+{
+  for(auto i = cache.begin(); i != cache.end();) {
+    if(used.count(i->first)) {
+      ++i;
+    } else {
+      delete i->second;
+      i = cache.erase(i);
+    }
+  }
+}
+
+// Meshes can only go away along with the last proxy using them, which
+// is a layout change, so this runs on every rebuild
+void PipelineImpl::pruneMeshCaches()
+{
+  if(occluder_meshes.empty() && cluster_sets.empty())
+    return;
+  std::unordered_set<DrawableMesh*> occluders;
+  std::unordered_set<DrawableMesh*> meshes;
+  for(RenderScene::ProxyId id = 0; id < scene.capacity(); ++id) {
+    const RenderScene::Proxy& p = scene.proxy(id);
+    if(!p.live)
+      continue;
+    meshes.insert(p.mesh);
+    if(p.occluder)
+      occluders.insert(p.mesh);
+  }
+  pruneMeshCache(occluder_meshes, occluders);
+  pruneMeshCache(cluster_sets, meshes);
+}
+
+// Here's our render target documentation!
+// R,G,B,A = color
+// X,Y,Z = Normal components
+// S = Specular Blend
+// Em = emission
+// Se = specular exponent
+// 0: [R][G][B][A]
+// 1: [X][Y][Z][S]
+// 2: [Em  ][Se  ]
+//
+// This is also (shockingly enough) the packing that the default material shader will expect for texture files
+// Alpha is stored even though we'll never use it directly, because it's needed for alpha-to-coverage support
+
+static GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+
+static GLenum internalFormat(RenderGraph::Format format)
+{
+  switch(format) {
+  case RenderGraph::RGBA8:
+    return GL_RGBA8;
+  case RenderGraph::RG16F:
+    return GL_RG16F;
+  case RenderGraph::RGBA16F:
+    return GL_RGBA16F;
+  default:
+    return GL_DEPTH24_STENCIL8;
+  }
+}
+
+bool PipelineImpl::hasDraws(Pipeline::RenderPass pass)
+{
+  size_t begin, end;
+  retained.passRange(pass, begin, end);
+  if(begin != end)
+    return true;
+  renderingFrame().passRange(pass, begin, end);
+  return begin != end;
+}
+
+// The frame's passes, in the order they run. The G-buffer is transient;
+// the lit image belongs to the RenderTarget and the screen to the
+// window, so passes that end up in either of those are what keeps the
+// rest alive. User passes with nothing to draw are left out.
+void PipelineImpl::buildGraph()
+{
+  const uint32_t w = current_framebuffer->width;
+  const uint32_t h = current_framebuffer->height;
+  RenderGraph::Handle gbuf[4];
+  gbuf[0] = graph.createTarget("gcol", RenderGraph::TargetDesc(w, h, RenderGraph::RGBA8, cur_fsaa));
+  gbuf[1] = graph.createTarget("gnor", RenderGraph::TargetDesc(w, h, RenderGraph::RGBA8, cur_fsaa));
+  gbuf[2] = graph.createTarget("gmat", RenderGraph::TargetDesc(w, h, RenderGraph::RG16F, cur_fsaa));
+  gbuf[3] = graph.createTarget("depth", RenderGraph::TargetDesc(w, h, RenderGraph::Depth24Stencil8, cur_fsaa));
+  RenderGraph::Handle lit = graph.importTarget("lcol");
+  RenderGraph::Handle screen = graph.importTarget("screen");
+
+  RenderGraph::PassId pass = graph.addPass("geometry", [this, w, h]() {
+      GL_CHECK(gl->bindFramebuffer(GL_FRAMEBUFFER, graphFramebuffer(gbuf_textures, 3, gbuf_textures[3])));
+      GL_CHECK(glViewport(0, 0, w, h));
+      // the depth mask applies to clears as well
+      GL_CHECK(gl->depthMask(true));
+      GL_CHECK(gl->setEnabled(GL_DEPTH_TEST, true));
+      GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+      doRenderPass(Pipeline::PassStandard);
+    });
+  for(size_t i = 0; i < 4; ++i)
+    gbuf[i] = graph.write(pass, gbuf[i]);
+
+  pass = graph.addPass("lighting", [this, w, h]() {
+      GL_CHECK(gl->bindFramebuffer(GL_FRAMEBUFFER, graphFramebuffer(&current_framebuffer->lighting_id, 1, 0)));
+      GL_CHECK(glViewport(0, 0, w, h));
+      GL_CHECK(glClear(GL_COLOR_BUFFER_BIT));
+      GL_CHECK(gl->depthMask(false));
+      GL_CHECK(gl->setEnabled(GL_DEPTH_TEST, false));
+      doRenderPass(Pipeline::PassLighting);
+    });
+  for(size_t i = 0; i < 4; ++i)
+    graph.read(pass, gbuf[i]);
+  lit = graph.write(pass, lit);
+
+  // Geometry drawn over the lit image. Its materials can bind the
+  // G-buffer, so that has to last until they're done.
+  RenderGraph::PassId end_pass = RenderGraph::none;
+  static const Pipeline::RenderPass overlays[] = { Pipeline::PassPostLighting, Pipeline::PassPostEffect };
+  for(size_t o = 0; o < 2; ++o) {
+    const Pipeline::RenderPass user_pass = overlays[o];
+    if(user_pass == Pipeline::PassPostEffect)
+      end_pass = graph.passCount();
+    if(!hasDraws(user_pass))
+      continue;
+    pass = graph.addPass(o ? "post-effect" : "post-lighting", [this, user_pass]() {
+        GL_CHECK(gl->bindFramebuffer(GL_FRAMEBUFFER, graphFramebuffer(&current_framebuffer->lighting_id, 1, 0)));
+        doRenderPass(user_pass);
+      });
+    for(size_t i = 0; i < 4; ++i)
+      graph.read(pass, gbuf[i]);
+    lit = graph.modify(pass, lit);
+  }
+
+  pass = graph.addPass("blit", [this]() {
+      GL_CHECK(gl->bindFramebuffer(GL_READ_FRAMEBUFFER, graphFramebuffer(&current_framebuffer->lighting_id, 1, 0)));
+      GL_CHECK(gl->bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0));
+      GL_CHECK(glViewport(0, 0, width, height));
+      GL_CHECK(glBlitFramebuffer(0, 0, current_framebuffer->width, current_framebuffer->height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST));
+    });
+  graph.read(pass, lit);
+  screen = graph.write(pass, screen);
+
+  graph.compile();
+  allocateGraphTargets(gbuf);
+  graph_split = graph.position(end_pass);
+}
+
+// Textures for every physical slot, for this frame only
+void PipelineImpl::allocateGraphTargets(const RenderGraph::Handle* gbuf)
+{
+  releaseGraphTargets(); // in case endFrame() never came
+  for(size_t s = 0; s < graph.physicalCount(); ++s) {
+    PooledTexture t;
+    t.desc = graph.physicalDesc(s);
+    t.id = acquireTexture(t.desc);
+    graph_textures.push_back(t);
+  }
+  for(size_t i = 0; i < 4; ++i) {
+    const uint32_t slot = graph.physical(graph.target(gbuf[i]));
+    gbuf_textures[i] = slot == RenderGraph::none ? 0 : graph_textures[slot].id;
+  }
+}
+
+// Backwards, so the pool hands each slot the same texture next frame
+// and the FBOs made for them stay good
+void PipelineImpl::releaseGraphTargets()
+{
+  for(size_t s = graph_textures.size(); s-- > 0;)
+    target_pool.release(graph_textures[s].desc, graph_textures[s].id);
+  graph_textures.clear();
+}
+
+GLuint PipelineImpl::acquireTexture(const RenderGraph::TargetDesc& desc)
+{
+  GLuint id = target_pool.acquire(desc);
+  if(id)
+    return id;
+  GL_CHECK(glGenTextures(1, &id));
+  GL_CHECK(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, id));
+  GL_CHECK(glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, internalFormat(desc.format), desc.width, desc.height, GL_FALSE));
+  gl->invalidate(); // we bound things behind its back
+  target_pool.add(desc);
+  return id;
+}
+
+void PipelineImpl::freeTextures(const std::vector<uint32_t>& ids)
+{
+  for(size_t i = 0; i < ids.size(); ++i) {
+    releaseFramebuffers(ids[i]);
+    GL_CHECK(glDeleteTextures(1, &ids[i]));
+  }
+  if(!ids.empty())
+    gl->invalidate(); // deleting bound objects unbinds them
+}
+
+GLuint PipelineImpl::graphFramebuffer(const GLuint* colors, size_t count, GLuint depth)
+{
+  std::vector<GLuint> key(colors, colors + count);
+  key.push_back(depth);
+  auto i = graph_fbos.find(key);
+  if(i != graph_fbos.end())
+    return i->second;
+
+  GLuint fbo;
+  GL_CHECK(glGenFramebuffers(1, &fbo));
+  GL_CHECK(gl->bindFramebuffer(GL_FRAMEBUFFER, fbo));
+  for(size_t c = 0; c < count; ++c) {
+    GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + c, GL_TEXTURE_2D_MULTISAMPLE, colors[c], 0));
+  }
+  if(depth) {
+    GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D_MULTISAMPLE, depth, 0));
+  }
+  GL_CHECK(glDrawBuffers(count, buffers));
+  FBO_CHECK;
+  graph_fbos[key] = fbo;
+  return fbo;
+}
+
+void PipelineImpl::releaseFramebuffers(GLuint texture)
+{
+  bool deleted = false;
+  for(auto i = graph_fbos.begin(); i != graph_fbos.end();) {
+    if(std::find(i->first.begin(), i->first.end(), texture) != i->first.end()) {
+      GL_CHECK(glDeleteFramebuffers(1, &i->second));
+      graph_fbos.erase(i++);
+      deleted = true;
+    } else {
+      ++i;
+    }
+  }
+  if(deleted)
+    gl->invalidate(); // deleting bound objects unbinds them
+}
+
+void PipelineImpl::bindMaterial(MaterialBindings* b)
+{
+  if(!b->unsupported.empty())
+    throw std::runtime_error("Tried to use unimplemenented uniform type (" + b->unsupported + ")");
+  for(auto t = b->textures.begin(); t != b->textures.end(); ++t) {
+    GLuint id = 0;
+    switch(t->source) {
+    case TextureBinding::FromImage:
+      if(!t->texture && t->image->tex)
+        t->texture = t->image->tex->id;
+      id = t->texture;
+      break;
+    case TextureBinding::GBufColor:
+      id = gbuf_textures[0];
+      break;
+    case TextureBinding::GBufNormal:
+      id = gbuf_textures[1];
+      break;
+    case TextureBinding::GBufMatProp:
+      id = gbuf_textures[2];
+      break;
+    case TextureBinding::GBufDepth:
+      id = gbuf_textures[3];
+      break;
+    }
+    GL_CHECK(gl->bindTexture(t->unit, t->target, id));
+  }
+}
+
+// Bin this frame's lamps and put them where shaders look for them.
+// They're in the space cull_matrix takes to clip space, so that's what
+// the grid is built over.
+void PipelineImpl::buildLightGrid()
+{
+  // with no lamps this is next to free, and leaves every list empty
+  // for any shader that still looks
+  const std::vector<Lamp>& frame = lamps[recording ^ 1];
+  frame_lamps = frame.size();
+  light_grid->build(cull_matrix, frame);
+  light_buffers->upload(*light_grid);
+  clip_to_lamp = glm::inverse(cull_matrix);
+  for(size_t b = 0; b < LightBuffers::BufferCount; ++b) {
+    GL_CHECK(gl->bindTexture(SENSE_LIGHT_UNIT + b, GL_TEXTURE_BUFFER, light_buffers->texture(LightBuffers::Buffer(b))));
+  }
+}
+
+void PipelineImpl::bindLamps(const ShaderProgram* prog)
+{
+  if(prog->lamp_grid_loc != -1) {
+    GL_CHECK(glUniform3i(prog->lamp_grid_loc, light_grid->tilesX(), light_grid->tilesY(), light_grid->slices()));
+  }
+  if(prog->lamp_slices_loc != -1) {
+    GL_CHECK(glUniform2f(prog->lamp_slices_loc, light_grid->sliceScale(), light_grid->sliceBias()));
+  }
+  if(prog->viewport_loc != -1) {
+    GL_CHECK(glUniform2f(prog->viewport_loc, current_framebuffer->width, current_framebuffer->height));
+  }
+  if(prog->clip_to_lamp_loc != -1) {
+    GL_CHECK(glUniformMatrix4fv(prog->clip_to_lamp_loc, 1, GL_FALSE, &clip_to_lamp[0][0]));
+  }
+  if(prog->samples_loc != -1) {
+    GL_CHECK(gl->uniform1i(prog->samples_loc, cur_fsaa));
+  }
+}
+
+// Meshes whose vertices decode the same way can share a draw call
+static bool sameDecode(const DrawableMesh* a, const DrawableMesh* b)
+{
+  if(a->quant_flags != b->quant_flags)
+    return false;
+  if(!(a->quant_flags & DrawableMesh::QuantPosition))
+    return true;
+  return memcmp(a->pos_scale, b->pos_scale, sizeof(a->pos_scale)) == 0 &&
+         memcmp(a->pos_bias, b->pos_bias, sizeof(a->pos_bias)) == 0;
+}
+
+// Retained draws first, then whatever was submitted this frame. Each
+// list brings its own instance buffer.
 void PipelineImpl::doRenderPass(Pipeline::RenderPass pass)
 {
-  auto end = tasks[pass].end();
-  for(auto i = tasks[pass].begin(); i != end; ++i) {
-    DrawTaskObject dto = i->first;
-    DrawTaskData dtd = i->second;
+  if(retained.size()) {
+    GL_CHECK(gl->bindTexture(SENSE_INSTANCE_UNIT, GL_TEXTURE_BUFFER, retained_buffer->texture()));
+    drawPass(retained, retained_bindings, retained_instances, &retained_visible[0], &retained_ranges, pass);
+  }
+  GL_CHECK(gl->bindTexture(SENSE_INSTANCE_UNIT, GL_TEXTURE_BUFFER, instances->texture()));
+  drawPass(renderingFrame(), frame_bindings, frame_instances, 0, 0, pass);
+}
+
+void PipelineImpl::drawPass(DrawList& draws, const std::vector<MaterialBindings*>& bindings, const std::vector<GLint>& instance_bases, const uint8_t* visible,
+                            const std::vector<std::pair<uint32_t, uint32_t> >* ranges, Pipeline::RenderPass pass)
+{
+  size_t begin, end;
+  draws.passRange(pass, begin, end);
 
-    // break out if the data isn't fully loaded
-    if(!dto.mat->shaders || !dto.mesh->buffer || !dto.mesh->buffer->vao)
+  // The list is sorted by program, then material, then mesh, so state
+  // only gets touched when it actually changes
+  ShaderProgram* cur_prog = 0;
+  MaterialBindings* cur_mat = 0;
+  DrawableMesh* cur_mesh = 0;
+  for(size_t i = begin; i != end;) {
+    const size_t first = i++;
+    const DrawList::Record& r = draws.record(first);
+    MaterialBindings* mat = bindings[first];
+
+    // skip it if the data isn't fully loaded, or it's out of view
+    if(!mat || !r.mesh->buffer || !r.mesh->buffer->vao || (visible && !visible[first]))
       continue;
 
-    // bind the shader and vertex array
-    GL_CHECK(glUseProgram(dto.mat->shaders->gl_id));
-    GL_CHECK(glBindVertexArray(dto.mesh->buffer->vao));
-
-    // loop over the uniforms. Set aside the modelview matrix if found.
-    GLint mv_id = -1;
-    GLuint current_tex = 0;
-    auto uend = dto.mat->uniforms.end();
-    for(auto j = dto.mat->uniforms.begin(); j != uend; j++) {
-      GLuint uid = boost::any_cast<int>(j->pipe_id);
-      switch(j->type) {
-      case UniformDef::Texture:
-        {
-          Image *img = boost::any_cast<Image*>(j->value);
-          GL_CHECK(glActiveTexture(GL_TEXTURE0+current_tex));
-          if(img->tex) {
-            GL_CHECK(glBindTexture(GL_TEXTURE_2D, img->tex->id));
-          } else {
-            GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
-          }
-          GL_CHECK(glUniform1i(uid, current_tex));
-          current_tex++;
-          break;
-        }
-      case UniformDef::ModelView:
-        {
-          mv_id = uid;
-          break;
-        }
-      case UniformDef::BoneMatrices:
-        {
-          size_t mat_count = dtd.transforms.size();
-          if(mat_count > SENSE_MAX_VTX_BONES)
-            mat_count = SENSE_MAX_VTX_BONES;
-          glUniformMatrix4fv(uid, mat_count, GL_FALSE, (GLfloat*)(&(dtd.transforms[0])));
-          break;
-        }
-      case UniformDef::GBufColor:
-        {
-          GL_CHECK(glActiveTexture(GL_TEXTURE0+current_tex));
-          GL_CHECK(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, current_framebuffer->color_id));
-          GL_CHECK(glUniform1i(uid, current_tex));
-          current_tex++;
+    // Neighbours with the same bindings, mesh page and vertex decoding
+    // share all their state and become one bucket of draw commands.
+    // Skinned draws bring their own bones, so they're always alone.
+    if(!r.skinned) {
+      for(; i != end; ++i) {
+        const DrawList::Record& n = draws.record(i);
+        if(n.skinned || bindings[i] != mat || !n.mesh->buffer || n.mesh->buffer->vao != r.mesh->buffer->vao || !sameDecode(n.mesh, r.mesh))
           break;
-        }
-      case UniformDef::GBufNormal:
-        {
-          GL_CHECK(glActiveTexture(GL_TEXTURE0+current_tex));
-          GL_CHECK(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, current_framebuffer->normal_id));
-          GL_CHECK(glUniform1i(uid, current_tex));
-          current_tex++;
-          break;
-        }
-      case UniformDef::GBufMatProp:
-        {
-          GL_CHECK(glActiveTexture(GL_TEXTURE0+current_tex));
-          GL_CHECK(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, current_framebuffer->matprop_id));
-          GL_CHECK(glUniform1i(uid, current_tex));
-          current_tex++;
-          break;
-        }
-      case UniformDef::DepthInfo:
-      case UniformDef::LightColor:
-      case UniformDef::LightPosition:
-      case UniformDef::LightRadius:
-      case UniformDef::Projection:
-      case UniformDef::Webview:
-      default:
-        throw std::runtime_error("Tried to use unimplemenented uniform type");
       }
     }
-    GL_CHECK(glValidateProgram(dto.mat->shaders->gl_id));
-    GLint status;
-    GL_CHECK(glGetProgramiv(dto.mat->shaders->gl_id, GL_VALIDATE_STATUS, &status));
-    if(status == GL_FALSE) {
-      int info_log_length;
-      GL_CHECK(glGetShaderiv(dto.mat->shaders->gl_id, GL_INFO_LOG_LENGTH, &info_log_length));
-      char *log = new char[info_log_length];
-      GL_CHECK(glGetShaderInfoLog(dto.mat->shaders->gl_id, info_log_length, &info_log_length, log));
-      std::string infolog = log;
-      delete[] log;
-      throw std::runtime_error("Error validating shader: " + infolog);
+
+    ShaderProgram* prog = mat->program;
+    if(prog != cur_prog) {
+      GL_CHECK(gl->useProgram(prog->gl_id));
+      bindLamps(prog);
+      cur_prog = prog;
+      cur_mat = 0;
+      cur_mesh = 0;
     }
-    if(mv_id != -1) {
-      // we have a model-view matrix array handle. We need to draw one or more instance passes now.
-      size_t cur_transform = 0;
-      size_t remaining_mvs = dtd.transforms.size();
-      do {
-        size_t batch_size = remaining_mvs <= SENSE_MAX_INSTANCES ? remaining_mvs : SENSE_MAX_INSTANCES;
-        GLfloat* data_ptr = (GLfloat*)&dtd.transforms[cur_transform];
-        GL_CHECK(glUniformMatrix4fv(mv_id, batch_size, GL_FALSE, data_ptr));
-        if(dto.mesh->index_data) {
-          GL_CHECK(glDrawElementsInstanced(GL_TRIANGLES, dto.mesh->index_count, dto.mesh->buffer->idx_type, 0, batch_size));
-        } else {
-          GL_CHECK(glDrawArraysInstanced(GL_TRIANGLES, 0, dto.mesh->data_size / dto.mesh->data_stride, batch_size));
+    if(r.mesh != cur_mesh) {
+      GL_CHECK(gl->bindVertexArray(r.mesh->buffer->vao));
+      // tell the shader how to unpack this mesh's vertices
+      if(prog->vtxfmt_loc != -1) {
+        GL_CHECK(gl->uniform1i(prog->vtxfmt_loc, r.mesh->quant_flags));
+      }
+      if(prog->pos_scale_loc != -1) {
+        GL_CHECK(gl->uniform3fv(prog->pos_scale_loc, r.mesh->pos_scale));
+      }
+      if(prog->pos_bias_loc != -1) {
+        GL_CHECK(gl->uniform3fv(prog->pos_bias_loc, r.mesh->pos_bias));
+      }
+      cur_mesh = r.mesh;
+    }
+    if(mat != cur_mat) {
+      bindMaterial(mat);
+      cur_mat = mat;
+    }
+    if(mat->bones_loc != -1 && r.skinned) {
+      size_t mat_count = r.transform_count;
+      if(mat_count > SENSE_MAX_VTX_BONES)
+        mat_count = SENSE_MAX_VTX_BONES;
+      GL_CHECK(glUniformMatrix4fv(mat->bones_loc, mat_count, GL_FALSE, (const GLfloat*)draws.transforms(r)));
+    }
+
+    commands.begin(prog->instance_base_loc != -1 ? instanceTexels(prog->instance_format) : 0);
+    for(size_t j = first; j != i; ++j) {
+      if(visible && !visible[j])
+        continue;
+      const DrawList::Record& d = draws.record(j);
+      const DrawableBuffer* b = d.mesh->buffer;
+      if(ranges && (*ranges)[j].first != (*ranges)[j].second) {
+        // just what's left of it after cluster culling
+        for(uint32_t c = (*ranges)[j].first; c != (*ranges)[j].second; ++c) {
+          const DrawCommand& cmd = cluster_commands[c];
+          commands.add(cmd.count, b->first_index + cmd.first_index, b->base_vertex, instance_bases[j]);
         }
-        cur_transform += batch_size;
-        remaining_mvs -= batch_size;
-      } while (remaining_mvs);
-    } else {
-      if(dto.mesh->index_data) {
-        GL_CHECK(glDrawElements(GL_TRIANGLES, dto.mesh->index_count, dto.mesh->buffer->idx_type, 0));
-      } else {
-        GL_CHECK(glDrawArrays(GL_TRIANGLES, 0, dto.mesh->data_size / dto.mesh->data_stride));
+        continue;
+      }
+      GLuint count = b->index_count;
+      GLuint start = b->first_index;
+      if(d.lod < d.mesh->lods.size()) {
+        count = d.mesh->lods[d.lod].index_count;
+        start += d.mesh->lods[d.lod].index_start;
       }
+      commands.add(count, start, b->base_vertex, instance_bases[j]);
+    }
+    submitCommands(prog, r.mesh->buffer->idx_type);
+  }
+}
+
+void PipelineImpl::submitCommands(const ShaderProgram* prog, GLenum idx_type)
+{
+  const std::vector<DrawCommand>& cmds = commands.commands();
+  const size_t idx_size = indexSize(idx_type);
+  if(prog->instance_base_loc != -1) {
+    // GL 3.2 can't give each draw of a multi-draw its own instance
+    // base, so instanced commands go one at a time
+    for(auto c = cmds.begin(); c != cmds.end(); ++c) {
+      GL_CHECK(gl->uniform1i(prog->instance_base_loc, c->base_instance));
+      GL_CHECK(glDrawElementsInstancedBaseVertex(GL_TRIANGLES, c->count, idx_type, (const GLvoid*)(c->first_index * idx_size), c->instance_count, c->base_vertex));
+      batches++;
+    }
+  } else if(cmds.size() == 1) {
+    GL_CHECK(glDrawElementsBaseVertex(GL_TRIANGLES, cmds[0].count, idx_type, (GLvoid*)(cmds[0].first_index * idx_size), cmds[0].base_vertex));
+    batches++;
+  } else {
+    multi_counts.clear();
+    multi_offsets.clear();
+    multi_base_vertices.clear();
+    for(auto c = cmds.begin(); c != cmds.end(); ++c) {
+      multi_counts.push_back(c->count);
+      multi_offsets.push_back((GLvoid*)(c->first_index * idx_size));
+      multi_base_vertices.push_back(c->base_vertex);
     }
+    GL_CHECK(glMultiDrawElementsBaseVertex(GL_TRIANGLES, &multi_counts[0], idx_type, &multi_offsets[0], cmds.size(), &multi_base_vertices[0]));
+    batches++;
   }
 }
@@ -0,0 +1,108 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "Upload.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+UploadQueue::UploadQueue(const FenceFunctions& gl)
+  : m_gl(gl), m_next_token(1)
+{
+  memset(&m_stats, 0, sizeof(m_stats));
+}
+
+UploadQueue::~UploadQueue()
+{
+  for(auto i = m_pending.begin(); i != m_pending.end(); ++i)
+    m_gl.deleteSync(i->sync);
+}
+
+uint64_t UploadQueue::submit(const Callback& done)
+{
+  Pending p;
+  p.token = m_next_token++;
+  p.sync = m_gl.fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  p.done = done;
+  m_pending.push_back(p);
+  // get the commands moving now, rather than whenever the driver feels like it
+  m_gl.flush();
+  m_stats.submitted++;
+  return p.token;
+}
+
+uint64_t UploadQueue::poll(bool wait)
+{
+  uint64_t finished = 0;
+  while(!m_pending.empty()) {
+    Pending& p = m_pending.front();
+    GLenum status = m_gl.clientWaitSync(p.sync, 0, 0);
+    if(status == GL_TIMEOUT_EXPIRED && wait) {
+      m_stats.stalls++;
+      do {
+        status = m_gl.clientWaitSync(p.sync, 0, 1000000000);
+      } while(status == GL_TIMEOUT_EXPIRED);
+    }
+    if(status == GL_TIMEOUT_EXPIRED)
+      break;
+    if(status == GL_WAIT_FAILED)
+      throw std::runtime_error("Waiting on an upload fence failed");
+    wait = false;
+    m_gl.deleteSync(p.sync);
+    finished = p.token;
+    Callback done = p.done;
+    m_pending.pop_front();
+    m_stats.completed++;
+    if(done)
+      done();
+  }
+  return finished;
+}
+
+// No GL_CHECK in here, so this links and runs against mock functions
+StagingBuffer::StagingBuffer(size_t size, const BufferFunctions& gl)
+  : m_gl(gl), m_ring(size)
+{
+  m_gl.genBuffers(1, &m_buffer);
+  m_gl.bindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+  m_gl.bufferData(GL_COPY_READ_BUFFER, size, 0, GL_STREAM_COPY);
+  m_gl.bindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+StagingBuffer::~StagingBuffer()
+{
+  m_gl.deleteBuffers(1, &m_buffer);
+}
+
+size_t StagingBuffer::stage(const void* data, size_t size, UploadQueue& uploads)
+{
+  if(size > m_ring.size())
+    return ringAllocator::npos;
+  size_t offset;
+  while((offset = m_ring.allocate(size, 16)) == ringAllocator::npos) {
+    // if it's only the unfenced data in the way, fence it so there's something to wait on
+    if(uploads.empty())
+      fence(uploads.submit(UploadQueue::Callback()));
+    retire(uploads.poll(true));
+  }
+  m_gl.bindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+  // the ring only hands out space whose uploads have finished
+  void* ptr = m_gl.mapBufferRange(GL_COPY_READ_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+  if(!ptr)
+    throw std::runtime_error("Couldn't map the staging buffer");
+  memcpy(ptr, data, size);
+  m_gl.unmapBuffer(GL_COPY_READ_BUFFER);
+  return offset;
+}
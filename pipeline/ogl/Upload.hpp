@@ -0,0 +1,144 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SENSE_PIPELINE_OGL_UPLOAD_HPP
+#define SENSE_PIPELINE_OGL_UPLOAD_HPP
+
+#include "GL/glew.h"
+#include "util/ring.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// The sync object entry points UploadQueue uses. Same idea as
+// GlFunctions: fill it from GLEW, or from a mock to drive the queue
+// without a context.
+struct FenceFunctions
+{
+  GLsync (GLAPIENTRY *fenceSync)(GLenum, GLbitfield);
+  GLenum (GLAPIENTRY *clientWaitSync)(GLsync, GLbitfield, GLuint64);
+  void (GLAPIENTRY *deleteSync)(GLsync);
+  void (GLAPIENTRY *flush)();
+
+  static FenceFunctions fromGlew() {
+    FenceFunctions f;
+    f.fenceSync = glFenceSync;
+    f.clientWaitSync = glClientWaitSync;
+    f.deleteSync = glDeleteSync;
+    f.flush = glFlush;
+    return f;
+  }
+};
+
+// And the buffer object ones StagingBuffer uses
+struct BufferFunctions
+{
+  void (GLAPIENTRY *genBuffers)(GLsizei, GLuint*);
+  void (GLAPIENTRY *deleteBuffers)(GLsizei, const GLuint*);
+  void (GLAPIENTRY *bindBuffer)(GLenum, GLuint);
+  void (GLAPIENTRY *bufferData)(GLenum, GLsizeiptr, const GLvoid*, GLenum);
+  GLvoid* (GLAPIENTRY *mapBufferRange)(GLenum, GLintptr, GLsizeiptr, GLbitfield);
+  GLboolean (GLAPIENTRY *unmapBuffer)(GLenum);
+
+  static BufferFunctions fromGlew() {
+    BufferFunctions f;
+    f.genBuffers = glGenBuffers;
+    f.deleteBuffers = glDeleteBuffers;
+    f.bindBuffer = glBindBuffer;
+    f.bufferData = glBufferData;
+    f.mapBufferRange = glMapBufferRange;
+    f.unmapBuffer = glUnmapBuffer;
+    return f;
+  }
+};
+
+// Uploads the loader has issued but the GPU may not have finished.
+// Each submit() fences everything issued before it; the callback runs
+// from poll() once the GPU is past that fence, which is when the asset
+// can be handed to the renderer.
+class UploadQueue
+{
+public:
+  typedef std::function<void()> Callback;
+
+  struct Stats
+  {
+    size_t submitted;
+    size_t completed;
+    size_t stalls; // times poll() had to block
+  };
+
+  explicit UploadQueue(const FenceFunctions&);
+  ~UploadQueue();
+
+  // Returns the fence's token; tokens count up from 1
+  uint64_t submit(const Callback& done);
+  // Run the callbacks of every finished upload, oldest first. With
+  // wait set, blocks until at least the oldest one is done. Returns the
+  // newest finished token, or 0 if nothing finished.
+  uint64_t poll(bool wait = false);
+
+  bool empty() const { return m_pending.empty(); }
+  const Stats& stats() const { return m_stats; }
+
+private:
+  struct Pending
+  {
+    uint64_t token;
+    GLsync sync;
+    Callback done;
+  };
+
+  FenceFunctions m_gl;
+  std::deque<Pending> m_pending;
+  uint64_t m_next_token;
+  Stats m_stats;
+
+  UploadQueue(const UploadQueue&);
+  UploadQueue& operator=(const UploadQueue&);
+};
+
+// Buffer the loader copies asset data into before handing it to GL, so
+// uploads come out of a buffer object (asynchronously) instead of
+// client memory. Space is recycled as the UploadQueue tokens it was
+// fenced with finish.
+class StagingBuffer
+{
+public:
+  StagingBuffer(size_t size, const BufferFunctions&);
+  ~StagingBuffer();
+
+  // Copy data in and return its offset in buffer(). Blocks on the queue
+  // if the ring is full of in-flight data. Returns ringAllocator::npos
+  // if it won't ever fit; upload straight from client memory then.
+  size_t stage(const void* data, size_t size, UploadQueue&);
+  // Close off what's been staged since the last call under token
+  void fence(uint64_t token) { m_ring.fence(token); }
+  void retire(uint64_t token) { if(token) m_ring.retire(token); }
+
+  GLuint buffer() const { return m_buffer; }
+
+private:
+  BufferFunctions m_gl;
+  ringAllocator m_ring;
+  GLuint m_buffer;
+
+  StagingBuffer(const StagingBuffer&);
+  StagingBuffer& operator=(const StagingBuffer&);
+};
+
+#endif // SENSE_PIPELINE_OGL_UPLOAD_HPP
@@ -17,7 +17,28 @@
 
 #include "GL/glew.h"
 #include "../interface.hpp"
+#include "../AabbTree.hpp"
+#include "../ClusterCulling.hpp"
+#include "../DrawCommands.hpp"
+#include "../DrawList.hpp"
+#include "../InstanceData.hpp"
+#include "../Lamp.hpp"
+#include "../LightGrid.hpp"
+#include "../Occlusion.hpp"
+#include "../RenderGraph.hpp"
+#include "../RenderScene.hpp"
+#include "../TargetPool.hpp"
+#include "GlState.hpp"
+#include "InstanceBuffer.hpp"
+#include "InstanceRing.hpp"
+#include "LightBuffers.hpp"
+#include "Upload.hpp"
+#include "util/tlsf.hpp"
 
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
@@ -25,8 +46,9 @@
 #include <unordered_set>
 #include <vector>
 
-#define SENSE_MAX_INSTANCES 128 // completely made-up number. No basis in any testing
-#define SENSE_MAX_VTX_BONES 128 // ditto
+#define SENSE_MAX_VTX_BONES 128 // completely made-up number. No basis in any testing
+#define SENSE_INSTANCE_UNIT 15 // texture unit the instance buffer lives on
+#define SENSE_LIGHT_UNIT 12 // and the light grid's three buffers, from here up; materials get the ones below
 
 class SenseClient;
 
@@ -51,6 +73,26 @@ struct ShaderProgram
   GlShader* vert;
   GlShader* geom;
   GlShader* frag;
+
+  // vertex decoding uniforms; -1 if the program doesn't use them
+  GLint vtxfmt_loc;
+  GLint pos_scale_loc;
+  GLint pos_bias_loc;
+  // base of this draw's transforms in the instance buffer, for
+  // whichever sense_modelview variant the program calls; -1 if none
+  GLint instance_base_loc;
+  InstanceFormat instance_format;
+  // light grid uniforms (see LightGrid.hpp), filled in when the
+  // program is bound; -1 if it doesn't look up lamps
+  GLint lamp_grid_loc;
+  GLint lamp_slices_loc;
+  GLint viewport_loc;
+  GLint clip_to_lamp_loc;
+  GLint samples_loc;
+
+  // texture unit for each sampler location. Programs are shared
+  // between materials, so units are handed out per program.
+  std::map<GLint, GLuint> sampler_units;
 };
 
 struct ShaderSet
@@ -79,58 +121,89 @@ namespace std {
 
 struct Image;
 
+// One texture a material binds per draw
+struct TextureBinding
+{
+  enum Source {
+    FromImage,
+    GBufColor,
+    GBufNormal,
+    GBufMatProp,
+    GBufDepth,
+  };
+  Source source;
+  GLenum target;
+  GLuint unit;
+  GLuint texture; // resolved lazily for images, which load in the background
+  const Image* image;
+};
+
+// A material's uniforms baked against a specific program
+struct MaterialBindings
+{
+  ShaderProgram* program;
+  std::vector<TextureBinding> textures;
+  GLint bones_loc;
+  // set if the material uses a uniform type the pipeline can't feed yet
+  std::string unsupported;
+};
+
 struct Texture
 {
   GLuint id;
 };
 
+// Only the lit image lives in the target; the G-buffer it's lit from
+// is transient, and comes from the frame's render graph
 struct RenderTarget
 {
-  GLuint lbuffer_id;
-  GLuint gbuffer_id;
-  GLuint depth_id;
-  GLuint color_id;
-  GLuint normal_id;
-  GLuint matprop_id;
   GLuint lighting_id;
+  RenderGraph::TargetDesc lighting_desc; // for giving it back to the target pool
   bool build_mips;
   bool dirty;
   uint32_t width, height;
 };
 
-struct DrawableBuffer
+// Shared vertex and index buffers for meshes with the same vertex
+// layout and index type, so switching between them doesn't need a new
+// VAO. Space in both is handed out by TLSF allocators (in vertices and
+// indices), so released meshes leave holes the next ones can reuse.
+struct MeshPage
 {
   GLuint vtxbuffer;
   GLuint idxbuffer;
-  GLuint vao;
+  GLuint vao; // made by the main thread, for the first mesh that needs it
   GLenum idx_type;
+  uint32_t id;
+  tlsfAllocator vertices;
+  tlsfAllocator indices;
+  size_t meshes;
 };
 
-struct DrawTaskObject
+struct DrawableBuffer
 {
-  DrawableMesh* mesh;
-  Material* mat;
+  MeshPage* page;
+  tlsfAllocator::handle vtx_alloc;
+  tlsfAllocator::handle idx_alloc;
+  GLuint vao;
+  GLenum idx_type;
+  GLint base_vertex;
+  GLuint first_index;
+  GLuint index_count;
+  uint32_t sort_id; // page, then mesh within it
 };
 
-inline bool operator==(const DrawTaskObject& lhs, const DrawTaskObject& rhs) {
-  return lhs.mesh == rhs.mesh && lhs.mat == rhs.mat;
-}
-
-namespace std {
-  template <>
-  struct hash<DrawTaskObject> : public unary_function<ShaderSet, size_t> {
-    size_t operator()(const DrawTaskObject& k) const {
-      size_t result = 0;
-      boost::hash_combine(result, k.mesh);
-      boost::hash_combine(result, k.mat);
-      return result;
-    }
-  };
-}
+// A texture from the target pool, with what it was asked for as
+struct PooledTexture
+{
+  RenderGraph::TargetDesc desc;
+  GLuint id;
+};
 
-struct DrawTaskData
+// Draws recorded by one worker thread, merged into the frame by render()
+struct DrawBucket
 {
-  std::vector<glm::mat4> transforms; // instanced matrices for normal pass; bones for skinning pass
+  DrawList draws;
 };
 
 struct PipelineImpl 
@@ -142,24 +215,167 @@ struct PipelineImpl
 
   GLuint width, height;
 
-  std::unordered_multimap<DrawTaskObject, DrawTaskData> tasks[Pipeline::PassCount];
+  // Draws are recorded into one list while render() consumes the other.
+  // render() flips them and clears the new recording list.
+  DrawList frames[2];
+  size_t recording;
+  DrawList& recordingFrame() { return frames[recording]; }
+  DrawList& renderingFrame() { return frames[recording ^ 1]; }
+  std::vector<DrawBucket*> buckets; // by slot
+  InstanceRing* instances;
+  // per sorted record of the frame being rendered: the bindings it was
+  // packed for, and where its instance data starts (in texels)
+  std::vector<MaterialBindings*> frame_bindings;
+  std::vector<GLint> frame_instances;
+
+  // The retained scene, and the sorted list and instance data built
+  // from it. The list is only rebuilt when the scene's layout changes,
+  // or when something it snapshotted (bindings, mesh buffers) did.
+  RenderScene scene;
+  DrawList retained;
+  std::vector<MaterialBindings*> retained_bindings; // per sorted record, like frame_bindings
+  std::vector<GLint> retained_instances;
+  std::vector<uint32_t> proxy_records; // proxy id -> sorted record, or ~0
+  std::vector<RenderScene::ProxyId> record_proxies; // unsorted record -> proxy id
+  std::vector<std::pair<Material*, MaterialBindings*> > retained_materials;
+  std::vector<std::pair<DrawableMesh*, GLuint> > retained_meshes;
+  std::vector<float> instance_scratch;
+  InstanceBuffer* retained_buffer;
+  size_t retained_texels;
+
+  // Frustum culling for the retained scene: a cull tree leaf per proxy
+  // with bounds, and the result per sorted record. Only redone when the
+  // scene or the frustum changes.
+  Frustum frustum;
+  AabbTree cull_tree;
+  std::vector<AabbTree::NodeId> proxy_leaves; // by proxy id
+  std::vector<uint8_t> retained_visible;
+  std::vector<uint32_t> visible_proxies;
+  bool retained_culled;
+  glm::mat4 cull_matrix; // from setFrustum
+
+  // Occlusion culling, after the frustum: occluder proxies that are in
+  // view get drawn into a small depth buffer on the CPU, and the rest of
+  // what's in view is tested against it. Occluder meshes are built on
+  // first use and dropped once nothing in the scene uses them.
+  OcclusionBuffer* occlusion;
+  std::unordered_map<DrawableMesh*, OccluderMesh*> occluder_meshes;
+  size_t occluded;
 
-  void addDrawTask(DrawableMesh* mesh, Material* mat, glm::mat4 mv, Pipeline::RenderPass pass);
+  // Cluster culling, for big meshes drawn at full detail: what's left of
+  // each record after culling its clusters, as a range of commands
+  // relative to the mesh. An empty range draws the whole LOD.
+  std::unordered_map<DrawableMesh*, ClusterSet*> cluster_sets;
+  std::vector<DrawCommand> cluster_commands;
+  std::vector<std::pair<uint32_t, uint32_t> > retained_ranges; // per sorted record
+  size_t clusters_culled;
+  size_t cluster_hidden; // records with none left at all
+
+  // Lamps are recorded alongside the draws and binned into the light
+  // grid once per frame, for whatever passes look them up
+  std::vector<Lamp> lamps[2];
+  LightGrid* light_grid;
+  LightBuffers* light_buffers;
+  glm::mat4 clip_to_lamp; // inverse of cull_matrix
+  size_t frame_lamps;
+
+  // The frame as a render graph: built and compiled by render(), which
+  // runs it up to the passes endFrame() finishes off. Physical slots
+  // get textures from the pool for the frame, and endFrame() gives them
+  // back. FBOs are made once per set of attachments, and last until a
+  // texture in them is freed.
+  RenderGraph graph;
+  size_t graph_split; // schedule position endFrame() starts from
+  TargetPool target_pool; // the graph's textures and RenderTargets'
+  std::vector<PooledTexture> graph_textures; // by physical slot, this frame
+  std::map<std::vector<GLuint>, GLuint> graph_fbos; // colors, then depth -> FBO
+  GLuint gbuf_textures[4]; // color, normal, matprop and depth this frame; 0 if unused
+
+  // the bucket being drawn, plus scratch for glMultiDrawElementsBaseVertex
+  DrawCommandList commands;
+  std::vector<GLsizei> multi_counts;
+  std::vector<GLvoid*> multi_offsets;
+  std::vector<GLint> multi_base_vertices;
+
+  GlState* gl;
+  Pipeline::FrameStats stats;
+  size_t batches;
+
+  uint64_t drawKey(DrawableMesh* mesh, Material* mat, const glm::mat4& mv, Pipeline::RenderPass pass, size_t lod);
+  void addDrawTask(DrawableMesh* mesh, Material* mat, glm::mat4 mv, Pipeline::RenderPass pass, size_t lod=0);
   void doRenderPass(Pipeline::RenderPass pass);
+  // visible and ranges are per sorted record, or null to draw everything
+  void drawPass(DrawList&, const std::vector<MaterialBindings*>&, const std::vector<GLint>&, const uint8_t* visible,
+                const std::vector<std::pair<uint32_t, uint32_t> >* ranges, Pipeline::RenderPass);
+  void bindMaterial(MaterialBindings*);
+  void bindLamps(const ShaderProgram*);
+  void buildLightGrid();
+  void uploadInstances();
+  bool retainedStale() const;
+  void rebuildRetained();
+  void repackRetained();
+  void placeProxy(RenderScene::ProxyId, bool refit);
+  void updateRetained();
+  void cullRetained();
+  void occludeRetained();
+  OccluderMesh* occluderFor(DrawableMesh*);
+  void cullClusters();
+  ClusterSet* clusterSetFor(DrawableMesh*);
+  void pruneMeshCaches();
+  void submitCommands(const ShaderProgram*, GLenum idx_type);
+  bool hasDraws(Pipeline::RenderPass);
+  void buildGraph();
+  void allocateGraphTargets(const RenderGraph::Handle* gbuf);
+  void releaseGraphTargets();
+  GLuint acquireTexture(const RenderGraph::TargetDesc&);
+  void freeTextures(const std::vector<uint32_t>&);
+  GLuint graphFramebuffer(const GLuint* colors, size_t count, GLuint depth);
+  void releaseFramebuffers(GLuint texture); // the ones using it
 
   DrawableMesh* screenQuad;
-  Material* flatLight;
+  Material* flatLight; // for frames without lamps
+  Material* lampLight;
+};
+
+// A mesh released on the main thread. Frames issued before the fence
+// may still draw out of its space, so that's only freed once it passes.
+struct RetiredMesh
+{
+  DrawableBuffer* buffer;
+  GLsync fence;
 };
 
 struct LoaderImpl
 {
   std::string shader_header;
+  std::string vertex_header;
+  std::string fragment_header;
   std::unordered_map<ShaderSet, ShaderProgram*> programs;
-  std::unordered_map<std::string, GlShader*> shaders;
+  std::unordered_map<uint64_t, GlShader*> shaders; // keyed by source hash and stage
   std::unordered_map<std::string, Texture*> textures;
   std::unordered_set<DrawableMesh*> meshes;
+  std::unordered_map<uint64_t, std::vector<MeshPage*> > mesh_pages; // by layout
+  uint32_t next_page_id;
+  UploadQueue* uploads;
+  StagingBuffer* staging;
+  boost::mutex retired_lock;
+  std::deque<RetiredMesh> retired; // oldest first
+
+  // Find room for a mesh in a page with its layout, making a new page if
+  // none of them have space. Fills in the buffer's page and allocations.
+  void allocateMesh(const DrawableMesh*, DrawableBuffer*, size_t vertices, size_t indices);
+
+  // Copy data into the staging buffer and from there to the buffer
+  // bound at target. Falls back to a plain glBufferSubData if it won't
+  // fit in the staging ring.
+  void upload(GLenum target, size_t offset, size_t size, const void* data);
+  // Fence everything issued since the last call, and run done once it's finished
+  void finishUpload(const Loader::UploadDone& done);
 
-  GlShader* loadShader(std::string, GLenum);
+  GlShader* loadShader(const ShaderSource&, GLenum);
+  // Give back the space of retired meshes the GPU is done with; all of
+  // them if wait is set. Loader thread only, like the allocators.
+  void freeRetiredMeshes(bool wait);
 };
 
 #endif // SENSE_PIPELINE_OGL_IMPLEMENTATION_HPP
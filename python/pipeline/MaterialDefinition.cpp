@@ -135,6 +135,32 @@ static PyObject *PyMaterialDef_add_uniform(PyMaterialDef *self, PyObject *args,
   Py_RETURN_NONE;
 }
 
+static PyObject *PyMaterialDef_add_define(PyMaterialDef *self, PyObject *args, PyObject *kwds) {
+  static char* keywords[] = { "name", "value", 0 };
+  PyObject *name;
+  PyObject *value = 0;
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "U|U", keywords, &name, &value))
+    return 0;
+  PyObject *bytes = PyUnicode_AsUTF8String(name);
+  if(!bytes)
+    return 0;
+  char *cname = PyBytes_AsString(bytes);
+  std::string sname = cname ? cname : "";
+  Py_DECREF(bytes);
+
+  std::string svalue;
+  if(value) {
+    bytes = PyUnicode_AsUTF8String(value);
+    if(!bytes)
+      return 0;
+    char *cvalue = PyBytes_AsString(bytes);
+    svalue = cvalue ? cvalue : "";
+    Py_DECREF(bytes);
+  }
+  self->def.defines[sname] = svalue;
+  Py_RETURN_NONE;
+}
+
 static PyGetSetDef PyMaterialDef_getsetters[] = {
   { "vertex_shader", (getter)PyMaterialDef_getVert, (setter)PyMaterialDef_setVert, "Vertex shader to be used by this material", NULL },
   { "fragment_shader", (getter)PyMaterialDef_getFrag, (setter)PyMaterialDef_setFrag, "Fragment shader to be used by this material", NULL },
@@ -144,6 +170,7 @@ static PyGetSetDef PyMaterialDef_getsetters[] = {
 
 static PyMethodDef PyMaterialDef_methods[] = {
   {"add_uniform", (PyCFunction)PyMaterialDef_add_uniform, METH_VARARGS|METH_KEYWORDS, "Add uniform data to this material" },
+  {"add_define", (PyCFunction)PyMaterialDef_add_define, METH_VARARGS|METH_KEYWORDS, "Add a preprocessor definition to this material's shaders" },
   {0, 0, 0, 0}
 };
 
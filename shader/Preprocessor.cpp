@@ -0,0 +1,116 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Preprocessor.hpp"
+#include "util/hash.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+  struct State
+  {
+    const ShaderFileReader& read;
+    ShaderSource& out;
+    std::ostringstream text;
+    std::vector<std::string> stack;
+
+    State(const ShaderFileReader& r, ShaderSource& o) : read(r), out(o) {}
+  };
+
+  bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+  }
+
+  // If line is an #include directive, put the file name in name.
+  // Throws if it's an #include we can't make sense of.
+  bool parseInclude(const std::string& line, std::string& name) {
+    size_t i = 0;
+    while(i < line.size() && isSpace(line[i])) ++i;
+    if(i == line.size() || line[i] != '#')
+      return false;
+    ++i;
+    while(i < line.size() && isSpace(line[i])) ++i;
+    if(line.compare(i, 7, "include") != 0)
+      return false;
+    i += 7;
+    while(i < line.size() && isSpace(line[i])) ++i;
+    const size_t end = i < line.size() ? line.find('"', i + 1) : std::string::npos;
+    if(i == line.size() || line[i] != '"' || end == std::string::npos)
+      throw std::runtime_error("Malformed shader #include: " + line);
+    name = line.substr(i + 1, end - i - 1);
+    return true;
+  }
+
+  // GLSL 1.50 #line sets the number of the line *after* the directive
+  void lineDirective(std::ostringstream& os, size_t next_line, size_t file) {
+    os << "#line " << next_line - 1 << " " << file + 1 << "\n";
+  }
+
+  void processFile(State& s, const std::string& name) {
+    if(std::find(s.stack.begin(), s.stack.end(), name) != s.stack.end())
+      throw std::runtime_error("Shader #include cycle through " + name);
+    if(std::find(s.out.files.begin(), s.out.files.end(), name) != s.out.files.end())
+      return; // already pulled in
+
+    std::string contents;
+    if(!s.read(name, contents)) {
+      if(s.stack.empty())
+        throw std::runtime_error("Can't find shader file " + name);
+      throw std::runtime_error("Can't find shader file " + name + " (included from " + s.stack.back() + ")");
+    }
+    const size_t file = s.out.files.size();
+    s.out.files.push_back(name);
+    s.stack.push_back(name);
+
+    lineDirective(s.text, 1, file);
+    std::istringstream is(contents);
+    std::string line, include;
+    for(size_t line_no = 1; std::getline(is, line); ++line_no) {
+      if(parseInclude(line, include)) {
+        processFile(s, include);
+        lineDirective(s.text, line_no + 1, file);
+      } else {
+        s.text << line << "\n";
+      }
+    }
+    s.stack.pop_back();
+  }
+}
+
+ShaderSource preprocessShader(const std::string& name, const ShaderDefines& defines, const ShaderFileReader& read)
+{
+  ShaderSource out;
+  State s(read, out);
+  for(auto i = defines.begin(); i != defines.end(); ++i)
+    s.text << "#define " << i->first << " " << i->second << "\n";
+  processFile(s, name);
+  out.text = s.text.str();
+  out.hash = hashBytes(out.text.data(), out.text.size());
+  if(!out.hash)
+    out.hash = 1;
+  return out;
+}
+
+uint64_t shaderVariantKey(const std::string& name, const ShaderDefines& defines)
+{
+  // the separators keep ("ab", "c") and ("a", "bc") apart
+  uint64_t h = hashBytes(name.data(), name.size() + 1);
+  for(auto i = defines.begin(); i != defines.end(); ++i) {
+    h = hashBytes(i->first.c_str(), i->first.size() + 1, h);
+    h = hashBytes(i->second.c_str(), i->second.size() + 1, h);
+  }
+  return h;
+}
@@ -0,0 +1,54 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_SHADER_PREPROCESSOR_HPP
+#define SENSE_SHADER_PREPROCESSOR_HPP
+
+#include "pipeline/DefinitionTypes.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A shader stage after preprocessing, ready to hand to the Loader.
+// The pipeline's own header (#version and friends) isn't part of the
+// text; the Loader adds that when it compiles.
+struct ShaderSource
+{
+  std::string text;
+  // hash of text; 0 means there's no shader for this stage
+  uint64_t hash;
+  // every file that went into the text. GLSL reports errors as
+  // "string(line)", where string is an index into this list plus one.
+  std::vector<std::string> files;
+
+  ShaderSource() : hash(0) {}
+  bool empty() const { return hash == 0; }
+};
+
+// Fetches the contents of a shader file by name, returning false if
+// there's no such file
+typedef std::function<bool(const std::string&, std::string&)> ShaderFileReader;
+
+// Expand #include "file" directives in the named shader and prepend
+// the defines. Each file is only pulled in once per shader, so
+// includes don't need guards. Throws std::runtime_error on missing
+// files and malformed includes.
+ShaderSource preprocessShader(const std::string& name, const ShaderDefines& defines, const ShaderFileReader& read);
+
+// Key for a (file, defines) pair, for caching preprocessed variants
+uint64_t shaderVariantKey(const std::string& name, const ShaderDefines& defines);
+
+#endif // SENSE_SHADER_PREPROCESSOR_HPP
@@ -0,0 +1,235 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/tlsf.hpp"
+#include "test/check.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+// sense-test-alloc [rounds]
+//
+// Runs the TLSF allocator against a simple model of what should be
+// allocated where: random allocations and frees, growing the space now
+// and then, and defragmenting it. After every step the allocations must
+// not overlap, stats() must agree with the model, and free space must
+// be fully coalesced. Defragmenting must keep every handle and, once
+// the moves are applied, its contents. Exits non-zero on any failure.
+
+namespace {
+  struct Live
+  {
+    tlsfAllocator::handle h;
+    uint32_t size;
+  };
+
+  // What the allocator should look like: live allocations by handle,
+  // and the space itself, each allocation filled with its handle
+  struct Model
+  {
+    uint32_t capacity;
+    std::vector<Live> live;
+    std::vector<uint32_t> space;
+  };
+
+  // The largest size allocate() promises to find room for, given the
+  // biggest free block: it only looks in lists that are sure to fit
+  bool shouldFit(uint32_t size, uint32_t largest_free) {
+    uint64_t rounded = size;
+    if(size >= 16) {
+      uint32_t bit = 0;
+      while(size >> (bit + 1))
+        ++bit;
+      rounded += (uint64_t(1) << (bit - 4)) - 1;
+    }
+    // rounding up lands on a list boundary, and every block on that
+    // list or above fits
+    uint64_t boundary = rounded;
+    if(rounded >= 16) {
+      uint32_t bit = 0;
+      while(rounded >> (bit + 1))
+        ++bit;
+      boundary = rounded & ~((uint64_t(1) << (bit - 4)) - 1);
+    }
+    return boundary <= largest_free;
+  }
+
+  void verify(const tlsfAllocator& a, const Model& m) {
+    std::vector<std::pair<uint32_t, uint32_t> > ranges; // offset, size
+    uint32_t used = 0;
+    for(size_t i = 0; i < m.live.size(); ++i) {
+      check(a.size(m.live[i].h) == m.live[i].size, "allocation keeps its size");
+      ranges.push_back(std::make_pair(a.offset(m.live[i].h), m.live[i].size));
+      used += m.live[i].size;
+    }
+    std::sort(ranges.begin(), ranges.end());
+
+    // the gaps between allocations are the free blocks, since freeing
+    // merges with both neighbours
+    uint32_t cursor = 0, free_blocks = 0, largest = 0;
+    for(size_t i = 0; i < ranges.size(); ++i) {
+      check(ranges[i].first >= cursor, "allocations don't overlap");
+      if(ranges[i].first > cursor) {
+        ++free_blocks;
+        largest = std::max(largest, ranges[i].first - cursor);
+      }
+      cursor = ranges[i].first + ranges[i].second;
+    }
+    check(cursor <= m.capacity, "allocations stay inside the space");
+    if(cursor < m.capacity) {
+      ++free_blocks;
+      largest = std::max(largest, m.capacity - cursor);
+    }
+
+    const tlsfAllocator::Stats s = a.stats();
+    check(s.capacity == m.capacity, "stats: capacity");
+    check(s.used == used, "stats: used");
+    check(s.allocations == m.live.size(), "stats: allocations");
+    check(s.free_blocks == free_blocks, "stats: free blocks are coalesced");
+    check(s.largest_free == largest, "stats: largest free block");
+  }
+
+  void fill(const tlsfAllocator& a, Model& m, const Live& l) {
+    std::fill(m.space.begin() + a.offset(l.h), m.space.begin() + a.offset(l.h) + l.size, l.h);
+  }
+
+  void verifyContents(const tlsfAllocator& a, const Model& m) {
+    for(size_t i = 0; i < m.live.size(); ++i) {
+      const uint32_t* p = &m.space[a.offset(m.live[i].h)];
+      bool same = true;
+      for(uint32_t j = 0; j < m.live[i].size; ++j)
+        same = same && p[j] == m.live[i].h;
+      check(same, "contents follow their allocation");
+    }
+  }
+
+  uint32_t randomSize() {
+    // mostly small, now and then big
+    return rand() % 8 ? 1 + rand() % 300 : 1 + rand() % 5000;
+  }
+
+  // the simple cases, spelled out
+  void checkBasics() {
+    tlsfAllocator a(1000);
+    const tlsfAllocator::handle x = a.allocate(100);
+    const tlsfAllocator::handle y = a.allocate(200);
+    const tlsfAllocator::handle z = a.allocate(300);
+    check(x != tlsfAllocator::none && y != tlsfAllocator::none && z != tlsfAllocator::none, "basics: allocate");
+    const tlsfAllocator::handle tiny = a.allocate(0);
+    check(a.size(tiny) == 1, "basics: zero-sized allocations take one unit");
+    a.free(tiny);
+    check(a.allocate(2000) == tlsfAllocator::none, "basics: too big fails");
+
+    a.free(y);
+    check(a.stats().free_blocks == 2, "basics: a hole in the middle");
+    a.free(x);
+    check(a.stats().free_blocks == 2, "basics: freeing next to a hole merges with it");
+    check(a.stats().largest_free == 400, "basics: merged hole");
+    a.free(z);
+    check(a.stats().free_blocks == 1 && a.stats().largest_free == 1000, "basics: everything merges back");
+
+    tlsfAllocator g;
+    check(g.allocate(10) == tlsfAllocator::none, "grow: empty allocator fails");
+    g.grow(64);
+    const tlsfAllocator::handle b = g.allocate(64);
+    check(b != tlsfAllocator::none && g.offset(b) == 0, "grow: space appears");
+    g.grow(64);
+    check(g.stats().free_blocks == 1 && g.stats().largest_free == 64, "grow: new space after an allocation");
+    g.grow(64);
+    check(g.stats().free_blocks == 1 && g.stats().largest_free == 128, "grow: merges with free space at the end");
+    check(g.stats().capacity == 192, "grow: capacity");
+  }
+
+  void run(size_t rounds) {
+    tlsfAllocator a(1 << 16);
+    Model m;
+    m.capacity = 1 << 16;
+    m.space.resize(m.capacity);
+    std::vector<tlsfAllocator::Move> moves;
+
+    for(size_t round = 0; round < rounds; ++round) {
+      const int op = rand() % 100;
+      if(op < 55) {
+        Live l;
+        l.size = randomSize();
+        const uint32_t largest = a.stats().largest_free;
+        l.h = a.allocate(l.size);
+        if(l.h == tlsfAllocator::none) {
+          check(!shouldFit(l.size, largest), "allocate only fails when nothing is sure to fit");
+        } else {
+          m.live.push_back(l);
+          fill(a, m, l);
+        }
+      } else if(op < 97) {
+        if(m.live.empty())
+          continue;
+        const size_t i = rand() % m.live.size();
+        a.free(m.live[i].h);
+        m.live[i] = m.live.back();
+        m.live.pop_back();
+      } else if(op < 98) {
+        const uint32_t extra = 1 + rand() % 4096;
+        a.grow(extra);
+        m.capacity += extra;
+        m.space.resize(m.capacity);
+      } else {
+        std::vector<uint32_t> offsets;
+        for(size_t i = 0; i < m.live.size(); ++i)
+          offsets.push_back(a.offset(m.live[i].h));
+        a.defragment(moves);
+        uint32_t moved = 0;
+        for(size_t i = 0; i < moves.size(); ++i) {
+          check(moves[i].to < moves[i].from, "defragment: moves only go down");
+          check(moves[i].size == a.size(moves[i].h), "defragment: moves the whole allocation");
+          memmove(&m.space[moves[i].to], &m.space[moves[i].from], moves[i].size * sizeof(uint32_t));
+          moved++;
+        }
+        uint32_t used = 0;
+        for(size_t i = 0; i < m.live.size(); ++i) {
+          used += m.live[i].size;
+          if(a.offset(m.live[i].h) != offsets[i])
+            moved--;
+        }
+        check(moved == 0, "defragment: a move for every allocation that moved");
+        const tlsfAllocator::Stats s = a.stats();
+        check(s.free_blocks == (used < m.capacity ? 1u : 0u), "defragment: one free block left");
+        check(s.largest_free == m.capacity - used, "defragment: all the free space at the end");
+        verifyContents(a, m);
+      }
+      verify(a, m);
+    }
+
+    // everything freed is one block again
+    for(size_t i = 0; i < m.live.size(); ++i)
+      a.free(m.live[i].h);
+    m.live.clear();
+    verify(a, m);
+    verifyContents(a, m);
+  }
+}
+
+int main(int argc, char **argv) {
+  const size_t rounds = argc > 1 ? atoi(argv[1]) : 10000;
+
+  srand(1);
+  checkBasics();
+  run(rounds);
+
+  return checkResult();
+}
@@ -0,0 +1,49 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SENSE_TEST_CHECK_HPP
+#define SENSE_TEST_CHECK_HPP
+
+#include <cstddef>
+#include <cstdio>
+
+// What the sense-test-* programs (and the benches that check their
+// results) report through. check() counts a failure and prints the
+// first few; main() returns checkResult().
+
+inline size_t& checkFailures() {
+  static size_t failures = 0;
+  return failures;
+}
+
+inline void check(bool ok, const char* what) {
+  if(!ok) {
+    if(checkFailures() < 20)
+      printf("FAILED: %s\n", what);
+    ++checkFailures();
+  }
+}
+
+// Exit code: non-zero if anything failed
+inline int checkResult() {
+  if(checkFailures()) {
+    printf("%u checks failed\n", unsigned(checkFailures()));
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
+
+#endif // SENSE_TEST_CHECK_HPP
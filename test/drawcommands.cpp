@@ -0,0 +1,196 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "pipeline/DrawCommands.hpp"
+#include "test/check.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// sense-test-drawcommands [rounds]
+//
+// DrawCommandList::add on its own. Consecutive instances of the same
+// range fold into one instanced command, a gap in the instance data or a
+// different range starts a new one, stride 0 drops repeats, and the
+// per-cluster commands cluster culling leaves behind come out one per
+// cluster. Then random draw streams, checking the commands expand back
+// into exactly the draws that went in. Exits non-zero on any failure.
+
+namespace {
+  bool is(const DrawCommand& c, uint32_t count, uint32_t instances, uint32_t first, int32_t base_vertex, uint32_t base_instance) {
+    return c.count == count && c.instance_count == instances && c.first_index == first && c.base_vertex == base_vertex && c.base_instance == base_instance;
+  }
+
+  void checkBasics() {
+    DrawCommandList l;
+    l.begin(4);
+    check(l.empty(), "begin: starts empty");
+
+    // instance data written back to back folds into one command
+    for(uint32_t i = 0; i < 3; ++i)
+      l.add(36, 0, 0, 100 + i * 4);
+    check(l.size() == 1 && is(l.commands()[0], 36, 3, 0, 0, 100), "fold: consecutive instances");
+
+    // a gap in the instance data can't be expressed with one base
+    l.add(36, 0, 0, 120);
+    check(l.size() == 2 && is(l.commands()[1], 36, 1, 0, 0, 120), "fold: a gap starts a new command");
+    // nor can going backwards, or repeating an instance
+    l.add(36, 0, 0, 120);
+    check(l.size() == 3, "fold: a repeated instance starts a new command");
+
+    // any difference in the range starts a new command
+    l.add(36, 6, 0, 124);
+    l.add(30, 6, 0, 128);
+    l.add(30, 6, 8, 132);
+    check(l.size() == 6, "fold: count, first index and base vertex all matter");
+    check(is(l.commands()[5], 30, 1, 6, 8, 132), "fold: new command has the draw's values");
+
+    // only the last command is folded into
+    l.add(36, 0, 0, 136);
+    check(l.size() == 7 && l.commands()[0].instance_count == 3, "fold: earlier commands are left alone");
+
+    l.begin(4);
+    check(l.empty(), "begin: clears");
+
+    // no per-instance data: repeats are the same draw, so they're dropped
+    l.begin(0);
+    l.add(36, 0, 0, 0);
+    l.add(36, 0, 0, 0);
+    l.add(36, 0, 0, 7);
+    check(l.size() == 1 && is(l.commands()[0], 36, 1, 0, 0, 0), "stride 0: repeats dropped, not instanced");
+    l.add(12, 36, 0, 0);
+    l.add(36, 0, 0, 0);
+    check(l.size() == 3, "stride 0: only consecutive repeats are dropped");
+    check(is(l.commands()[1], 12, 1, 36, 0, 0) && is(l.commands()[2], 36, 1, 0, 0, 0), "stride 0: others kept in order");
+  }
+
+  void checkClusters() {
+    // what's left of a mesh after cluster culling comes in as one add
+    // per surviving cluster, all with the same instance
+    DrawCommandList l;
+    l.begin(4);
+    const uint32_t clusters[][2] = { { 0, 96 }, { 192, 64 }, { 384, 128 } };
+    for(uint32_t j = 0; j < 2; ++j) {
+      for(size_t c = 0; c < 3; ++c)
+        l.add(clusters[c][1], 1000 + clusters[c][0], 10, 40 + j * 4);
+    }
+    check(l.size() == 6, "clusters: one command per cluster and instance");
+    bool each = true;
+    for(size_t i = 0; i < 6; ++i) {
+      const uint32_t c = i % 3;
+      each = each && is(l.commands()[i], clusters[c][1], 1, 1000 + clusters[c][0], 10, 40 + uint32_t(i / 3) * 4);
+    }
+    check(each, "clusters: ranges offset by the mesh's first index, instance kept");
+
+    // a single surviving cluster for consecutive instances still folds
+    l.begin(4);
+    l.add(96, 1000, 10, 40);
+    l.add(96, 1000, 10, 44);
+    check(l.size() == 1 && l.commands()[0].instance_count == 2, "clusters: one cluster per instance folds");
+
+    // and without instance data the clusters of one draw are all kept
+    l.begin(0);
+    for(size_t c = 0; c < 3; ++c)
+      l.add(clusters[c][1], clusters[c][0], 0, 0);
+    check(l.size() == 3, "clusters: stride 0 keeps distinct clusters");
+  }
+
+  struct Draw
+  {
+    uint32_t count, first;
+    int32_t base_vertex;
+    uint32_t instance;
+  };
+
+  bool sameRange(const Draw& a, const Draw& b) {
+    return a.count == b.count && a.first == b.first && a.base_vertex == b.base_vertex;
+  }
+
+  void run(size_t rounds) {
+    DrawCommandList l;
+    for(size_t round = 0; round < rounds; ++round) {
+      const uint32_t stride = rand() % 3 ? 1 + rand() % 8 : 0;
+      l.begin(stride);
+      std::vector<Draw> in;
+      uint32_t instance = rand() % 64;
+      const size_t n = 1 + rand() % 40;
+      for(size_t k = 0; k < n; ++k) {
+        Draw d;
+        // few distinct ranges, so repeats happen often
+        const uint32_t range = rand() % 3;
+        d.count = 3 + range * 3;
+        d.first = range * 100;
+        d.base_vertex = rand() % 8 ? 0 : 5;
+        if(stride && rand() % 4)
+          instance += stride; // written right after the last one
+        else
+          instance += rand() % 3 * 4;
+        d.instance = instance;
+        l.add(d.count, d.first, d.base_vertex, d.instance);
+        in.push_back(d);
+      }
+
+      // what GL would draw
+      std::vector<Draw> out;
+      for(auto c = l.commands().begin(); c != l.commands().end(); ++c) {
+        check(c->instance_count >= 1, "random: no empty commands");
+        check(stride || c->instance_count == 1, "random: stride 0 never instances");
+        for(uint32_t i = 0; i < c->instance_count; ++i) {
+          Draw d;
+          d.count = c->count;
+          d.first = c->first_index;
+          d.base_vertex = c->base_vertex;
+          d.instance = c->base_instance + i * stride;
+          out.push_back(d);
+        }
+      }
+
+      // with instance data everything comes back; without, consecutive
+      // repeats of a range collapse into the first of them
+      std::vector<Draw> expect;
+      for(size_t k = 0; k < in.size(); ++k) {
+        if(!stride && !expect.empty() && sameRange(expect.back(), in[k]))
+          continue;
+        expect.push_back(in[k]);
+      }
+      bool same = out.size() == expect.size();
+      for(size_t k = 0; same && k < out.size(); ++k)
+        same = sameRange(out[k], expect[k]) && (!stride || out[k].instance == expect[k].instance);
+      check(same, "random: commands expand back into the draws");
+
+      // and nothing that could have been folded was left unfolded
+      bool folded = true;
+      for(size_t c = 1; c < l.size(); ++c) {
+        const DrawCommand& a = l.commands()[c - 1];
+        const DrawCommand& b = l.commands()[c];
+        const bool same_range = a.count == b.count && a.first_index == b.first_index && a.base_vertex == b.base_vertex;
+        folded = folded && !(same_range && (!stride || a.base_instance + a.instance_count * stride == b.base_instance));
+      }
+      check(folded, "random: adjacent foldable commands were folded");
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  const size_t rounds = argc > 1 ? atoi(argv[1]) : 20000;
+
+  srand(1);
+  checkBasics();
+  checkClusters();
+  run(rounds);
+
+  return checkResult();
+}
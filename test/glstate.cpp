@@ -0,0 +1,230 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "pipeline/ogl/GlState.hpp"
+#include "test/check.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+// sense-test-glstate
+//
+// GlState against GL functions that only count what reaches them, so
+// no context is needed. Redundant binds have to be dropped and changed
+// ones passed on, invalidate() has to make everything go through once
+// more, GL_FRAMEBUFFER has to track the draw and read bindings, and
+// uniform values are cached per program. Exits non-zero on any failure.
+
+namespace {
+  // what reached "GL"
+  size_t calls[GlState::CallCount];
+  GLenum last_target, last_unit;
+  GLuint last_name;
+  GLint last_int;
+
+  void GLAPIENTRY countUseProgram(GLuint p) { calls[GlState::UseProgram]++; last_name = p; }
+  void GLAPIENTRY countBindVertexArray(GLuint v) { calls[GlState::BindVertexArray]++; last_name = v; }
+  void GLAPIENTRY countActiveTexture(GLenum unit) { calls[GlState::ActiveTexture]++; last_unit = unit; }
+  void GLAPIENTRY countBindTexture(GLenum target, GLuint t) { calls[GlState::BindTexture]++; last_target = target; last_name = t; }
+  void GLAPIENTRY countBindFramebuffer(GLenum target, GLuint f) { calls[GlState::BindFramebuffer]++; last_target = target; last_name = f; }
+  void GLAPIENTRY countEnable(GLenum) { calls[GlState::Enable]++; }
+  void GLAPIENTRY countDisable(GLenum) { calls[GlState::Enable]++; }
+  void GLAPIENTRY countDepthMask(GLboolean) { calls[GlState::DepthMask]++; }
+  void GLAPIENTRY countBlendFunc(GLenum, GLenum) { calls[GlState::BlendFunc]++; }
+  void GLAPIENTRY countUniform1i(GLint, GLint v) { calls[GlState::Uniform]++; last_int = v; }
+  void GLAPIENTRY countUniform3fv(GLint, GLsizei, const GLfloat*) { calls[GlState::Uniform]++; }
+
+  GlFunctions counting() {
+    GlFunctions f;
+    f.useProgram = countUseProgram;
+    f.bindVertexArray = countBindVertexArray;
+    f.activeTexture = countActiveTexture;
+    f.bindTexture = countBindTexture;
+    f.bindFramebuffer = countBindFramebuffer;
+    f.enable = countEnable;
+    f.disable = countDisable;
+    f.depthMask = countDepthMask;
+    f.blendFunc = countBlendFunc;
+    f.uniform1i = countUniform1i;
+    f.uniform3fv = countUniform3fv;
+    return f;
+  }
+
+  // calls of a kind since the last time we looked
+  size_t seen[GlState::CallCount];
+  size_t reached(GlState::Call call) {
+    const size_t n = calls[call] - seen[call];
+    seen[call] = calls[call];
+    return n;
+  }
+
+  void checkBinds() {
+    GlState gl(counting());
+
+    gl.useProgram(1);
+    gl.useProgram(1);
+    check(reached(GlState::UseProgram) == 1 && last_name == 1, "program: the repeat is dropped");
+    gl.useProgram(2);
+    check(reached(GlState::UseProgram) == 1 && last_name == 2, "program: a change goes through");
+
+    gl.bindVertexArray(5);
+    gl.bindVertexArray(5);
+    check(reached(GlState::BindVertexArray) == 1, "vao: the repeat is dropped");
+
+    gl.bindTexture(0, GL_TEXTURE_2D, 9);
+    check(reached(GlState::ActiveTexture) == 1 && last_unit == GL_TEXTURE0 && reached(GlState::BindTexture) == 1, "texture: binds on its unit");
+    gl.bindTexture(0, GL_TEXTURE_2D, 9);
+    check(reached(GlState::ActiveTexture) == 0 && reached(GlState::BindTexture) == 0, "texture: the repeat is dropped, active unit too");
+    gl.bindTexture(3, GL_TEXTURE_2D, 9);
+    check(reached(GlState::ActiveTexture) == 1 && last_unit == GL_TEXTURE3 && reached(GlState::BindTexture) == 1, "texture: units are tracked separately");
+    gl.bindTexture(3, GL_TEXTURE_2D, 10);
+    check(reached(GlState::ActiveTexture) == 0 && reached(GlState::BindTexture) == 1, "texture: same unit, no glActiveTexture");
+    gl.bindTexture(3, GL_TEXTURE_2D_MULTISAMPLE, 10);
+    check(reached(GlState::BindTexture) == 1 && last_target == GL_TEXTURE_2D_MULTISAMPLE, "texture: targets are tracked separately");
+    gl.bindTexture(3, GL_TEXTURE_BUFFER, 4);
+    gl.bindTexture(3, GL_TEXTURE_BUFFER, 4);
+    check(reached(GlState::BindTexture) == 2, "texture: untracked targets always go through");
+
+    gl.setEnabled(GL_BLEND, true);
+    gl.setEnabled(GL_BLEND, true);
+    check(reached(GlState::Enable) == 1, "enable: the repeat is dropped");
+    gl.setEnabled(GL_DEPTH_TEST, true);
+    gl.setEnabled(GL_BLEND, false);
+    check(reached(GlState::Enable) == 2, "enable: per capability, disable goes through");
+
+    gl.depthMask(false);
+    gl.depthMask(false);
+    gl.depthMask(true);
+    check(reached(GlState::DepthMask) == 2, "depth mask: only changes");
+    gl.blendFunc(GL_ONE, GL_ONE);
+    gl.blendFunc(GL_ONE, GL_ONE);
+    gl.blendFunc(GL_ONE, GL_ZERO);
+    check(reached(GlState::BlendFunc) == 2, "blend func: only changes");
+
+    const GlState::Stats& s = gl.stats();
+    check(s.issued[GlState::UseProgram] == 2 && s.skipped[GlState::UseProgram] == 1, "stats: issued and skipped");
+    size_t total = 0;
+    for(size_t i = 0; i < GlState::CallCount; ++i)
+      total += calls[i];
+    check(s.totalIssued() == total, "stats: issued is what reached GL");
+    // the unit is already active for four of the texture binds
+    check(s.totalSkipped() == 10 && s.skipped[GlState::ActiveTexture] == 4, "stats: skipped");
+    gl.resetStats();
+    check(gl.stats().totalIssued() == 0 && gl.stats().totalSkipped() == 0, "stats: reset");
+
+    // after invalidate() nothing is known, so it all goes through once
+    gl.invalidate();
+    gl.useProgram(2);
+    gl.bindVertexArray(5);
+    gl.bindTexture(3, GL_TEXTURE_2D, 10);
+    gl.setEnabled(GL_BLEND, false);
+    gl.depthMask(true);
+    gl.blendFunc(GL_ONE, GL_ZERO);
+    check(reached(GlState::UseProgram) == 1 && reached(GlState::BindVertexArray) == 1, "invalidate: program and vao");
+    check(reached(GlState::ActiveTexture) == 1 && reached(GlState::BindTexture) == 1, "invalidate: textures and the active unit");
+    check(reached(GlState::Enable) == 1 && reached(GlState::DepthMask) == 1 && reached(GlState::BlendFunc) == 1, "invalidate: capabilities and blending");
+    gl.useProgram(2);
+    gl.bindTexture(3, GL_TEXTURE_2D, 10);
+    check(reached(GlState::UseProgram) == 0 && reached(GlState::BindTexture) == 0, "invalidate: then back to dropping repeats");
+  }
+
+  void checkFramebuffers() {
+    GlState gl(counting());
+
+    gl.bindFramebuffer(GL_FRAMEBUFFER, 3);
+    check(reached(GlState::BindFramebuffer) == 1 && last_target == GL_FRAMEBUFFER, "fbo: first bind");
+    gl.bindFramebuffer(GL_FRAMEBUFFER, 3);
+    gl.bindFramebuffer(GL_DRAW_FRAMEBUFFER, 3);
+    gl.bindFramebuffer(GL_READ_FRAMEBUFFER, 3);
+    check(reached(GlState::BindFramebuffer) == 0, "fbo: GL_FRAMEBUFFER sets both draw and read");
+
+    gl.bindFramebuffer(GL_READ_FRAMEBUFFER, 4);
+    check(reached(GlState::BindFramebuffer) == 1 && last_target == GL_READ_FRAMEBUFFER, "fbo: read on its own");
+    gl.bindFramebuffer(GL_DRAW_FRAMEBUFFER, 3);
+    check(reached(GlState::BindFramebuffer) == 0, "fbo: a read bind leaves draw alone");
+    gl.bindFramebuffer(GL_FRAMEBUFFER, 3);
+    check(reached(GlState::BindFramebuffer) == 1 && last_name == 3, "fbo: GL_FRAMEBUFFER goes through if only read differs");
+    gl.bindFramebuffer(GL_READ_FRAMEBUFFER, 3);
+    check(reached(GlState::BindFramebuffer) == 0, "fbo: and then read is known");
+
+    gl.bindFramebuffer(GL_DRAW_FRAMEBUFFER, 5);
+    check(reached(GlState::BindFramebuffer) == 1 && last_target == GL_DRAW_FRAMEBUFFER, "fbo: draw on its own");
+    gl.bindFramebuffer(GL_READ_FRAMEBUFFER, 3);
+    check(reached(GlState::BindFramebuffer) == 0, "fbo: a draw bind leaves read alone");
+    gl.bindFramebuffer(GL_FRAMEBUFFER, 3);
+    check(reached(GlState::BindFramebuffer) == 1, "fbo: GL_FRAMEBUFFER goes through if only draw differs");
+
+    gl.invalidate();
+    gl.bindFramebuffer(GL_READ_FRAMEBUFFER, 3);
+    gl.bindFramebuffer(GL_DRAW_FRAMEBUFFER, 3);
+    check(reached(GlState::BindFramebuffer) == 2, "fbo: invalidate forgets both");
+  }
+
+  void checkUniforms() {
+    GlState gl(counting());
+    const GLfloat a[3] = { 1.f, 2.f, 3.f };
+    const GLfloat b[3] = { 1.f, 2.f, 4.f };
+
+    // no program known yet, so nothing can be cached
+    gl.uniform1i(2, 7);
+    gl.uniform1i(2, 7);
+    check(reached(GlState::Uniform) == 2, "uniform: always goes through without a program");
+
+    gl.useProgram(1);
+    gl.uniform1i(2, 7);
+    gl.uniform1i(2, 7);
+    check(reached(GlState::Uniform) == 1 && last_int == 7, "uniform: the repeat is dropped");
+    gl.uniform1i(2, 8);
+    check(reached(GlState::Uniform) == 1 && last_int == 8, "uniform: a new value goes through");
+    gl.uniform1i(3, 8);
+    check(reached(GlState::Uniform) == 1, "uniform: per location");
+    gl.uniform1i(-1, 8);
+    gl.uniform1i(-1, 8);
+    check(reached(GlState::Uniform) == 2, "uniform: location -1 isn't cached");
+
+    gl.uniform3fv(4, a);
+    gl.uniform3fv(4, a);
+    check(reached(GlState::Uniform) == 1, "uniform3fv: the repeat is dropped");
+    gl.uniform3fv(4, b);
+    check(reached(GlState::Uniform) == 1, "uniform3fv: any component changing goes through");
+
+    // values belong to the program
+    gl.useProgram(2);
+    gl.uniform1i(2, 8);
+    check(reached(GlState::Uniform) == 1, "uniform: per program");
+    gl.useProgram(1);
+    gl.uniform1i(2, 8);
+    gl.uniform3fv(4, b);
+    check(reached(GlState::Uniform) == 0, "uniform: the first program's values are remembered");
+
+    // and survive invalidate(), once the program is known again
+    gl.invalidate();
+    gl.uniform1i(2, 8);
+    check(reached(GlState::Uniform) == 1, "uniform: unknown program after invalidate");
+    gl.useProgram(1);
+    gl.uniform1i(2, 8);
+    check(reached(GlState::Uniform) == 0, "uniform: values are kept over invalidate");
+    gl.uniform1i(2, 9);
+    check(reached(GlState::Uniform) == 1, "uniform: and still updated");
+  }
+}
+
+int main(int, char **) {
+  checkBinds();
+  checkFramebuffers();
+  checkUniforms();
+
+  return checkResult();
+}
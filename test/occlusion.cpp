@@ -0,0 +1,290 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mesh/Occluder.hpp"
+#include "pipeline/Culling.hpp"
+#include "pipeline/Occlusion.hpp"
+#include "test/check.hpp"
+
+#include "3rdparty/glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// sense-test-occlusion [out-dir]
+//
+// The occlusion buffer against a plain per-pixel reference rasterizer,
+// from a fixed seed. A single wall with boxes around it, then a block
+// of rooms with boxes on the floors seen from a few places. The
+// buffer's depth must never be nearer than the reference depth, and no
+// box the buffer culls may have a pixel in front of the reference.
+// Threaded and single-threaded rasterizing have to agree, and the
+// buffer has to keep most of what the reference covers, so passing
+// doesn't just mean it culled nothing. Exits non-zero on any failure.
+// Given out-dir, writes the depth images there as PFM files.
+
+namespace {
+  float randf(float lo, float hi) {
+    return lo + (hi - lo) * float(rand()) / RAND_MAX;
+  }
+
+  OccluderMesh unitCube() {
+    OccluderMesh m;
+    for(int i = 0; i < 8; ++i)
+      m.positions.push_back(glm::vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+    const uint32_t faces[6][4] = {
+      {0, 2, 3, 1}, {4, 5, 7, 6}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 4, 6, 2}, {1, 3, 7, 5},
+    };
+    for(int f = 0; f < 6; ++f) {
+      const uint32_t tri[6] = {faces[f][0], faces[f][1], faces[f][2], faces[f][0], faces[f][2], faces[f][3]};
+      m.indices.insert(m.indices.end(), tri, tri + 6);
+    }
+    return m;
+  }
+
+  // Every pixel center a triangle covers gets the triangle's exact depth there
+  void referenceDraw(const OccluderMesh& m, const glm::mat4& transform, size_t width, size_t height, std::vector<float>& depth) {
+    for(size_t i = 0; i + 2 < m.indices.size(); i += 3) {
+      double x[3], y[3], z[3];
+      bool clipped = false;
+      for(int v = 0; v < 3; ++v) {
+        const glm::vec4 c = transform * glm::vec4(m.positions[m.indices[i + v]], 1.f);
+        clipped |= c.w <= 1e-6f || c.z < -c.w;
+        x[v] = (c.x / c.w * 0.5 + 0.5) * width;
+        y[v] = (c.y / c.w * 0.5 + 0.5) * height;
+        z[v] = c.z / c.w * 0.5 + 0.5;
+      }
+      const double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+      if(clipped || std::abs(area) < 1e-8)
+        continue;
+      // only the pixels under the triangle's bounding box
+      const double bx0 = std::min(x[0], std::min(x[1], x[2])), bx1 = std::max(x[0], std::max(x[1], x[2]));
+      const double by0 = std::min(y[0], std::min(y[1], y[2])), by1 = std::max(y[0], std::max(y[1], y[2]));
+      if(bx1 < 0. || by1 < 0. || bx0 >= width || by0 >= height)
+        continue;
+      const size_t x0 = size_t(std::max(bx0, 0.)), x1 = std::min(size_t(bx1) + 1, width);
+      const size_t y0 = size_t(std::max(by0, 0.)), y1 = std::min(size_t(by1) + 1, height);
+      for(size_t py = y0; py < y1; ++py) {
+        for(size_t px = x0; px < x1; ++px) {
+          const double cx = px + 0.5, cy = py + 0.5;
+          double b[3];
+          for(int e = 0; e < 3; ++e) {
+            const int a = (e + 1) % 3, c = (e + 2) % 3;
+            b[e] = ((x[c] - x[a]) * (cy - y[a]) - (cx - x[a]) * (y[c] - y[a])) / area;
+          }
+          if(b[0] <= 0. || b[1] <= 0. || b[2] <= 0.)
+            continue;
+          float& d = depth[py * width + px];
+          d = std::min(d, float(b[0] * z[0] + b[1] * z[1] + b[2] * z[2]));
+        }
+      }
+    }
+  }
+
+  // Whether any pixel the box touches is in front of the reference depth
+  bool referenceVisible(const Aabb& box, size_t width, size_t height, const std::vector<float>& depth) {
+    if(box.min.z < -1.f)
+      return true;
+    const float z = box.min.z * 0.5f + 0.5f;
+    const float fx0 = (box.min.x * 0.5f + 0.5f) * width, fx1 = (box.max.x * 0.5f + 0.5f) * width;
+    const float fy0 = (box.min.y * 0.5f + 0.5f) * height, fy1 = (box.max.y * 0.5f + 0.5f) * height;
+    if(fx1 < 0.f || fy1 < 0.f || fx0 >= width || fy0 >= height)
+      return false;
+    const size_t x0 = size_t(std::max(fx0, 0.f)), x1 = std::min(size_t(fx1), width - 1);
+    const size_t y0 = size_t(std::max(fy0, 0.f)), y1 = std::min(size_t(fy1), height - 1);
+    for(size_t y = y0; y <= y1; ++y) {
+      for(size_t x = x0; x <= x1; ++x) {
+        if(z < depth[y * width + x])
+          return true;
+      }
+    }
+    return false;
+  }
+
+  void writePfm(const std::string& path, size_t width, size_t height, const std::vector<float>& depth) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if(!f) {
+      fprintf(stderr, "can't write %s\n", path.c_str());
+      return;
+    }
+    // negative scale means little endian; rows go bottom to top, same as ours
+    fprintf(f, "Pf\n%zu %zu\n-1.0\n", width, height);
+    fwrite(&depth[0], sizeof(float), depth.size(), f);
+    fclose(f);
+  }
+
+  struct Totals
+  {
+    size_t boxes, culled, reference_hidden;
+  };
+
+  // Draw the occluders both ways and check the buffer against the
+  // reference, for the depth and for each of the objects
+  void compare(const char* name, const OccluderMesh& mesh, const std::vector<glm::mat4>& occluders,
+               const std::vector<DrawableMesh::Bounds>& objects, const glm::mat4& view_proj,
+               const std::string& out_dir, Totals& totals) {
+    OcclusionBuffer buffer;
+    for(size_t i = 0; i < occluders.size(); ++i)
+      buffer.addOccluder(&mesh, view_proj * occluders[i]);
+    buffer.rasterize(false);
+    std::vector<float> depth, threaded;
+    buffer.depthImage(depth);
+
+    buffer.clear();
+    for(size_t i = 0; i < occluders.size(); ++i)
+      buffer.addOccluder(&mesh, view_proj * occluders[i]);
+    buffer.rasterize(true);
+    buffer.depthImage(threaded);
+    check(depth == threaded, "threaded rasterizing gives the same depth");
+
+    const size_t w = buffer.width(), h = buffer.height();
+    std::vector<float> reference(w * h, 1.f);
+    for(size_t i = 0; i < occluders.size(); ++i)
+      referenceDraw(mesh, view_proj * occluders[i], w, h, reference);
+
+    size_t too_near = 0, covered = 0, kept = 0;
+    for(size_t i = 0; i < depth.size(); ++i) {
+      too_near += depth[i] < reference[i] - 1e-5f;
+      covered += reference[i] < 1.f;
+      kept += reference[i] < 1.f && depth[i] < 1.f;
+    }
+    check(too_near == 0, "depth is never nearer than the reference");
+    check(covered > 0 && kept * 10 >= covered * 9, "most of what the reference covers is kept");
+
+    const Frustum frustum = frustumFromMatrix(view_proj);
+    size_t wrongly_culled = 0;
+    for(size_t i = 0; i < objects.size(); ++i) {
+      Aabb world, box;
+      world.min = objects[i].min;
+      world.max = objects[i].max;
+      if(testAabb(frustum, world) == CullOutside || !transformBounds(objects[i], view_proj, box))
+        continue;
+      const bool visible = buffer.testAabb(box);
+      const bool ref = referenceVisible(box, w, h, reference);
+      wrongly_culled += ref && !visible;
+      totals.boxes++;
+      totals.culled += !visible;
+      totals.reference_hidden += !ref;
+    }
+    check(wrongly_culled == 0, "no box the reference can see is culled");
+
+    printf("%s: %zu of %zu covered pixels kept, %zu nearer than the reference, %zu boxes wrongly culled\n",
+           name, kept, covered, too_near, wrongly_culled);
+    if(!out_dir.empty()) {
+      writePfm(out_dir + "/" + name + ".pfm", w, h, depth);
+      writePfm(out_dir + "/" + name + "-reference.pfm", w, h, reference);
+    }
+  }
+
+  DrawableMesh::Bounds boxAt(const glm::vec3& c, const glm::vec3& e) {
+    DrawableMesh::Bounds b;
+    b.min = c - e;
+    b.max = c + e;
+    b.center = c;
+    b.radius = glm::length(e);
+    return b;
+  }
+
+  // One wall across the middle of the view: a box behind it is hidden,
+  // one in front of it and one off to the side aren't
+  void checkWall(const OccluderMesh& cube, const std::string& out_dir) {
+    std::vector<glm::mat4> wall(1, glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(-2.f, -1.f, -5.f)), glm::vec3(4.f, 2.f, 0.2f)));
+    std::vector<DrawableMesh::Bounds> boxes;
+    boxes.push_back(boxAt(glm::vec3(0.f, 0.f, -8.f), glm::vec3(0.3f)));
+    boxes.push_back(boxAt(glm::vec3(0.f, 0.f, -3.f), glm::vec3(0.3f)));
+    boxes.push_back(boxAt(glm::vec3(6.f, 0.f, -8.f), glm::vec3(0.3f)));
+    const glm::mat4 view_proj = glm::perspective(70.f, 2.f, 0.1f, 100.f);
+
+    OcclusionBuffer buffer;
+    buffer.addOccluder(&cube, view_proj * wall[0]);
+    buffer.rasterize(false);
+    bool seen[3];
+    for(size_t i = 0; i < 3; ++i) {
+      Aabb box;
+      check(transformBounds(boxes[i], view_proj, box), "wall: boxes are in front of the eye");
+      seen[i] = buffer.testAabb(box);
+    }
+    check(!seen[0], "wall: box behind it is culled");
+    check(seen[1], "wall: box in front of it isn't");
+    check(seen[2], "wall: box beside it isn't");
+
+    Totals totals = Totals();
+    compare("wall", cube, wall, boxes, view_proj, out_dir, totals);
+  }
+
+  // 8x8 rooms, 10m on a side, with 3m walls and a 2m gap for a door in
+  // the middle of each one, and boxes scattered on the floors
+  void checkRooms(const OccluderMesh& cube, const std::string& out_dir) {
+    const int rooms = 8;
+    const float room = 10.f, wall = 0.2f, height = 3.f, door = 2.f;
+    std::vector<glm::mat4> walls;
+    for(int i = 0; i <= rooms; ++i) {
+      for(int j = 0; j < rooms; ++j) {
+        const float along = j * room;
+        const float half = (room - door) * 0.5f;
+        for(int side = 0; side < 2; ++side) {
+          const float start = along + side * (half + door);
+          walls.push_back(glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(start, 0.f, i * room)), glm::vec3(half, height, wall)));
+          walls.push_back(glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(i * room, 0.f, start)), glm::vec3(wall, height, half)));
+        }
+      }
+    }
+
+    srand(1);
+    std::vector<DrawableMesh::Bounds> objects(5000);
+    for(size_t i = 0; i < objects.size(); ++i) {
+      const glm::vec3 c(randf(0.f, rooms * room), randf(0.2f, 1.5f), randf(0.f, rooms * room));
+      objects[i] = boxAt(c, glm::vec3(randf(0.1f, 0.5f), randf(0.1f, 0.5f), randf(0.1f, 0.5f)));
+    }
+
+    struct View {
+      const char* name;
+      glm::vec3 eye, dir;
+    };
+    const float mid = rooms * room * 0.5f;
+    const View views[] = {
+      // inside a room, looking across it at a corner
+      { "room", glm::vec3(mid - 3.f, 1.7f, mid - 2.f), glm::vec3(1.f, -0.05f, 0.6f) },
+      // through a line of doors
+      { "doors", glm::vec3(mid - 5.f, 1.5f, 1.f), glm::vec3(0.02f, -0.02f, 1.f) },
+      // from above the walls, looking down over the block
+      { "above", glm::vec3(-5.f, 12.f, -5.f), glm::vec3(1.f, -0.5f, 1.f) },
+    };
+    Totals totals = Totals();
+    for(size_t v = 0; v < sizeof(views) / sizeof(views[0]); ++v) {
+      const glm::mat4 view = glm::lookAt(views[v].eye, views[v].eye + views[v].dir, glm::vec3(0.f, 1.f, 0.f));
+      compare(views[v].name, cube, walls, objects, glm::perspective(70.f, 2.f, 0.1f, 200.f) * view, out_dir, totals);
+    }
+    printf("rooms: %zu boxes in view, %zu culled, the reference hides %zu\n", totals.boxes, totals.culled, totals.reference_hidden);
+    check(totals.culled > 0 && totals.culled < totals.boxes, "rooms: some boxes culled, some not");
+    // boxes are tested against whole tiles at their nearest depth, so
+    // it can only get some of the way to the reference
+    check(totals.culled * 2 >= totals.reference_hidden, "rooms: culls at least half of what the reference hides");
+  }
+}
+
+int main(int argc, char **argv) {
+  const std::string out_dir = argc > 1 ? argv[1] : "";
+  const OccluderMesh cube = unitCube();
+
+  checkWall(cube, out_dir);
+  checkRooms(cube, out_dir);
+
+  return checkResult();
+}
@@ -0,0 +1,296 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "pipeline/RenderGraph.hpp"
+#include "test/check.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+// sense-test-rendergraph [random-graphs] [passes]
+//
+// Compiles render graphs without any GL around. Checks the deferred
+// frame the pipeline builds and a bloom chain for the passes they
+// should cull, the lifetimes of their targets and the slots they should
+// share; that misuse throws; and that execute() runs the live passes in
+// order. Then random graphs from a fixed seed, checked against a
+// from-scratch liveness and overlap check: live passes only depend on
+// live passes, culled ones have nothing live depending on them, and
+// targets sharing a slot look the same and are never in use at the same
+// time. Exits non-zero on any failure.
+
+namespace {
+  typedef RenderGraph::Handle Handle;
+  typedef RenderGraph::PassId PassId;
+
+  // Same shape as what the pipeline builds, plus a debug view nobody looks at
+  void buildFrame(RenderGraph& g, bool post_lighting) {
+    const RenderGraph::TargetDesc rgba(1280, 720, RenderGraph::RGBA8, 4);
+    Handle gbuf[4];
+    gbuf[0] = g.createTarget("gcol", rgba);
+    gbuf[1] = g.createTarget("gnor", rgba);
+    gbuf[2] = g.createTarget("gmat", RenderGraph::TargetDesc(1280, 720, RenderGraph::RG16F, 4));
+    gbuf[3] = g.createTarget("depth", RenderGraph::TargetDesc(1280, 720, RenderGraph::Depth24Stencil8, 4));
+    Handle lit = g.importTarget("lcol");
+    Handle screen = g.importTarget("screen");
+    Handle debug = g.createTarget("debug", rgba);
+
+    PassId p = g.addPass("geometry");
+    for(size_t i = 0; i < 4; ++i)
+      gbuf[i] = g.write(p, gbuf[i]);
+    p = g.addPass("lighting");
+    for(size_t i = 0; i < 4; ++i)
+      g.read(p, gbuf[i]);
+    lit = g.write(p, lit);
+    p = g.addPass("debug-normals");
+    g.read(p, gbuf[1]);
+    debug = g.write(p, debug);
+    if(post_lighting) {
+      p = g.addPass("post-lighting");
+      for(size_t i = 0; i < 4; ++i)
+        g.read(p, gbuf[i]);
+      lit = g.modify(p, lit);
+    }
+    p = g.addPass("blit");
+    g.read(p, lit);
+    screen = g.write(p, screen);
+  }
+
+  void checkFrame() {
+    RenderGraph g;
+    buildFrame(g, true);
+    g.compile();
+    check(g.schedule().size() == 4, "frame: four live passes");
+    check(g.culledCount() == 1 && g.culled(2), "frame: debug pass culled");
+    check(g.position(2) == 2, "frame: culled pass positioned at the next live one");
+    check(g.physical(6) == RenderGraph::none, "frame: debug target not allocated");
+    check(g.physicalCount() == 4, "frame: G-buffer gets four slots");
+    check(g.firstUse(0) == 0 && g.lastUse(0) == 2, "frame: G-buffer lives from geometry until post-lighting");
+    check(g.firstUse(4) == 1 && g.lastUse(4) == 3, "frame: lighting target from lighting to the blit");
+    check(g.firstUse(6) == RenderGraph::none && g.lastUse(6) == RenderGraph::none, "frame: debug target never used");
+    check(g.physical(4) == RenderGraph::none && g.physical(5) == RenderGraph::none, "frame: imported targets have no slot");
+
+    g.clear();
+    buildFrame(g, false);
+    g.compile();
+    check(g.schedule().size() == 3, "frame without post-lighting: three live passes");
+    check(g.lastUse(0) == 1, "frame without post-lighting: G-buffer dies after lighting");
+  }
+
+  // Bright pass, two blurs and a composite. The second blur can go in
+  // the bright pass's slot once the first blur has read it.
+  void checkBloom() {
+    RenderGraph g;
+    const RenderGraph::TargetDesc full(1280, 720, RenderGraph::RGBA16F);
+    const RenderGraph::TargetDesc half(640, 360, RenderGraph::RGBA16F);
+    Handle hdr = g.createTarget("hdr", full);
+    const Handle bright_start = g.createTarget("bright", half);
+    Handle bright = bright_start;
+    Handle blur_x = g.createTarget("blur-x", half);
+    Handle blur_y = g.createTarget("blur-y", half);
+    Handle screen = g.importTarget("screen");
+
+    PassId p = g.addPass("scene");
+    hdr = g.write(p, hdr);
+    p = g.addPass("bright");
+    g.read(p, hdr);
+    bright = g.write(p, bright);
+    p = g.addPass("blur-x");
+    g.read(p, bright);
+    blur_x = g.write(p, blur_x);
+    p = g.addPass("blur-y");
+    g.read(p, blur_x);
+    blur_y = g.write(p, blur_y);
+    p = g.addPass("composite");
+    g.read(p, hdr);
+    g.read(p, blur_y);
+    screen = g.write(p, screen);
+    g.compile();
+
+    check(g.culledCount() == 0, "bloom: nothing culled");
+    check(g.physicalCount() == 3, "bloom: three slots for four targets");
+    check(g.physical(g.target(blur_y)) == g.physical(g.target(bright)), "bloom: second blur reuses the bright pass slot");
+    check(g.physical(g.target(blur_x)) != g.physical(g.target(bright)), "bloom: first blur can't");
+
+    bool threw = false;
+    try {
+      g.write(p, bright_start);
+    } catch(std::runtime_error&) {
+      threw = true;
+    }
+    check(threw, "bloom: writing an old version throws");
+  }
+
+  template <typename F>
+  bool throws(F f) {
+    try {
+      f();
+    } catch(std::runtime_error&) {
+      return true;
+    }
+    return false;
+  }
+
+  void checkErrors() {
+    RenderGraph g;
+    const Handle a = g.createTarget("a", RenderGraph::TargetDesc(64, 64, RenderGraph::RGBA8));
+    const PassId first = g.addPass("first");
+    const PassId second = g.addPass("second");
+    const Handle a1 = g.write(second, a);
+    check(throws([&] { g.read(first, a1); }), "errors: reading what a later pass writes");
+    check(throws([&] { g.read(second, a1); }), "errors: reading what the same pass writes");
+    check(throws([&] { g.write(second, a); }), "errors: writing an old version");
+    check(throws([&] { g.write(first, a1); }), "errors: writing before a later pass");
+    check(throws([&] { g.read(7, a1); }), "errors: bad pass id");
+    check(throws([&] { g.read(first, 99); }), "errors: bad target handle");
+    check(throws([&] { g.keep(7); }), "errors: keeping a bad pass id");
+    check(throws([&] { g.execute(); }), "errors: executing without compiling");
+    g.compile();
+    check(!throws([&] { g.execute(); }), "errors: executing once compiled");
+    g.addPass("third");
+    check(throws([&] { g.execute(); }), "errors: changed since compiling");
+  }
+
+  void checkExecute() {
+    RenderGraph g;
+    std::vector<int> ran;
+    Handle t = g.createTarget("t", RenderGraph::TargetDesc(64, 64, RenderGraph::RGBA8));
+    Handle screen = g.importTarget("screen");
+    PassId p = g.addPass("write", [&] { ran.push_back(0); });
+    t = g.write(p, t);
+    p = g.addPass("unused", [&] { ran.push_back(1); });
+    g.read(p, t);
+    g.write(p, g.createTarget("u", RenderGraph::TargetDesc(64, 64, RenderGraph::RGBA8)));
+    p = g.addPass("no callback");
+    t = g.modify(p, t);
+    p = g.addPass("side effect", [&] { ran.push_back(3); });
+    g.keep(p);
+    p = g.addPass("blit", [&] { ran.push_back(4); });
+    g.read(p, t);
+    screen = g.write(p, screen);
+    g.compile();
+
+    g.execute(0, 2);
+    check(ran.size() == 1 && ran[0] == 0, "execute: first part of the schedule");
+    g.execute(2);
+    check(ran.size() == 3 && ran[1] == 3 && ran[2] == 4, "execute: the rest, culled pass skipped");
+    g.execute(10, 20);
+    check(ran.size() == 3, "execute: past the end runs nothing");
+  }
+
+  // What went into a random graph, to check the compiled one against
+  struct Recording
+  {
+    std::vector<std::vector<Handle> > reads; // by pass
+    std::vector<Handle> writes; // by pass
+    std::map<Handle, PassId> writers;
+    std::vector<bool> kept;
+  };
+
+  // Passes read random targets and write one, out of a few
+  // descriptions. Now and then one writes to the screen or is kept.
+  void buildRandom(RenderGraph& g, size_t passes, Recording* rec) {
+    const RenderGraph::TargetDesc descs[3] = {
+      RenderGraph::TargetDesc(1280, 720, RenderGraph::RGBA8),
+      RenderGraph::TargetDesc(640, 360, RenderGraph::RGBA16F),
+      RenderGraph::TargetDesc(1280, 720, RenderGraph::Depth24Stencil8)
+    };
+    std::vector<Handle> latest;
+    char name[32];
+    for(size_t i = 0; i < passes / 2 + 1; ++i) {
+      snprintf(name, sizeof(name), "t%u", unsigned(i));
+      latest.push_back(g.createTarget(name, descs[rand() % 3]));
+    }
+    latest.push_back(g.importTarget("screen"));
+    for(size_t i = 0; i < passes; ++i) {
+      snprintf(name, sizeof(name), "p%u", unsigned(i));
+      const PassId p = g.addPass(name);
+      std::vector<Handle> reads(rand() % 3);
+      for(size_t r = 0; r < reads.size(); ++r) {
+        reads[r] = latest[rand() % (latest.size() - 1)];
+        g.read(p, reads[r]);
+      }
+      size_t t = rand() % (latest.size() - 1);
+      if(rand() % 8 == 0)
+        t = latest.size() - 1;
+      if(rand() & 1)
+        reads.push_back(latest[t]);
+      latest[t] = reads.size() && reads.back() == latest[t] ? g.modify(p, latest[t]) : g.write(p, latest[t]);
+      const bool kept = rand() % 32 == 0;
+      if(kept)
+        g.keep(p);
+      if(rec) {
+        rec->reads.push_back(reads);
+        rec->writes.push_back(latest[t]);
+        rec->writers[latest[t]] = p;
+        rec->kept.push_back(kept);
+      }
+    }
+  }
+
+  // Work out from scratch which passes should live, and check the slots
+  void verifyRandom(const RenderGraph& g, const Recording& rec) {
+    const size_t passes = rec.writes.size();
+    std::vector<bool> live(passes);
+    for(size_t i = passes; i-- > 0;) {
+      live[i] = live[i] || rec.kept[i] || g.imported(g.target(rec.writes[i]));
+      if(!live[i])
+        continue;
+      for(size_t r = 0; r < rec.reads[i].size(); ++r) {
+        auto w = rec.writers.find(rec.reads[i][r]);
+        if(w != rec.writers.end())
+          live[w->second] = true;
+      }
+    }
+    for(size_t i = 0; i < passes; ++i)
+      check(live[i] == !g.culled(i), "random: pass culled exactly when nothing live needs it");
+
+    for(size_t a = 0; a < g.targetCount(); ++a) {
+      if(g.physical(a) == RenderGraph::none)
+        continue;
+      check(g.targetDesc(a) == g.physicalDesc(g.physical(a)), "random: slot matches its targets");
+      for(size_t b = a + 1; b < g.targetCount(); ++b) {
+        if(g.physical(a) != g.physical(b))
+          continue;
+        check(g.lastUse(a) < g.firstUse(b) || g.lastUse(b) < g.firstUse(a), "random: targets sharing a slot don't overlap");
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  const size_t graphs = argc > 1 ? atoi(argv[1]) : 500;
+  const size_t passes = argc > 2 ? atoi(argv[2]) : 64;
+
+  checkFrame();
+  checkBloom();
+  checkErrors();
+  checkExecute();
+
+  srand(1);
+  RenderGraph g;
+  for(size_t i = 0; i < graphs; ++i) {
+    Recording rec;
+    g.clear();
+    buildRandom(g, passes, &rec);
+    g.compile();
+    verifyRandom(g, rec);
+  }
+
+  return checkResult();
+}
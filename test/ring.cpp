@@ -0,0 +1,154 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/ring.hpp"
+#include "test/check.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// sense-test-ring [rounds]
+//
+// The ring allocator behind the instance ring and the staging buffer,
+// without a GPU. A few cases spelled out (wrapping, the skipped tail,
+// alignment, retiring in order, reset), then random allocations with
+// fences retired out behind them the way frames finish. No allocation
+// may overlap one whose region hasn't been retired. Exits non-zero on
+// any failure.
+
+namespace {
+  void checkBasics() {
+    // wrapping only works once the front is retired
+    ringAllocator r(100);
+    check(r.allocate(40, 1) == 0 && r.allocate(40, 1) == 40, "wrap: first allocations in order");
+    r.fence(1);
+    check(r.allocate(30, 1) == ringAllocator::npos, "wrap: no room until the front is retired");
+    check(r.retire(1), "wrap: retiring releases");
+    check(r.used() == 0 && r.allocate(30, 1) == 0, "wrap: an empty ring starts over at 0");
+
+    // the space skipped at the end counts as used until it's retired
+    ringAllocator t(100);
+    t.allocate(60, 1);
+    t.fence(1);
+    check(t.allocate(30, 1) == 60, "tail: second allocation");
+    t.fence(2);
+    t.retire(1);
+    check(t.allocate(20, 1) == 0, "tail: wraps when it doesn't fit before the end");
+    check(t.used() == 60, "tail: skipped bytes are used");
+    t.retire(2);
+    check(t.used() == 30, "tail: skipped bytes go with the region that skipped them");
+
+    ringAllocator a(256);
+    check(a.allocate(3, 1) == 0, "align: unaligned");
+    check(a.allocate(8, 16) == 16, "align: rounds up");
+    check(a.used() == 24, "align: padding is used");
+    check(a.allocate(300) == ringAllocator::npos, "align: bigger than the ring fails");
+
+    ringAllocator o(64);
+    for(uint64_t token = 1; token <= 3; ++token) {
+      o.allocate(8);
+      o.fence(token);
+    }
+    o.fence(4); // empty regions still get a token
+    check(o.retire(2) && o.pending() && o.oldest() == 3, "retire: everything up to the token goes");
+    check(!o.retire(1), "retire: older tokens do nothing");
+    check(o.retire(4) && !o.pending() && o.used() == 0, "retire: empty regions retire too");
+
+    o.allocate(8);
+    o.fence(5);
+    o.reset(512);
+    check(o.size() == 512 && o.used() == 0 && !o.pending(), "reset: forgets everything");
+    check(o.allocate(512, 1) == 0, "reset: the whole ring is free");
+  }
+
+  struct Allocation
+  {
+    size_t offset, bytes;
+    uint64_t token; // of the region it's in; 0 while open
+  };
+
+  void run(size_t rounds) {
+    const size_t size = 4096;
+    ringAllocator r(size);
+    std::vector<int> owner(size, -1); // 1 where a live allocation is
+    std::vector<Allocation> live;
+    uint64_t next_token = 1, retired = 0;
+    size_t failed = 0;
+
+    for(size_t round = 0; round < rounds; ++round) {
+      const int op = rand() % 100;
+      if(op < 70) {
+        static const size_t aligns[] = { 1, 4, 16, 256 };
+        const size_t align = aligns[rand() % 4];
+        const size_t bytes = 1 + rand() % 700;
+        const size_t offset = r.allocate(bytes, align);
+        if(offset == ringAllocator::npos) {
+          ++failed;
+          continue;
+        }
+        check(offset % align == 0, "random: aligned");
+        check(offset + bytes <= size, "random: inside the ring");
+        bool clear = true;
+        for(size_t i = offset; i < offset + bytes && i < size; ++i) {
+          clear = clear && owner[i] == -1;
+          owner[i] = 1;
+        }
+        check(clear, "random: no overlap with anything in flight");
+        Allocation a;
+        a.offset = offset;
+        a.bytes = bytes;
+        a.token = 0;
+        live.push_back(a);
+      } else if(op < 90) {
+        for(size_t i = 0; i < live.size(); ++i) {
+          if(!live[i].token)
+            live[i].token = next_token;
+        }
+        r.fence(next_token++);
+      } else if(next_token - 1 > retired) {
+        // the GPU gets through some of what's been fenced
+        retired += 1 + rand() % (next_token - 1 - retired);
+        r.retire(retired);
+        for(size_t i = live.size(); i-- > 0;) {
+          if(live[i].token && live[i].token <= retired) {
+            for(size_t j = live[i].offset; j < live[i].offset + live[i].bytes; ++j)
+              owner[j] = -1;
+            live[i] = live.back();
+            live.pop_back();
+          }
+        }
+        check(!r.pending() || r.oldest() > retired, "random: retired regions are gone");
+      }
+    }
+
+    // once everything is retired, the whole ring is there again
+    r.fence(next_token);
+    r.retire(next_token);
+    check(r.used() == 0, "random: nothing used after retiring everything");
+    check(r.allocate(size, 1) == 0, "random: the whole ring is free again");
+    check(failed < rounds / 2, "random: most allocations fit");
+  }
+}
+
+int main(int argc, char **argv) {
+  const size_t rounds = argc > 1 ? atoi(argv[1]) : 200000;
+
+  srand(1);
+  checkBasics();
+  run(rounds);
+
+  return checkResult();
+}
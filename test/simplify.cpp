@@ -0,0 +1,315 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mesh/Bounds.hpp"
+#include "mesh/Simplify.hpp"
+#include "mesh/VertexData.hpp"
+#include "pipeline/Drawable.hpp"
+#include "test/check.hpp"
+
+#include "3rdparty/glm/glm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <vector>
+
+// sense-test-simplify
+//
+// Decimation quality on a few known meshes, all on the CPU. A flat
+// grid with an open border and a UV seam down the middle has to lose
+// most of its triangles while keeping every border and seam vertex and
+// its exact area. A bumpy sphere with seams at the poles and along a
+// meridian goes through simplifyMesh() and generateLods(): every level
+// has to be a real reduction, and the surface it describes may not be
+// further from the full detail one than the error it reports, measured
+// both ways. Exits non-zero on any failure.
+
+namespace {
+  struct Mesh
+  {
+    std::vector<float> positions;
+    std::vector<uint32_t> indices;
+
+    glm::vec3 position(uint32_t v) const {
+      return glm::vec3(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]);
+    }
+  };
+
+  // size x size quads in the xy plane. The column of vertices at x =
+  // seam is doubled, with the quads on each side using their own copy,
+  // the way a UV seam comes out of an exporter.
+  Mesh grid(size_t size, size_t seam) {
+    Mesh m;
+    for(size_t y = 0; y <= size; ++y) {
+      for(size_t x = 0; x <= size; ++x) {
+        m.positions.push_back(float(x));
+        m.positions.push_back(float(y));
+        m.positions.push_back(0.f);
+      }
+    }
+    const uint32_t copies = m.positions.size() / 3;
+    for(size_t y = 0; y <= size; ++y) {
+      m.positions.push_back(float(seam));
+      m.positions.push_back(float(y));
+      m.positions.push_back(0.f);
+    }
+    for(size_t y = 0; y < size; ++y) {
+      for(size_t x = 0; x < size; ++x) {
+        uint32_t v[4] = {
+          uint32_t(y * (size + 1) + x), uint32_t(y * (size + 1) + x + 1),
+          uint32_t((y + 1) * (size + 1) + x), uint32_t((y + 1) * (size + 1) + x + 1)
+        };
+        // right of the seam uses the copies
+        if(x == seam) {
+          v[0] = copies + y;
+          v[2] = copies + y + 1;
+        }
+        const uint32_t quad[6] = { v[0], v[1], v[3], v[0], v[3], v[2] };
+        m.indices.insert(m.indices.end(), quad, quad + 6);
+      }
+    }
+    return m;
+  }
+
+  // segments around, segments / 2 rings down, with bumps. The first
+  // and last column meet in a seam, and each pole is a ring of vertices
+  // at one point.
+  Mesh bumpySphere(size_t segments) {
+    Mesh m;
+    const size_t rings = segments / 2;
+    for(size_t i = 0; i <= rings; ++i) {
+      const float theta = float(M_PI) * i / rings;
+      for(size_t j = 0; j <= segments; ++j) {
+        const float phi = 2.f * float(M_PI) * j / segments;
+        const float r = 1.f + 0.05f * std::sin(4.f * theta) * std::sin(3.f * phi);
+        m.positions.push_back(r * std::sin(theta) * std::cos(phi));
+        m.positions.push_back(r * std::cos(theta));
+        m.positions.push_back(r * std::sin(theta) * std::sin(phi));
+      }
+    }
+    for(size_t i = 0; i < rings; ++i) {
+      for(size_t j = 0; j < segments; ++j) {
+        const uint32_t a = i * (segments + 1) + j, b = a + 1, c = a + segments + 1, d = c + 1;
+        // the quads at the poles are really triangles
+        if(i != 0) {
+          const uint32_t t[3] = { a, b, d };
+          m.indices.insert(m.indices.end(), t, t + 3);
+        }
+        if(i != rings - 1) {
+          const uint32_t t[3] = { a, d, c };
+          m.indices.insert(m.indices.end(), t, t + 3);
+        }
+      }
+    }
+    return m;
+  }
+
+  double triangleArea(const Mesh& m, const uint32_t* tri) {
+    return 0.5 * glm::length(glm::cross(m.position(tri[1]) - m.position(tri[0]), m.position(tri[2]) - m.position(tri[0])));
+  }
+
+  double area(const Mesh& m, const std::vector<uint32_t>& indices) {
+    double total = 0.;
+    for(size_t i = 0; i + 2 < indices.size(); i += 3)
+      total += triangleArea(m, &indices[i]);
+    return total;
+  }
+
+  // Distance from p to the triangle abc
+  float pointTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    const glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    const float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if(d1 <= 0.f && d2 <= 0.f)
+      return glm::length(p - a);
+    const glm::vec3 bp = p - b;
+    const float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if(d3 >= 0.f && d4 <= d3)
+      return glm::length(p - b);
+    const float vc = d1 * d4 - d3 * d2;
+    if(vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+      return glm::length(p - (a + ab * (d1 / (d1 - d3))));
+    const glm::vec3 cp = p - c;
+    const float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if(d6 >= 0.f && d5 <= d6)
+      return glm::length(p - c);
+    const float vb = d5 * d2 - d1 * d6;
+    if(vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+      return glm::length(p - (a + ac * (d2 / (d2 - d6))));
+    const float va = d3 * d6 - d5 * d4;
+    if(va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f)
+      return glm::length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+    const float denom = 1.f / (va + vb + vc);
+    return glm::length(p - (a + ab * (vb * denom) + ac * (vc * denom)));
+  }
+
+  // Stops looking once it's down to enough
+  float pointSurface(const glm::vec3& p, const Mesh& m, const std::vector<uint32_t>& indices, float enough) {
+    float best = 1e30f;
+    for(size_t i = 0; i + 2 < indices.size() && best > enough; i += 3)
+      best = std::min(best, pointTriangle(p, m.position(indices[i]), m.position(indices[i + 1]), m.position(indices[i + 2])));
+    return best;
+  }
+
+  // Furthest that points on one surface get from the other, sampled at
+  // the corners, edge middles and centers of the triangles, both ways
+  float deviation(const Mesh& m, const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+    float worst = 0.f;
+    for(int pass = 0; pass < 2; ++pass) {
+      const std::vector<uint32_t>& from = pass ? b : a;
+      const std::vector<uint32_t>& to = pass ? a : b;
+      for(size_t i = 0; i + 2 < from.size(); i += 3) {
+        const glm::vec3 p0 = m.position(from[i]), p1 = m.position(from[i + 1]), p2 = m.position(from[i + 2]);
+        const glm::vec3 samples[7] = { p0, p1, p2, (p0 + p1) * 0.5f, (p1 + p2) * 0.5f, (p2 + p0) * 0.5f, (p0 + p1 + p2) / 3.f };
+        for(size_t s = 0; s < 7; ++s)
+          worst = std::max(worst, pointSurface(samples[s], m, to, worst));
+      }
+    }
+    return worst;
+  }
+
+  // The simplifier measures in double, this in float
+  bool within(float measured, float error) {
+    return measured <= error + 1e-5f;
+  }
+
+  std::set<uint32_t> referenced(const std::vector<uint32_t>& indices) {
+    return std::set<uint32_t>(indices.begin(), indices.end());
+  }
+
+  void checkGrid() {
+    const size_t size = 24, seam = 12;
+    const Mesh m = grid(size, seam);
+    std::vector<uint32_t> out(m.indices.size());
+    float error = -1.f;
+    out.resize(simplifyMesh(&out[0], &m.indices[0], m.indices.size(), &m.positions[0], m.positions.size() / 3, 0, 0.01f, &error));
+    printf("grid: %zu triangles down to %zu, error %g\n", m.indices.size() / 3, out.size() / 3, error);
+
+    check(out.size() % 3 == 0 && out.size() * 4 < m.indices.size(), "grid: loses at least three quarters of its triangles");
+    check(error >= 0.f && error < 1e-5f, "grid: a flat grid simplifies without error");
+    check(std::fabs(area(m, out) - area(m, m.indices)) < 1e-3, "grid: area is kept exactly, no holes or overlaps");
+
+    const std::set<uint32_t> used = referenced(out);
+    bool border = true, seams = true;
+    for(uint32_t v = 0; v < m.positions.size() / 3; ++v) {
+      const glm::vec3 p = m.position(v);
+      if(p.x == 0.f || p.y == 0.f || p.x == float(size) || p.y == float(size))
+        border = border && used.count(v);
+      if(p.x == float(seam))
+        seams = seams && used.count(v);
+    }
+    check(border, "grid: every border vertex is kept");
+    check(seams, "grid: both sides of the seam are kept");
+
+    // the seam still splits the triangles: none reach across it
+    bool split = true;
+    for(size_t i = 0; i < out.size(); i += 3) {
+      float lo = 1e30f, hi = -1e30f;
+      for(size_t k = 0; k < 3; ++k) {
+        lo = std::min(lo, m.position(out[i + k]).x);
+        hi = std::max(hi, m.position(out[i + k]).x);
+      }
+      split = split && (hi <= float(seam) || lo >= float(seam));
+    }
+    check(split, "grid: no triangle crosses the seam");
+
+    // nothing at all happens with no error allowed on something curved
+    const Mesh s = bumpySphere(24);
+    out.resize(s.indices.size());
+    out.resize(simplifyMesh(&out[0], &s.indices[0], s.indices.size(), &s.positions[0], s.positions.size() / 3, 0, 0.f, &error));
+    check(out.size() == s.indices.size(), "sphere: zero error keeps everything");
+
+    // and the target count is respected
+    out.resize(m.indices.size());
+    out.resize(simplifyMesh(&out[0], &m.indices[0], m.indices.size(), &m.positions[0], m.positions.size() / 3, m.indices.size() / 2, 1.f, &error));
+    check(out.size() <= m.indices.size() / 2 && out.size() * 3 >= m.indices.size(), "grid: stops around the target count");
+  }
+
+  void checkSphere() {
+    const Mesh m = bumpySphere(40);
+    const size_t vertex_count = m.positions.size() / 3;
+    const float target_error = 0.02f;
+    std::vector<uint32_t> out(m.indices.size());
+    float error = -1.f;
+    out.resize(simplifyMesh(&out[0], &m.indices[0], m.indices.size(), &m.positions[0], vertex_count, m.indices.size() / 4, target_error, &error));
+    const float measured = deviation(m, m.indices, out);
+    printf("sphere: %zu triangles down to %zu, error %g reported, %g measured\n", m.indices.size() / 3, out.size() / 3, error, measured);
+
+    check(out.size() * 2 < m.indices.size(), "sphere: at least halves the triangles");
+    check(error > 0.f && error <= target_error, "sphere: reported error within the target");
+    check(within(measured, error), "sphere: surface within the reported error");
+
+    // the seam along the first meridian and the poles stay put
+    const std::set<uint32_t> used = referenced(out);
+    const size_t segments = 40, rings = 20;
+    bool seams = true;
+    for(size_t i = 0; i <= rings; ++i) {
+      seams = seams && (i == 0 || i == rings || (used.count(i * (segments + 1)) && used.count(i * (segments + 1) + segments)));
+    }
+    check(seams, "sphere: both sides of the seam are kept");
+  }
+
+  void checkLods() {
+    const Mesh s = bumpySphere(40);
+    DrawableMesh mesh = DrawableMesh();
+    DrawableMesh::Attribute a;
+    a.type = DrawableMesh::Float;
+    a.loc = DrawableMesh::Pos;
+    a.start = 0;
+    a.size = 3;
+    a.special = DrawableMesh::None;
+    mesh.attributes.push_back(a);
+    mesh.data_stride = 12;
+    mesh.data_size = s.positions.size() * 4;
+    mesh.data = new char[mesh.data_size];
+    memcpy(mesh.data, &s.positions[0], mesh.data_size);
+    writeIndices(&mesh, s.indices, s.positions.size() / 3);
+    computeMeshBounds(&mesh);
+
+    LodOptions opts;
+    const size_t added = generateLods(&mesh, opts);
+    check(added >= 2 && added == mesh.lods.size() - 1, "lods: a chain of levels is built");
+    check(generateLods(&mesh, opts) == 0, "lods: meshes with LODs are left alone");
+
+    std::vector<uint32_t> indices;
+    readIndices(&mesh, indices);
+    check(mesh.lods.size() && mesh.lods[0].index_count == s.indices.size() && mesh.lods[0].error == 0.f, "lods: level 0 is the full mesh");
+    const std::vector<uint32_t> full(indices.begin(), indices.begin() + s.indices.size());
+    for(size_t l = 1; l < mesh.lods.size(); ++l) {
+      const DrawableMesh::Lod& lod = mesh.lods[l];
+      const DrawableMesh::Lod& prev = mesh.lods[l - 1];
+      check(lod.index_start + lod.index_count <= indices.size() && lod.index_count % 3 == 0, "lods: level inside the index data");
+      check(lod.index_count <= prev.index_count * 0.85f, "lods: every level saves at least 15%");
+      check(lod.index_count / 3 >= opts.min_triangles, "lods: no level below min_triangles");
+      check(lod.error >= prev.error, "lods: error doesn't go down");
+      const std::vector<uint32_t> level(indices.begin() + lod.index_start, indices.begin() + lod.index_start + lod.index_count);
+      const float measured = deviation(s, full, level);
+      printf("lod %zu: %zu triangles, error %g reported, %g measured\n", l, lod.index_count / 3, lod.error, measured);
+      check(within(measured, lod.error), "lods: surface within the reported error");
+    }
+    delete[] (char*)mesh.data;
+    delete[] (char*)mesh.index_data;
+  }
+}
+
+int main(int, char **) {
+  checkGrid();
+  checkSphere();
+  checkLods();
+
+  return checkResult();
+}
@@ -0,0 +1,293 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "pipeline/ogl/Upload.hpp"
+#include "test/check.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// sense-test-upload [rounds]
+//
+// UploadQueue and StagingBuffer against mock GL, no context needed. The
+// mock fence's sync is the token it was created for, and the "GPU" is
+// just the newest token it has finished; a wait with a timeout finishes
+// up to the sync it's waiting on. The queue has to run callbacks in
+// order, count the stalls, delete every sync once, and the staging
+// buffer must never hand out space the GPU could still be reading.
+// Exits non-zero on any failure.
+
+namespace {
+  // mock fences
+  uintptr_t fences_made = 0;
+  uintptr_t gpu_done = 0;
+  size_t flushes = 0;
+  std::vector<uintptr_t> deleted;
+
+  GLsync GLAPIENTRY mockFenceSync(GLenum, GLbitfield) {
+    return reinterpret_cast<GLsync>(++fences_made);
+  }
+
+  GLenum GLAPIENTRY mockClientWaitSync(GLsync sync, GLbitfield, GLuint64 timeout) {
+    const uintptr_t id = reinterpret_cast<uintptr_t>(sync);
+    if(id <= gpu_done)
+      return GL_ALREADY_SIGNALED;
+    if(!timeout)
+      return GL_TIMEOUT_EXPIRED;
+    gpu_done = id;
+    return GL_CONDITION_SATISFIED;
+  }
+
+  void GLAPIENTRY mockDeleteSync(GLsync sync) {
+    deleted.push_back(reinterpret_cast<uintptr_t>(sync));
+  }
+
+  void GLAPIENTRY mockFlush() {
+    ++flushes;
+  }
+
+  FenceFunctions mockFences() {
+    FenceFunctions f;
+    f.fenceSync = mockFenceSync;
+    f.clientWaitSync = mockClientWaitSync;
+    f.deleteSync = mockDeleteSync;
+    f.flush = mockFlush;
+    return f;
+  }
+
+  // mock buffer object; one buffer, mapped straight into host memory
+  std::vector<unsigned char> storage;
+  size_t maps = 0, unmaps = 0, buffers_deleted = 0;
+
+  void GLAPIENTRY mockGenBuffers(GLsizei, GLuint* ids) { ids[0] = 7; }
+  void GLAPIENTRY mockDeleteBuffers(GLsizei, const GLuint*) { ++buffers_deleted; }
+  void GLAPIENTRY mockBindBuffer(GLenum, GLuint) {}
+
+  void GLAPIENTRY mockBufferData(GLenum, GLsizeiptr size, const GLvoid*, GLenum) {
+    storage.assign(size, 0);
+  }
+
+  GLvoid* GLAPIENTRY mockMapBufferRange(GLenum, GLintptr offset, GLsizeiptr size, GLbitfield access) {
+    ++maps;
+    check(offset >= 0 && size_t(offset + size) <= storage.size(), "map: inside the buffer");
+    check((access & GL_MAP_UNSYNCHRONIZED_BIT) != 0, "map: unsynchronized");
+    return &storage[offset];
+  }
+
+  GLboolean GLAPIENTRY mockUnmapBuffer(GLenum) {
+    ++unmaps;
+    return GL_TRUE;
+  }
+
+  BufferFunctions mockBuffers() {
+    BufferFunctions f;
+    f.genBuffers = mockGenBuffers;
+    f.deleteBuffers = mockDeleteBuffers;
+    f.bindBuffer = mockBindBuffer;
+    f.bufferData = mockBufferData;
+    f.mapBufferRange = mockMapBufferRange;
+    f.unmapBuffer = mockUnmapBuffer;
+    return f;
+  }
+
+  void resetMocks() {
+    fences_made = gpu_done = 0;
+    flushes = 0;
+    deleted.clear();
+    maps = unmaps = buffers_deleted = 0;
+  }
+
+  std::vector<uint64_t> ran;
+
+  struct Record
+  {
+    uint64_t token;
+    void operator()() const { ran.push_back(token); }
+  };
+
+  UploadQueue::Callback record(uint64_t token) {
+    Record r;
+    r.token = token;
+    return r;
+  }
+
+  void checkQueue() {
+    resetMocks();
+    ran.clear();
+    {
+      UploadQueue q(mockFences());
+      check(q.empty() && q.poll() == 0, "queue: starts empty");
+      check(q.poll(true) == 0 && q.stats().stalls == 0, "queue: waiting on nothing doesn't stall");
+      for(uint64_t i = 1; i <= 3; ++i)
+        check(q.submit(record(i)) == i, "queue: tokens count up from 1");
+      check(flushes == 3, "queue: every submit flushes");
+      check(q.stats().submitted == 3 && !q.empty(), "queue: submitted");
+
+      check(q.poll() == 0 && ran.empty(), "queue: nothing finished, nothing runs");
+      gpu_done = 2;
+      check(q.poll() == 2, "queue: poll returns the newest finished token");
+      check(ran.size() == 2 && ran[0] == 1 && ran[1] == 2, "queue: callbacks run oldest first");
+      check(deleted.size() == 2 && deleted[0] == 1 && deleted[1] == 2, "queue: finished syncs are deleted");
+      check(q.stats().completed == 2 && q.stats().stalls == 0, "queue: completed without stalling");
+
+      check(q.poll(true) == 3 && q.stats().stalls == 1, "queue: poll(true) blocks on the oldest and counts a stall");
+      check(ran.size() == 3 && ran[2] == 3 && q.empty(), "queue: the blocked on upload ran");
+
+      // the oldest is done already: no stall, and it doesn't wait on the rest
+      q.submit(record(4));
+      q.submit(record(5));
+      gpu_done = 4;
+      check(q.poll(true) == 4 && q.stats().stalls == 1, "queue: no stall when the oldest is already done");
+      check(ran.size() == 4 && !q.empty(), "queue: poll(true) only waits for one");
+
+      // an empty callback is allowed
+      q.submit(UploadQueue::Callback());
+      check(q.poll(true) == 5 && q.stats().stalls == 2, "queue: blocking finishes the oldest");
+      check(ran.size() == 5 && ran[4] == 5 && !q.empty(), "queue: blocking leaves the newer ones");
+      gpu_done = 6;
+      check(q.poll() == 6 && ran.size() == 5 && q.empty(), "queue: empty callbacks are skipped");
+
+      q.submit(record(7));
+    }
+    check(deleted.size() == 7, "queue: the destructor deletes what's still pending");
+    bool in_order = true;
+    for(size_t i = 0; i < deleted.size(); ++i)
+      in_order = in_order && deleted[i] == i + 1;
+    check(in_order, "queue: each sync deleted once, in order");
+    check(ran.size() == 5, "queue: the destructor doesn't run callbacks");
+  }
+
+  void checkStaging() {
+    resetMocks();
+    {
+      UploadQueue q(mockFences());
+      StagingBuffer s(1024, mockBuffers());
+      check(s.buffer() == 7 && storage.size() == 1024, "staging: creates its buffer");
+
+      unsigned char data[2048];
+      for(size_t i = 0; i < sizeof(data); ++i)
+        data[i] = (unsigned char)(i * 31 + 5);
+
+      check(s.stage(data, 2048, q) == ringAllocator::npos && maps == 0, "staging: too big never maps");
+      const size_t a = s.stage(data, 600, q);
+      check(a == 0 && memcmp(&storage[a], data, 600) == 0, "staging: copies into the buffer");
+      check(maps == 1 && unmaps == 1, "staging: maps and unmaps once");
+
+      // only unfenced data in the way: it fences it and waits
+      const size_t b = s.stage(data + 1, 600, q);
+      check(b == 0 && q.stats().submitted == 1 && q.stats().stalls == 1, "staging: a full ring fences and blocks");
+      check(memcmp(&storage[b], data + 1, 600) == 0, "staging: copied after waiting");
+
+      // fenced by the caller; the next one waits on that token
+      s.fence(q.submit(UploadQueue::Callback()));
+      check(s.stage(data, 600, q) == 0 && q.stats().stalls == 2 && gpu_done == 2, "staging: blocks on the caller's fence");
+
+      s.fence(q.submit(UploadQueue::Callback()));
+      gpu_done = 3;
+      s.retire(q.poll());
+      check(s.stage(data, 1024, q) == 0 && q.stats().stalls == 2, "staging: retired space comes back without a stall");
+    }
+    check(buffers_deleted == 1, "staging: deletes its buffer");
+  }
+
+  struct Staged
+  {
+    size_t offset, bytes;
+    uint64_t token; // 0 until fenced
+    unsigned char fill;
+  };
+
+  void run(size_t rounds) {
+    resetMocks();
+    const size_t size = 64 << 10;
+    UploadQueue q(mockFences());
+    StagingBuffer s(size, mockBuffers());
+    std::vector<Staged> live;
+    std::vector<unsigned char> data(size);
+    size_t bytes_staged = 0;
+
+    for(size_t round = 0; round < rounds; ++round) {
+      const int op = rand() % 100;
+      if(op < 60) {
+        const size_t bytes = 1 + rand() % (size / 4);
+        const unsigned char fill = (unsigned char)rand();
+        memset(&data[0], fill, bytes);
+        const uintptr_t fenced = fences_made;
+        const size_t offset = s.stage(&data[0], bytes, q);
+        // a full ring with nothing fenced gets fenced by stage() itself
+        for(size_t i = 0; i < live.size() && fences_made > fenced; ++i) {
+          if(!live[i].token)
+            live[i].token = fenced + 1;
+        }
+        if(offset == ringAllocator::npos) {
+          check(false, "random: staging fits");
+          continue;
+        }
+        s.retire(q.poll());
+        // whatever the GPU hasn't finished must still be intact
+        for(size_t i = live.size(); i-- > 0;) {
+          const Staged& l = live[i];
+          if(l.token && l.token <= gpu_done) {
+            live[i] = live.back();
+            live.pop_back();
+            continue;
+          }
+          check(offset + bytes <= l.offset || l.offset + l.bytes <= offset, "random: no overlap with anything in flight");
+        }
+        check(storage[offset] == fill && storage[offset + bytes - 1] == fill, "random: copied");
+        Staged st;
+        st.offset = offset;
+        st.bytes = bytes;
+        st.token = 0;
+        st.fill = fill;
+        live.push_back(st);
+        bytes_staged += bytes;
+      } else if(op < 85) {
+        const uint64_t token = q.submit(UploadQueue::Callback());
+        for(size_t i = 0; i < live.size(); ++i) {
+          if(!live[i].token)
+            live[i].token = token;
+        }
+        s.fence(token);
+      } else if(fences_made > gpu_done) {
+        gpu_done += 1 + rand() % (fences_made - gpu_done);
+        s.retire(q.poll());
+      }
+    }
+
+    bool intact = true;
+    for(size_t i = 0; i < live.size(); ++i) {
+      if(live[i].token && live[i].token <= gpu_done)
+        continue;
+      intact = intact && storage[live[i].offset] == live[i].fill && storage[live[i].offset + live[i].bytes - 1] == live[i].fill;
+    }
+    check(intact, "random: in flight data never overwritten");
+    check(q.stats().stalls < q.stats().submitted, "random: most fences finish without blocking");
+    printf("staged %u MB in %u uploads, %u stalls\n", unsigned(bytes_staged >> 20), unsigned(maps), unsigned(q.stats().stalls));
+  }
+}
+
+int main(int argc, char **argv) {
+  const size_t rounds = argc > 1 ? atoi(argv[1]) : 100000;
+
+  srand(1);
+  checkQueue();
+  checkStaging();
+  run(rounds);
+
+  return checkResult();
+}
@@ -0,0 +1,179 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_UTIL_ARENA_HPP
+#define SENSE_UTIL_ARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for data that all dies at the same time, like a
+// frame's worth of draw commands. Nothing is freed individually;
+// reset() rewinds to the start in O(1) and keeps every block, so once
+// the arena has grown to fit a frame it stops allocating.
+class linearArena {
+public:
+  explicit linearArena(size_t block_size = 1 << 20)
+    : m_block_size(block_size), m_block(0), m_cur(0), m_end(0), m_used_before(0) {}
+
+  ~linearArena() {
+    for(size_t i = 0; i < m_blocks.size(); ++i)
+      delete[] m_blocks[i].data;
+  }
+
+  void* allocate(size_t size, size_t align = 16) {
+    char* p = alignUp(m_cur, align);
+    if(!m_cur || p + size > m_end) {
+      nextBlock(size + align);
+      p = alignUp(m_cur, align);
+    }
+    m_cur = p + size;
+    return p;
+  }
+
+  // Uninitialized storage for count Ts. Only for types that don't need destructors.
+  template <typename T>
+  T* allocate(size_t count) {
+    return (T*)allocate(sizeof(T) * count, std::max(std::alignment_of<T>::value, size_t(16)));
+  }
+
+  void reset() {
+    m_block = 0;
+    m_used_before = 0;
+    if(m_blocks.empty()) {
+      m_cur = m_end = 0;
+    } else {
+      m_cur = m_blocks[0].data;
+      m_end = m_cur + m_blocks[0].size;
+    }
+  }
+
+  // bytes handed out since the last reset, including alignment padding
+  size_t used() const {
+    if(m_blocks.empty())
+      return 0;
+    return m_used_before + (m_cur - m_blocks[m_block].data);
+  }
+
+  size_t capacity() const {
+    size_t total = 0;
+    for(size_t i = 0; i < m_blocks.size(); ++i)
+      total += m_blocks[i].size;
+    return total;
+  }
+
+private:
+  struct Block {
+    char* data;
+    size_t size;
+  };
+
+  size_t m_block_size;
+  std::vector<Block> m_blocks;
+  size_t m_block;
+  char* m_cur;
+  char* m_end;
+  size_t m_used_before; // bytes used in the blocks before m_block
+
+  linearArena(const linearArena&);
+  linearArena& operator=(const linearArena&);
+
+  static char* alignUp(char* p, size_t align) {
+    return (char*)(((size_t)p + align - 1) & ~(align - 1));
+  }
+
+  void nextBlock(size_t min_size) {
+    // reuse the blocks from earlier frames when they're big enough
+    size_t next = m_cur ? m_block + 1 : 0;
+    if(m_cur)
+      m_used_before += m_cur - m_blocks[m_block].data;
+    while(next < m_blocks.size() && m_blocks[next].size < min_size)
+      ++next;
+    if(next == m_blocks.size()) {
+      Block b;
+      b.size = std::max(m_block_size, min_size);
+      b.data = new char[b.size];
+      m_blocks.push_back(b);
+    }
+    m_block = next;
+    m_cur = m_blocks[next].data;
+    m_end = m_cur + m_blocks[next].size;
+  }
+};
+
+// Growable array living in a linearArena. Growing copies into a new
+// chunk twice the size and abandons the old one until the next reset.
+// Elements are never constructed or destroyed, so T has to be plain
+// data. Call clear() whenever the arena is reset.
+template <typename T>
+class arenaArray {
+public:
+  explicit arenaArray(linearArena& arena) : m_arena(arena), m_data(0), m_size(0), m_capacity(0) {}
+
+  void push_back(const T& t) {
+    if(m_size == m_capacity)
+      grow(m_size + 1);
+    m_data[m_size++] = t;
+  }
+
+  template <typename It>
+  void append(It begin, It end) {
+    const size_t count = end - begin;
+    if(m_size + count > m_capacity)
+      grow(m_size + count);
+    std::copy(begin, end, m_data + m_size);
+    m_size += count;
+  }
+
+  void reserve(size_t capacity) {
+    if(capacity > m_capacity)
+      grow(capacity);
+  }
+
+  void resize(size_t size) {
+    if(size > m_capacity)
+      grow(size);
+    m_size = size;
+  }
+
+  void clear() {
+    m_data = 0;
+    m_size = m_capacity = 0;
+  }
+
+  T* data() { return m_data; }
+  const T* data() const { return m_data; }
+  size_t size() const { return m_size; }
+  T& operator[](size_t i) { return m_data[i]; }
+  const T& operator[](size_t i) const { return m_data[i]; }
+
+private:
+  linearArena& m_arena;
+  T* m_data;
+  size_t m_size;
+  size_t m_capacity;
+
+  void grow(size_t min_capacity) {
+    const size_t capacity = std::max(std::max(m_capacity * 2, min_capacity), size_t(64));
+    T* data = m_arena.allocate<T>(capacity);
+    std::copy(m_data, m_data + m_size, data);
+    m_data = data;
+    m_capacity = capacity;
+  }
+};
+
+#endif // SENSE_UTIL_ARENA_HPP
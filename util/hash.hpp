@@ -0,0 +1,36 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_UTIL_HASH_HPP
+#define SENSE_UTIL_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit FNV-1a. Not cryptographic, but it's fast, stable across
+// platforms and runs, and good enough for keying caches on content.
+const uint64_t hash_seed = 14695981039346656037ULL;
+
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed=hash_seed)
+{
+  const unsigned char* p = (const unsigned char*)data;
+  uint64_t h = seed;
+  for(size_t i = 0; i < size; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+#endif // SENSE_UTIL_HASH_HPP
@@ -0,0 +1,147 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_UTIL_PARALLEL_HPP
+#define SENSE_UTIL_PARALLEL_HPP
+
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+
+// Most threads parallelForSlots will use, for sizing per-slot state
+inline size_t parallelSlots()
+{
+  return std::max(boost::thread::hardware_concurrency(), 1u);
+}
+
+// The threads parallelForSlots hands its ranges to: one less than
+// parallelSlots(), since the caller works too. They're started the first
+// time they're needed and sleep between jobs for the rest of the run,
+// rather than being created and joined for every call.
+class WorkerPool {
+public:
+  static WorkerPool& get() {
+    static WorkerPool pool;
+    return pool;
+  }
+
+  ~WorkerPool() {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_stop = true;
+    lock.unlock();
+    m_wake.notify_all();
+    m_threads.join_all();
+  }
+
+  // Run job(t) for every t in [0, tasks) and wait for all of them. The
+  // caller runs task 0 and anything the workers haven't got to yet. If
+  // the pool is already busy (a nested call from inside a job, or
+  // another thread's job) everything just runs here, in order.
+  void run(size_t tasks, const std::function<void(size_t)>& job) {
+    boost::mutex::scoped_lock busy(m_busy, boost::try_to_lock);
+    if(!busy.owns_lock()) {
+      for(size_t t = 0; t < tasks; ++t)
+        job(t);
+      return;
+    }
+
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_job = &job;
+    m_next = 1;
+    m_tasks = tasks;
+    m_pending = tasks - 1;
+    lock.unlock();
+    m_wake.notify_all();
+
+    job(0);
+    lock.lock();
+    while(m_next < m_tasks) {
+      const size_t t = m_next++;
+      lock.unlock();
+      job(t);
+      lock.lock();
+      --m_pending;
+    }
+    while(m_pending)
+      m_done.wait(lock);
+    m_job = 0;
+  }
+
+private:
+  WorkerPool() : m_job(0), m_next(0), m_tasks(0), m_pending(0), m_stop(false) {
+    for(size_t t = 1; t < parallelSlots(); ++t)
+      m_threads.create_thread([this]() { work(); });
+  }
+
+  void work() {
+    boost::mutex::scoped_lock lock(m_mutex);
+    for(;;) {
+      while(!m_stop && (!m_job || m_next >= m_tasks))
+        m_wake.wait(lock);
+      if(m_stop)
+        return;
+      const size_t t = m_next++;
+      const std::function<void(size_t)>& job = *m_job;
+      lock.unlock();
+      job(t);
+      lock.lock();
+      if(--m_pending == 0)
+        m_done.notify_one();
+    }
+  }
+
+  boost::mutex m_busy; // held by whoever's job is running
+  boost::mutex m_mutex;
+  boost::condition_variable m_wake;
+  boost::condition_variable m_done;
+  const std::function<void(size_t)>* m_job;
+  size_t m_next;
+  size_t m_tasks;
+  size_t m_pending;
+  bool m_stop;
+  boost::thread_group m_threads;
+};
+
+// Run func(slot, begin, end) over [0, count) split across the worker
+// pool, and wait for all of it. Each chunk gets its own slot in
+// [0, parallelSlots()), and slots go up with begin, so per-slot output
+// can be stitched back together in order. Ranges smaller than min_chunk
+// per thread aren't worth handing out, so small jobs just run inline.
+// func must be safe to call concurrently on disjoint ranges.
+template <typename Func>
+void parallelForSlots(size_t count, size_t min_chunk, Func func)
+{
+  size_t threads = parallelSlots();
+  threads = std::min(threads, count / std::max(min_chunk, size_t(1)));
+  if(threads <= 1) {
+    if(count)
+      func(size_t(0), size_t(0), count);
+    return;
+  }
+
+  const size_t chunk = (count + threads - 1) / threads;
+  const size_t chunks = (count + chunk - 1) / chunk;
+  WorkerPool::get().run(chunks, [&](size_t t) { func(t, t * chunk, std::min(t * chunk + chunk, count)); });
+}
+
+// Same, for when func(begin, end) doesn't care which slot it's in
+template <typename Func>
+void parallelFor(size_t count, size_t min_chunk, Func func)
+{
+  parallelForSlots(count, min_chunk, [&](size_t, size_t begin, size_t end) { func(begin, end); });
+}
+
+#endif // SENSE_UTIL_PARALLEL_HPP
@@ -0,0 +1,78 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_UTIL_RADIX_HPP
+#define SENSE_UTIL_RADIX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+struct SortKey
+{
+  uint64_t key;
+  uint32_t index; // whatever the key belongs to
+};
+
+// Stable LSD radix sort on the 64-bit keys, a byte at a time. All the
+// histograms are built in one read of the data, and bytes that are the
+// same for every key (common for the high bits of packed keys) are
+// skipped. scratch must have room for count keys. Returns whichever of
+// keys and scratch ended up holding the sorted result.
+inline SortKey* radixSort(SortKey* keys, SortKey* scratch, size_t count)
+{
+  if(count < 2)
+    return keys;
+
+  size_t hist[8][256];
+  memset(hist, 0, sizeof(hist));
+  for(size_t i = 0; i < count; ++i) {
+    uint64_t k = keys[i].key;
+    for(size_t b = 0; b < 8; ++b, k >>= 8)
+      hist[b][k & 0xff]++;
+  }
+
+  SortKey* src = keys;
+  SortKey* dst = scratch;
+  for(size_t b = 0; b < 8; ++b) {
+    const size_t shift = b * 8;
+    if(hist[b][(src[0].key >> shift) & 0xff] == count)
+      continue; // every key has the same byte here
+    size_t offset = 0;
+    for(size_t d = 0; d < 256; ++d) {
+      const size_t n = hist[b][d];
+      hist[b][d] = offset;
+      offset += n;
+    }
+    for(size_t i = 0; i < count; ++i)
+      dst[hist[b][(src[i].key >> shift) & 0xff]++] = src[i];
+    std::swap(src, dst);
+  }
+  return src;
+}
+
+// Same, for keys kept in a vector. scratch is resized to match; keep it
+// around between calls to avoid allocating.
+inline void radixSort(std::vector<SortKey>& keys, std::vector<SortKey>& scratch)
+{
+  if(keys.size() < 2)
+    return;
+  scratch.resize(keys.size());
+  if(radixSort(&keys[0], &scratch[0], keys.size()) != &keys[0])
+    keys.swap(scratch);
+}
+
+#endif // SENSE_UTIL_RADIX_HPP
@@ -0,0 +1,105 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SENSE_UTIL_RING_HPP
+#define SENSE_UTIL_RING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+// Hands out space in a fixed-size ring buffer that something else (the
+// GPU) reads behind us. Allocations are grouped into regions, each closed
+// by fence() with a token; a region's space only comes back when
+// retire() is called with that token or a later one. There's no GL in
+// here, the caller decides what a token means and when it has passed.
+class ringAllocator {
+public:
+  static const size_t npos = size_t(-1);
+
+  explicit ringAllocator(size_t size = 0)
+    : m_size(size), m_head(0), m_used(0), m_open(0) {}
+
+  // Offset of bytes contiguous bytes, or npos if there's not enough room
+  // without running into a region that hasn't been retired yet.
+  size_t allocate(size_t bytes, size_t align = 16) {
+    if(!m_used)
+      m_head = 0; // nothing in flight, so start over instead of wrapping
+    size_t start = (m_head + align - 1) & ~(align - 1);
+    if(start + bytes > m_size)
+      start = 0; // doesn't fit before the end; skip the tail of the buffer
+    const size_t consumed = (start >= m_head ? start - m_head : m_size - m_head + start) + bytes;
+    if(bytes > m_size || m_used + consumed > m_size)
+      return npos;
+    m_head = start + bytes;
+    if(m_head == m_size)
+      m_head = 0;
+    m_used += consumed;
+    m_open += consumed;
+    return start;
+  }
+
+  // Close the current region. Empty regions are still recorded so
+  // tokens can be retired in order.
+  void fence(uint64_t token) {
+    Region r;
+    r.token = token;
+    r.bytes = m_open;
+    m_regions.push_back(r);
+    m_open = 0;
+  }
+
+  // Free every region fenced with a token <= token. Tokens are assumed
+  // to increase. Returns true if any region was released.
+  bool retire(uint64_t token) {
+    bool released = false;
+    while(!m_regions.empty() && m_regions.front().token <= token) {
+      m_used -= m_regions.front().bytes;
+      m_regions.pop_front();
+      released = true;
+    }
+    return released;
+  }
+
+  bool pending() const { return !m_regions.empty(); }
+  // only meaningful if pending()
+  uint64_t oldest() const { return m_regions.front().token; }
+
+  // Forget everything, including regions still in flight. Only call
+  // this once the old storage can't be read anymore (orphaned, etc.)
+  void reset(size_t size) {
+    m_size = size;
+    m_head = m_used = m_open = 0;
+    m_regions.clear();
+  }
+
+  size_t size() const { return m_size; }
+  // includes space lost to alignment and wrapping
+  size_t used() const { return m_used; }
+
+private:
+  struct Region {
+    uint64_t token;
+    size_t bytes;
+  };
+
+  size_t m_size;
+  size_t m_head;
+  size_t m_used;
+  size_t m_open; // bytes allocated since the last fence
+  std::deque<Region> m_regions;
+};
+
+#endif // SENSE_UTIL_RING_HPP
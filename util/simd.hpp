@@ -0,0 +1,32 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SENSE_UTIL_SIMD_HPP
+#define SENSE_UTIL_SIMD_HPP
+
+// Figure out which vector instruction sets we're allowed to use. GCC
+// tells us through -march (we target nocona/prescott, so SSE3 is
+// always there), MSVC only tells us about SSE2 through /arch.
+// Anything that uses these must have a scalar fallback.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SENSE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX__)
+#define SENSE_AVX 1
+#include <immintrin.h>
+#endif
+
+#endif // SENSE_UTIL_SIMD_HPP
@@ -0,0 +1,361 @@
+// Copyright 2011 Branan Purvine-Riley and Adam Johnson
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SENSE_UTIL_TLSF_HPP
+#define SENSE_UTIL_TLSF_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Two-level segregated fit allocator for space that lives somewhere
+// else, like a GPU buffer. It only hands out offsets; sizes and offsets
+// are in whatever unit the caller likes (bytes, vertices, indices).
+// Allocating and freeing are O(1): free blocks sit in lists by size
+// class, a first level per power of two split into 16 linear steps, and
+// two bitmaps find the smallest class that's guaranteed to fit.
+class tlsfAllocator {
+public:
+  typedef uint32_t handle;
+  static const handle none = ~0u;
+
+  struct Stats
+  {
+    uint32_t capacity;
+    uint32_t used;
+    uint32_t allocations;
+    uint32_t free_blocks;
+    uint32_t largest_free;
+
+    uint32_t freeSpace() const { return capacity - used; }
+    // 0 when all the free space is one block, approaching 1 as it's
+    // scattered into pieces too small to use
+    float fragmentation() const {
+      const uint32_t f = freeSpace();
+      return f ? 1.f - float(largest_free) / float(f) : 0.f;
+    }
+  };
+
+  // One allocation that has to be copied by the caller after defragment()
+  struct Move
+  {
+    handle h;
+    uint32_t from, to, size;
+  };
+
+  explicit tlsfAllocator(uint32_t size = 0)
+    : m_first(none), m_last(none), m_capacity(0), m_used(0), m_allocations(0), m_fl_bitmap(0) {
+    memset(m_sl_bitmap, 0, sizeof(m_sl_bitmap));
+    for(size_t i = 0; i < fl_count; ++i) {
+      for(size_t j = 0; j < sl_count; ++j)
+        m_heads[i][j] = none;
+    }
+    if(size)
+      grow(size);
+  }
+
+  // none if there's no free block big enough
+  handle allocate(uint32_t size) {
+    if(!size)
+      size = 1;
+    uint32_t fl, sl;
+    if(!mappingSearch(size, fl, sl))
+      return none;
+    const handle b = findSuitable(fl, sl);
+    if(b == none)
+      return none;
+    removeFree(b);
+    if(m_blocks[b].size > size) {
+      // the rest goes back on a free list
+      const handle rest = newBlock();
+      Block& n = m_blocks[rest];
+      Block& a = m_blocks[b];
+      n.offset = a.offset + size;
+      n.size = a.size - size;
+      n.prev_phys = b;
+      n.next_phys = a.next_phys;
+      if(a.next_phys != none)
+        m_blocks[a.next_phys].prev_phys = rest;
+      else
+        m_last = rest;
+      a.next_phys = rest;
+      a.size = size;
+      insertFree(rest);
+    }
+    m_blocks[b].free = false;
+    m_used += size;
+    m_allocations++;
+    return b;
+  }
+
+  void free(handle h) {
+    handle b = h;
+    m_blocks[b].free = true;
+    m_used -= m_blocks[b].size;
+    m_allocations--;
+    const handle prev = m_blocks[b].prev_phys;
+    if(prev != none && m_blocks[prev].free) {
+      removeFree(prev);
+      absorbNext(prev);
+      b = prev;
+    }
+    const handle next = m_blocks[b].next_phys;
+    if(next != none && m_blocks[next].free) {
+      removeFree(next);
+      absorbNext(b);
+    }
+    insertFree(b);
+  }
+
+  uint32_t offset(handle h) const { return m_blocks[h].offset; }
+  uint32_t size(handle h) const { return m_blocks[h].size; }
+
+  // Add space to the end, e.g. after the caller has resized its buffer
+  void grow(uint32_t extra) {
+    if(!extra)
+      return;
+    if(m_last != none && m_blocks[m_last].free) {
+      removeFree(m_last);
+      m_blocks[m_last].size += extra;
+      insertFree(m_last);
+    } else {
+      const handle b = newBlock();
+      Block& n = m_blocks[b];
+      n.offset = m_capacity;
+      n.size = extra;
+      n.prev_phys = m_last;
+      n.next_phys = none;
+      if(m_last != none)
+        m_blocks[m_last].next_phys = b;
+      else
+        m_first = b;
+      m_last = b;
+      insertFree(b);
+    }
+    m_capacity += extra;
+  }
+
+  Stats stats() const {
+    Stats s;
+    s.capacity = m_capacity;
+    s.used = m_used;
+    s.allocations = m_allocations;
+    s.free_blocks = 0;
+    s.largest_free = 0;
+    for(handle b = m_first; b != none; b = m_blocks[b].next_phys) {
+      if(!m_blocks[b].free)
+        continue;
+      s.free_blocks++;
+      if(m_blocks[b].size > s.largest_free)
+        s.largest_free = m_blocks[b].size;
+    }
+    return s;
+  }
+
+  // Slide every allocation down to the front, in address order, leaving
+  // one free block at the end. Handles stay valid. moves gets what the
+  // caller has to copy; doing them in order is safe as long as each
+  // copy handles its own source and destination overlapping (memmove).
+  void defragment(std::vector<Move>& moves) {
+    moves.clear();
+    std::vector<handle> live;
+    for(handle b = m_first; b != none;) {
+      const handle next = m_blocks[b].next_phys;
+      if(m_blocks[b].free) {
+        removeFree(b);
+        m_unused.push_back(b);
+      } else {
+        live.push_back(b);
+      }
+      b = next;
+    }
+    uint32_t cursor = 0;
+    handle prev = none;
+    m_first = m_last = none;
+    for(size_t i = 0; i < live.size(); ++i) {
+      Block& a = m_blocks[live[i]];
+      if(a.offset != cursor) {
+        Move m;
+        m.h = live[i];
+        m.from = a.offset;
+        m.to = cursor;
+        m.size = a.size;
+        moves.push_back(m);
+        a.offset = cursor;
+      }
+      a.prev_phys = prev;
+      a.next_phys = none;
+      if(prev != none)
+        m_blocks[prev].next_phys = live[i];
+      else
+        m_first = live[i];
+      prev = m_last = live[i];
+      cursor += a.size;
+    }
+    const uint32_t capacity = m_capacity;
+    m_capacity = cursor;
+    grow(capacity - cursor);
+  }
+
+private:
+  static const uint32_t sl_bits = 4;
+  static const uint32_t sl_count = 1 << sl_bits;
+  static const uint32_t fl_count = 32 - sl_bits + 1;
+
+  struct Block
+  {
+    uint32_t offset, size;
+    handle prev_phys, next_phys;
+    handle prev_free, next_free;
+    bool free;
+  };
+
+  std::vector<Block> m_blocks;
+  std::vector<handle> m_unused; // slots in m_blocks to reuse
+  handle m_first, m_last; // in address order
+  uint32_t m_capacity;
+  uint32_t m_used;
+  uint32_t m_allocations;
+  uint32_t m_fl_bitmap;
+  uint32_t m_sl_bitmap[fl_count];
+  handle m_heads[fl_count][sl_count];
+
+  static uint32_t highBit(uint32_t x) {
+#if defined(__GNUC__)
+    return 31 - __builtin_clz(x);
+#elif defined(_MSC_VER)
+    unsigned long i;
+    _BitScanReverse(&i, x);
+    return i;
+#else
+    uint32_t i = 0;
+    while(x >>= 1)
+      ++i;
+    return i;
+#endif
+  }
+
+  static uint32_t lowBit(uint32_t x) {
+#if defined(__GNUC__)
+    return __builtin_ctz(x);
+#elif defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return i;
+#else
+    uint32_t i = 0;
+    while(!(x & 1)) {
+      x >>= 1;
+      ++i;
+    }
+    return i;
+#endif
+  }
+
+  // the list a free block of this size goes on
+  static void mapping(uint32_t size, uint32_t& fl, uint32_t& sl) {
+    if(size < sl_count) {
+      fl = 0;
+      sl = size;
+    } else {
+      const uint32_t bit = highBit(size);
+      sl = (size >> (bit - sl_bits)) ^ sl_count;
+      fl = bit - sl_bits + 1;
+    }
+  }
+
+  // the first list where every block is at least size
+  static bool mappingSearch(uint32_t size, uint32_t& fl, uint32_t& sl) {
+    uint64_t rounded = size;
+    if(size >= sl_count)
+      rounded += (uint64_t(1) << (highBit(size) - sl_bits)) - 1;
+    if(rounded > 0xffffffffu)
+      return false;
+    mapping(uint32_t(rounded), fl, sl);
+    return true;
+  }
+
+  handle findSuitable(uint32_t fl, uint32_t sl) const {
+    uint32_t sl_map = m_sl_bitmap[fl] & (~0u << sl);
+    if(!sl_map) {
+      const uint32_t fl_map = fl + 1 < 32 ? m_fl_bitmap & (~0u << (fl + 1)) : 0;
+      if(!fl_map)
+        return none;
+      fl = lowBit(fl_map);
+      sl_map = m_sl_bitmap[fl];
+    }
+    return m_heads[fl][lowBit(sl_map)];
+  }
+
+  handle newBlock() {
+    if(!m_unused.empty()) {
+      const handle b = m_unused.back();
+      m_unused.pop_back();
+      return b;
+    }
+    m_blocks.push_back(Block());
+    return m_blocks.size() - 1;
+  }
+
+  void insertFree(handle b) {
+    uint32_t fl, sl;
+    mapping(m_blocks[b].size, fl, sl);
+    Block& a = m_blocks[b];
+    a.free = true;
+    a.prev_free = none;
+    a.next_free = m_heads[fl][sl];
+    if(a.next_free != none)
+      m_blocks[a.next_free].prev_free = b;
+    m_heads[fl][sl] = b;
+    m_fl_bitmap |= 1u << fl;
+    m_sl_bitmap[fl] |= 1u << sl;
+  }
+
+  void removeFree(handle b) {
+    uint32_t fl, sl;
+    mapping(m_blocks[b].size, fl, sl);
+    const Block& a = m_blocks[b];
+    if(a.prev_free != none)
+      m_blocks[a.prev_free].next_free = a.next_free;
+    else
+      m_heads[fl][sl] = a.next_free;
+    if(a.next_free != none)
+      m_blocks[a.next_free].prev_free = a.prev_free;
+    if(m_heads[fl][sl] == none) {
+      m_sl_bitmap[fl] &= ~(1u << sl);
+      if(!m_sl_bitmap[fl])
+        m_fl_bitmap &= ~(1u << fl);
+    }
+  }
+
+  // merge b's physical successor into b; the successor must be off the free lists
+  void absorbNext(handle b) {
+    const handle next = m_blocks[b].next_phys;
+    m_blocks[b].size += m_blocks[next].size;
+    m_blocks[b].next_phys = m_blocks[next].next_phys;
+    if(m_blocks[next].next_phys != none)
+      m_blocks[m_blocks[next].next_phys].prev_phys = b;
+    else
+      m_last = b;
+    m_unused.push_back(next);
+  }
+};
+
+#endif // SENSE_UTIL_TLSF_HPP
@@ -18,24 +18,66 @@
 #include "pipeline/Image.hpp"
 #include "pipeline/Material.hpp"
 #include "pipeline/interface.hpp"
+#include "image/Png.hpp"
+#include "image/Stx.hpp"
+#include "mesh/Bounds.hpp"
+#include "mesh/Prepare.hpp"
+#include "mesh/Sbm.hpp"
 
 #include <boost/thread/thread.hpp>
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 
-#include <png.h>
+#include <functional>
+#include <iostream>
+
+// A re-registered material whose shaders didn't change
+struct MaterialUpdate
+{
+  std::string name;
+  MaterialDef old_def;
+  MaterialDef new_def;
+};
+
+namespace {
+  bool sameUniform(const UniformDef& a, const UniformDef& b) {
+    if(a.type != b.type)
+      return false;
+    if(a.value.empty() || b.value.empty())
+      return a.value.empty() && b.value.empty();
+    // definitions only carry strings (texture and webview names) so far;
+    // anything else counts as changed
+    const std::string* sa = boost::any_cast<std::string>(&a.value);
+    const std::string* sb = boost::any_cast<std::string>(&b.value);
+    return sa && sb && *sa == *sb;
+  }
+
+  bool sameUniforms(const MaterialDef& a, const MaterialDef& b) {
+    if(a.uniforms.size() != b.uniforms.size())
+      return false;
+    for(auto i = a.uniforms.begin(); i != a.uniforms.end(); ++i) {
+      auto j = b.uniforms.find(i->first);
+      if(j == b.uniforms.end() || !sameUniform(i->second, j->second))
+        return false;
+    }
+    return true;
+  }
+}
 
 enum {
   BUILD_MATERIAL,
+  UPDATE_MATERIAL,
   LOAD_TEXTURE,
   LOAD_MESH,
 
   FINISH_MESH_LOAD,
+  RELEASE_BINDINGS,
+  RELEASE_MESH,
 };
 
 DataManager::DataManager(Loader* loader)
-  : m_loader(loader)
+  : m_loader(loader), m_next_material_id(1)
 {
   loadBuiltinData();
 }
@@ -55,6 +97,9 @@ void DataManager::exec()
       case BUILD_MATERIAL:
         buildMaterial(any_cast<std::string>(j.second));
         break;
+      case UPDATE_MATERIAL:
+        updateMaterial(any_cast<const MaterialUpdate&>(j.second));
+        break;
       case LOAD_TEXTURE:
         loadTexture(any_cast<std::string>(j.second));
         break;
@@ -62,6 +107,7 @@ void DataManager::exec()
 	loadMeshFile(any_cast<std::string>(j.second));
       }
     }
+    m_loader->pollUploads();
     boost::this_thread::yield();
   }
 }
@@ -81,6 +127,12 @@ void DataManager::mainThreadTick()
     case FINISH_MESH_LOAD: 
       m_loader->mainThreadLoadMesh(any_cast<DrawableMesh*>(j.second));
       break;
+    case RELEASE_BINDINGS:
+      m_loader->releaseBindings(any_cast<MaterialBindings*>(j.second));
+      break;
+    case RELEASE_MESH:
+      m_loader->releaseMesh(any_cast<DrawableMesh*>(j.second));
+      break;
     }
   }
 }
@@ -94,7 +146,9 @@ Material* DataManager::loadMaterial(std::string name)
   } else {
     Material* m = new Material;
     m->shaders = 0;
+    m->bindings = 0;
     m->refcnt = 0;
+    m->id = m_next_material_id++;
     m_materials.insert(std::make_pair(name, m));
     m_jobs.push(job(BUILD_MATERIAL, name));
     return m;
@@ -103,14 +157,25 @@ Material* DataManager::loadMaterial(std::string name)
 
 void DataManager::addMaterial(MaterialDef def, std::string name)
 {
-  bool inserted = m_matdefs.insert(std::make_pair(name, def)).second;
-  if(!inserted) {
-    m_matdefs[name] = def;
-    if(m_materials.find(name) != m_materials.end()) {
-      // there are instances of this material. Reload the sucker!
-      m_jobs.push(job(BUILD_MATERIAL, name));
-    }
+  auto i = m_matdefs.find(name);
+  if(i == m_matdefs.end()) {
+    m_matdefs.insert(std::make_pair(name, def));
+    return;
   }
+  MaterialUpdate update;
+  update.name = name;
+  update.old_def = i->second;
+  update.new_def = def;
+  i->second = def;
+  if(m_materials.find(name) == m_materials.end())
+    return;
+
+  // there are instances of this material. Only relink if we have to;
+  // tweaking uniforms just patches the existing material.
+  if(!(update.old_def.shaders == def.shaders) || update.old_def.defines != def.defines)
+    m_jobs.push(job(BUILD_MATERIAL, name));
+  else if(!sameUniforms(update.old_def, def))
+    m_jobs.push(job(UPDATE_MATERIAL, update));
 }
 
 DrawableMesh* DataManager::loadMesh(std::string name)
@@ -122,6 +187,7 @@ DrawableMesh* DataManager::loadMesh(std::string name)
   }
   DrawableMesh* msh = new DrawableMesh;
   msh->buffer = 0;
+  msh->quant_flags = 0;
   m_meshes.insert(std::make_pair(name, msh));
   m_jobs.push(job(LOAD_MESH, name));
   return msh;
@@ -130,34 +196,18 @@ DrawableMesh* DataManager::loadMesh(std::string name)
 void DataManager::buildMaterial(std::string name)
 {
   MaterialDef def = m_matdefs[name];
-  std::string vert, frag, geom;
-  vert = loadShaderString(def.shaders.vert + ".vs");
-  frag = loadShaderString(def.shaders.frag + ".fs");
-  geom = loadShaderString(def.shaders.geom + ".gs");
+  // all the file reading, preprocessing and hashing happens here on
+  // the worker thread; the loader only compiles variants it hasn't seen
+  const ShaderSource& vert = loadShaderVariant(def.shaders.vert, ".vs", def.defines);
+  const ShaderSource& frag = loadShaderVariant(def.shaders.frag, ".fs", def.defines);
+  const ShaderSource& geom = loadShaderVariant(def.shaders.geom, ".gs", def.defines);
 
   ShaderProgram* s = m_loader->loadProgram(vert, frag, geom);
   std::vector<Uniform> uniforms;
   for(auto i = def.uniforms.begin(); i!= def.uniforms.end(); ++i) {
     Uniform u;
-    u.type = i->second.type;
-    if(u.type == UniformDef::Texture) {
-      std::string name = boost::any_cast<std::string>(i->second.value);
-      auto j = m_images.find(name);
-      if(j == m_images.end()) {
-        Image* img = new Image;
-        img->data = 0;
-        img->tex = 0;
-        m_imglock.lock();
-        m_images.insert(std::make_pair(name, img));
-        m_imglock.unlock();
-        u.value = img;
-        m_jobs.push(job(LOAD_TEXTURE, name));
-      } else {
-        u.value = i->second;
-      }
-    } else {
-      u.value = i->second.value;
-    }
+    u.name = i->first;
+    resolveUniform(i->second, u);
     u.pipe_id = m_loader->queryUniform(s, i->first);
     uniforms.push_back(u);
   }
@@ -170,222 +220,183 @@ void DataManager::buildMaterial(std::string name)
   } else {
     // This *should* never be a valid codepath. But just in case...
     m = new Material;
+    m->bindings = 0;
     m->refcnt = 0;
+    m->id = m_next_material_id++;
     m_materials.insert(std::make_pair(name, m));
   }
   m->uniforms = uniforms;
   m->shaders = s;
+  bakeMaterial(m);
 }
 
-std::string DataManager::loadShaderString(std::string name)
+void DataManager::updateMaterial(const MaterialUpdate& update)
+{
+  auto i = m_materials.find(update.name);
+  if(i == m_materials.end() || !i->second->shaders)
+    return; // the pending build will pick up the new definition
+  Material* m = i->second;
+
+  std::vector<Uniform> uniforms;
+  uniforms.reserve(update.new_def.uniforms.size());
+  for(auto j = update.new_def.uniforms.begin(); j != update.new_def.uniforms.end(); ++j) {
+    const Uniform* existing = 0;
+    for(auto k = m->uniforms.begin(); k != m->uniforms.end(); ++k) {
+      if(k->name == j->first) {
+        existing = &(*k);
+        break;
+      }
+    }
+    auto old = update.old_def.uniforms.find(j->first);
+    if(existing && old != update.old_def.uniforms.end() && sameUniform(old->second, j->second)) {
+      uniforms.push_back(*existing);
+      continue;
+    }
+    Uniform u;
+    u.name = j->first;
+    resolveUniform(j->second, u);
+    // the program didn't change, so known locations are still good
+    u.pipe_id = existing ? existing->pipe_id : m_loader->queryUniform(m->shaders, j->first);
+    uniforms.push_back(u);
+  }
+  m->uniforms.swap(uniforms);
+  bakeMaterial(m);
+}
+
+void DataManager::bakeMaterial(Material* m)
+{
+  MaterialBindings* old = m->bindings;
+  m->bindings = m_loader->compileBindings(m->shaders, m->uniforms);
+  // the renderer may still be drawing with the old table this frame
+  if(old)
+    m_main_thread_jobs.push(job(RELEASE_BINDINGS, old));
+}
+
+void DataManager::resolveUniform(const UniformDef& def, Uniform& u)
+{
+  u.type = def.type;
+  if(u.type == UniformDef::Texture) {
+    std::string name = boost::any_cast<std::string>(def.value);
+    auto j = m_images.find(name);
+    if(j == m_images.end()) {
+      Image* img = new Image;
+      img->data = 0;
+      img->tex = 0;
+      img->mip_count = 0;
+      m_imglock.lock();
+      m_images.insert(std::make_pair(name, img));
+      m_imglock.unlock();
+      u.value = img;
+      m_jobs.push(job(LOAD_TEXTURE, name));
+    } else {
+      u.value = j->second;
+    }
+  } else {
+    u.value = def.value;
+  }
+}
+
+bool DataManager::readShaderFile(const std::string& name, std::string& contents)
 {
-  if(name.size() == 3 && name[0] == '.' && name[2] == 's' &&
-     ( name[1] == 'f' || name[1] == 'v' || name[1] == 'g'))
-    return ""; // empty shader name means empty shader string
   auto i = m_shaderstrings.find(name);
-  if(i != m_shaderstrings.end())
-    return i->second;
+  if(i != m_shaderstrings.end()) {
+    contents = i->second;
+    return true;
+  }
 
   boost::filesystem::path shader_path("../data/shaders");
   shader_path = shader_path / name;
   if(!exists(shader_path))
-    throw std::runtime_error("Can't find shader file " + shader_path.string());
+    return false;
   boost::filesystem::ifstream stream;
   stream.open(shader_path);
-  std::string shader =  std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
-  m_shaderstrings.insert(std::make_pair(name, shader));
-  return shader;
+  contents = std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+  m_shaderstrings.insert(std::make_pair(name, contents));
+  return true;
+}
+
+const ShaderSource& DataManager::loadShaderVariant(const std::string& name, const std::string& ext, const ShaderDefines& defines)
+{
+  static const ShaderSource no_shader;
+  if(name.empty())
+    return no_shader; // empty shader name means no shader for this stage
+
+  const std::string file = name + ext;
+  const uint64_t key = shaderVariantKey(file, defines);
+  auto i = m_shadervariants.find(key);
+  if(i != m_shadervariants.end())
+    return i->second;
+
+  using namespace std::placeholders;
+  ShaderSource src = preprocessShader(file, defines, std::bind(&DataManager::readShaderFile, this, _1, _2));
+  return m_shadervariants.insert(std::make_pair(key, src)).first->second;
 }
 
 namespace {
-  void readPngData(png_structp pngPtr, png_bytep data, png_size_t length) {
-    png_voidp a = png_get_io_ptr(pngPtr);
-    ((std::istream*)a)->read((char*)data, length);
+  // Cooked data (see sense-cook) is used over the source file when it's there
+  boost::filesystem::path findDataFile(const std::string& dir, const std::string& file, const std::string& cooked_file, bool* cooked) {
+    boost::filesystem::path cooked_path = boost::filesystem::path("../data/cooked") / dir / cooked_file;
+    *cooked = exists(cooked_path);
+    if(*cooked)
+      return cooked_path;
+    return boost::filesystem::path("../data") / dir / file;
   }
 }
 
 void DataManager::loadTexture(std::string name)
 {
-  boost::filesystem::path img_path("../data/textures");
-  img_path = img_path / (name+".png");
+  bool cooked;
+  boost::filesystem::path img_path = findDataFile("textures", name + ".png", name + ".stx", &cooked);
   if(!exists(img_path))
     throw std::runtime_error("Can't find texture file " + img_path.string());
   boost::filesystem::ifstream stream;
   stream.open(img_path, std::ios_base::binary);
 
-  char pngsig[8];
-  stream.read(pngsig, 8);
-  int is_png = png_sig_cmp((png_bytep)pngsig, 0, 8);
-  if(is_png != 0)
-    throw std::runtime_error(img_path.string() + " is not a PNG file");
-  png_structp pngPtr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-  if(!pngPtr)
-    throw std::runtime_error("Error initializing PNG reader");
-  png_infop infoPtr = png_create_info_struct(pngPtr);
-  if(!infoPtr) {
-    png_destroy_read_struct(&pngPtr, 0, 0);
-    throw std::runtime_error("Error initializing PNG reader");
-  }
-  stream.seekg(0);
-  png_set_read_fn(pngPtr, (png_voidp)(&stream), readPngData);
-  png_set_sig_bytes(pngPtr, 0);
-  png_read_info(pngPtr, infoPtr);
-
   m_imglock.lock();
   auto iter = m_images.find(name);
-  if(iter == m_images.end())
+  if(iter == m_images.end()) {
+    m_imglock.unlock();
     throw std::runtime_error("Tried to load image that hasn't been created: " + name);
+  }
   Image* img = iter->second;
   m_imglock.unlock();
-  img->width = png_get_image_width(pngPtr, infoPtr);
-  img->height = png_get_image_height(pngPtr, infoPtr);
-
-  png_uint_32 bitdepth = png_get_bit_depth(pngPtr, infoPtr);
-  png_uint_32 channels = png_get_channels(pngPtr, infoPtr);
-  png_uint_32 color_type = png_get_color_type(pngPtr, infoPtr);
-
-  png_set_expand(pngPtr);
-
-  switch(color_type) {
-  case PNG_COLOR_TYPE_PALETTE:
-    channels = 3;
-    break;
-  case PNG_COLOR_TYPE_GRAY:
-    bitdepth = 8;
-    break;
-  }
-
-  if(png_get_valid(pngPtr, infoPtr, PNG_INFO_tRNS)) {
-    channels++;
-  }
-
-  if(bitdepth == 16) {
-    png_set_strip_16(pngPtr);
-    bitdepth = 8;
-  }
-
-  if(bitdepth != 8) {
-    png_destroy_read_struct(&pngPtr, &infoPtr,(png_infopp)0);
-    throw std::runtime_error("PNGs with bitdepths other than 8 are not supported");
-  }
 
-  png_bytep* rowPtrs = new png_bytep[img->height];
-  img->data = new char[img->width*img->height*channels];
-  img->pipe_build_mips = true;
-  const unsigned int stride = img->width * channels;
-  for(size_t i = 0; i < img->height; i++) {
-    png_uint_32 q = (img->height - i - 1) * stride;
-    rowPtrs[i] = (png_bytep)img->data + q;
-  }
-  png_read_image(pngPtr, rowPtrs);
-  delete[] rowPtrs;
-  png_destroy_read_struct(&pngPtr, &infoPtr,(png_infopp)0);
-
-  switch(channels) {
-  case 1: img->format = Image::R8; break;
-  case 2: img->format = Image::RG8; break;
-  case 3: img->format = Image::RGB8; break;
-  case 4: img->format = Image::RGBA8; break;
+  try {
+    if(cooked)
+      readStx(stream, img);
+    else
+      readPng(stream, img);
+  } catch(std::runtime_error& e) {
+    throw std::runtime_error(img_path.string() + ": " + e.what());
   }
 
   m_loader->loadTexture(img);
 }
 
-#pragma pack(push, 1)
-namespace {
-  static const char sbm_magic[] = "SBM\0";
-  const unsigned sbm_hasIndices = 0x01;
-  const unsigned sbm_streamData = 0x02;
-  const unsigned sbm_calcNormal = 0x06;
-  const unsigned sbm_calcTangent = 0x0A;
-  const unsigned sbm_calcNorTan = 0x0C; // intentionally not masking Stream here
-
-  const unsigned sbm_attr_normalized = 0x80;
-  const unsigned sbm_attr_integer = 0x40;
-  const unsigned sbm_sizemask = 0x07; // TODO: save ourselves a bit here
-
-  struct SbmHeader {
-    char magic[4];
-    uint32_t num_verts;
-    uint16_t num_attribs;
-    uint16_t vert_stride;
-    uint16_t flags;
-  };
-
-  struct SbmAttrib {
-    uint16_t type;
-    uint16_t id;
-    uint16_t start_offset;
-    uint8_t size; // 1-4. Normalized/Integer are encoded in this field
-  };
-}
-#pragma pack(pop)
-
 void DataManager::loadMeshFile(std::string name)
 {
   DrawableMesh* msh = m_meshes[name];
 
-  boost::filesystem::path mdl_path("../data/models");
-  mdl_path = mdl_path / (name+".sbm");
+  bool cooked;
+  boost::filesystem::path mdl_path = findDataFile("models", name + ".sbm", name + ".sbm", &cooked);
   if(!exists(mdl_path))
     throw std::runtime_error("Can't find model file " + mdl_path.string());
   boost::filesystem::ifstream stream;
   stream.open(mdl_path, std::ios_base::binary);
 
-  SbmHeader head;
-  stream.read((char*)&head, sizeof(SbmHeader));
-  if(memcmp(head.magic, sbm_magic, 4) != 0)
-    throw std::runtime_error("QBM signature verification failed");
-  if(head.flags & sbm_calcNorTan)
-    throw std::runtime_error("Runtime normal/tangent calculation is not yet implemented");
-  msh->data_size = head.num_verts*head.vert_stride;
-  msh->data_stride = head.vert_stride;
-  msh->data = new char[msh->data_size];
-  stream.read((char*)msh->data, msh->data_size);
-
-  if(head.flags & sbm_hasIndices) {
-    uint16_t idx_count;
-    uint16_t idx_type;
-    stream.read((char*)&idx_count, 2);
-    stream.read((char*)&idx_type, 2);
-    msh->index_type = (DrawableMesh::AttribType)idx_type;
-    msh->index_count = idx_count;
-    switch(msh->index_type) {
-    case DrawableMesh::UByte:
-      msh->index_data = new char[idx_count];
-      stream.read((char*)msh->index_data, idx_count);
-      break;
-    case DrawableMesh::UShort:
-      msh->index_data = new char[idx_count*2];
-      stream.read((char*)msh->index_data, idx_count*2);
-      break;
-    default:
-      throw std::runtime_error("Can't read SBM indices: bad index type");
-    }
-  } else {
-    msh->index_data = 0;
-    msh->index_count = 0;
-  }
-
-  for(size_t i = 0; i < head.num_attribs; ++i) {
-    SbmAttrib attr;
-    stream.read((char*)&attr, sizeof(SbmAttrib));
-    DrawableMesh::Attribute a;
-    a.type = (DrawableMesh::AttribType)attr.type;
-    a.loc = (DrawableMesh::AttribLocation)attr.id;
-    a.start = attr.start_offset;
-    a.size = attr.size & sbm_sizemask;
-    if(attr.size & sbm_attr_normalized)
-      a.special = DrawableMesh::Normalize;
-    else if(attr.size & sbm_attr_integer)
-      a.special = DrawableMesh::Integer;
-    else
-      a.special = DrawableMesh::None;
-    msh->attributes.push_back(a);
+  readSbm(stream, msh);
+  if(!cooked) {
+    // This is the loader thread, and the full report is sense-cook's
+    // job. Debug builds still get it on stderr.
+#ifdef NDEBUG
+    std::ostream log(0);
+#else
+    std::ostream& log = std::clog;
+#endif
+    prepareMesh(msh, name, log);
   }
 
-  m_loader->loadMesh(msh);
-  m_main_thread_jobs.push(job(FINISH_MESH_LOAD, msh));
+  m_loader->loadMesh(msh, [=] { m_main_thread_jobs.push(job(FINISH_MESH_LOAD, msh)); });
 }
 
 void DataManager::loadBuiltinData()
@@ -401,6 +412,7 @@ void DataManager::loadBuiltinData()
   builtin->data = builtin_quad_data;
   builtin->data_size = 120;
   builtin->data_stride = 20;
+  builtin->quant_flags = 0;
   builtin->index_data = 0;
 
   a.loc = DrawableMesh::Pos;
@@ -413,15 +425,16 @@ void DataManager::loadBuiltinData()
   a.size = 2;
   builtin->attributes.push_back(a);
 
+  computeMeshBounds(builtin);
   m_meshes.insert(std::make_pair("__quad__", builtin));
-  m_loader->loadMesh(builtin);
-  m_main_thread_jobs.push(job(FINISH_MESH_LOAD, builtin));
+  m_loader->loadMesh(builtin, [=] { m_main_thread_jobs.push(job(FINISH_MESH_LOAD, builtin)); });
 
   builtin = new DrawableMesh;
   builtin->refcnt = 1; // builtin data is *never* erased
   builtin->data = builtin_missing_data;
   builtin->data_size = 480;
   builtin->data_stride = 20;
+  builtin->quant_flags = 0;
   builtin->index_data = builtin_missing_indices;
   builtin->index_count = 36;
   builtin->index_type = DrawableMesh::UShort;
@@ -436,7 +449,7 @@ void DataManager::loadBuiltinData()
   a.size = 2;
   builtin->attributes.push_back(a);
 
+  computeMeshBounds(builtin);
   m_meshes.insert(std::make_pair("__missing__", builtin));
-  m_loader->loadMesh(builtin);
-  m_main_thread_jobs.push(job(FINISH_MESH_LOAD, builtin));
+  m_loader->loadMesh(builtin, [=] { m_main_thread_jobs.push(job(FINISH_MESH_LOAD, builtin)); });
 }
@@ -16,6 +16,7 @@
 #define SENSE_CLIENT_DATAMANAGER_HPP
 
 #include "pipeline/DefinitionTypes.hpp"
+#include "shader/Preprocessor.hpp"
 
 #include "util/queue.hpp"
 
@@ -27,6 +28,8 @@ class Loader;
 struct Material;
 struct DrawableMesh;
 struct Image;
+struct Uniform;
+struct MaterialUpdate;
 
 // The data manager loads anything that exists inside
 // a game data package. It should be run on a worker thread,
@@ -48,18 +51,24 @@ public:
 
 private:
   Loader* m_loader;
+  uint32_t m_next_material_id;
   volatile bool m_finished;
 
   std::unordered_map<std::string, Material*> m_materials;
   std::unordered_map<std::string, MaterialDef> m_matdefs;
   std::unordered_map<std::string, std::string> m_shaderstrings;
+  std::unordered_map<uint64_t, ShaderSource> m_shadervariants;
   std::unordered_map<std::string, DrawableMesh*> m_meshes;
   std::unordered_map<std::string, Image*> m_images;
 
   boost::mutex m_imglock;
 
   void buildMaterial(std::string);
-  std::string loadShaderString(std::string);
+  void updateMaterial(const MaterialUpdate&);
+  void bakeMaterial(Material*);
+  void resolveUniform(const UniformDef&, Uniform&);
+  bool readShaderFile(const std::string&, std::string&);
+  const ShaderSource& loadShaderVariant(const std::string& name, const std::string& ext, const ShaderDefines&);
 
   void loadTexture(std::string);
 